@@ -0,0 +1,166 @@
+#include <rtp_repacketizer/h264_repacketizer.hpp>
+#include <rtp_repacketizer/rtp_repacketizer.hpp>
+
+#include <rtc/rtc.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Compare the throughput of the span and sink RtpRepacketizer interface with
+ * the previous interface, which took the packet as a std::vector by value
+ * and returned the output packets as new vectors.
+ *
+ * The input is a synthetic H264 stream of FU-A fragmented frames. The plain
+ * repacketizer only rewrites headers, the H264 repacketizer runs the
+ * libdatachannel depacketizer and packetizer chains.
+ */
+
+namespace {
+
+const size_t FRAMES = 2000;
+const size_t FRAME_SIZE = 20000;
+const size_t FRAGMENT_SIZE = 1200;
+const uint32_t SSRC = 42;
+const int PAYLOAD_TYPE = 96;
+
+using Clock = std::chrono::steady_clock;
+
+// The previous interface of RtpRepacketizer.
+std::vector<std::vector<uint8_t>> legacyRewrite(std::vector<uint8_t> data) {
+  auto rtp = reinterpret_cast<rtc::RtpHeader*>(data.data());
+  rtp->setSsrc(SSRC);
+  rtp->setPayloadType(PAYLOAD_TYPE);
+  std::vector<std::vector<uint8_t>> ret = {data};
+  return ret;
+}
+
+// The previous H264Repacketizer::handlePacket.
+std::vector<std::vector<uint8_t>> legacyH264(rtc::MediaHandler& depacketizer,
+                                            rtc::MediaHandler& packetizer,
+                                            std::vector<uint8_t> data) {
+  std::vector<std::vector<uint8_t>> ret;
+  auto src = reinterpret_cast<const std::byte*>(data.data());
+  rtc::message_ptr msg =
+      std::make_shared<rtc::Message>(src, src + data.size());
+  rtc::message_vector vec;
+  vec.push_back(msg);
+  depacketizer.incomingChain(vec, nullptr);
+  packetizer.outgoingChain(vec, nullptr);
+  for (auto m : vec) {
+    uint8_t* out = (uint8_t*)m->data();
+    ret.push_back(std::vector<uint8_t>(out, out + m->size()));
+  }
+  return ret;
+}
+
+std::vector<std::vector<uint8_t>> makeStream() {
+  std::vector<std::vector<uint8_t>> packets;
+  uint16_t seq = 0;
+  for (size_t frame = 0; frame < FRAMES; frame++) {
+    uint32_t timestamp = static_cast<uint32_t>(frame * 3000);
+    // IDR every 100 frames, else a non-IDR slice.
+    uint8_t nalType = frame % 100 == 0 ? 5 : 1;
+    for (size_t offset = 0; offset < FRAME_SIZE; offset += FRAGMENT_SIZE) {
+      bool first = offset == 0;
+      bool last = offset + FRAGMENT_SIZE >= FRAME_SIZE;
+      std::vector<uint8_t> p = {
+          0x80,
+          static_cast<uint8_t>((last ? 0x80 : 0) | PAYLOAD_TYPE),
+          static_cast<uint8_t>(seq >> 8),
+          static_cast<uint8_t>(seq),
+          static_cast<uint8_t>(timestamp >> 24),
+          static_cast<uint8_t>(timestamp >> 16),
+          static_cast<uint8_t>(timestamp >> 8),
+          static_cast<uint8_t>(timestamp),
+          0,
+          0,
+          0,
+          1,
+          0x60 | 28,
+          static_cast<uint8_t>((first ? 0x80 : 0) | (last ? 0x40 : 0) |
+                               nalType)};
+      p.resize(p.size() + FRAGMENT_SIZE, 0xAB);
+      packets.push_back(std::move(p));
+      seq++;
+    }
+  }
+  return packets;
+}
+
+void report(const std::string& name, Clock::duration elapsed, size_t packets,
+            size_t bytes) {
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  std::cout << name << static_cast<size_t>(packets / seconds) << " pps, "
+            << static_cast<size_t>(bytes / seconds / 1e6) << " MB/s"
+            << std::endl;
+}
+
+}  // namespace
+
+int main() {
+  auto stream = makeStream();
+  auto rtpConf = std::make_shared<rtc::RtpPacketizationConfig>(
+      SSRC, "", PAYLOAD_TYPE, 90000);
+  size_t bytes = 0;
+  size_t outputs = 0;
+  nabto::RtpPacketCallbackSink countSink([&](const uint8_t*, size_t size) {
+    outputs++;
+    bytes += size;
+  });
+
+  auto start = Clock::now();
+  for (const auto& p : stream) {
+    for (const auto& out : legacyRewrite(p)) {
+      outputs++;
+      bytes += out.size();
+    }
+  }
+  report("rewrite vector:     ", Clock::now() - start, stream.size(), bytes);
+
+  bytes = 0;
+  nabto::RtpRepacketizer rewrite(SSRC, PAYLOAD_TYPE);
+  std::vector<uint8_t> scratch;
+  start = Clock::now();
+  for (const auto& p : stream) {
+    // The callers rewrite a private copy of shared packets.
+    scratch.assign(p.begin(), p.end());
+    rewrite.handlePacket(scratch.data(), scratch.size(), countSink);
+  }
+  report("rewrite span+sink:  ", Clock::now() - start, stream.size(), bytes);
+
+  bytes = 0;
+  rtc::MediaHandler depacketizer;
+  depacketizer.addToChain(std::make_shared<rtc::H264RtpDepacketizer>());
+  rtc::MediaHandler packetizer;
+  packetizer.addToChain(std::make_shared<rtc::H264RtpPacketizer>(
+      rtc::NalUnit::Separator::LongStartSequence, rtpConf));
+  start = Clock::now();
+  for (const auto& p : stream) {
+    for (const auto& out : legacyH264(depacketizer, packetizer, p)) {
+      outputs++;
+      bytes += out.size();
+    }
+  }
+  report("H264 vector:        ", Clock::now() - start, stream.size(), bytes);
+
+  bytes = 0;
+  nabto::H264Repacketizer h264(rtpConf);
+  start = Clock::now();
+  for (const auto& p : stream) {
+    scratch.assign(p.begin(), p.end());
+    h264.handlePacket(scratch.data(), scratch.size(), countSink);
+  }
+  report("H264 span+sink:     ", Clock::now() - start, stream.size(), bytes);
+
+  if (outputs == 0) {
+    std::cout << "No packets repacketized" << std::endl;
+    return 1;
+  }
+  return 0;
+}
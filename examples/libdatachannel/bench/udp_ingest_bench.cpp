@@ -0,0 +1,171 @@
+#include <rtp_client/udp_batch.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Measure RTP packet rates on loopback for the per-packet recvfrom()/sendto()
+ * calls previously used by the RtpClient, against the recvmmsg()/sendmmsg()
+ * batching of UdpBatchReceiver and sendBatch().
+ *
+ * Ingest: a sender floods the receiver socket for a fixed time, the
+ * receiver counts what it manages to read. The rate is often limited by the
+ * sender, so the CPU time the receiving thread spends per packet is reported
+ * as well. Backchannel: packets are sent to a sink socket nobody reads, so
+ * only the send side is measured.
+ */
+
+namespace {
+
+const size_t PACKET_SIZE = 1200;
+const size_t BATCH_SIZE = 32;
+const std::chrono::milliseconds DURATION(2000);
+
+using Clock = std::chrono::steady_clock;
+
+int bindLoopback(struct sockaddr_in& addr) {
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  addr.sin_port = 0;
+  bind(sock, reinterpret_cast<const struct sockaddr*>(&addr), sizeof(addr));
+  socklen_t len = sizeof(addr);
+  getsockname(sock, reinterpret_cast<struct sockaddr*>(&addr), &len);
+  int rcvBufSize = 212992;
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvBufSize, sizeof(rcvBufSize));
+  struct timeval timeout = {0, 200000};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return sock;
+}
+
+double threadCpuNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<double>(ts.tv_sec) * 1e9 +
+         static_cast<double>(ts.tv_nsec);
+}
+
+double perSecond(size_t count, Clock::duration elapsed) {
+  return static_cast<double>(count) /
+         std::chrono::duration<double>(elapsed).count();
+}
+
+std::vector<nabto::example::RtpPacket> makeBatch(
+    nabto::example::RtpPacketPool& pool) {
+  std::vector<nabto::example::RtpPacket> batch;
+  std::vector<uint8_t> payload(PACKET_SIZE, 0x80);
+  for (size_t i = 0; i < BATCH_SIZE; i++) {
+    batch.push_back(pool.copy(payload.data(), payload.size()));
+  }
+  return batch;
+}
+
+// Flood dst from another socket until stopped.
+void flood(const struct sockaddr_in& dst, const std::atomic<bool>& stop) {
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  auto pool = nabto::example::RtpPacketPool::create();
+  auto batch = makeBatch(*pool);
+  while (!stop) {
+    nabto::example::sendBatch(sock, dst, batch);
+  }
+  close(sock);
+}
+
+void ingest(const std::string& name, bool batched, bool gro) {
+  struct sockaddr_in addr;
+  int sock = bindLoopback(addr);
+  std::atomic<bool> stop{false};
+  std::thread sender(flood, std::cref(addr), std::cref(stop));
+
+  size_t received = 0;
+  auto start = Clock::now();
+  double cpuStart = threadCpuNs();
+  if (batched) {
+    nabto::example::UdpBatchReceiver receiver(
+        sock, BATCH_SIZE, gro, nabto::example::RtpPacketPool::create());
+    while (Clock::now() - start < DURATION && receiver.receive()) {
+      received += receiver.packets().size();
+    }
+  } else {
+    std::vector<uint8_t> buffer(
+        nabto::example::UdpBatchReceiver::MAX_DATAGRAM_SIZE);
+    struct sockaddr_in srcAddr;
+    socklen_t srcAddrLen = sizeof(srcAddr);
+    while (Clock::now() - start < DURATION &&
+           recvfrom(sock, buffer.data(), buffer.size(), 0,
+                    reinterpret_cast<struct sockaddr*>(&srcAddr),
+                    &srcAddrLen) > 0) {
+      received++;
+    }
+  }
+  auto elapsed = Clock::now() - start;
+  double cpuNs = threadCpuNs() - cpuStart;
+  stop = true;
+  sender.join();
+  close(sock);
+  std::cout << name << static_cast<size_t>(perSecond(received, elapsed))
+            << " pps, "
+            << (received > 0 ? cpuNs / static_cast<double>(received) : 0)
+            << " ns CPU/packet" << std::endl;
+}
+
+void backchannel(const std::string& name, bool batched) {
+  struct sockaddr_in sinkAddr;
+  int sink = bindLoopback(sinkAddr);
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  auto pool = nabto::example::RtpPacketPool::create();
+  auto batch = makeBatch(*pool);
+
+  size_t sent = 0;
+  auto start = Clock::now();
+  while (Clock::now() - start < DURATION) {
+    if (batched) {
+      sent += nabto::example::sendBatch(sock, sinkAddr, batch);
+    } else {
+      for (const auto& packet : batch) {
+        // The address was resolved per packet before.
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        addr.sin_port = sinkAddr.sin_port;
+        if (sendto(sock, packet.data(), packet.size(), 0,
+                   reinterpret_cast<const struct sockaddr*>(&addr),
+                   sizeof(addr)) > 0) {
+          sent++;
+        }
+      }
+    }
+  }
+  auto elapsed = Clock::now() - start;
+  close(sock);
+  close(sink);
+  std::cout << name << static_cast<size_t>(perSecond(sent, elapsed)) << " pps"
+            << std::endl;
+}
+
+}  // namespace
+
+int main() {
+  std::cout << PACKET_SIZE << " byte packets, batches of " << BATCH_SIZE
+            << std::endl;
+  ingest("ingest recvfrom:      ", false, false);
+  ingest("ingest recvmmsg:      ", true, false);
+  ingest("ingest recvmmsg+GRO:  ", true, true);
+  backchannel("backchannel sendto:   ", false);
+  backchannel("backchannel sendmmsg: ", true);
+  return 0;
+}
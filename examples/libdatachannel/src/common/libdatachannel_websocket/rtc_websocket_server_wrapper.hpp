@@ -0,0 +1,50 @@
+#pragma once
+
+#include <nabto/webrtc/device.hpp>
+#include <nabto/webrtc/util/logging.hpp>
+#include <rtc/rtc.hpp>
+
+#include "rtc_websocket_wrapper.hpp"
+
+namespace nabto {
+namespace example {
+
+/**
+ * Local signaling listener on a plain websocket port, for viewers on the same
+ * network as the device.
+ */
+class RtcWebsocketServerWrapper
+    : public nabto::webrtc::SignalingWebsocketServer {
+ public:
+  static nabto::webrtc::SignalingWebsocketServerPtr create(uint16_t port) {
+    return std::make_shared<RtcWebsocketServerWrapper>(port);
+  }
+
+  RtcWebsocketServerWrapper(uint16_t port) {
+    rtc::WebSocketServerConfiguration conf;
+    conf.port = port;
+    server_ = std::make_shared<rtc::WebSocketServer>(conf);
+    NPLOGI << "Local signaling listening on port: " << server_->port();
+  }
+
+  void onConnection(std::function<void(nabto::webrtc::SignalingWebsocketPtr)>
+                        callback) {
+    server_->onClient([callback](std::shared_ptr<rtc::WebSocket> ws) {
+      // The SDK expects the websocket to be open, so it is passed on when the
+      // handshake has completed.
+      ws->onOpen([callback, ws]() {
+        NPLOGI << "Local signaling client connected from: "
+               << ws->remoteAddress().value_or("unknown");
+        callback(RtcWebsocketWrapper::create(ws));
+      });
+    });
+  }
+
+  void close() { server_->stop(); }
+
+ private:
+  std::shared_ptr<rtc::WebSocketServer> server_;
+};
+
+}  // namespace example
+}  // namespace nabto
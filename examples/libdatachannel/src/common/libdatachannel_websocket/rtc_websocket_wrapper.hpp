@@ -18,6 +18,17 @@ class RtcWebsocketWrapper
     return std::make_shared<RtcWebsocketWrapper>(caBundle);
   }
 
+  /**
+   * Wrap a websocket accepted by a rtc::WebSocketServer.
+   */
+  static nabto::webrtc::SignalingWebsocketPtr create(
+      std::shared_ptr<rtc::WebSocket> ws) {
+    return std::make_shared<RtcWebsocketWrapper>(std::move(ws));
+  }
+
+  explicit RtcWebsocketWrapper(std::shared_ptr<rtc::WebSocket> ws)
+      : ws_(std::move(ws)) {}
+
   RtcWebsocketWrapper(std::optional<std::string>& caBundle) {
     if (caBundle.has_value()) {
       rtc::WebSocketConfiguration conf;
@@ -28,13 +39,16 @@ class RtcWebsocketWrapper
     }
   }
 
-  bool send(const std::string& data) { return ws_->send(data); }
+  bool send(const std::string& data) override { return ws_->send(data); }
 
-  void close() { return ws_->close(); }
+  void close() override { return ws_->close(); }
 
-  void onOpen(std::function<void()> callback) { ws_->onOpen(callback); }
+  void onOpen(std::function<void()> callback) override {
+    ws_->onOpen(callback);
+  }
 
-  void onMessage(std::function<void(const std::string& message)> callback) {
+  void onMessage(
+      std::function<void(const std::string& message)> callback) override {
     auto self = shared_from_this();
     ws_->onMessage(
         [self, callback](std::variant<rtc::binary, rtc::string> message) {
@@ -52,14 +66,28 @@ class RtcWebsocketWrapper
         });
   }
 
-  void onClosed(std::function<void()> callback) { ws_->onClosed(callback); }
+  void onClosed(std::function<void()> callback) override {
+    ws_->onClosed(callback);
+  }
 
-  void open(const std::string& url) { ws_->open(url); }
+  void open(const std::string& url) override { ws_->open(url); }
 
-  void onError(std::function<void(const std::string& error)> callback) {
+  void onError(
+      std::function<void(const std::string& error)> callback) override {
     ws_->onError(callback);
   }
 
+  // libdatachannel counts the bytes queued in its TCP transport and calls
+  // onBufferedAmountLow when the queue drains, which is what the SDK needs to
+  // keep its priority lanes in front of bulk data.
+  size_t bufferedAmount() override { return ws_->bufferedAmount(); }
+
+  void onBufferedAmountLow(size_t threshold,
+                           std::function<void()> callback) override {
+    ws_->setBufferedAmountLowThreshold(threshold);
+    ws_->onBufferedAmountLow(callback);
+  }
+
  private:
   std::shared_ptr<rtc::WebSocket> ws_;
 };
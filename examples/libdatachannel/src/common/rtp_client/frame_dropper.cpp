@@ -0,0 +1,290 @@
+#include "frame_dropper.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace nabto {
+namespace example {
+
+namespace {
+
+const size_t RTP_HEADER_SIZE = 12;
+
+// RFC 6184
+const uint8_t NAL_SLICE = 1;
+const uint8_t NAL_IDR = 5;
+const uint8_t NAL_SPS = 7;
+const uint8_t NAL_PPS = 8;
+const uint8_t NAL_STAP_A = 24;
+const uint8_t NAL_FU_A = 28;
+
+// draft-alvestrand-rmcat-remb
+const uint8_t RTCP_PSFB = 206;
+const uint8_t PSFB_FMT_AFB = 15;
+const size_t RTCP_HEADER_SIZE = 4;
+// Feedback header, "REMB", number of SSRCs and the bitrate.
+const size_t REMB_MIN_SIZE = 20;
+const uint8_t RTCP_TYPE_MIN = 192;
+const uint8_t RTCP_TYPE_MAX = 223;
+
+// An estimate below this share of the bitrate sent is congestion.
+const uint64_t CONGESTION_PERCENT = 90;
+const std::chrono::seconds MEASURE_WINDOW{1};
+const std::chrono::seconds ESTIMATE_TIMEOUT{5};
+const std::chrono::seconds SEND_FAILURE_WINDOW{1};
+// Minimum time at a level before raising it, so the estimate can react.
+const std::chrono::seconds ESCALATE_HOLD{1};
+// Minimum time at a level before lowering it when the estimate allows it.
+const std::chrono::seconds RECOVER_HOLD{2};
+// Time at a probed level after which the probe has succeeded.
+const std::chrono::seconds PROBE_SUCCESS{10};
+const std::chrono::seconds MIN_PROBE_INTERVAL{5};
+const std::chrono::seconds MAX_PROBE_INTERVAL{60};
+
+enum PacketClass {
+  PACKET_KEY,
+  PACKET_REFERENCE,
+  PACKET_NON_REFERENCE,
+  // Not a slice, eg. SEI, belongs to the frame it is in.
+  PACKET_OTHER,
+};
+
+PacketClass classifyNal(uint8_t header, uint8_t type) {
+  if (type == NAL_IDR || type == NAL_SPS || type == NAL_PPS) {
+    return PACKET_KEY;
+  }
+  if (type >= NAL_SLICE && type < NAL_IDR) {
+    return (header & 0x60) ? PACKET_REFERENCE : PACKET_NON_REFERENCE;
+  }
+  return PACKET_OTHER;
+}
+
+PacketClass classify(const uint8_t* payload, size_t size) {
+  uint8_t type = payload[0] & 0x1f;
+  if (type == NAL_FU_A) {
+    if (size < 2) {
+      return PACKET_OTHER;
+    }
+    return classifyNal(payload[0], payload[1] & 0x1f);
+  }
+  if (type != NAL_STAP_A) {
+    return classifyNal(payload[0], type);
+  }
+  // The most important unit decides for the aggregate.
+  PacketClass result = PACKET_OTHER;
+  size_t offset = 1;
+  while (offset + 2 < size) {
+    size_t length = (payload[offset] << 8) | payload[offset + 1];
+    uint8_t header = payload[offset + 2];
+    PacketClass c = classifyNal(header, header & 0x1f);
+    if (c < result) {
+      result = c;
+    }
+    offset += 2 + length;
+  }
+  return result;
+}
+
+}  // namespace
+
+bool FrameDropper::forward(const uint8_t* data, size_t size,
+                           Clock::time_point now) {
+  if (size < RTP_HEADER_SIZE) {
+    return true;
+  }
+  size_t offset = RTP_HEADER_SIZE + (data[0] & 0x0f) * 4;
+  if ((data[0] & 0x10) && offset + 4 <= size) {
+    offset += 4 + ((data[offset + 2] << 8) | data[offset + 3]) * 4;
+  }
+  if (offset >= size) {
+    return true;
+  }
+  uint32_t timestamp = (static_cast<uint32_t>(data[4]) << 24) |
+                       (data[5] << 16) | (data[6] << 8) | data[7];
+  if (!inFrame_ || timestamp != frameTimestamp_) {
+    inFrame_ = true;
+    frameTimestamp_ = timestamp;
+    classified_ = false;
+    dropping_ = false;
+  }
+
+  PacketClass packetClass = classify(data + offset, size - offset);
+  if (!classified_ && packetClass != PACKET_OTHER) {
+    classified_ = true;
+    startFrame(static_cast<FrameClass>(packetClass), now);
+  }
+  measure(now);
+  windowBytes_[packetClass == PACKET_OTHER
+                   ? frameClass_
+                   : static_cast<FrameClass>(packetClass)] += size;
+
+  if (dropping_) {
+    counters_.packetsDropped++;
+    return false;
+  }
+  return true;
+}
+
+void FrameDropper::startFrame(FrameClass frameClass, Clock::time_point now) {
+  frameClass_ = frameClass;
+  updateLevel(now);
+  if (frameClass == FRAME_KEY) {
+    waitingForIdr_ = false;
+  }
+  dropping_ = dropFrame(frameClass);
+  if (dropping_) {
+    counters_.framesDropped++;
+    if (frameClass == FRAME_REFERENCE) {
+      waitingForIdr_ = true;
+    }
+  }
+}
+
+bool FrameDropper::dropFrame(FrameClass frameClass) const {
+  if (frameClass == FRAME_KEY) {
+    return false;
+  }
+  if (waitingForIdr_) {
+    return true;
+  }
+  switch (level_) {
+    case DROP_NONE:
+      return false;
+    case DROP_NON_REFERENCE:
+      return frameClass == FRAME_NON_REFERENCE;
+    case DROP_ALL_BUT_IDR:
+      return true;
+  }
+  return false;
+}
+
+void FrameDropper::measure(Clock::time_point now) {
+  if (!windowStarted_) {
+    windowStarted_ = true;
+    windowStart_ = now;
+    return;
+  }
+  auto elapsed = now - windowStart_;
+  if (elapsed < MEASURE_WINDOW) {
+    return;
+  }
+  uint64_t us =
+      std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+  for (int i = 0; i < FRAME_CLASSES; i++) {
+    bitrate_[i] = windowBytes_[i] * 8 * 1000000 / us;
+    windowBytes_[i] = 0;
+  }
+  windowStart_ = now;
+}
+
+uint64_t FrameDropper::requiredBitrate(Level level) const {
+  switch (level) {
+    case DROP_NONE:
+      return bitrate_[FRAME_KEY] + bitrate_[FRAME_REFERENCE] +
+             bitrate_[FRAME_NON_REFERENCE];
+    case DROP_NON_REFERENCE:
+      return bitrate_[FRAME_KEY] + bitrate_[FRAME_REFERENCE];
+    case DROP_ALL_BUT_IDR:
+      return bitrate_[FRAME_KEY];
+  }
+  return 0;
+}
+
+void FrameDropper::updateLevel(Clock::time_point now) {
+  bool estimated = estimateTime_ != Clock::time_point() &&
+                   now - estimateTime_ < ESTIMATE_TIMEOUT;
+  bool failing = sendFailure_ && now - sendFailureTime_ < SEND_FAILURE_WINDOW;
+  auto atLevel = now - levelChanged_;
+  uint64_t limit = requiredBitrate(level_) * CONGESTION_PERCENT / 100;
+
+  if (failing || (estimated && estimate_ < limit)) {
+    if (level_ == DROP_ALL_BUT_IDR || atLevel < ESCALATE_HOLD) {
+      return;
+    }
+    if (probing_) {
+      probeInterval_ = std::min<Clock::duration>(probeInterval_ * 2,
+                                                 MAX_PROBE_INTERVAL);
+      probing_ = false;
+    }
+    counters_.escalations++;
+    setLevel(static_cast<Level>(level_ + 1), now);
+    return;
+  }
+
+  if (probing_ && atLevel >= PROBE_SUCCESS) {
+    probing_ = false;
+    probeInterval_ = MIN_PROBE_INTERVAL;
+  }
+  if (level_ == DROP_NONE) {
+    return;
+  }
+  // The estimate of a viewer rarely grows much beyond what it receives, so
+  // without probing a lower level would never be reached.
+  Level lower = static_cast<Level>(level_ - 1);
+  bool covered = estimated && estimate_ >= requiredBitrate(lower);
+  if ((covered && atLevel >= RECOVER_HOLD) || atLevel >= probeInterval_) {
+    probing_ = !covered;
+    setLevel(lower, now);
+  }
+}
+
+void FrameDropper::setLevel(Level level, Clock::time_point now) {
+  if (level_ == DROP_ALL_BUT_IDR && level < level_ && waitingForIdr_) {
+    keyframeRequest_ = true;
+    counters_.keyframeRequests++;
+  }
+  level_ = level;
+  levelChanged_ = now;
+}
+
+void FrameDropper::handleEstimate(uint64_t bitrate, Clock::time_point now) {
+  estimate_ = bitrate;
+  estimateTime_ = now;
+}
+
+void FrameDropper::handleSendFailure(Clock::time_point now) {
+  sendFailure_ = true;
+  sendFailureTime_ = now;
+}
+
+bool FrameDropper::takeKeyframeRequest() {
+  bool request = keyframeRequest_;
+  keyframeRequest_ = false;
+  return request;
+}
+
+bool FrameDropper::parseRemb(const uint8_t* data, size_t size,
+                             uint64_t& bitrate) {
+  size_t offset = 0;
+  while (offset + RTCP_HEADER_SIZE <= size) {
+    const uint8_t* header = data + offset;
+    if ((header[0] >> 6) != 2 || header[1] < RTCP_TYPE_MIN ||
+        header[1] > RTCP_TYPE_MAX) {
+      return false;
+    }
+    // The length is in 32 bit words minus one.
+    size_t length = ((header[2] << 8) | header[3]) * 4 + RTCP_HEADER_SIZE;
+    if (offset + length > size) {
+      return false;
+    }
+    if (header[1] == RTCP_PSFB && (header[0] & 0x1f) == PSFB_FMT_AFB &&
+        length >= REMB_MIN_SIZE && header[12] == 'R' && header[13] == 'E' &&
+        header[14] == 'M' && header[15] == 'B') {
+      uint8_t exp = header[17] >> 2;
+      uint64_t mantissa =
+          ((header[17] & 0x03) << 16) | (header[18] << 8) | header[19];
+      // The mantissa has 18 bits.
+      if (mantissa != 0 && exp > 64 - 18) {
+        bitrate = std::numeric_limits<uint64_t>::max();
+      } else {
+        bitrate = mantissa << exp;
+      }
+      return true;
+    }
+    offset += length;
+  }
+  return false;
+}
+
+}  // namespace example
+}  // namespace nabto
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nabto {
+namespace example {
+
+class FrameDropperCounters {
+ public:
+  uint64_t packetsDropped = 0;
+  uint64_t framesDropped = 0;
+  // Times the drop level was raised because of congestion.
+  uint64_t escalations = 0;
+  // Keyframes requested to recover after dropping reference frames.
+  uint64_t keyframeRequests = 0;
+};
+
+/**
+ * Decides which frames of an H264 stream a single viewer gets, so a viewer on
+ * a slow link gets the best stream it can carry without holding the others
+ * back.
+ *
+ * Congestion is detected from the viewer's receiver estimated bitrate (REMB)
+ * compared to the bitrate of the frames it is currently sent, and from
+ * failing sends. Under congestion the drop level is raised one step at a
+ * time: first frames no other frame references are dropped, then all frames
+ * except IDR frames. When the estimate covers the lower level, or after a
+ * probing interval which doubles each time a probe fails, the level is
+ * lowered again. Once a reference frame has been dropped, the following
+ * frames cannot be decoded, so they are dropped until the next IDR and a
+ * keyframe is requested.
+ *
+ * Levels only change between frames, so a frame is sent or dropped whole.
+ * Not thread safe, the owner serializes access with the forwarding.
+ */
+class FrameDropper {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  enum Level {
+    DROP_NONE = 0,
+    DROP_NON_REFERENCE,
+    DROP_ALL_BUT_IDR,
+  };
+
+  /**
+   * Whether to send the H264 RTP packet to the viewer. Also measures the
+   * bitrate of the stream.
+   */
+  bool forward(const uint8_t* data, size_t size, Clock::time_point now);
+
+  /**
+   * The viewer's receiver estimated maximum bitrate in bits per second.
+   */
+  void handleEstimate(uint64_t bitrate, Clock::time_point now);
+
+  /**
+   * A send to the viewer failed, its queue is likely full.
+   */
+  void handleSendFailure(Clock::time_point now);
+
+  /**
+   * True once for each keyframe the viewer needs to recover.
+   */
+  bool takeKeyframeRequest();
+
+  Level level() const { return level_; }
+
+  const FrameDropperCounters& counters() const { return counters_; }
+
+  /**
+   * Find the bitrate of a REMB message in an RTCP compound packet.
+   *
+   * @return false if there is none.
+   */
+  static bool parseRemb(const uint8_t* data, size_t size, uint64_t& bitrate);
+
+ private:
+  enum FrameClass {
+    FRAME_KEY = 0,
+    FRAME_REFERENCE,
+    FRAME_NON_REFERENCE,
+    FRAME_CLASSES,
+  };
+
+  void startFrame(FrameClass frameClass, Clock::time_point now);
+  void measure(Clock::time_point now);
+  void updateLevel(Clock::time_point now);
+  void setLevel(Level level, Clock::time_point now);
+  bool dropFrame(FrameClass frameClass) const;
+  // Bitrate of the frames sent at a level.
+  uint64_t requiredBitrate(Level level) const;
+
+  Level level_ = DROP_NONE;
+  Clock::time_point levelChanged_;
+  bool probing_ = false;
+  Clock::duration probeInterval_ = std::chrono::seconds(5);
+
+  // The current frame, and whether a packet has told what kind it is yet.
+  bool inFrame_ = false;
+  uint32_t frameTimestamp_ = 0;
+  bool classified_ = false;
+  bool dropping_ = false;
+  bool waitingForIdr_ = false;
+  bool keyframeRequest_ = false;
+
+  uint64_t estimate_ = 0;
+  Clock::time_point estimateTime_;
+  Clock::time_point sendFailureTime_;
+  bool sendFailure_ = false;
+
+  // Bytes per frame class in the current measurement window, and the
+  // resulting bitrates of the last window.
+  Clock::time_point windowStart_;
+  bool windowStarted_ = false;
+  uint64_t windowBytes_[FRAME_CLASSES] = {};
+  uint64_t bitrate_[FRAME_CLASSES] = {};
+  FrameClass frameClass_ = FRAME_REFERENCE;
+
+  FrameDropperCounters counters_;
+};
+
+/**
+ * Renumbers the packets sent to a viewer, so the packets dropped for it do
+ * not show up as losses, and maps the sequence numbers the viewer NACKs back
+ * to those of the source.
+ */
+class RtpSequenceRewriter {
+ public:
+  static constexpr size_t HISTORY = 1024;
+
+  RtpSequenceRewriter() : sources_(HISTORY), outputs_(HISTORY) {
+    // Nothing is known before the first packet.
+    for (size_t i = 0; i < HISTORY; i++) {
+      outputs_[i] = i + 1;
+    }
+  }
+
+  /**
+   * The sequence number to send a packet of the source with.
+   */
+  uint16_t forward(uint16_t sourceSeq) {
+    uint16_t seq = sourceSeq - offset_;
+    sources_[seq % HISTORY] = sourceSeq;
+    outputs_[seq % HISTORY] = seq;
+    return seq;
+  }
+
+  /**
+   * A source packet is not sent to the viewer.
+   */
+  void drop() { offset_++; }
+
+  /**
+   * The source sequence number of a packet sent to the viewer, if it is
+   * recent enough to be known.
+   */
+  bool sourceSeq(uint16_t seq, uint16_t& sourceSeq) const {
+    if (outputs_[seq % HISTORY] != seq) {
+      return false;
+    }
+    sourceSeq = sources_[seq % HISTORY];
+    return true;
+  }
+
+ private:
+  uint16_t offset_ = 0;
+  std::vector<uint16_t> sources_;
+  std::vector<uint16_t> outputs_;
+};
+
+}  // namespace example
+}  // namespace nabto
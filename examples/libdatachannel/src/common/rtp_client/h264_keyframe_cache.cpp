@@ -0,0 +1,201 @@
+#include "h264_keyframe_cache.hpp"
+
+namespace nabto {
+namespace example {
+
+namespace {
+
+// RFC 6184 NAL unit types
+const uint8_t NAL_IDR = 5;
+const uint8_t NAL_SPS = 7;
+const uint8_t NAL_PPS = 8;
+const uint8_t NAL_STAP_A = 24;
+const uint8_t NAL_FU_A = 28;
+
+const size_t RTP_HEADER_SIZE = 12;
+// A keyframe may have SPS and PPS in separate packets, and some encoders
+// repeat them. Keep the last few.
+const size_t MAX_PARAM_SET_PACKETS = 4;
+
+}  // namespace
+
+void H264KeyframeCache::handlePacket(const RtpPacket& rtpPacket) {
+  const uint8_t* data = rtpPacket.data();
+  size_t len = rtpPacket.size();
+  uint16_t seq = 0;
+  uint32_t timestamp = 0;
+  NalInfo info;
+  if (!parse(data, len, seq, timestamp, info)) {
+    return;
+  }
+  seenPacket_ = true;
+  lastSeq_ = seq;
+  lastTimestamp_ = timestamp;
+
+  Packet packet = {rtpPacket, timestamp};
+
+  // An IDR may be split in several slices, only the first starts a new
+  // keyframe.
+  bool newKeyframe =
+      info.idrStart && (gop_.empty() || timestamp != keyframeTimestamp_);
+  if (newKeyframe) {
+    gop_.clear();
+    bytes_ = 0;
+    full_ = false;
+    keyframeTimestamp_ = timestamp;
+    if (!info.sps) {
+      for (const auto& p : paramSets_) {
+        gop_.push_back({p.packet, timestamp});
+        bytes_ += p.packet.size();
+      }
+    }
+    bytes_ += len;
+    gop_.push_back(packet);
+  } else if (!gop_.empty() && !full_ && !info.paramSet) {
+    if (!conf_.keepFollowingFrames && timestamp != keyframeTimestamp_) {
+      full_ = true;
+    } else if (gop_.size() >= conf_.maxPackets ||
+               bytes_ + len > conf_.maxBytes) {
+      full_ = true;
+    } else {
+      bytes_ += len;
+      gop_.push_back(packet);
+    }
+  }
+
+  if (info.paramSet) {
+    if (!paramSets_.empty() && paramSets_.back().timestamp != timestamp) {
+      paramSets_.clear();
+    }
+    if (paramSets_.size() < MAX_PARAM_SET_PACKETS) {
+      paramSets_.push_back(std::move(packet));
+    }
+  }
+}
+
+bool H264KeyframeCache::startsFrame(const RtpPacket& next) const {
+  uint16_t seq = 0;
+  uint32_t timestamp = 0;
+  NalInfo info;
+  if (!parse(next.data(), next.size(), seq, timestamp, info)) {
+    return false;
+  }
+  return !seenPacket_ || timestamp != lastTimestamp_;
+}
+
+std::vector<RtpPacket> H264KeyframeCache::replay(RtpPacketPool& pool) const {
+  std::vector<RtpPacket> result;
+  if (gop_.empty()) {
+    return result;
+  }
+
+  size_t frames = 1;
+  for (size_t i = 1; i < gop_.size(); i++) {
+    if (gop_[i].timestamp != gop_[i - 1].timestamp) {
+      frames++;
+    }
+  }
+
+  result.reserve(gop_.size());
+  size_t frame = 0;
+  for (size_t i = 0; i < gop_.size(); i++) {
+    if (i > 0 && gop_[i].timestamp != gop_[i - 1].timestamp) {
+      frame++;
+    }
+    const RtpPacket& cached = gop_[i].packet;
+    RtpPacket copy = pool.copy(cached.data(), cached.size());
+    uint8_t* data = copy.data();
+    uint16_t seq = lastSeq_ - static_cast<uint16_t>(gop_.size() - 1 - i);
+    uint32_t timestamp = lastTimestamp_ - static_cast<uint32_t>(
+                                              (frames - 1 - frame) *
+                                              REPLAY_FRAME_TICKS);
+    data[2] = static_cast<uint8_t>(seq >> 8);
+    data[3] = static_cast<uint8_t>(seq);
+    data[4] = static_cast<uint8_t>(timestamp >> 24);
+    data[5] = static_cast<uint8_t>(timestamp >> 16);
+    data[6] = static_cast<uint8_t>(timestamp >> 8);
+    data[7] = static_cast<uint8_t>(timestamp);
+    result.push_back(std::move(copy));
+  }
+  return result;
+}
+
+void H264KeyframeCache::clear() {
+  seenPacket_ = false;
+  paramSets_.clear();
+  gop_.clear();
+  bytes_ = 0;
+  full_ = false;
+}
+
+bool H264KeyframeCache::parse(const uint8_t* data, size_t len, uint16_t& seq,
+                              uint32_t& timestamp, NalInfo& info) {
+  if (len < RTP_HEADER_SIZE || (data[0] >> 6) != 2) {
+    return false;
+  }
+  // Ignore RTCP sent to the RTP port.
+  uint8_t pt = data[1] & 0x7F;
+  if (pt >= 72 && pt <= 76) {
+    return false;
+  }
+  seq = static_cast<uint16_t>((data[2] << 8) | data[3]);
+  timestamp = (static_cast<uint32_t>(data[4]) << 24) |
+              (static_cast<uint32_t>(data[5]) << 16) |
+              (static_cast<uint32_t>(data[6]) << 8) | data[7];
+
+  size_t offset = RTP_HEADER_SIZE + 4 * (data[0] & 0x0F);
+  if (data[0] & 0x10) {
+    if (len < offset + 4) {
+      return false;
+    }
+    offset += 4 + 4 * ((data[offset + 2] << 8) | data[offset + 3]);
+  }
+  size_t end = len;
+  if (data[0] & 0x20) {
+    uint8_t padding = data[len - 1];
+    if (padding > len) {
+      return false;
+    }
+    end -= padding;
+  }
+  if (offset >= end) {
+    return false;
+  }
+
+  const uint8_t* payload = data + offset;
+  size_t payloadLen = end - offset;
+  uint8_t nalType = payload[0] & 0x1F;
+  if (nalType == NAL_STAP_A) {
+    size_t pos = 1;
+    while (pos + 2 < payloadLen) {
+      size_t nalSize = (payload[pos] << 8) | payload[pos + 1];
+      inspectNal(payload[pos + 2] & 0x1F, info);
+      pos += 2 + nalSize;
+    }
+  } else if (nalType == NAL_FU_A) {
+    if (payloadLen < 2) {
+      return false;
+    }
+    bool start = (payload[1] & 0x80) != 0;
+    if (start) {
+      inspectNal(payload[1] & 0x1F, info);
+    }
+  } else {
+    inspectNal(nalType, info);
+  }
+  return true;
+}
+
+void H264KeyframeCache::inspectNal(uint8_t nalType, NalInfo& info) {
+  if (nalType == NAL_SPS) {
+    info.sps = true;
+    info.paramSet = true;
+  } else if (nalType == NAL_PPS) {
+    info.paramSet = true;
+  } else if (nalType == NAL_IDR) {
+    info.idrStart = true;
+  }
+}
+
+}  // namespace example
+}  // namespace nabto
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <rtp_packet/rtp_packet.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nabto {
+namespace example {
+
+class H264KeyframeCacheConf {
+ public:
+  // Also cache the frames following the keyframe, so a new viewer can decode
+  // up to the live position instead of showing the keyframe until the next
+  // one.
+  bool keepFollowingFrames = true;
+  // Stop adding to the cache when it reaches either limit. Following frames
+  // past the limit are not cached, which may show as artifacts until the next
+  // keyframe.
+  size_t maxPackets = 2000;
+  size_t maxBytes = 2 * 1024 * 1024;
+};
+
+/**
+ * Keeps the RTP packets of the most recent H264 keyframe (SPS, PPS and IDR)
+ * and, optionally, the frames following it, so a new viewer can start
+ * decoding at once instead of waiting for the next keyframe. The live packets
+ * are shared, not copied.
+ *
+ * Not thread safe, the owner serializes access with the forwarding of the
+ * live packets.
+ */
+class H264KeyframeCache {
+ public:
+  // The replayed frames are this many RTP timestamp ticks apart so the
+  // receiver decodes them immediately. 1 ms at the 90 kHz video clock.
+  static constexpr uint32_t REPLAY_FRAME_TICKS = 90;
+
+  H264KeyframeCache(const H264KeyframeCacheConf& conf = {}) : conf_(conf) {}
+
+  /**
+   * Update the cache with a live RTP packet. Call after the packet has been
+   * forwarded to the viewers which already receive the stream.
+   */
+  void handlePacket(const RtpPacket& packet);
+
+  /**
+   * Check if a live packet starts a new frame, ie. the frame of the last
+   * packet passed to handlePacket() is complete. Only replay to a new viewer
+   * ahead of such a packet. Otherwise the viewer gets the rest of the frame
+   * in flight right after the replay, and its receiver merges it with the
+   * last replayed frame into one corrupt access unit.
+   */
+  bool startsFrame(const RtpPacket& next) const;
+
+  /**
+   * The cached packets, ready to send to a new viewer before the next live
+   * packet, which must start a new frame, see startsFrame(). Sequence
+   * numbers and timestamps are rewritten so the replay ends at the last live
+   * packet and continues seamlessly into the live stream. Empty if no
+   * keyframe has been seen. The packets are copies from pool.
+   */
+  std::vector<RtpPacket> replay(RtpPacketPool& pool) const;
+
+  size_t packetCount() const { return gop_.size(); }
+
+  void clear();
+
+ private:
+  struct Packet {
+    RtpPacket packet;
+    // Timestamp of the access unit the packet belongs to.
+    uint32_t timestamp;
+  };
+
+  struct NalInfo {
+    bool paramSet = false;
+    bool sps = false;
+    bool idrStart = false;
+  };
+
+  static bool parse(const uint8_t* data, size_t len, uint16_t& seq,
+                    uint32_t& timestamp, NalInfo& info);
+  static void inspectNal(uint8_t nalType, NalInfo& info);
+
+  H264KeyframeCacheConf conf_;
+
+  // The most recent SPS and PPS packets, prepended to the cache when an IDR
+  // arrives in packets of its own.
+  std::vector<Packet> paramSets_;
+  // The keyframe and the frames following it.
+  std::vector<Packet> gop_;
+  size_t bytes_ = 0;
+  bool full_ = false;
+  uint32_t keyframeTimestamp_ = 0;
+
+  bool seenPacket_ = false;
+  uint16_t lastSeq_ = 0;
+  uint32_t lastTimestamp_ = 0;
+};
+
+}  // namespace example
+}  // namespace nabto
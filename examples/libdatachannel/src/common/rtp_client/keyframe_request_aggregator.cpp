@@ -0,0 +1,81 @@
+#include "keyframe_request_aggregator.hpp"
+
+namespace nabto {
+namespace example {
+
+namespace {
+
+// RFC 4585 and RFC 5104
+const uint8_t RTCP_PSFB = 206;
+const uint8_t PSFB_FMT_PLI = 1;
+const uint8_t PSFB_FMT_FIR = 4;
+const size_t RTCP_HEADER_SIZE = 4;
+// RTCP packet types are 192 to 223, which RTP payload types with or without
+// the marker bit never are (RFC 5761).
+const uint8_t RTCP_TYPE_MIN = 192;
+const uint8_t RTCP_TYPE_MAX = 223;
+
+}  // namespace
+
+void KeyframeRequestAggregator::request(Clock::time_point now) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_++;
+    if (sent_ && now - lastSent_ < interval_) {
+      pending_ = true;
+      return;
+    }
+    sent_ = true;
+    lastSent_ = now;
+    pending_ = false;
+    upstreamRequests_++;
+  }
+  upstream_();
+}
+
+void KeyframeRequestAggregator::poll(Clock::time_point now) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pending_ || now - lastSent_ < interval_) {
+      return;
+    }
+    lastSent_ = now;
+    pending_ = false;
+    upstreamRequests_++;
+  }
+  upstream_();
+}
+
+uint64_t KeyframeRequestAggregator::requestCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return requests_;
+}
+
+uint64_t KeyframeRequestAggregator::upstreamCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return upstreamRequests_;
+}
+
+bool KeyframeRequestAggregator::isKeyframeRequest(const uint8_t* data,
+                                                  size_t size) {
+  size_t offset = 0;
+  while (offset + RTCP_HEADER_SIZE <= size) {
+    const uint8_t* header = data + offset;
+    if ((header[0] >> 6) != 2 || header[1] < RTCP_TYPE_MIN ||
+        header[1] > RTCP_TYPE_MAX) {
+      return false;
+    }
+    uint8_t fmt = header[0] & 0x1f;
+    if (header[1] == RTCP_PSFB &&
+        (fmt == PSFB_FMT_PLI || fmt == PSFB_FMT_FIR)) {
+      return true;
+    }
+    // The length is in 32 bit words minus one.
+    size_t length = ((header[2] << 8) | header[3]) * 4 + RTCP_HEADER_SIZE;
+    offset += length;
+  }
+  return false;
+}
+
+}  // namespace example
+}  // namespace nabto
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace nabto {
+namespace example {
+
+class KeyframeRequestAggregator;
+typedef std::shared_ptr<KeyframeRequestAggregator>
+    KeyframeRequestAggregatorPtr;
+
+/**
+ * Collects the keyframe requests, RTCP PLI and FIR, from all viewers of a
+ * stream into at most one upstream request per interval. A request within
+ * the interval after the last upstream request is held back until the
+ * interval ends, together with any others arriving meanwhile.
+ *
+ * Thread safe. The upstream function is called without locks held, on the
+ * thread calling request() or poll().
+ */
+class KeyframeRequestAggregator {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  static constexpr std::chrono::milliseconds DEFAULT_INTERVAL{1000};
+
+  static KeyframeRequestAggregatorPtr create(
+      std::function<void()> upstream,
+      Clock::duration interval = DEFAULT_INTERVAL) {
+    return std::make_shared<KeyframeRequestAggregator>(upstream, interval);
+  }
+
+  KeyframeRequestAggregator(std::function<void()> upstream,
+                            Clock::duration interval = DEFAULT_INTERVAL)
+      : upstream_(upstream), interval_(interval) {}
+
+  /**
+   * A viewer requested a keyframe.
+   */
+  void request(Clock::time_point now);
+
+  /**
+   * Send a held back request if its interval has ended. Call regularly, eg.
+   * for every received packet.
+   */
+  void poll(Clock::time_point now);
+
+  // Requests from viewers, and requests sent upstream.
+  uint64_t requestCount();
+  uint64_t upstreamCount();
+
+  /**
+   * True if data is an RTCP compound packet containing a PLI or FIR. False
+   * for RTP packets.
+   */
+  static bool isKeyframeRequest(const uint8_t* data, size_t size);
+
+ private:
+  std::function<void()> upstream_;
+  Clock::duration interval_;
+
+  std::mutex mutex_;
+  bool sent_ = false;
+  Clock::time_point lastSent_;
+  bool pending_ = false;
+  uint64_t requests_ = 0;
+  uint64_t upstreamRequests_ = 0;
+};
+
+}  // namespace example
+}  // namespace nabto
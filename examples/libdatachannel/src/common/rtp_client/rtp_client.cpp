@@ -1,13 +1,14 @@
 #include "rtp_client.hpp"
 
+#include "udp_batch.hpp"
+
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <unistd.h>
 
-#include <iomanip>  // For std::setfill and std::setw
-#include <nabto/webrtc/util/logging.hpp>
+#include <algorithm>
 
-const int RTP_BUFFER_SIZE = 2048;
+#include <nabto/webrtc/util/logging.hpp>
 
 namespace nabto {
 namespace example {
@@ -19,7 +20,25 @@ RtpClientPtr RtpClient::create(const RtpClientConf& conf) {
 RtpClient::RtpClient(const RtpClientConf& conf)
     : remoteHost_(conf.remoteHost),
       videoPort_(conf.port),
-      remotePort_(conf.port + 1) {}
+      remotePort_(conf.port + 1),
+      recvBatchSize_(conf.recvBatchSize),
+      udpGro_(conf.udpGro) {
+  remoteAddr_.sin_family = AF_INET;
+  remoteAddr_.sin_addr.s_addr = inet_addr(remoteHost_.c_str());
+  remoteAddr_.sin_port = htons(remotePort_);
+  if (conf.cacheH264Keyframes) {
+    keyframeCache_ = std::make_unique<H264KeyframeCache>();
+  }
+  receptionStats_ = conf.receptionStats;
+  if (conf.requestKeyframe) {
+    keyframeRequests_ =
+        KeyframeRequestAggregator::create(conf.requestKeyframe);
+  }
+  if (conf.answerNacks) {
+    history_ = std::make_unique<RtpHistory>();
+  }
+  adaptToViewers_ = conf.adaptToViewers;
+}
 
 RtpClient::~RtpClient() {}
 
@@ -34,6 +53,13 @@ size_t RtpClient::addConnection(std::shared_ptr<rtc::Track> track,
 
   index_++;
   RtpTrack t = {index_, track, ssrc, payloadType, pt};
+  if (adaptToViewers_) {
+    t.dropper = std::make_shared<FrameDropper>();
+    t.rewriter = std::make_shared<RtpSequenceRewriter>();
+  }
+  if (keyframeCache_ && history_) {
+    t.replayHistory = std::make_shared<RtpHistory>();
+  }
   addConnection(t);
   return index_;
 }
@@ -54,7 +80,25 @@ void RtpClient::addConnection(RtpTrack track) {
     auto msg = rtc::make_message(data);
 
     if (msg->type == rtc::Message::Binary) {
-      rtc::byte* data = msg->data();
+      auto bytes = reinterpret_cast<const uint8_t*>(msg->data());
+      uint64_t bitrate = 0;
+      if (track.dropper &&
+          FrameDropper::parseRemb(bytes, msg->size(), bitrate)) {
+        self->handleEstimate(track, bitrate);
+      }
+      if (self->history_) {
+        std::vector<uint16_t> nacked;
+        if (RtpHistory::parseNacks(bytes, msg->size(), nacked)) {
+          self->retransmit(track, nacked);
+        }
+      }
+      if (KeyframeRequestAggregator::isKeyframeRequest(bytes, msg->size())) {
+        if (self->keyframeRequests_) {
+          self->keyframeRequests_->request(
+              KeyframeRequestAggregator::Clock::now());
+        }
+        return;
+      }
       auto rtp = reinterpret_cast<rtc::RtpHeader*>(msg->data());
 
       uint8_t pt = rtp->payloadType();
@@ -63,25 +107,177 @@ void RtpClient::addConnection(RtpTrack track) {
       }
 
       rtp->setPayloadType(track.srcPayloadType);
+      self->sendBackchannel(msg->data(), msg->size());
+    }
+  });
+}
 
-      struct sockaddr_in addr = {};
-      addr.sin_family = AF_INET;
-      addr.sin_addr.s_addr = inet_addr(self->remoteHost_.c_str());
-      addr.sin_port = htons(self->remotePort_);
+void RtpClient::retransmit(const RtpTrack& track,
+                           const std::vector<uint16_t>& seqs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto now = RtpHistory::Clock::now();
+  auto sendAsIs = [&track](const RtpPacket& p) {
+    try {
+      track.track->send((const rtc::byte*)p.data(), p.size());
+    } catch (std::runtime_error& ex) {
+      NPLOGE << "Failed to retransmit on track: " << ex.what();
+    }
+  };
 
-      auto ret = sendto(self->videoRtpSock_, msg->data(), msg->size(), 0,
-                        (struct sockaddr*)&addr, sizeof(addr));
+  // Packets of the keyframe replay are answered from the track's own
+  // history, the shared one has other packets under the same numbers.
+  std::vector<uint16_t> live;
+  if (track.replayHistory) {
+    std::vector<uint16_t> replayed;
+    for (uint16_t seq : seqs) {
+      if (track.replayHistory->contains(seq, now)) {
+        replayed.push_back(seq);
+      } else {
+        live.push_back(seq);
+      }
     }
-  });
+    if (!replayed.empty()) {
+      track.replayHistory->retransmit(replayed, now, sendAsIs);
+    }
+  } else {
+    live = seqs;
+  }
+  if (live.empty()) {
+    return;
+  }
+
+  if (!track.rewriter) {
+    history_->retransmit(live, now, sendAsIs);
+    return;
+  }
+
+  // The viewer NACKs the sequence numbers it got, the history has those of
+  // the source.
+  std::vector<uint16_t> sources;
+  std::vector<uint16_t> outputs;
+  for (uint16_t seq : live) {
+    uint16_t source = 0;
+    if (track.rewriter->sourceSeq(seq, source)) {
+      sources.push_back(source);
+      outputs.push_back(seq);
+    }
+  }
+  auto send = [&](const RtpPacket& p) {
+    uint16_t source = (p.data()[2] << 8) | p.data()[3];
+    auto i = std::find(sources.begin(), sources.end(), source) -
+             sources.begin();
+    rewriteBuffer_.assign(p.data(), p.data() + p.size());
+    rewriteBuffer_[2] = outputs[i] >> 8;
+    rewriteBuffer_[3] = outputs[i] & 0xff;
+    try {
+      track.track->send((const rtc::byte*)rewriteBuffer_.data(),
+                        rewriteBuffer_.size());
+    } catch (std::runtime_error& ex) {
+      NPLOGE << "Failed to retransmit on track: " << ex.what();
+    }
+  };
+  history_->retransmit(sources, now, send);
+}
+
+void RtpClient::handleEstimate(const RtpTrack& track, uint64_t bitrate) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  track.dropper->handleEstimate(bitrate, FrameDropper::Clock::now());
+}
+
+bool RtpClient::send(RtpTrack& track, const RtpPacket& packet,
+                     RtpReceptionStats::Clock::time_point now) {
+  const uint8_t* data = packet.data();
+  size_t size = packet.size();
+  if (!track.dropper) {
+    track.track->send((const rtc::byte*)data, size);
+    return false;
+  }
+
+  FrameDropper& dropper = *track.dropper;
+  FrameDropper::Level level = dropper.level();
+  bool keep = dropper.forward(data, size, now);
+  if (dropper.level() != level) {
+    NPLOGD << "Track " << track.ref << " frame drop level " << level << "->"
+           << dropper.level();
+  }
+  if (!keep) {
+    track.rewriter->drop();
+    return dropper.takeKeyframeRequest();
+  }
+
+  uint16_t seq = (data[2] << 8) | data[3];
+  uint16_t out = track.rewriter->forward(seq);
+  bool sent = false;
+  try {
+    if (out == seq) {
+      sent = track.track->send((const rtc::byte*)data, size);
+    } else {
+      rewriteBuffer_.assign(data, data + size);
+      rewriteBuffer_[2] = out >> 8;
+      rewriteBuffer_[3] = out & 0xff;
+      sent = track.track->send((const rtc::byte*)rewriteBuffer_.data(), size);
+    }
+  } catch (std::runtime_error&) {
+    dropper.handleSendFailure(now);
+    throw;
+  }
+  if (!sent) {
+    // The transport refused the packet, typically because the socket buffer
+    // is full.
+    dropper.handleSendFailure(now);
+  }
+  return dropper.takeKeyframeRequest();
+}
+
+RtpHistoryCounters RtpClient::nackCounters() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return history_ ? history_->counters() : RtpHistoryCounters();
+}
+
+void RtpClient::sendBackchannel(const rtc::byte* data, size_t size) {
+  RtpPacket packet =
+      backchannelPool_->copy(reinterpret_cast<const uint8_t*>(data), size);
+  std::unique_lock<std::mutex> lock(backchannelMutex_);
+  backchannelQueue_.push_back(std::move(packet));
+  if (backchannelSending_) {
+    return;
+  }
+  backchannelSending_ = true;
+  std::vector<RtpPacket>& batch = backchannelBatch_;
+  while (!backchannelQueue_.empty()) {
+    batch.swap(backchannelQueue_);
+    lock.unlock();
+    size_t sent = sendBatch(videoRtpSock_, remoteAddr_, batch);
+    if (sent < batch.size()) {
+      NPLOGD << "Failed to send " << batch.size() - sent
+             << " RTP packets to " << remoteHost_ << ":" << remotePort_;
+    }
+    batch.clear();
+    lock.lock();
+  }
+  backchannelSending_ = false;
 }
 
 void RtpClient::removeConnection(size_t ref) {
   NPLOGD << "Removing Nabto Connection from RTP";
+  if (history_) {
+    auto counters = nackCounters();
+    NPLOGD << "    NACKs: " << counters.nacks
+           << " packets requested: " << counters.requested
+           << " retransmitted: " << counters.retransmitted;
+  }
   size_t mediaTracksSize = 0;
   {
     std::lock_guard<std::mutex> lock(mutex_);
     for (auto it = mediaTracks_.begin(); it != mediaTracks_.end(); ++it) {
       if (it->ref == ref) {
+        if (it->dropper) {
+          const auto& counters = it->dropper->counters();
+          NPLOGD << "    Frames dropped: " << counters.framesDropped
+                 << " packets dropped: " << counters.packetsDropped
+                 << " congestion events: " << counters.escalations
+                 << " keyframes requested: " << counters.keyframeRequests;
+        }
         mediaTracks_.erase(it);
         break;
       }
@@ -100,6 +296,13 @@ void RtpClient::start() {
   NPLOGI << "Starting RTP Client listen on port " << videoPort_;
 
   stopped_ = false;
+  if (keyframeCache_) {
+    keyframeCache_->clear();
+  }
+  if (receptionStats_) {
+    // The stream continued while we were not listening, which is not loss.
+    receptionStats_->reset();
+  }
   videoRtpSock_ = socket(AF_INET, SOCK_DGRAM, 0);
   struct sockaddr_in addr = {};
   addr.sin_family = AF_INET;
@@ -142,11 +345,8 @@ void RtpClient::stop() {
 }
 
 void RtpClient::rtpVideoRunner(RtpClient* self) {
-  char buffer[RTP_BUFFER_SIZE];
-  int len;
-  int count = 0;
-  struct sockaddr_in srcAddr;
-  socklen_t srcAddrLen = sizeof(srcAddr);
+  UdpBatchReceiver receiver(self->videoRtpSock_, self->recvBatchSize_,
+                            self->udpGro_, self->pool_);
   while (true) {
     {
       std::lock_guard<std::mutex> lock(self->mutex_);
@@ -155,38 +355,68 @@ void RtpClient::rtpVideoRunner(RtpClient* self) {
       }
     }
 
-    len = recvfrom(self->videoRtpSock_, buffer, RTP_BUFFER_SIZE, 0,
-                   (struct sockaddr*)&srcAddr, &srcAddrLen);
-
-    if (len < 0) {
+    if (!receiver.receive()) {
       break;
     }
-
-    count++;
-    if (count % 100 == 0) {
-      std::cout << ".";
-    }
-    if (count % 1600 == 0) {
-      std::cout << std::endl;
-      count = 0;
+    auto now = RtpReceptionStats::Clock::now();
+    if (self->receptionStats_) {
+      self->receptionStats_->handlePackets(receiver.packets(), now);
     }
-    if (len < sizeof(rtc::RtpHeader)) {
-      continue;
+    if (self->keyframeRequests_) {
+      self->keyframeRequests_->poll(now);
     }
 
+    bool keyframeNeeded = false;
     {
       std::lock_guard<std::mutex> lock(self->mutex_);
-      for (auto it = self->mediaTracks_.begin(); it != self->mediaTracks_.end();
-           ++it) {
-        if (it->track->isOpen()) {
-          try {
-            it->track->send((rtc::byte*)buffer, len);
-          } catch (std::runtime_error& ex) {
-            NPLOGE << "Failed to send on track: " << ex.what();
+      for (const auto& packet : receiver.packets()) {
+        if (packet.size() < sizeof(rtc::RtpHeader)) {
+          continue;
+        }
+        for (auto it = self->mediaTracks_.begin();
+             it != self->mediaTracks_.end(); ++it) {
+          if (it->track->isOpen()) {
+            try {
+              if (!it->primed) {
+                if (self->keyframeCache_ &&
+                    !self->keyframeCache_->startsFrame(packet)) {
+                  // The rest of a frame the viewer has not seen the start
+                  // of. Wait for the next frame and replay ahead of it.
+                  continue;
+                }
+                // First frame since the track opened, send the cached
+                // keyframe ahead of it.
+                it->primed = true;
+                if (self->keyframeCache_) {
+                  for (const auto& p :
+                       self->keyframeCache_->replay(*self->pool_)) {
+                    it->track->send((rtc::byte*)p.data(), p.size());
+                    if (it->replayHistory) {
+                      it->replayHistory->add(p, now);
+                    }
+                  }
+                }
+              }
+              if (self->send(*it, packet, now)) {
+                keyframeNeeded = true;
+              }
+            } catch (std::runtime_error& ex) {
+              NPLOGE << "Failed to send on track: " << ex.what();
+            }
           }
         }
+        if (self->keyframeCache_) {
+          self->keyframeCache_->handlePacket(packet);
+        }
+        if (self->history_) {
+          self->history_->add(packet, now);
+        }
       }
     }
+    // A viewer recovering from dropped frames.
+    if (keyframeNeeded && self->keyframeRequests_) {
+      self->keyframeRequests_->request(now);
+    }
   }
 }
 
@@ -1,11 +1,19 @@
 #pragma once
 
+#include <netinet/in.h>
 #include <sys/socket.h>
 
+#include "h264_keyframe_cache.hpp"
+#include "keyframe_request_aggregator.hpp"
+#include "rtp_history.hpp"
+#include "rtp_reception_stats.hpp"
 #include "rtp_track.hpp"
 
+#include <rtp_packet/rtp_packet.hpp>
+
 typedef int SOCKET;
 
+#include <functional>
 #include <memory>
 #include <thread>
 
@@ -19,6 +27,32 @@ class RtpClientConf {
  public:
   std::string remoteHost;
   uint16_t port = 0;
+  // Replay the latest H264 keyframe to new tracks so they can start decoding
+  // without waiting for the next keyframe. Only set this for H264 streams.
+  bool cacheH264Keyframes = false;
+  // Datagrams received per recvmmsg() call. Packets of a batch are forwarded
+  // under one lock.
+  size_t recvBatchSize = 32;
+  // Let the kernel coalesce datagrams with UDP GRO. Reduces per-packet
+  // overhead further at high rates, costs 64 KB of buffer per batch slot.
+  bool udpGro = false;
+  // Updated with every packet received, for the RTCP receiver reports. The
+  // statistics are reset when the client starts listening. Optional.
+  RtpReceptionStatsPtr receptionStats = nullptr;
+  // Called when viewers request a keyframe with RTCP PLI or FIR, at most once
+  // per KeyframeRequestAggregator::DEFAULT_INTERVAL. Send a PLI to the source
+  // or ask a custom encoder for a keyframe. Requests are dropped if unset.
+  // The keyframe cache is not used for these, as all tracks share the
+  // sequence numbers of the source.
+  std::function<void()> requestKeyframe = nullptr;
+  // Keep the packets sent in the last second to answer NACKs from the tracks
+  // with retransmissions. Advertise nack feedback on the tracks if set.
+  bool answerNacks = false;
+  // Drop frames for tracks whose viewer cannot keep up, judged from their
+  // REMB feedback and failing sends, see FrameDropper. The packets sent to
+  // such a track are renumbered. Only set this for H264 streams, and
+  // advertise goog-remb feedback on the tracks.
+  bool adaptToViewers = false;
 };
 
 class RtpClient : public std::enable_shared_from_this<RtpClient> {
@@ -32,10 +66,20 @@ class RtpClient : public std::enable_shared_from_this<RtpClient> {
                        int payloadType);
   void removeConnection(size_t ref);
 
+  // NACKs answered for all tracks. Zero unless answerNacks is set.
+  RtpHistoryCounters nackCounters();
+
  private:
   void start();
   void stop();
   void addConnection(RtpTrack track);
+  void sendBackchannel(const rtc::byte* data, size_t size);
+  void retransmit(const RtpTrack& track, const std::vector<uint16_t>& seqs);
+  void handleEstimate(const RtpTrack& track, uint64_t bitrate);
+  // Send a packet to a track, dropping or renumbering it for the viewer.
+  // Returns true if the viewer needs a keyframe.
+  bool send(RtpTrack& track, const RtpPacket& packet,
+            RtpReceptionStats::Clock::time_point now);
   static void rtpVideoRunner(RtpClient* self);
 
   std::string trackId_;
@@ -44,12 +88,35 @@ class RtpClient : public std::enable_shared_from_this<RtpClient> {
   size_t index_ = 0;
 
   std::vector<RtpTrack> mediaTracks_;
+  std::unique_ptr<H264KeyframeCache> keyframeCache_;
+  RtpReceptionStatsPtr receptionStats_;
+  KeyframeRequestAggregatorPtr keyframeRequests_;
+  // The tracks all get the same packets, so they share the history.
+  std::unique_ptr<RtpHistory> history_;
+  // Received packets, shared by the tracks and the keyframe cache.
+  RtpPacketPoolPtr pool_ = RtpPacketPool::create();
 
   uint16_t videoPort_ = 6000;
   uint16_t remotePort_ = 6002;
   std::string remoteHost_ = "127.0.0.1";
+  struct sockaddr_in remoteAddr_ = {};
+  size_t recvBatchSize_ = 32;
+  bool udpGro_ = false;
+  bool adaptToViewers_ = false;
+  // Renumbered packets, owned by the thread holding mutex_.
+  std::vector<uint8_t> rewriteBuffer_;
   SOCKET videoRtpSock_ = 0;
   std::thread videoThread_;
+
+  // Packets from the tracks waiting to be sent to the remote. Whichever
+  // thread finds the queue idle sends it, including packets queued by other
+  // threads meanwhile, in batches.
+  std::mutex backchannelMutex_;
+  std::vector<RtpPacket> backchannelQueue_;
+  // Owned by the thread sending, reused to avoid allocations.
+  std::vector<RtpPacket> backchannelBatch_;
+  bool backchannelSending_ = false;
+  RtpPacketPoolPtr backchannelPool_ = RtpPacketPool::create();
 };
 
 }  // namespace example
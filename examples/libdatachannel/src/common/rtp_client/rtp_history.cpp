@@ -0,0 +1,102 @@
+#include "rtp_history.hpp"
+
+#include <algorithm>
+
+namespace nabto {
+namespace example {
+
+namespace {
+
+const size_t RTP_HEADER_SIZE = 12;
+
+// RFC 4585
+const uint8_t RTCP_RTPFB = 205;
+const uint8_t RTPFB_FMT_NACK = 1;
+const size_t RTCP_HEADER_SIZE = 4;
+// Header, sender SSRC and media source SSRC.
+const size_t RTCP_FB_HEADER_SIZE = 12;
+const size_t NACK_FCI_SIZE = 4;
+const uint8_t RTCP_TYPE_MIN = 192;
+const uint8_t RTCP_TYPE_MAX = 223;
+
+size_t roundUpPow2(size_t n) {
+  size_t p = 1;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+}  // namespace
+
+RtpHistory::RtpHistory(const RtpHistoryConf& conf)
+    : conf_(conf),
+      ring_(roundUpPow2(std::min(INITIAL_CAPACITY,
+                                 std::max<size_t>(conf.maxPackets, 1)))) {}
+
+void RtpHistory::add(const RtpPacket& packet, Clock::time_point now) {
+  if (packet.size() < RTP_HEADER_SIZE) {
+    return;
+  }
+  const uint8_t* data = packet.data();
+  uint16_t seq = (data[2] << 8) | data[3];
+  Entry* e = &ring_[seq & (ring_.size() - 1)];
+  while (e->packet && e->seq != seq && now - e->sent < conf_.window &&
+         ring_.size() * 2 <= conf_.maxPackets) {
+    grow();
+    e = &ring_[seq & (ring_.size() - 1)];
+  }
+  e->packet = packet;
+  e->seq = seq;
+  e->sent = now;
+}
+
+void RtpHistory::grow() {
+  std::vector<Entry> ring(ring_.size() * 2);
+  for (auto& e : ring_) {
+    if (!e.packet) {
+      continue;
+    }
+    Entry& slot = ring[e.seq & (ring.size() - 1)];
+    if (!slot.packet || slot.sent < e.sent) {
+      slot = std::move(e);
+    }
+  }
+  ring_.swap(ring);
+}
+
+bool RtpHistory::parseNacks(const uint8_t* data, size_t size,
+                            std::vector<uint16_t>& seqs) {
+  size_t before = seqs.size();
+  size_t offset = 0;
+  while (offset + RTCP_HEADER_SIZE <= size) {
+    const uint8_t* header = data + offset;
+    if ((header[0] >> 6) != 2 || header[1] < RTCP_TYPE_MIN ||
+        header[1] > RTCP_TYPE_MAX) {
+      break;
+    }
+    // The length is in 32 bit words minus one.
+    size_t length = ((header[2] << 8) | header[3]) * 4 + RTCP_HEADER_SIZE;
+    if (offset + length > size) {
+      break;
+    }
+    if (header[1] == RTCP_RTPFB && (header[0] & 0x1f) == RTPFB_FMT_NACK) {
+      for (size_t fci = RTCP_FB_HEADER_SIZE; fci + NACK_FCI_SIZE <= length;
+           fci += NACK_FCI_SIZE) {
+        uint16_t pid = (header[fci] << 8) | header[fci + 1];
+        uint16_t blp = (header[fci + 2] << 8) | header[fci + 3];
+        seqs.push_back(pid);
+        for (int i = 0; i < 16; i++) {
+          if (blp & (1 << i)) {
+            seqs.push_back(static_cast<uint16_t>(pid + i + 1));
+          }
+        }
+      }
+    }
+    offset += length;
+  }
+  return seqs.size() > before;
+}
+
+}  // namespace example
+}  // namespace nabto
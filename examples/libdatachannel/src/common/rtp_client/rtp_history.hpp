@@ -0,0 +1,108 @@
+#pragma once
+
+#include <rtp_packet/rtp_packet.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nabto {
+namespace example {
+
+class RtpHistoryConf {
+ public:
+  // How long packets are kept for retransmission. Longer than the round trip
+  // time of the viewers, later retransmissions are useless.
+  std::chrono::milliseconds window{1000};
+  // Upper bound on the number of packets kept, whatever the rate.
+  size_t maxPackets = 2048;
+};
+
+class RtpHistoryCounters {
+ public:
+  // NACK messages received.
+  uint64_t nacks = 0;
+  // Packets requested by the NACKs.
+  uint64_t requested = 0;
+  // Requested packets which were still in the history and were resent.
+  uint64_t retransmitted = 0;
+};
+
+/**
+ * Ring of the RTP packets recently sent on a track, indexed by sequence
+ * number, to answer NACKs from the viewer with retransmissions. The packets
+ * are shared, not copied. The ring starts small and doubles, up to
+ * maxPackets, whenever it would overwrite a packet younger than the window,
+ * so it ends up sized by the window and the packet rate.
+ *
+ * Not thread safe, the owner serializes access with the sending of the
+ * packets.
+ */
+class RtpHistory {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  static constexpr size_t INITIAL_CAPACITY = 256;
+
+  RtpHistory(const RtpHistoryConf& conf = {});
+
+  /**
+   * Keep a packet sent at now. Packets too short to be RTP are ignored.
+   */
+  void add(const RtpPacket& packet, Clock::time_point now);
+
+  /**
+   * Answer a NACK: the packets with the requested sequence numbers which are
+   * still in the history are passed to send, in the order requested.
+   */
+  template <typename F>
+  void retransmit(const std::vector<uint16_t>& seqs, Clock::time_point now,
+                  F&& send) {
+    counters_.nacks++;
+    for (uint16_t seq : seqs) {
+      counters_.requested++;
+      if (contains(seq, now)) {
+        counters_.retransmitted++;
+        send(ring_[seq & (ring_.size() - 1)].packet);
+      }
+    }
+  }
+
+  /**
+   * Check if a packet with the sequence number is still in the history.
+   */
+  bool contains(uint16_t seq, Clock::time_point now) const {
+    const Entry& e = ring_[seq & (ring_.size() - 1)];
+    return e.packet && e.seq == seq && now - e.sent <= conf_.window;
+  }
+
+  const RtpHistoryCounters& counters() const { return counters_; }
+
+  size_t capacity() const { return ring_.size(); }
+
+  /**
+   * Collect the sequence numbers of the generic NACKs (RFC 4585) in an RTCP
+   * compound packet into seqs.
+   *
+   * @return false if there are none.
+   */
+  static bool parseNacks(const uint8_t* data, size_t size,
+                         std::vector<uint16_t>& seqs);
+
+ private:
+  struct Entry {
+    RtpPacket packet;
+    uint16_t seq = 0;
+    Clock::time_point sent;
+  };
+
+  void grow();
+
+  RtpHistoryConf conf_;
+  std::vector<Entry> ring_;
+  RtpHistoryCounters counters_;
+};
+
+}  // namespace example
+}  // namespace nabto
@@ -0,0 +1,265 @@
+#include "rtp_reception_stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace nabto {
+namespace example {
+
+namespace {
+
+// RFC 3550 appendix A.1
+const uint32_t RTP_SEQ_MOD = 1 << 16;
+const uint16_t MAX_DROPOUT = 3000;
+const uint16_t MAX_MISORDER = 100;
+const uint32_t MIN_SEQUENTIAL = 2;
+
+const size_t RTP_HEADER_SIZE = 12;
+
+bool parseHeader(const uint8_t* data, size_t size, uint16_t& seq,
+                 uint32_t& timestamp, uint32_t& ssrc) {
+  if (size < RTP_HEADER_SIZE || (data[0] >> 6) != 2) {
+    return false;
+  }
+  seq = (data[2] << 8) | data[3];
+  timestamp = (static_cast<uint32_t>(data[4]) << 24) | (data[5] << 16) |
+              (data[6] << 8) | data[7];
+  ssrc = (static_cast<uint32_t>(data[8]) << 24) | (data[9] << 16) |
+         (data[10] << 8) | data[11];
+  return true;
+}
+
+}  // namespace
+
+void RtpReceptionStats::handlePacket(const uint8_t* data, size_t size,
+                                     Clock::time_point arrival) {
+  uint16_t seq;
+  uint32_t timestamp;
+  uint32_t ssrc;
+  if (!parseHeader(data, size, seq, timestamp, ssrc)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  update(source(ssrc, arrival), seq, timestamp, size, rtpTime(arrival));
+}
+
+void RtpReceptionStats::handlePackets(const std::vector<RtpPacket>& packets,
+                                      Clock::time_point arrival) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint32_t rtpArrival = rtpTime(arrival);
+  for (const auto& packet : packets) {
+    uint16_t seq;
+    uint32_t timestamp;
+    uint32_t ssrc;
+    if (!parseHeader(packet.data(), packet.size(), seq, timestamp, ssrc)) {
+      continue;
+    }
+    update(source(ssrc, arrival), seq, timestamp, packet.size(), rtpArrival);
+  }
+}
+
+void RtpReceptionStats::handleSenderReport(uint32_t ssrc, uint64_t ntpTimestamp,
+                                           Clock::time_point arrival) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Source& s = source(ssrc, arrival);
+  s.senderReports++;
+  s.lastSrNtp = ntpTimestamp;
+  s.lastSrArrival = arrival;
+}
+
+void RtpReceptionStats::prepareReportBlock(uint32_t ssrc,
+                                           rtc::RtcpReportBlock* block,
+                                           Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = sources_.find(ssrc);
+  if (it == sources_.end()) {
+    block->preparePacket(ssrc, 0, 0, 0, 0, 0, 0, 0);
+    block->setPacketsLost(0, 0);
+    return;
+  }
+  Source& s = it->second;
+
+  // Delay since the last sender report in units of 1/65536 seconds.
+  uint64_t dlsr = 0;
+  if (s.senderReports > 0) {
+    auto delay = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - s.lastSrArrival);
+    dlsr = (static_cast<uint64_t>(delay.count()) << 16) / 1000000;
+  }
+
+  if (!s.initialized || s.probation > 0) {
+    block->preparePacket(ssrc, 0, 0, 0, 0, 0, s.lastSrNtp, dlsr);
+    block->setPacketsLost(0, 0);
+    return;
+  }
+
+  // RFC 3550 appendix A.3
+  int64_t expectedTotal = expected(s);
+  int64_t lost = expectedTotal - static_cast<int64_t>(s.received);
+  // The cumulative number lost is a signed 24 bit field.
+  lost = std::min<int64_t>(std::max<int64_t>(lost, -0x800000), 0x7fffff);
+
+  int64_t expectedInterval = expectedTotal - s.expectedPrior;
+  s.expectedPrior = expectedTotal;
+  int64_t receivedInterval = s.received - s.receivedPrior;
+  s.receivedPrior = s.received;
+  int64_t lostInterval = expectedInterval - receivedInterval;
+  if (expectedInterval == 0 || lostInterval <= 0) {
+    s.fractionLost = 0;
+  } else {
+    s.fractionLost =
+        static_cast<uint8_t>((lostInterval << 8) / expectedInterval);
+  }
+
+  block->preparePacket(ssrc, 0, 0, s.maxSeq,
+                       static_cast<uint16_t>(s.cycles >> 16),
+                       static_cast<uint32_t>(s.jitter), s.lastSrNtp, dlsr);
+  block->setPacketsLost(s.fractionLost,
+                        static_cast<unsigned int>(lost) & 0xffffff);
+}
+
+std::vector<RtpReceptionMetrics> RtpReceptionStats::metrics() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<RtpReceptionMetrics> ret;
+  for (const auto& entry : sources_) {
+    const Source& s = entry.second;
+    RtpReceptionMetrics m;
+    m.ssrc = entry.first;
+    m.clockRate = clockRate_;
+    m.packetsReceived = s.received;
+    m.bytesReceived = s.bytes;
+    m.senderReports = s.senderReports;
+    if (s.initialized && s.probation == 0) {
+      m.extendedHighestSequence = s.cycles + s.maxSeq;
+      m.cumulativeLost = expected(s) - static_cast<int64_t>(s.received);
+      m.fractionLost = s.fractionLost;
+      m.jitter = static_cast<uint32_t>(s.jitter);
+    }
+    ret.push_back(m);
+  }
+  return ret;
+}
+
+void RtpReceptionStats::reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sources_.clear();
+  last_ = nullptr;
+}
+
+void RtpReceptionStats::setClockRate(uint32_t clockRate) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  clockRate_ = clockRate;
+  sources_.clear();
+  last_ = nullptr;
+}
+
+RtpReceptionStats::Source& RtpReceptionStats::source(uint32_t ssrc,
+                                                     Clock::time_point now) {
+  if (last_ != nullptr && lastSsrc_ == ssrc) {
+    last_->lastArrival = now;
+    return *last_;
+  }
+  auto it = sources_.find(ssrc);
+  if (it == sources_.end()) {
+    if (sources_.size() >= MAX_SOURCES) {
+      auto oldest = std::min_element(
+          sources_.begin(), sources_.end(), [](const auto& a, const auto& b) {
+            return a.second.lastArrival < b.second.lastArrival;
+          });
+      sources_.erase(oldest);
+    }
+    it = sources_.emplace(ssrc, Source()).first;
+  }
+  lastSsrc_ = ssrc;
+  last_ = &it->second;
+  last_->lastArrival = now;
+  return *last_;
+}
+
+void RtpReceptionStats::update(Source& s, uint16_t seq, uint32_t timestamp,
+                               size_t size, uint32_t arrival) {
+  if (!s.initialized) {
+    initSeq(s, seq);
+    s.maxSeq = seq - 1;
+    s.probation = MIN_SEQUENTIAL;
+    s.initialized = true;
+  }
+  if (!updateSeq(s, seq)) {
+    return;
+  }
+  s.bytes += size;
+
+  // RFC 3550 appendix A.8
+  uint32_t transit = arrival - timestamp;
+  if (s.hasTransit) {
+    int32_t d = static_cast<int32_t>(transit - s.transit);
+    s.jitter += (std::abs(static_cast<double>(d)) - s.jitter) / 16;
+  }
+  s.transit = transit;
+  s.hasTransit = true;
+}
+
+void RtpReceptionStats::initSeq(Source& s, uint16_t seq) {
+  s.baseSeq = seq;
+  s.maxSeq = seq;
+  s.badSeq = RTP_SEQ_MOD + 1;
+  s.cycles = 0;
+  s.received = 0;
+  s.receivedPrior = 0;
+  s.expectedPrior = 0;
+}
+
+bool RtpReceptionStats::updateSeq(Source& s, uint16_t seq) {
+  uint16_t udelta = seq - s.maxSeq;
+  if (s.probation > 0) {
+    // The source is valid once MIN_SEQUENTIAL packets arrive in sequence.
+    if (seq == static_cast<uint16_t>(s.maxSeq + 1)) {
+      s.probation--;
+      s.maxSeq = seq;
+      if (s.probation == 0) {
+        initSeq(s, seq);
+        s.received++;
+        return true;
+      }
+    } else {
+      s.probation = MIN_SEQUENTIAL - 1;
+      s.maxSeq = seq;
+    }
+    return false;
+  } else if (udelta < MAX_DROPOUT) {
+    // In order, with permissible gap.
+    if (seq < s.maxSeq) {
+      s.cycles += RTP_SEQ_MOD;
+    }
+    s.maxSeq = seq;
+  } else if (udelta <= RTP_SEQ_MOD - MAX_MISORDER) {
+    // A very large jump. If the next packet follows it, the source restarted
+    // without changing SSRC.
+    if (seq == s.badSeq) {
+      initSeq(s, seq);
+      s.hasTransit = false;
+    } else {
+      s.badSeq = (seq + 1) & (RTP_SEQ_MOD - 1);
+      return false;
+    }
+  }
+  // Else a duplicate or reordered packet, counted as received.
+  s.received++;
+  return true;
+}
+
+int64_t RtpReceptionStats::expected(const Source& s) {
+  uint64_t extendedMax = static_cast<uint64_t>(s.cycles) + s.maxSeq;
+  return static_cast<int64_t>(extendedMax) - s.baseSeq + 1;
+}
+
+uint32_t RtpReceptionStats::rtpTime(Clock::time_point t) const {
+  uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    t - start_).count();
+  uint64_t ticks = (us / 1000000) * clockRate_ +
+                   (us % 1000000) * clockRate_ / 1000000;
+  return static_cast<uint32_t>(ticks);
+}
+
+}  // namespace example
+}  // namespace nabto
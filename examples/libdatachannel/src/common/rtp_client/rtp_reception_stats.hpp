@@ -0,0 +1,153 @@
+#pragma once
+
+#include <rtc/rtc.hpp>
+#include <rtp_packet/rtp_packet.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace nabto {
+namespace example {
+
+class RtpReceptionStats;
+typedef std::shared_ptr<RtpReceptionStats> RtpReceptionStatsPtr;
+
+/**
+ * Snapshot of the reception statistics of one RTP source.
+ */
+class RtpReceptionMetrics {
+ public:
+  uint32_t ssrc = 0;
+  uint32_t clockRate = 0;
+  uint64_t packetsReceived = 0;
+  uint64_t bytesReceived = 0;
+  // Highest sequence number received, with the number of sequence number
+  // cycles in the upper 16 bits.
+  uint32_t extendedHighestSequence = 0;
+  // Packets expected but not received, negative if duplicates were received.
+  int64_t cumulativeLost = 0;
+  // Fraction of packets lost in the interval before the last receiver
+  // report, in 1/256.
+  uint8_t fractionLost = 0;
+  // Interarrival jitter in RTP timestamp units.
+  uint32_t jitter = 0;
+  uint64_t senderReports = 0;
+
+  double jitterMs() const {
+    return clockRate == 0 ? 0 : jitter * 1000.0 / clockRate;
+  }
+};
+
+/**
+ * RTP reception statistics per source SSRC as specified in RFC 3550: the
+ * interarrival jitter estimator, cumulative and fractional loss, the extended
+ * highest sequence number and the LSR and DLSR fields, for filling in the
+ * report blocks of RTCP receiver reports.
+ *
+ * Thread safe, packets are usually counted on the RTP ingest thread while
+ * reports are prepared on the RTCP thread.
+ */
+class RtpReceptionStats {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  // Sources tracked at once. The least recently heard is forgotten when a
+  // new source appears.
+  static constexpr size_t MAX_SOURCES = 8;
+
+  static RtpReceptionStatsPtr create(uint32_t clockRate) {
+    return std::make_shared<RtpReceptionStats>(clockRate);
+  }
+
+  RtpReceptionStats(uint32_t clockRate) : clockRate_(clockRate) {}
+
+  /**
+   * Count a received RTP packet. Invalid packets are ignored.
+   */
+  void handlePacket(const uint8_t* data, size_t size,
+                    Clock::time_point arrival);
+
+  /**
+   * Count a batch of packets received at the same time, under one lock.
+   */
+  void handlePackets(const std::vector<RtpPacket>& packets,
+                     Clock::time_point arrival);
+
+  /**
+   * Record an RTCP sender report from the source for the LSR and DLSR fields.
+   */
+  void handleSenderReport(uint32_t ssrc, uint64_t ntpTimestamp,
+                          Clock::time_point arrival);
+
+  /**
+   * Fill in a report block for the source, and start a new interval for the
+   * fraction lost. Sources without statistics get a block with only the SSRC
+   * and the LSR and DLSR fields set.
+   */
+  void prepareReportBlock(uint32_t ssrc, rtc::RtcpReportBlock* block,
+                          Clock::time_point now);
+
+  std::vector<RtpReceptionMetrics> metrics();
+
+  /**
+   * Forget all sources, for when reception restarts and the sequence numbers
+   * continue from an unknown point.
+   */
+  void reset();
+
+  /**
+   * Set the RTP clock rate used for the jitter, and forget all sources.
+   */
+  void setClockRate(uint32_t clockRate);
+
+ private:
+  struct Source {
+    // Sequence number state as in RFC 3550 appendix A.1.
+    bool initialized = false;
+    uint16_t maxSeq = 0;
+    uint32_t cycles = 0;
+    uint32_t baseSeq = 0;
+    uint32_t badSeq = 0;
+    uint32_t probation = 0;
+    uint64_t received = 0;
+    uint64_t expectedPrior = 0;
+    uint64_t receivedPrior = 0;
+    uint64_t bytes = 0;
+
+    // Jitter state as in RFC 3550 appendix A.8.
+    bool hasTransit = false;
+    uint32_t transit = 0;
+    double jitter = 0;
+
+    uint8_t fractionLost = 0;
+    uint64_t senderReports = 0;
+    uint64_t lastSrNtp = 0;
+    Clock::time_point lastSrArrival;
+    Clock::time_point lastArrival;
+  };
+
+  Source& source(uint32_t ssrc, Clock::time_point now);
+  void update(Source& s, uint16_t seq, uint32_t timestamp, size_t size,
+              uint32_t arrival);
+  bool updateSeq(Source& s, uint16_t seq);
+  static void initSeq(Source& s, uint16_t seq);
+  static int64_t expected(const Source& s);
+  // Arrival time in RTP timestamp units.
+  uint32_t rtpTime(Clock::time_point t) const;
+
+  std::mutex mutex_;
+  uint32_t clockRate_;
+  Clock::time_point start_ = Clock::now();
+  std::map<uint32_t, Source> sources_;
+  // The source of the last packet, as packets come in runs from one source.
+  uint32_t lastSsrc_ = 0;
+  Source* last_ = nullptr;
+};
+
+}  // namespace example
+}  // namespace nabto
@@ -1,6 +1,9 @@
 
 #pragma once
 
+#include "frame_dropper.hpp"
+#include "rtp_history.hpp"
+
 #include <memory>
 #include <rtc/rtc.hpp>
 
@@ -14,6 +17,17 @@ class RtpTrack {
   rtc::SSRC ssrc;
   int srcPayloadType = 0;
   int dstPayloadType = 0;
+  // Set once the keyframe cache has been replayed to the track.
+  bool primed = false;
+  // The keyframe cache replay sent to the track, to answer its NACKs. The
+  // replay reuses sequence numbers which the shared history has for other
+  // live packets. Set when the client answers NACKs and caches keyframes.
+  // Shared with the track's message handler.
+  std::shared_ptr<RtpHistory> replayHistory = nullptr;
+  // Set when the client adapts to the viewer. Shared with the track's
+  // message handler.
+  std::shared_ptr<FrameDropper> dropper = nullptr;
+  std::shared_ptr<RtpSequenceRewriter> rewriter = nullptr;
 };
 
 }  // namespace example
@@ -0,0 +1,186 @@
+#include "udp_batch.hpp"
+
+#include <netinet/udp.h>
+
+#include <nabto/webrtc/util/logging.hpp>
+
+#include <algorithm>
+#include <cerrno>
+
+namespace nabto {
+namespace example {
+
+namespace {
+
+#ifdef __linux__
+const size_t CONTROL_SIZE = CMSG_SPACE(sizeof(int));
+// Messages per sendmmsg() call, on the stack.
+const size_t SEND_CHUNK = 64;
+#endif
+
+}  // namespace
+
+UdpBatchReceiver::UdpBatchReceiver(int sock, size_t batchSize, bool gro,
+                                   RtpPacketPoolPtr pool)
+    : sock_(sock),
+      batchSize_(std::max<size_t>(batchSize, 1)),
+      pool_(std::move(pool)) {
+#if defined(__linux__) && defined(UDP_GRO)
+  if (gro) {
+    int on = 1;
+    if (setsockopt(sock_, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) == 0) {
+      gro_ = true;
+    } else {
+      NPLOGW << "UDP GRO not supported, receiving without it";
+    }
+  }
+#else
+  (void)gro;
+#endif
+  if (gro_) {
+    groSlab_.resize(batchSize_ * MAX_GRO_SIZE);
+  } else {
+    slots_.resize(batchSize_);
+  }
+  packets_.reserve(batchSize_);
+
+#ifdef __linux__
+  control_.resize(batchSize_ * CONTROL_SIZE);
+  msgs_.resize(batchSize_);
+  iovecs_.resize(batchSize_);
+  for (size_t i = 0; i < batchSize_ && gro_; i++) {
+    iovecs_[i].iov_base = groSlab_.data() + i * MAX_GRO_SIZE;
+    iovecs_[i].iov_len = MAX_GRO_SIZE;
+  }
+#endif
+}
+
+bool UdpBatchReceiver::receive() {
+  packets_.clear();
+  for (auto& slot : slots_) {
+    if (!slot) {
+      slot = pool_->allocate(MAX_DATAGRAM_SIZE);
+    }
+  }
+#ifdef __linux__
+  for (size_t i = 0; i < batchSize_; i++) {
+    if (!gro_) {
+      iovecs_[i].iov_base = slots_[i].data();
+      iovecs_[i].iov_len = slots_[i].capacity();
+    }
+    struct msghdr& hdr = msgs_[i].msg_hdr;
+    hdr = {};
+    hdr.msg_iov = &iovecs_[i];
+    hdr.msg_iovlen = 1;
+    if (gro_) {
+      hdr.msg_control = control_.data() + i * CONTROL_SIZE;
+      hdr.msg_controllen = CONTROL_SIZE;
+    }
+    msgs_[i].msg_len = 0;
+  }
+
+  int n = 0;
+  do {
+    n = recvmmsg(sock_, msgs_.data(), static_cast<unsigned int>(batchSize_),
+                 MSG_WAITFORONE, nullptr);
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0) {
+    return false;
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (msgs_[i].msg_len == 0) {
+      // As with recv(), an empty read means the socket was shut down.
+      // recvmmsg() reports it as an empty datagram.
+      return !packets_.empty();
+    }
+    if (!gro_) {
+      slots_[i].resize(msgs_[i].msg_len);
+      packets_.push_back(std::move(slots_[i]));
+      continue;
+    }
+    size_t segmentSize = 0;
+#ifdef UDP_GRO
+    struct msghdr& hdr = msgs_[i].msg_hdr;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+      if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+        int size = 0;
+        std::copy_n(CMSG_DATA(cmsg), sizeof(size),
+                    reinterpret_cast<uint8_t*>(&size));
+        segmentSize = static_cast<size_t>(size);
+      }
+    }
+#endif
+    splitGroSegments(groSlab_.data() + i * MAX_GRO_SIZE, msgs_[i].msg_len,
+                     segmentSize, *pool_, packets_);
+  }
+#else
+  ssize_t len = 0;
+  do {
+    len = recv(sock_, slots_[0].data(), slots_[0].capacity(), 0);
+  } while (len < 0 && errno == EINTR);
+  if (len <= 0) {
+    return false;
+  }
+  slots_[0].resize(static_cast<size_t>(len));
+  packets_.push_back(std::move(slots_[0]));
+#endif
+  return true;
+}
+
+void splitGroSegments(const uint8_t* data, size_t size, size_t segmentSize,
+                      RtpPacketPool& pool, std::vector<RtpPacket>& packets) {
+  if (segmentSize == 0 || segmentSize >= size) {
+    packets.push_back(pool.copy(data, size));
+    return;
+  }
+  for (size_t offset = 0; offset < size; offset += segmentSize) {
+    packets.push_back(
+        pool.copy(data + offset, std::min(segmentSize, size - offset)));
+  }
+}
+
+size_t sendBatch(int sock, const struct sockaddr_in& dst,
+                 const std::vector<RtpPacket>& packets) {
+  size_t sent = 0;
+#ifdef __linux__
+  struct mmsghdr msgs[SEND_CHUNK];
+  struct iovec iovecs[SEND_CHUNK];
+  while (sent < packets.size()) {
+    size_t count = std::min(packets.size() - sent, SEND_CHUNK);
+    for (size_t i = 0; i < count; i++) {
+      const auto& packet = packets[sent + i];
+      iovecs[i].iov_base = const_cast<uint8_t*>(packet.data());
+      iovecs[i].iov_len = packet.size();
+      struct msghdr& hdr = msgs[i].msg_hdr;
+      hdr = {};
+      hdr.msg_name = const_cast<struct sockaddr_in*>(&dst);
+      hdr.msg_namelen = sizeof(dst);
+      hdr.msg_iov = &iovecs[i];
+      hdr.msg_iovlen = 1;
+    }
+    int n = sendmmsg(sock, msgs, static_cast<unsigned int>(count), 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    sent += static_cast<size_t>(n);
+  }
+#else
+  for (const auto& packet : packets) {
+    if (sendto(sock, packet.data(), packet.size(), 0,
+               reinterpret_cast<const struct sockaddr*>(&dst),
+               sizeof(dst)) < 0) {
+      break;
+    }
+    sent++;
+  }
+#endif
+  return sent;
+}
+
+}  // namespace example
+}  // namespace nabto
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <rtp_packet/rtp_packet.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nabto {
+namespace example {
+
+/**
+ * Receives a batch of datagrams with one recvmmsg() call directly into
+ * packets from an RtpPacketPool. With UDP GRO the kernel may coalesce several
+ * datagrams from the same flow into one buffer, which are split into pool
+ * packets here so callers always see single datagrams.
+ *
+ * On platforms without recvmmsg() one datagram is received per call.
+ */
+class UdpBatchReceiver {
+ public:
+  // Largest datagram expected without GRO.
+  static constexpr size_t MAX_DATAGRAM_SIZE = 2048;
+  // Largest coalesced buffer the kernel delivers with GRO.
+  static constexpr size_t MAX_GRO_SIZE = 65535;
+
+  UdpBatchReceiver(int sock, size_t batchSize, bool gro,
+                   RtpPacketPoolPtr pool);
+
+  /**
+   * Block until at least one datagram is available, then receive as many as
+   * are queued, up to the batch size, without blocking further.
+   *
+   * @return false if the socket failed or was closed.
+   */
+  bool receive();
+
+  /**
+   * The datagrams from the last receive(). Cleared by the next call, move
+   * the packets out to keep them.
+   */
+  std::vector<RtpPacket>& packets() { return packets_; }
+
+ private:
+  int sock_;
+  size_t batchSize_;
+  bool gro_ = false;
+  RtpPacketPoolPtr pool_;
+  // Pool packets the next datagrams are received into.
+  std::vector<RtpPacket> slots_;
+  // Receive buffer for coalesced datagrams, only used with GRO.
+  std::vector<uint8_t> groSlab_;
+  std::vector<uint8_t> control_;
+#ifdef __linux__
+  std::vector<struct mmsghdr> msgs_;
+  std::vector<struct iovec> iovecs_;
+#endif
+  std::vector<RtpPacket> packets_;
+};
+
+/**
+ * Split a buffer coalesced by UDP GRO into its datagrams, which are all
+ * segmentSize bytes except the last which may be shorter, and append them to
+ * packets. A segmentSize of 0 means the buffer is a single datagram.
+ */
+void splitGroSegments(const uint8_t* data, size_t size, size_t segmentSize,
+                      RtpPacketPool& pool, std::vector<RtpPacket>& packets);
+
+/**
+ * Send the packets to dst, with as few sendmmsg() calls as possible.
+ *
+ * @return the number of packets sent, which is less than packets.size() if
+ * the socket failed.
+ */
+size_t sendBatch(int sock, const struct sockaddr_in& dst,
+                 const std::vector<RtpPacket>& packets);
+
+}  // namespace example
+}  // namespace nabto
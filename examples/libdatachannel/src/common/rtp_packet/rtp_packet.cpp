@@ -0,0 +1,126 @@
+#include "rtp_packet.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace nabto {
+namespace example {
+
+namespace detail {
+
+class RtpPacketPoolState {
+ public:
+  RtpPacketPoolState(size_t packetCapacity, size_t slabPackets)
+      : packetCapacity_(packetCapacity),
+        slabPackets_(std::max<size_t>(slabPackets, 1)) {}
+
+  RtpPacketBuffer* acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+      grow();
+    }
+    RtpPacketBuffer* buffer = free_.back();
+    free_.pop_back();
+    refs_.fetch_add(1, std::memory_order_relaxed);
+    return buffer;
+  }
+
+  void recycle(RtpPacketBuffer* buffer) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(buffer);
+    }
+    unref();
+  }
+
+  // Called once by the pool and once per recycled buffer.
+  void unref() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  size_t packetCapacity() const { return packetCapacity_; }
+
+  size_t bufferCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buffers_.size() * slabPackets_;
+  }
+
+ private:
+  void grow() {
+    auto buffers = std::make_unique<RtpPacketBuffer[]>(slabPackets_);
+    auto data = std::make_unique<uint8_t[]>(slabPackets_ * packetCapacity_);
+    free_.reserve(free_.size() + slabPackets_);
+    for (size_t i = 0; i < slabPackets_; i++) {
+      buffers[i].capacity = packetCapacity_;
+      buffers[i].data = data.get() + i * packetCapacity_;
+      buffers[i].pool = this;
+      free_.push_back(&buffers[i]);
+    }
+    buffers_.push_back(std::move(buffers));
+    data_.push_back(std::move(data));
+  }
+
+  const size_t packetCapacity_;
+  const size_t slabPackets_;
+  // The pool and each buffer in use.
+  std::atomic<size_t> refs_{1};
+  std::mutex mutex_;
+  std::vector<RtpPacketBuffer*> free_;
+  std::vector<std::unique_ptr<RtpPacketBuffer[]>> buffers_;
+  std::vector<std::unique_ptr<uint8_t[]>> data_;
+};
+
+}  // namespace detail
+
+void RtpPacket::release() {
+  if (buffer_ == nullptr ||
+      buffer_->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  if (buffer_->pool != nullptr) {
+    buffer_->pool->recycle(buffer_);
+  } else {
+    delete[] buffer_->data;
+    delete buffer_;
+  }
+}
+
+RtpPacketPool::RtpPacketPool(size_t packetCapacity, size_t slabPackets)
+    : state_(new detail::RtpPacketPoolState(packetCapacity, slabPackets)) {}
+
+RtpPacketPool::~RtpPacketPool() { state_->unref(); }
+
+RtpPacket RtpPacketPool::allocate(size_t size) {
+  detail::RtpPacketBuffer* buffer = nullptr;
+  if (size <= state_->packetCapacity()) {
+    buffer = state_->acquire();
+  } else {
+    buffer = new detail::RtpPacketBuffer();
+    buffer->capacity = size;
+    buffer->data = new uint8_t[size];
+  }
+  buffer->size = size;
+  buffer->refs.store(1, std::memory_order_relaxed);
+  return RtpPacket(buffer);
+}
+
+RtpPacket RtpPacketPool::copy(const uint8_t* data, size_t size) {
+  RtpPacket packet = allocate(size);
+  if (size > 0) {
+    std::memcpy(packet.data(), data, size);
+  }
+  return packet;
+}
+
+size_t RtpPacketPool::packetCapacity() const {
+  return state_->packetCapacity();
+}
+
+size_t RtpPacketPool::bufferCount() const { return state_->bufferCount(); }
+
+}  // namespace example
+}  // namespace nabto
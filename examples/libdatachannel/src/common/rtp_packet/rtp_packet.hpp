@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace nabto {
+namespace example {
+
+class RtpPacketPool;
+typedef std::shared_ptr<RtpPacketPool> RtpPacketPoolPtr;
+
+namespace detail {
+
+class RtpPacketPoolState;
+
+struct RtpPacketBuffer {
+  std::atomic<uint32_t> refs{0};
+  size_t size = 0;
+  size_t capacity = 0;
+  uint8_t* data = nullptr;
+  // Null for buffers too large for their pool, which are freed on release.
+  RtpPacketPoolState* pool = nullptr;
+};
+
+}  // namespace detail
+
+/**
+ * Reference counted handle to a packet buffer from an RtpPacketPool.
+ *
+ * Copying the handle shares the buffer, so one received packet can be fanned
+ * out to any number of viewers without copying the payload. A buffer is
+ * returned to its pool when the last handle is gone. Handles may be copied
+ * and released on any thread.
+ *
+ * A packet is read only once it has been passed on. The number of handles
+ * does not tell whether a buffer is shared, as a single handle is commonly
+ * passed by reference to each viewer in turn. A consumer which rewrites a
+ * packet, eg. the RTP header, works on its own copy.
+ */
+class RtpPacket {
+ public:
+  RtpPacket() = default;
+  RtpPacket(const RtpPacket& other) : buffer_(other.buffer_) { ref(); }
+  RtpPacket(RtpPacket&& other) noexcept : buffer_(other.buffer_) {
+    other.buffer_ = nullptr;
+  }
+  RtpPacket& operator=(const RtpPacket& other) {
+    if (this != &other) {
+      release();
+      buffer_ = other.buffer_;
+      ref();
+    }
+    return *this;
+  }
+  RtpPacket& operator=(RtpPacket&& other) noexcept {
+    if (this != &other) {
+      release();
+      buffer_ = other.buffer_;
+      other.buffer_ = nullptr;
+    }
+    return *this;
+  }
+  ~RtpPacket() { release(); }
+
+  uint8_t* data() { return buffer_ ? buffer_->data : nullptr; }
+  const uint8_t* data() const { return buffer_ ? buffer_->data : nullptr; }
+  size_t size() const { return buffer_ ? buffer_->size : 0; }
+  size_t capacity() const { return buffer_ ? buffer_->capacity : 0; }
+  bool empty() const { return size() == 0; }
+  explicit operator bool() const { return buffer_ != nullptr; }
+
+  /**
+   * Set the size of the packet. Must not exceed capacity().
+   */
+  void resize(size_t size) { buffer_->size = size; }
+
+  void reset() {
+    release();
+    buffer_ = nullptr;
+  }
+
+ private:
+  friend class RtpPacketPool;
+  explicit RtpPacket(detail::RtpPacketBuffer* buffer) : buffer_(buffer) {}
+
+  void ref() {
+    if (buffer_ != nullptr) {
+      buffer_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  void release();
+
+  detail::RtpPacketBuffer* buffer_ = nullptr;
+};
+
+/**
+ * Slab allocator for RtpPackets. Buffers are allocated in slabs of
+ * slabPackets buffers of packetCapacity bytes and recycled when released,
+ * so once the pool has grown to the number of packets in flight it does
+ * not allocate any more.
+ *
+ * Thread safe. Packets may outlive the pool, the memory is freed when both
+ * the pool and its last packet are gone.
+ */
+class RtpPacketPool {
+ public:
+  static constexpr size_t DEFAULT_PACKET_CAPACITY = 2048;
+  static constexpr size_t DEFAULT_SLAB_PACKETS = 64;
+
+  static RtpPacketPoolPtr create(
+      size_t packetCapacity = DEFAULT_PACKET_CAPACITY,
+      size_t slabPackets = DEFAULT_SLAB_PACKETS) {
+    return std::make_shared<RtpPacketPool>(packetCapacity, slabPackets);
+  }
+
+  RtpPacketPool(size_t packetCapacity, size_t slabPackets);
+  ~RtpPacketPool();
+  RtpPacketPool(const RtpPacketPool&) = delete;
+  RtpPacketPool& operator=(const RtpPacketPool&) = delete;
+
+  /**
+   * A packet of the given size with unspecified content. Packets larger than
+   * packetCapacity are allocated on their own.
+   */
+  RtpPacket allocate(size_t size);
+
+  RtpPacket copy(const uint8_t* data, size_t size);
+
+  size_t packetCapacity() const;
+
+  // Number of pooled buffers, in use or free.
+  size_t bufferCount() const;
+
+ private:
+  detail::RtpPacketPoolState* state_;
+};
+
+}  // namespace example
+}  // namespace nabto
@@ -0,0 +1,314 @@
+#include "h264_repacketizer.hpp"
+
+#include "h264_start_code.hpp"
+
+#include <nabto/webrtc/util/logging.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace nabto {
+
+namespace {
+
+// RFC 6184 NAL unit and payload structure types
+const uint8_t STAP_A = 24;
+const uint8_t STAP_B = 25;
+const uint8_t MTAP16 = 26;
+const uint8_t MTAP24 = 27;
+const uint8_t FU_A = 28;
+const uint8_t FU_B = 29;
+
+const size_t RTP_HEADER_SIZE = 12;
+const size_t FU_HEADER_SIZE = 2;
+const size_t DON_SIZE = 2;
+
+uint16_t readUint16(const uint8_t* p) {
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+}  // namespace
+
+H264Repacketizer::H264Repacketizer(
+    std::shared_ptr<rtc::RtpPacketizationConfig> rtpConf, bool passThrough)
+    : RtpRepacketizer(rtpConf->ssrc, rtpConf->payloadType),
+      rtpConf_(rtpConf),
+      passThrough_(passThrough),
+      sequenceNumber_(rtpConf->sequenceNumber) {
+  if (passThrough_) {
+    packet_.reserve(RTP_HEADER_SIZE + MAX_PAYLOAD_SIZE);
+    return;
+  }
+  depacketizerMediaHandler_ = std::make_shared<rtc::MediaHandler>();
+  depacketizerMediaHandler_->addToChain(
+      std::make_shared<rtc::H264RtpDepacketizer>(rtc::H264RtpDepacketizer()));
+
+  repacketizerMediaHandler_ = std::make_shared<rtc::MediaHandler>();
+  repacketizerMediaHandler_->addToChain(
+      std::make_shared<rtc::H264RtpPacketizer>(rtc::H264RtpPacketizer(
+          rtc::NalUnit::Separator::LongStartSequence, rtpConf)));
+}
+
+void H264Repacketizer::handlePacket(uint8_t* data, size_t size,
+                                    RtpPacketSink& sink) {
+  if (passThrough_) {
+    passThrough(data, size, sink);
+  } else {
+    repacketize(data, size, sink);
+  }
+}
+
+void H264Repacketizer::repacketize(uint8_t* data, size_t size,
+                                   RtpPacketSink& sink) {
+  if (size < 2 || data[1] == 200) {
+    // ignore RTCP packets for now
+    return;
+  }
+
+  // The libdatachannel handler chains work on their own messages.
+  auto src = reinterpret_cast<const std::byte*>(data);
+  rtc::message_ptr msg = std::make_shared<rtc::Message>(src, src + size);
+
+  rtc::message_vector vec;
+  vec.push_back(msg);
+
+  depacketizerMediaHandler_->incomingChain(vec, nullptr);
+
+  repacketizerMediaHandler_->outgoingChain(vec, nullptr);
+  for (const auto& m : vec) {
+    sink.onPacket(reinterpret_cast<const uint8_t*>(m->data()), m->size());
+  }
+}
+
+void H264Repacketizer::passThrough(const uint8_t* data, size_t size,
+                                   RtpPacketSink& sink) {
+  if (size < RTP_HEADER_SIZE || (data[0] >> 6) != 2) {
+    return;
+  }
+  uint8_t pt = data[1] & 0x7F;
+  if (pt >= 72 && pt <= 76) {
+    // RTCP
+    return;
+  }
+
+  size_t headerSize = RTP_HEADER_SIZE + 4 * (data[0] & 0x0F);
+  if (data[0] & 0x10) {
+    if (size < headerSize + 4) {
+      return;
+    }
+    headerSize += 4 + 4 * readUint16(data + headerSize + 2);
+  }
+  size_t end = size;
+  if (data[0] & 0x20) {
+    if (data[size - 1] > size) {
+      return;
+    }
+    end -= data[size - 1];
+  }
+  if (headerSize >= end) {
+    return;
+  }
+
+  timestamp_ = (static_cast<uint32_t>(data[4]) << 24) |
+               (static_cast<uint32_t>(data[5]) << 16) |
+               (static_cast<uint32_t>(data[6]) << 8) | data[7];
+  uint16_t seq = readUint16(data + 2);
+  if (!nal_.empty() &&
+      seq != static_cast<uint16_t>(lastSequenceNumber_ + 1)) {
+    // Lost a fragment of the NAL unit being reassembled.
+    nal_.clear();
+  }
+  lastSequenceNumber_ = seq;
+
+  bool marker = (data[1] & 0x80) != 0;
+  const uint8_t* payload = data + headerSize;
+  size_t payloadSize = end - headerSize;
+  uint8_t type = payload[0] & 0x1F;
+
+  if (type >= 1 && type <= 23) {
+    if (findH264StartCode(payload, payload + payloadSize) !=
+        payload + payloadSize) {
+      if (!splitStartCodes_) {
+        NPLOGI << "H264 source embeds start codes in NAL units, splitting";
+        splitStartCodes_ = true;
+      }
+      sendAnnexB(payload, payloadSize, marker, sink);
+    } else {
+      sendNal(payload, payloadSize, marker, sink);
+    }
+  } else if (type == STAP_A && payloadSize <= MAX_PAYLOAD_SIZE) {
+    sendPacket(payload, payloadSize, marker, sink);
+  } else if (type == STAP_A || type == STAP_B) {
+    size_t pos = type == STAP_A ? 1 : 1 + DON_SIZE;
+    while (pos + 2 < payloadSize) {
+      size_t nalSize = readUint16(payload + pos);
+      pos += 2;
+      if (nalSize == 0 || pos + nalSize > payloadSize) {
+        break;
+      }
+      sendNal(payload + pos, nalSize, marker && pos + nalSize == payloadSize,
+              sink);
+      pos += nalSize;
+    }
+  } else if (type == MTAP16 || type == MTAP24) {
+    const size_t offsetSize = type == MTAP16 ? 2 : 3;
+    const uint32_t timestamp = timestamp_;
+    size_t pos = 1 + DON_SIZE;
+    while (pos + 3 + offsetSize < payloadSize) {
+      size_t nalSize = readUint16(payload + pos);
+      // Skip the size and the DON difference.
+      pos += 3;
+      uint32_t offset = 0;
+      for (size_t i = 0; i < offsetSize; i++) {
+        offset = (offset << 8) | payload[pos + i];
+      }
+      pos += offsetSize;
+      if (nalSize == 0 || pos + nalSize > payloadSize) {
+        break;
+      }
+      timestamp_ = timestamp + offset;
+      sendNal(payload + pos, nalSize, marker && pos + nalSize == payloadSize,
+              sink);
+      pos += nalSize;
+    }
+  } else if (type == FU_A || type == FU_B) {
+    handleFragment(marker, payload, payloadSize, type == FU_B, sink);
+  }
+}
+
+void H264Repacketizer::handleFragment(bool marker, const uint8_t* payload,
+                                      size_t payloadSize, bool fuB,
+                                      RtpPacketSink& sink) {
+  if (payloadSize <= FU_HEADER_SIZE) {
+    return;
+  }
+  uint8_t indicator = payload[0];
+  uint8_t fuHeader = payload[1];
+  bool start = (fuHeader & 0x80) != 0;
+  bool end = (fuHeader & 0x40) != 0;
+  uint8_t type = fuHeader & 0x1F;
+  const uint8_t* fragment = payload + FU_HEADER_SIZE;
+  size_t fragmentSize = payloadSize - FU_HEADER_SIZE;
+  if (fuB && start) {
+    // Only the first FU-B fragment has a DON.
+    if (fragmentSize <= DON_SIZE) {
+      return;
+    }
+    fragment += DON_SIZE;
+    fragmentSize -= DON_SIZE;
+  }
+
+  const uint8_t* fragmentEnd = fragment + fragmentSize;
+  if (!splitStartCodes_ &&
+      findH264StartCode(fragment, fragmentEnd) != fragmentEnd) {
+    NPLOGI << "H264 source embeds start codes in NAL units, splitting";
+    splitStartCodes_ = true;
+  }
+
+  if (splitStartCodes_) {
+    // The start codes can only be found in the reassembled NAL unit.
+    if (start) {
+      nal_.assign(1, static_cast<uint8_t>((indicator & 0xE0) | type));
+    } else if (nal_.empty()) {
+      return;
+    }
+    nal_.insert(nal_.end(), fragment, fragment + fragmentSize);
+    if (end) {
+      sendAnnexB(nal_.data(), nal_.size(), marker, sink);
+      nal_.clear();
+    }
+    return;
+  }
+
+  if (!fuB && payloadSize <= MAX_PAYLOAD_SIZE) {
+    sendPacket(payload, payloadSize, marker, sink);
+  } else {
+    sendFragments(static_cast<uint8_t>((indicator & 0xE0) | FU_A), type,
+                  fragment, fragmentSize, start, end, marker, sink);
+  }
+}
+
+void H264Repacketizer::sendNal(const uint8_t* nal, size_t size, bool marker,
+                               RtpPacketSink& sink) {
+  if (size <= MAX_PAYLOAD_SIZE) {
+    sendPacket(nal, size, marker, sink);
+    return;
+  }
+  sendFragments(static_cast<uint8_t>((nal[0] & 0xE0) | FU_A), nal[0] & 0x1F,
+                nal + 1, size - 1, true, true, marker, sink);
+}
+
+void H264Repacketizer::sendFragments(uint8_t indicator, uint8_t type,
+                                     const uint8_t* payload, size_t size,
+                                     bool start, bool end, bool marker,
+                                     RtpPacketSink& sink) {
+  const size_t maxFragment = MAX_PAYLOAD_SIZE - FU_HEADER_SIZE;
+  size_t offset = 0;
+  while (offset < size) {
+    size_t fragmentSize = std::min(maxFragment, size - offset);
+    bool first = offset == 0;
+    bool last = offset + fragmentSize == size;
+    uint8_t prefix[FU_HEADER_SIZE] = {
+        indicator,
+        static_cast<uint8_t>(type | (first && start ? 0x80 : 0) |
+                             (last && end ? 0x40 : 0))};
+    sendPacket(payload + offset, fragmentSize, marker && last, sink, prefix,
+               FU_HEADER_SIZE);
+    offset += fragmentSize;
+  }
+}
+
+void H264Repacketizer::sendAnnexB(const uint8_t* data, size_t size,
+                                  bool marker, RtpPacketSink& sink) {
+  const uint8_t* end = data + size;
+  const uint8_t* nal = data;
+  const uint8_t* pending = nullptr;
+  size_t pendingSize = 0;
+  while (nal < end) {
+    const uint8_t* startCode = findH264StartCode(nal, end);
+    const uint8_t* nalEnd = startCode;
+    // Leading zero of a 4 byte start code, or trailing zero bytes.
+    while (nalEnd > nal && nalEnd[-1] == 0) {
+      nalEnd--;
+    }
+    if (nalEnd > nal) {
+      // Sent when the next is found, so the marker goes on the last one.
+      if (pending != nullptr) {
+        sendNal(pending, pendingSize, false, sink);
+      }
+      pending = nal;
+      pendingSize = nalEnd - nal;
+    }
+    nal = startCode == end ? end : startCode + 3;
+  }
+  if (pending != nullptr) {
+    sendNal(pending, pendingSize, marker, sink);
+  }
+}
+
+void H264Repacketizer::sendPacket(const uint8_t* payload, size_t size,
+                                  bool marker, RtpPacketSink& sink,
+                                  const uint8_t* prefix, size_t prefixSize) {
+  packet_.resize(RTP_HEADER_SIZE + prefixSize + size);
+  uint8_t* p = packet_.data();
+  p[0] = 0x80;
+  p[1] = static_cast<uint8_t>((marker ? 0x80 : 0) | (dstPayloadType_ & 0x7F));
+  p[2] = static_cast<uint8_t>(sequenceNumber_ >> 8);
+  p[3] = static_cast<uint8_t>(sequenceNumber_);
+  p[4] = static_cast<uint8_t>(timestamp_ >> 24);
+  p[5] = static_cast<uint8_t>(timestamp_ >> 16);
+  p[6] = static_cast<uint8_t>(timestamp_ >> 8);
+  p[7] = static_cast<uint8_t>(timestamp_);
+  p[8] = static_cast<uint8_t>(ssrc_ >> 24);
+  p[9] = static_cast<uint8_t>(ssrc_ >> 16);
+  p[10] = static_cast<uint8_t>(ssrc_ >> 8);
+  p[11] = static_cast<uint8_t>(ssrc_);
+  if (prefixSize > 0) {
+    std::memcpy(p + RTP_HEADER_SIZE, prefix, prefixSize);
+  }
+  std::memcpy(p + RTP_HEADER_SIZE + prefixSize, payload, size);
+  sequenceNumber_++;
+  sink.onPacket(p, packet_.size());
+}
+
+}  // namespace nabto
@@ -4,73 +4,98 @@
 
 #include "rtp_repacketizer.hpp"
 
+#include <vector>
+
 namespace nabto {
 
 class H264Repacketizer;
 typedef std::shared_ptr<H264Repacketizer> H264RepacketizerPtr;
 
+/**
+ * Repacketizes an H264 RTP stream for a WebRTC viewer.
+ *
+ * In pass through mode packets already packetized as WebRTC expects, single
+ * NAL units, STAP-A and FU-A within the MTU, are forwarded with a new header
+ * and without any CSRCs, extension or padding. Oversized NAL units are fragmented to FU-A, and the
+ * interleaved mode STAP-B, MTAP and FU-B are unpacked to single NAL units
+ * and FU-A. If the camera embeds Annex B start codes in its NAL units, the
+ * NAL units are reassembled and split at the start codes.
+ *
+ * Without pass through, every packet is depacketized to frames and
+ * packetized again by libdatachannel.
+ *
+ * The input packet is never modified, so one packet can be passed to the
+ * repacketizers of several viewers.
+ */
 class H264Repacketizer : public RtpRepacketizer {
  public:
-  static RtpRepacketizerPtr create(
-      std::shared_ptr<rtc::RtpPacketizationConfig> rtpConf) {
-    return std::make_shared<H264Repacketizer>(rtpConf);
-  }
-
-  H264Repacketizer(std::shared_ptr<rtc::RtpPacketizationConfig> rtpConf)
-      : RtpRepacketizer(rtpConf->ssrc, rtpConf->payloadType),
-        rtpConf_(rtpConf) {
-    depacketizerMediaHandler_ = std::make_shared<rtc::MediaHandler>();
-    depacketizerMediaHandler_->addToChain(std::make_shared<rtc::H264RtpDepacketizer>(rtc::H264RtpDepacketizer()));
+  // Largest RTP payload sent, as the libdatachannel packetizer.
+  static constexpr size_t MAX_PAYLOAD_SIZE =
+      rtc::H264RtpPacketizer::DefaultMaxFragmentSize;
 
-    repacketizerMediaHandler_ = std::make_shared<rtc::MediaHandler>();
-
-    repacketizerMediaHandler_->addToChain(std::make_shared<rtc::H264RtpPacketizer>(rtc::H264RtpPacketizer(rtc::NalUnit::Separator::LongStartSequence, rtpConf)));
+  static RtpRepacketizerPtr create(
+      std::shared_ptr<rtc::RtpPacketizationConfig> rtpConf,
+      bool passThrough = true) {
+    return std::make_shared<H264Repacketizer>(rtpConf, passThrough);
   }
 
-  std::vector<std::vector<uint8_t>> handlePacket(std::vector<uint8_t> data) {
-    std::vector<std::vector<uint8_t>> ret;
-    if (data.size() < 2 || data.at(1) == 200) {
-      // ignore RTCP packets for now
-      return ret;
-    }
-
-    auto src = reinterpret_cast<const std::byte*>(data.data());
-    rtc::message_ptr msg =
-        std::make_shared<rtc::Message>(src, src + data.size());
+  H264Repacketizer(std::shared_ptr<rtc::RtpPacketizationConfig> rtpConf,
+                   bool passThrough = true);
 
-    rtc::message_vector vec;
-    vec.push_back(msg);
+  void handlePacket(uint8_t* data, size_t size, RtpPacketSink& sink) override;
 
-    depacketizerMediaHandler_->incomingChain(vec, nullptr);
-
-    repacketizerMediaHandler_->outgoingChain(vec, nullptr);
-    for (auto m : vec) {
-      uint8_t* src = (uint8_t*)m->data();
-      ret.push_back(std::vector<uint8_t>(src, src + m->size()));
-    }
-    return ret;
-  }
+  bool rewritesInPlace() const override { return false; }
 
  private:
+  void repacketize(uint8_t* data, size_t size, RtpPacketSink& sink);
+  void passThrough(const uint8_t* data, size_t size, RtpPacketSink& sink);
+  void handleFragment(bool marker, const uint8_t* payload,
+                      size_t payloadSize, bool fuB, RtpPacketSink& sink);
+  // Send one NAL unit as a single NAL unit packet or FU-A fragments.
+  void sendNal(const uint8_t* nal, size_t size, bool marker,
+               RtpPacketSink& sink);
+  void sendFragments(uint8_t indicator, uint8_t type, const uint8_t* payload,
+                     size_t size, bool start, bool end, bool marker,
+                     RtpPacketSink& sink);
+  // Send the NAL units of an Annex B byte stream.
+  void sendAnnexB(const uint8_t* data, size_t size, bool marker,
+                  RtpPacketSink& sink);
+  void sendPacket(const uint8_t* payload, size_t size, bool marker,
+                  RtpPacketSink& sink, const uint8_t* prefix = nullptr,
+                  size_t prefixSize = 0);
+
   std::shared_ptr<rtc::MediaHandler> depacketizerMediaHandler_;
   std::shared_ptr<rtc::MediaHandler> repacketizerMediaHandler_;
-  // rtc::H264RtpDepacketizer depacket_;
-  // std::shared_ptr<rtc::H264RtpPacketizer> packet_ = nullptr;
   std::shared_ptr<rtc::RtpPacketizationConfig> rtpConf_ = nullptr;
+
+  bool passThrough_;
+  uint16_t sequenceNumber_;
+  // Timestamp of the packet being handled.
+  uint32_t timestamp_ = 0;
+  uint16_t lastSequenceNumber_ = 0;
+  // Set once the camera has been seen to embed start codes in NAL units.
+  bool splitStartCodes_ = false;
+  // The FU-A fragments of the NAL unit being reassembled.
+  std::vector<uint8_t> nal_;
+  std::vector<uint8_t> packet_;
 };
 
 class H264RepacketizerFactory : public RtpRepacketizerFactory {
  public:
-  static RtpRepacketizerFactoryPtr create() {
-    return std::make_shared<H264RepacketizerFactory>();
+  static RtpRepacketizerFactoryPtr create(bool passThrough = true) {
+    return std::make_shared<H264RepacketizerFactory>(passThrough);
   }
-  H264RepacketizerFactory() {}
+  H264RepacketizerFactory(bool passThrough = true)
+      : passThrough_(passThrough) {}
   RtpRepacketizerPtr createPacketizer(std::shared_ptr<rtc::Track> track,
                                       uint32_t ssrc, int dstPayloadType) {
     auto rtpConf = std::make_shared<rtc::RtpPacketizationConfig>(
         ssrc, "", dstPayloadType, 90000);
-    return std::make_shared<H264Repacketizer>(rtpConf);
+    return std::make_shared<H264Repacketizer>(rtpConf, passThrough_);
   }
+
+ private:
+  bool passThrough_;
 };
 
 }  // namespace nabto
@@ -0,0 +1,40 @@
+#include "h264_start_code.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace nabto {
+
+const uint8_t* findH264StartCode(const uint8_t* begin, const uint8_t* end) {
+  const uint8_t* p = begin;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  // Each iteration tests the 16 positions p..p+15, reading up to p+17.
+  while (end - p >= 18) {
+    __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+    __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2));
+    __m128i match = _mm_and_si128(
+        _mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+        _mm_cmpeq_epi8(b2, one));
+    int mask = _mm_movemask_epi8(match);
+    if (mask != 0) {
+      return p + __builtin_ctz(static_cast<unsigned int>(mask));
+    }
+    p += 16;
+  }
+#endif
+  for (; end - p >= 3; p++) {
+    if (p[2] > 1) {
+      // No start code can begin at p, p+1 or p+2.
+      p += 2;
+    } else if (p[0] == 0 && p[1] == 0 && p[2] == 1) {
+      return p;
+    }
+  }
+  return end;
+}
+
+}  // namespace nabto
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nabto {
+
+/**
+ * Find the first H264 Annex B start code (00 00 01) in [begin, end).
+ *
+ * Uses SSE2 when available, 16 bytes per iteration. Emulation prevention
+ * guarantees the sequence never occurs inside a NAL unit, so this also finds
+ * start codes wrongly embedded in RTP payloads.
+ *
+ * @return pointer to the first 00 of the start code, or end if none.
+ */
+const uint8_t* findH264StartCode(const uint8_t* begin, const uint8_t* end);
+
+}  // namespace nabto
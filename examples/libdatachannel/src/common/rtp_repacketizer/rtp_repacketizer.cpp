@@ -7,13 +7,15 @@ namespace nabto {
 RtpRepacketizer::RtpRepacketizer(rtc::SSRC ssrc, int dstPayloadType)
     : ssrc_(ssrc), dstPayloadType_(dstPayloadType) {}
 
-std::vector<std::vector<uint8_t>> RtpRepacketizer::handlePacket(
-    std::vector<uint8_t> data) {
-  auto rtp = reinterpret_cast<rtc::RtpHeader*>(data.data());
+void RtpRepacketizer::handlePacket(uint8_t* data, size_t size,
+                                   RtpPacketSink& sink) {
+  if (size < sizeof(rtc::RtpHeader)) {
+    return;
+  }
+  auto rtp = reinterpret_cast<rtc::RtpHeader*>(data);
   rtp->setSsrc(ssrc_);
   rtp->setPayloadType(dstPayloadType_);
-  std::vector<std::vector<uint8_t>> ret = {data};
-  return ret;
+  sink.onPacket(data, size);
 }
 
 }  // namespace nabto
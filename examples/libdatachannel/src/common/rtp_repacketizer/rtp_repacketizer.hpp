@@ -13,11 +13,49 @@ typedef std::shared_ptr<RtpRepacketizer> RtpRepacketizerPtr;
 class RtpRepacketizerFactory;
 typedef std::shared_ptr<RtpRepacketizerFactory> RtpRepacketizerFactoryPtr;
 
+/**
+ * Receives the packets produced by an RtpRepacketizer.
+ */
+class RtpPacketSink {
+ public:
+  virtual ~RtpPacketSink() = default;
+  // The data is only valid during the call.
+  virtual void onPacket(const uint8_t* data, size_t size) = 0;
+};
+
+/**
+ * Sink calling a function or lambda, without allocating.
+ */
+template <typename F>
+class RtpPacketCallbackSink : public RtpPacketSink {
+ public:
+  explicit RtpPacketCallbackSink(F callback) : callback_(std::move(callback)) {}
+  void onPacket(const uint8_t* data, size_t size) override {
+    callback_(data, size);
+  }
+
+ private:
+  F callback_;
+};
+
 class RtpRepacketizer {
  public:
   RtpRepacketizer(uint32_t ssrc, int dstPayloadType);
-  virtual std::vector<std::vector<uint8_t>> handlePacket(
-      std::vector<uint8_t> data);
+  virtual ~RtpRepacketizer() = default;
+
+  /**
+   * Repacketize an RTP packet for the outgoing stream and emit the result to
+   * sink. The packet headers may be rewritten in place, see
+   * rewritesInPlace(). Emits nothing if the packet is dropped.
+   */
+  virtual void handlePacket(uint8_t* data, size_t size, RtpPacketSink& sink);
+
+  /**
+   * True if handlePacket() writes to the packet, in which case the caller
+   * must pass data no one else reads, eg. a private copy of a packet shared
+   * between viewers.
+   */
+  virtual bool rewritesInPlace() const { return true; }
 
  protected:
   uint32_t ssrc_;
@@ -66,7 +66,7 @@ void WebrtcConnection::handleMessage(
     nabto::webrtc::util::WebrtcSignalingMessage& msg) {
   mutex_.lock();
   try {
-    NPLOGI << "Webrtc got signaling message";
+    NPLOGD << "Webrtc got signaling message";
 
     if (msg.isDescription()) {
       auto desc = msg.getDescription();
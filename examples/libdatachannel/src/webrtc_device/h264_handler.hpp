@@ -47,7 +47,9 @@ class H264TrackHandler : public WebrtcTrackHandler,
 
   H264TrackHandler(std::shared_ptr<rtc::Track> track)
       : track_(track), ssrc_(SsrcGenerator::generateSsrc()) {
-    RtpClientConf conf = {"127.0.0.1", 6000};
+    RtpClientConf conf = {"127.0.0.1", 6000, true};
+    conf.answerNacks = true;
+    conf.adaptToViewers = true;
     rtp_ = RtpClient::create(conf);
     if (track_) {
       handleIncomingTrack();
@@ -75,10 +77,15 @@ class H264TrackHandler : public WebrtcTrackHandler,
     // packetization-mode=1
     // profile-level-id=42e01f
     // However, again to be technically correct, we remove the unsupported
-    // feedback extensions
+    // feedback extensions. NACKs are answered from the history of sent
+    // packets and REMB drives the frame dropping for slow viewers, but there
+    // is no one to forward keyframe requests to, so plain nack is listed
+    // without nack pli.
     auto r = media.rtpMap(payloadType_);
     r->removeFeedback("nack");
     r->removeFeedback("goog-remb");
+    r->addFeedback("goog-remb");
+    r->addFeedback("nack");
     return media;
   }
 
@@ -7,6 +7,7 @@
 #include <webrtc_connection/track_handler.hpp>
 
 #include "rtsp-client/rtsp_client.hpp"
+#include "rtsp-client/rtsp_session_registry.hpp"
 
 namespace nabto {
 namespace example {
@@ -40,14 +41,6 @@ class MidGenerator {
   }
 };
 
-class HandlerTrack {
- public:
-  std::shared_ptr<rtc::Track> videoTrack;
-  std::shared_ptr<rtc::Track> audioTrack;
-  RtspClientPtr rtp;
-  size_t ref;
-};
-
 class H264TrackHandler : public WebrtcTrackHandler,
                          public std::enable_shared_from_this<H264TrackHandler> {
  public:
@@ -58,49 +51,33 @@ class H264TrackHandler : public WebrtcTrackHandler,
   H264TrackHandler(std::string rtspUrl)
       : rtspUrl_(rtspUrl),
         ssrc_(SsrcGenerator::generateSsrc()),
-        audioSsrc_(SsrcGenerator::generateSsrc()) {
-    RtspClientConf conf = {rtspUrl, videoRepack_, nullptr,   96,
-                           111,     ssrc_,        audioSsrc_};
-    rtp_ = RtspClient::create(conf);
-  }
+        audioSsrc_(SsrcGenerator::generateSsrc()) {}
 
+  // All viewers share one RTSP session, so the camera only delivers the
+  // stream once.
   size_t addTrack(std::shared_ptr<rtc::PeerConnection> pc) {
-    counter_++;
-    RtspClientConf conf = {
-        rtspUrl_,   videoRepack_, nullptr,
-        96,         111,          ssrc_,
-        audioSsrc_, true,         (uint16_t)(42222 + (counter_ * 4))};
-    HandlerTrack track;
-
-    track.rtp = RtspClient::create(conf);
-    track.videoTrack = pc->addTrack(createVideoDescription());
-    track.audioTrack = pc->addTrack(createAudioDescription());
-    track.ref = track.rtp->addConnection(track.videoTrack, track.audioTrack);
-    return track.ref;
+    RtspClientConf conf = {rtspUrl_, videoRepack_, nullptr,   96,
+                           111,      ssrc_,        audioSsrc_};
+    conf.cacheVideoKeyframes = true;
+    conf.answerVideoNacks = true;
+    conf.adaptVideoToViewers = true;
+    auto videoTrack = pc->addTrack(createVideoDescription());
+    auto audioTrack = pc->addTrack(createAudioDescription());
+    return sessions_->addViewer(
+        rtspUrl_,
+        [conf](uint16_t port) {
+          RtspClientConf sessionConf = conf;
+          sessionConf.port = port;
+          return RtspClient::create(sessionConf);
+        },
+        videoTrack, audioTrack);
   }
 
-  void removeConnection(size_t ref) {
-    auto conn = connections_.find(ref);
-    if (conn == connections_.end()) {
-      return;
-    }
-    conn->second.rtp->removeConnection(ref);
-    connections_.erase(conn);
-  }
-
-  void close() {
-    videoTrack_ = nullptr;
-    rtp_ = nullptr;
-  }
+  void removeConnection(size_t ref) { sessions_->removeViewer(ref); }
 
  private:
   RtpRepacketizerFactoryPtr videoRepack_ = H264RepacketizerFactory::create();
-  std::shared_ptr<rtc::Track> videoTrack_;
-  std::shared_ptr<rtc::Track> audioTrack_;
-  RtspClientPtr rtp_;
-
-  std::map<size_t, HandlerTrack> connections_;
-  size_t counter_ = 0;
+  RtspSessionRegistryPtr sessions_ = RtspSessionRegistry::create();
 
   std::string rtspUrl_;
   uint32_t ssrc_;
@@ -124,10 +101,16 @@ class H264TrackHandler : public WebrtcTrackHandler,
     // packetization-mode=1
     // profile-level-id=42e01f
     // However, again to be technically correct, we remove the unsupported
-    // feedback extensions
+    // feedback extensions. NACKs are answered from the history of sent packets,
+    // keyframe requests are forwarded to the camera and REMB drives the frame
+    // dropping for slow viewers, so those are listed explicitly.
     auto r = media.rtpMap(payloadType_);
     r->removeFeedback("nack");
     r->removeFeedback("goog-remb");
+    r->addFeedback("goog-remb");
+    r->addFeedback("nack");
+    r->addFeedback("nack pli");
+    r->addFeedback("ccm fir");
     return media;
   }
 
@@ -1,12 +1,12 @@
-#include <plog/Appenders/ColorConsoleAppender.h>
-#include <plog/Formatters/TxtFormatter.h>
-
 #include <cxxopts.hpp>
 #include <fstream>
 #include <iostream>
+#include <libdatachannel_websocket/rtc_websocket_server_wrapper.hpp>
 #include <libdatachannel_websocket/rtc_websocket_wrapper.hpp>
 #include <nabto/webrtc/device.hpp>
-#include <nabto/webrtc/util/curl_async.hpp>
+#include <nabto/webrtc/util/async_log_appender.hpp>
+#include <nabto/webrtc/util/curl_multi_http_client.hpp>
+#include <nabto/webrtc/util/file_state_store.hpp>
 #include <nabto/webrtc/util/logging.hpp>
 #include <nabto/webrtc/util/message_transport.hpp>
 #include <nabto/webrtc/util/std_timer.hpp>
@@ -31,6 +31,8 @@ struct options {
   bool centralAuthorization;
   std::string rtspUrl;
   std::optional<std::string> caBundle;
+  std::optional<std::string> stateFile;
+  std::optional<uint16_t> localPort;
 };
 
 bool parse_options(int argc, char** argv, struct options& opts);
@@ -59,7 +61,9 @@ int main(int argc, char** argv) {
   // Register signal handler for Ctrl-C
   std::signal(SIGINT, signalHandler);
 
-  static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
+  // Formatting and writing log records happens on a background thread so it
+  // does not stall the RTP forwarding.
+  static nabto::webrtc::util::AsyncLogAppender consoleAppender;
   nabto::webrtc::util::initLogger(opts.logLevel, &consoleAppender);
 
   // init logging for Nabtonabto::webrtc::core
@@ -74,7 +78,7 @@ int main(int argc, char** argv) {
           opts.productId, opts.deviceId, opts.privateKey);
 
   nabto::webrtc::SignalingHttpClientPtr http =
-      nabto::webrtc::util::CurlHttpClient::create(opts.caBundle);
+      nabto::webrtc::util::CurlMultiHttpClient::create(opts.caBundle, true);
   nabto::webrtc::SignalingWebsocketPtr ws =
       nabto::example::RtcWebsocketWrapper::create(opts.caBundle);
   auto tf = nabto::webrtc::util::StdTimerFactory::create();
@@ -82,13 +86,25 @@ int main(int argc, char** argv) {
 
   nabto::webrtc::SignalingDeviceConfig conf = {
       opts.deviceId, opts.productId, jwtPtr, opts.signalingUrl, ws, http, tf};
+  if (opts.stateFile.has_value()) {
+    conf.stateStore =
+        nabto::webrtc::util::FileStateStore::create(opts.stateFile.value());
+  }
+  if (opts.localPort.has_value()) {
+    conf.localServer = nabto::example::RtcWebsocketServerWrapper::create(
+        opts.localPort.value());
+  }
 
   auto device = nabto::webrtc::SignalingDeviceFactory::create(conf);
   device->addNewChannelListener([device, trackHandler, &opts /*, &conns*/](
                                     nabto::webrtc::SignalingChannelPtr channel,
                                     bool authorized) {
     // Handle authorization
-    if (opts.centralAuthorization) {
+    // Local viewers cannot be authorized centrally, they are accepted if they
+    // sign their messages with the shared secret.
+    const bool localWithSecret =
+        channel->isLocal() && !opts.sharedSecret.empty();
+    if (opts.centralAuthorization && !localWithSecret) {
       if (!authorized) {
         NPLOGE << "Rejecting connection as central authorization is required";
         auto authorizationErrorMessage =
@@ -162,7 +178,15 @@ bool parse_options(int argc, char** argv, struct options& opts) {
         "ca-bundle",
         "Optional. Path to a CA certificate file; overrides CURL_CA_BUNDLE "
         "env var if set.",
-        cxxopts::value<std::string>())("h,help", "Shows this help text")(
+        cxxopts::value<std::string>())(
+        "state-file",
+        "Optional. File to keep signaling state in, so the device reconnects "
+        "faster after a restart.",
+        cxxopts::value<std::string>())(
+        "local-port",
+        "Optional. Port to accept signaling from viewers on the local network "
+        "on. Local viewers must use the shared secret.",
+        cxxopts::value<uint16_t>())("h,help", "Shows this help text")(
         "v,version", "Shows the Nabto WebRTC SDK version");
     auto result = options.parse(argc, argv);
 
@@ -248,6 +272,14 @@ bool parse_options(int argc, char** argv, struct options& opts) {
       }
     }
 
+    if (result.count("state-file")) {
+      opts.stateFile = result["state-file"].as<std::string>();
+    }
+
+    if (result.count("local-port")) {
+      opts.localPort = result["local-port"].as<uint16_t>();
+    }
+
   } catch (const cxxopts::exceptions::exception& e) {
     std::cout << "Error parsing options: " << e.what() << std::endl;
     return false;
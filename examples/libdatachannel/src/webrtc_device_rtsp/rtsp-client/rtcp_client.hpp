@@ -4,6 +4,7 @@
 
 #include <nabto/webrtc/util/logging.hpp>
 #include <rtc/rtc.hpp>
+#include <rtp_client/rtp_reception_stats.hpp>
 typedef int SOCKET;
 
 #include <arpa/inet.h>
@@ -13,6 +14,7 @@ typedef int SOCKET;
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 
@@ -30,11 +32,15 @@ class RtcpClient : public std::enable_shared_from_this<RtcpClient> {
     RECEIVER_REPORT,
   };
 
-  static RtcpClientPtr create(uint16_t port) {
-    return std::make_shared<RtcpClient>(port);
+  // stats are the reception statistics of the RTP stream the sender reports
+  // are for, which the receiver reports are filled in from.
+  static RtcpClientPtr create(uint16_t port,
+                              nabto::example::RtpReceptionStatsPtr stats) {
+    return std::make_shared<RtcpClient>(port, stats);
   }
 
-  RtcpClient(uint16_t port) : port_(port) {}
+  RtcpClient(uint16_t port, nabto::example::RtpReceptionStatsPtr stats)
+      : port_(port), stats_(stats) {}
 
   ~RtcpClient() {}
 
@@ -62,15 +68,40 @@ class RtcpClient : public std::enable_shared_from_this<RtcpClient> {
 
   void stop() {
     NPLOGD << "RtcpClient stopped";
-    stopped_ = true;
-    if (rtcpSock_ != 0) {
-      shutdown(rtcpSock_, SHUT_RDWR);
-      close(rtcpSock_);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopped_ = true;
+      if (rtcpSock_ != 0) {
+        shutdown(rtcpSock_, SHUT_RDWR);
+        close(rtcpSock_);
+      }
     }
     rtcpThread_.join();
     NPLOGD << "RtcpClient thread joined";
   }
 
+  /**
+   * Send a PLI asking the source for a keyframe. Dropped until a sender report
+   * has told us where the source is.
+   */
+  void sendPli() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+      return;
+    }
+    if (!haveSource_) {
+      NPLOGD << "No RTCP sender report yet, dropping PLI";
+      return;
+    }
+    char buffer[16];
+    memset(buffer, 0, sizeof(buffer));
+    auto pli = reinterpret_cast<rtc::RtcpPli*>(buffer);
+    pli->preparePacket(sourceSsrc_);
+    pli->header.setPacketSenderSSRC(1);
+    sendto(rtcpSock_, pli, rtc::RtcpPli::Size(), 0,
+           (struct sockaddr*)&sourceAddr_, sizeof(sourceAddr_));
+  }
+
  private:
   static void rtcpRunner(RtcpClient* self) {
     char buffer[RTP_BUFFER_SIZE];
@@ -98,8 +129,20 @@ class RtcpClient : public std::enable_shared_from_this<RtcpClient> {
         continue;
       }
       auto sr = reinterpret_cast<rtc::RtcpSr*>(buffer);
+      if (sr->header.payloadType() != SENDER_REPORT) {
+        continue;
+      }
+      auto now = nabto::example::RtpReceptionStats::Clock::now();
+      {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        self->haveSource_ = true;
+        self->sourceAddr_ = srcAddr;
+        self->sourceSsrc_ = sr->senderSSRC();
+      }
+      self->stats_->handleSenderReport(sr->senderSSRC(), sr->ntpTimestamp(),
+                                       now);
       rtc::RtcpReportBlock* rb = rr->getReportBlock(0);
-      rb->preparePacket(sr->senderSSRC(), 0, 0, 0, 0, 0, sr->ntpTimestamp(), 0);
+      self->stats_->prepareReportBlock(sr->senderSSRC(), rb, now);
       rr->preparePacket(1, 1);
 
       auto ret = sendto(self->rtcpSock_, rr, rr->header.lengthInBytes(), 0,
@@ -113,6 +156,14 @@ class RtcpClient : public std::enable_shared_from_this<RtcpClient> {
   std::string remoteHost_ = "127.0.0.1";
   SOCKET rtcpSock_ = 0;
   std::thread rtcpThread_;
+  nabto::example::RtpReceptionStatsPtr stats_;
+
+  // Protects the socket while stopping and where the sender reports come
+  // from, for PLIs.
+  std::mutex mutex_;
+  bool haveSource_ = false;
+  struct sockaddr_in sourceAddr_ = {};
+  uint32_t sourceSsrc_ = 0;
 };
 
 }  // namespace nabto
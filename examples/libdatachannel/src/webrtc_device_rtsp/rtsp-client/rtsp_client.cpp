@@ -173,6 +173,9 @@ RtspClient::RtspClient(const RtspClientConf& conf) {
 
   preferTcp_ = conf.preferTcp;
   port_ = conf.port;
+  cacheVideoKeyframes_ = conf.cacheVideoKeyframes;
+  answerVideoNacks_ = conf.answerVideoNacks;
+  adaptVideoToViewers_ = conf.adaptVideoToViewers;
 
   if (conf.videoRepack != nullptr) {
     videoRepack_ = conf.videoRepack;
@@ -196,6 +199,10 @@ RtspClient::~RtspClient() {
 
 void RtspClient::stop() {
   started_ = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    playing_ = false;
+  }
   if (videoRtcp_ != nullptr) {
     videoRtcp_->stop();
   }
@@ -205,7 +212,9 @@ void RtspClient::stop() {
   if (tcpClient_ != nullptr) {
     tcpClient_->stop();
   }
-  curl_->stop();
+  if (curl_ != nullptr) {
+    curl_->stop();
+  }
   // teardown();
 }
 
@@ -215,62 +224,100 @@ size_t RtspClient::addConnection(std::shared_ptr<rtc::Track> videoTrack,
                                  std::shared_ptr<rtc::Track> audioTrack) {
   NPLOGD << "RTSP client addConnection";
   RtspConnection rtsp;
-  rtsp.index = counter_;
   rtsp.videoTrack = videoTrack;
   rtsp.audioTrack = audioTrack;
 
-  counter_++;
-
-  if (started_) {
-    if (tcpClient_ != nullptr) {
-      tcpClient_->setConnection(rtsp.videoTrack, rtsp.audioTrack);
-    }
-    if (videoStream_ != nullptr && videoTrack != nullptr) {
-      rtsp.videoRef = videoStream_->addConnection(videoTrack, videoSsrc_,
-                                                  videoPayloadType_);
-    }
-    if (audioStream_ != nullptr && audioTrack != nullptr) {
-      rtsp.audioRef = audioStream_->addConnection(audioTrack, audioSsrc_,
-                                                  audioPayloadType_);
+  bool needStart = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rtsp.index = counter_;
+    counter_++;
+    if (playing_) {
+      attachConnection(rtsp);
+    } else if (!started_) {
+      // Claim the start so concurrent connections do not start it twice.
+      started_ = true;
+      needStart = true;
     }
-  } else {
+    connections_.push_back(rtsp);
+  }
+
+  if (needStart) {
     auto self = shared_from_this();
-    start([self, &rtsp, videoTrack,
-           audioTrack](std::optional<std::string> error) {
+    bool ok = start([self](std::optional<std::string> error) {
       if (error.has_value()) {
+        // The connections stay pending, the next connection added retries.
         NPLOGE << "Failed to start RTSP client with error: " << error.value();
         return;
       }
-      if (self->tcpClient_ != nullptr) {
-        self->tcpClient_->setConnection(videoTrack, audioTrack);
-      }
-      if (self->videoStream_ != nullptr && rtsp.videoTrack != nullptr) {
-        rtsp.videoRef = self->videoStream_->addConnection(
-            rtsp.videoTrack, self->videoSsrc_, self->videoPayloadType_);
-      }
-      if (self->audioStream_ != nullptr && rtsp.audioTrack != nullptr) {
-        rtsp.audioRef = self->audioStream_->addConnection(
-            rtsp.audioTrack, self->audioSsrc_, self->audioPayloadType_);
+      std::lock_guard<std::mutex> lock(self->mutex_);
+      self->playing_ = true;
+      for (auto& c : self->connections_) {
+        self->attachConnection(c);
       }
     });
+    if (!ok) {
+      started_ = false;
+    }
   }
-  connections_.push_back(rtsp);
   return rtsp.index;
 }
 
+void RtspClient::attachConnection(RtspConnection& rtsp) {
+  if (rtsp.attached) {
+    return;
+  }
+  if (tcpClient_ != nullptr) {
+    rtsp.tcpRef = tcpClient_->addConnection(rtsp.videoTrack, rtsp.audioTrack);
+  }
+  if (videoStream_ != nullptr && rtsp.videoTrack != nullptr) {
+    rtsp.videoRef = videoStream_->addConnection(rtsp.videoTrack, videoSsrc_,
+                                                videoPayloadType_);
+  }
+  if (audioStream_ != nullptr && rtsp.audioTrack != nullptr) {
+    rtsp.audioRef = audioStream_->addConnection(rtsp.audioTrack, audioSsrc_,
+                                                audioPayloadType_);
+  }
+  rtsp.attached = true;
+}
+
 void RtspClient::removeConnection(size_t ref) {
-  for (auto rtsp : connections_) {
-    if (rtsp.index == ref) {
-      if (videoStream_ != nullptr) {
-        videoStream_->removeConnection(rtsp.videoRef);
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = connections_.begin(); it != connections_.end(); ++it) {
+    if (it->index != ref) {
+      continue;
+    }
+    if (it->attached) {
+      if (tcpClient_ != nullptr) {
+        tcpClient_->removeConnection(it->tcpRef);
+      }
+      if (videoStream_ != nullptr && it->videoTrack != nullptr) {
+        videoStream_->removeConnection(it->videoRef);
       }
-      if (audioStream_ != nullptr) {
-        audioStream_->removeConnection(rtsp.audioRef);
+      if (audioStream_ != nullptr && it->audioTrack != nullptr) {
+        audioStream_->removeConnection(it->audioRef);
       }
     }
+    connections_.erase(it);
+    return;
   }
 }
 
+size_t RtspClient::connectionCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return connections_.size();
+}
+
+std::vector<nabto::example::RtpReceptionMetrics>
+RtspClient::videoReceptionMetrics() {
+  return videoStats_->metrics();
+}
+
+std::vector<nabto::example::RtpReceptionMetrics>
+RtspClient::audioReceptionMetrics() {
+  return audioStats_->metrics();
+}
+
 bool RtspClient::start(
     std::function<void(std::optional<std::string> error)> cb) {
   curl_ = nabto::webrtc::util::CurlAsync::create();
@@ -364,15 +411,27 @@ void RtspClient::setupRtsp() {
         TcpRtpClientConf conf = {
             curl_,        sessionControlUrl_, videoRepack_,
             audioRepack_, videoPayloadType_,  audioPayloadType_,
-            videoSsrc_,   audioSsrc_};
+            videoSsrc_,   audioSsrc_,         cacheVideoKeyframes_,
+            videoStats_,  audioStats_,        answerVideoNacks_};
+        conf.adaptVideoToViewers = adaptVideoToViewers_;
         tcpClient_ = TcpRtpClient::create(conf);
       }
     } else {
-      nabto::example::RtpClientConf conf = {std::string(), port_};
-      videoStream_ = nabto::example::RtpClient::create(conf);
-
-      videoRtcp_ = RtcpClient::create(port_ + 1);
+      videoRtcp_ = RtcpClient::create(port_ + 1, videoStats_);
       videoRtcp_->start();
+
+      nabto::example::RtpClientConf conf = {std::string(), port_,
+                                            cacheVideoKeyframes_};
+      conf.receptionStats = videoStats_;
+      conf.answerNacks = answerVideoNacks_;
+      conf.adaptToViewers = adaptVideoToViewers_;
+      std::weak_ptr<RtcpClient> rtcp = videoRtcp_;
+      conf.requestKeyframe = [rtcp]() {
+        if (auto r = rtcp.lock()) {
+          r->sendPli();
+        }
+      };
+      videoStream_ = nabto::example::RtpClient::create(conf);
     }
   }
   if (!audioControlUrl_.empty()) {
@@ -393,15 +452,18 @@ void RtspClient::setupRtsp() {
         TcpRtpClientConf conf = {
             curl_,        sessionControlUrl_, videoRepack_,
             audioRepack_, videoPayloadType_,  audioPayloadType_,
-            videoSsrc_,   audioSsrc_};
+            videoSsrc_,   audioSsrc_,         cacheVideoKeyframes_,
+            videoStats_,  audioStats_,        answerVideoNacks_};
+        conf.adaptVideoToViewers = adaptVideoToViewers_;
         tcpClient_ = TcpRtpClient::create(conf);
       }
     } else {
       nabto::example::RtpClientConf conf = {std::string(),
                                             (uint16_t)(port_ + 2)};
+      conf.receptionStats = audioStats_;
       audioStream_ = nabto::example::RtpClient::create(conf);
 
-      audioRtcp_ = RtcpClient::create(port_ + 3);
+      audioRtcp_ = RtcpClient::create(port_ + 3, audioStats_);
       audioRtcp_->start();
     }
   }
@@ -527,6 +589,7 @@ bool RtspClient::parseSdpDescription(const std::string& sdp) {
         } else {
           videoPayloadType_ = videoPayloadType_;
         }
+        videoStats_->setClockRate(clockRate(*m, videoPayloadType_, 90000));
         // TODO: make track validation
         // auto mediaMock = MockMediaTrack::create(*m);
         // if (videoNegotiator_->match(mediaMock) == 0) {
@@ -540,6 +603,7 @@ bool RtspClient::parseSdpDescription(const std::string& sdp) {
         } else {
           audioPayloadType_ = audioPayloadType_;
         }
+        audioStats_->setClockRate(clockRate(*m, audioPayloadType_, 8000));
         // auto mediaMock = MockMediaTrack::create(*m);
         // if (audioNegotiator_->match(mediaMock) == 0) {
         //     NPLOGE << "RTSP server offered invalid audio codec. The audio
@@ -555,6 +619,15 @@ bool RtspClient::parseSdpDescription(const std::string& sdp) {
   return true;
 }
 
+uint32_t RtspClient::clockRate(rtc::Description::Media& media,
+                               int payloadType, uint32_t fallback) {
+  if (!media.hasPayloadType(payloadType)) {
+    return fallback;
+  }
+  int rate = media.rtpMap(payloadType)->clockRate;
+  return rate > 0 ? rate : fallback;
+}
+
 std::string RtspClient::parseControlAttribute(const std::string& att) {
   auto url = att.substr(strlen("control:"));
   if (url.empty() || url[0] == '*') {
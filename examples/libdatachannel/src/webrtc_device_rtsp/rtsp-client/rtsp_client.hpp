@@ -6,13 +6,17 @@
 #include <nabto/webrtc/util/curl_async.hpp>
 #include <rtc/rtc.hpp>
 #include <rtp_client/rtp_client.hpp>
+#include <rtp_client/rtp_reception_stats.hpp>
 #include <rtp_repacketizer/rtp_repacketizer.hpp>
 
 #include "rtcp_client.hpp"
+#include "rtsp_session.hpp"
 #include "tcp_rtp_client.hpp"
 typedef int SOCKET;
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <thread>
 
 namespace nabto {
@@ -28,8 +32,12 @@ class RtspConnection {
   size_t index;
   std::shared_ptr<rtc::Track> videoTrack;
   std::shared_ptr<rtc::Track> audioTrack;
-  size_t videoRef;
-  size_t audioRef;
+  size_t videoRef = 0;
+  size_t audioRef = 0;
+  size_t tcpRef = 0;
+  // Whether the tracks have been added to the RTP streams. Connections added
+  // before PLAY completes are attached once it does.
+  bool attached = false;
 };
 
 class RtspClientConf {
@@ -51,21 +59,41 @@ class RtspClientConf {
   //   port+3: Port for Audio RTCP if exists
   // if unset port defaults to 42222 meaning 42222-42225 is used.
   uint16_t port = 42222;
+  // Replay the latest video keyframe to viewers joining a running session, so
+  // they do not wait for the next keyframe. Only set this for H264 video.
+  bool cacheVideoKeyframes = false;
+  // Answer NACKs from the viewers with retransmissions of recently sent video
+  // packets. Advertise nack feedback on the video tracks if set.
+  bool answerVideoNacks = false;
+  // Drop video frames for viewers which cannot keep up. Only set this for
+  // H264 video, and advertise goog-remb feedback on the video tracks.
+  bool adaptVideoToViewers = false;
 };
 
-class RtspClient : public std::enable_shared_from_this<RtspClient> {
+class RtspClient : public RtspSession,
+                   public std::enable_shared_from_this<RtspClient> {
  public:
   static RtspClientPtr create(const RtspClientConf& conf);
   RtspClient(const RtspClientConf& conf);
-  ~RtspClient();
+  ~RtspClient() override;
 
   bool start(std::function<void(std::optional<std::string> error)> cb);
   bool close(std::function<void()> cb);
-  void stop();
+  void stop() override;
 
+  // Forward the RTSP streams to these tracks, starting the RTSP session if it
+  // is not running. Any number of connections can share the session. Returns
+  // a reference for removeConnection().
   size_t addConnection(std::shared_ptr<rtc::Track> videoTrack,
-                       std::shared_ptr<rtc::Track> audioTrack);
-  void removeConnection(size_t ref);
+                       std::shared_ptr<rtc::Track> audioTrack) override;
+  void removeConnection(size_t ref) override;
+  size_t connectionCount() override;
+
+  // Reception statistics of the streams from the RTSP server, one entry per
+  // RTP source. These are also reported to the server in RTCP receiver
+  // reports.
+  std::vector<nabto::example::RtpReceptionMetrics> videoReceptionMetrics();
+  std::vector<nabto::example::RtpReceptionMetrics> audioReceptionMetrics();
 
  private:
   void setupRtsp();
@@ -78,17 +106,27 @@ class RtspClient : public std::enable_shared_from_this<RtspClient> {
                                              const std::string& transport);
   bool parseSdpDescription(const std::string& desc);
   std::string parseControlAttribute(const std::string& att);
+  // RTP clock rate of the payload type from its rtpmap, if it has one.
+  static uint32_t clockRate(rtc::Description::Media& media, int payloadType,
+                            uint32_t fallback);
 
   static size_t writeFunc(void* ptr, size_t size, size_t nmemb, void* self);
 
   void resolveStart(std::optional<std::string> error = std::nullopt);
+  void attachConnection(RtspConnection& rtsp);
 
   bool setDigestHeader(std::string method, std::string url);
 
   std::string url_;
   uint16_t port_ = 42222;
-  bool started_ = false;
+  std::atomic<bool> started_{false};
+  // Protects connections_ and whether the streams are playing.
+  std::mutex mutex_;
+  bool playing_ = false;
   bool preferTcp_ = true;
+  bool cacheVideoKeyframes_ = false;
+  bool answerVideoNacks_ = false;
+  bool adaptVideoToViewers_ = false;
 
   std::function<void(std::optional<std::string> error)> startCb_;
 
@@ -120,6 +158,8 @@ class RtspClient : public std::enable_shared_from_this<RtspClient> {
   uint32_t videoSsrc_;
   RtcpClientPtr videoRtcp_ = nullptr;
   RtpRepacketizerFactoryPtr videoRepack_ = RtpRepacketizerFactory::create();
+  nabto::example::RtpReceptionStatsPtr videoStats_ =
+      nabto::example::RtpReceptionStats::create(90000);
 
   nabto::example::RtpClientPtr audioStream_ = nullptr;
   std::string audioControlUrl_;
@@ -127,6 +167,10 @@ class RtspClient : public std::enable_shared_from_this<RtspClient> {
   uint32_t audioSsrc_;
   RtcpClientPtr audioRtcp_ = nullptr;
   RtpRepacketizerFactoryPtr audioRepack_ = RtpRepacketizerFactory::create();
+  // Until the SDP says otherwise, as the static audio payload types are
+  // mostly 8 kHz.
+  nabto::example::RtpReceptionStatsPtr audioStats_ =
+      nabto::example::RtpReceptionStats::create(8000);
 };
 
 }  // namespace nabto
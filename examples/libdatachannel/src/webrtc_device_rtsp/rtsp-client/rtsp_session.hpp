@@ -0,0 +1,33 @@
+#pragma once
+
+#include <rtc/rtc.hpp>
+
+#include <cstddef>
+#include <memory>
+
+namespace nabto {
+
+class RtspSession;
+typedef std::shared_ptr<RtspSession> RtspSessionPtr;
+
+/**
+ * An upstream RTSP session which any number of viewers can share, see
+ * RtspSessionRegistry. Implemented by RtspClient.
+ */
+class RtspSession {
+ public:
+  virtual ~RtspSession() = default;
+
+  // Forward the streams to these tracks, starting the session if it is not
+  // running. Returns a reference for removeConnection().
+  virtual size_t addConnection(std::shared_ptr<rtc::Track> videoTrack,
+                               std::shared_ptr<rtc::Track> audioTrack) = 0;
+  virtual void removeConnection(size_t ref) = 0;
+  virtual size_t connectionCount() = 0;
+
+  // Stop the session and release its ports. May block until the session
+  // threads are joined.
+  virtual void stop() = 0;
+};
+
+}  // namespace nabto
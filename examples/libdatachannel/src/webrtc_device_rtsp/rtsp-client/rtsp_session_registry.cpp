@@ -0,0 +1,84 @@
+#include "rtsp_session_registry.hpp"
+
+#include <nabto/webrtc/util/logging.hpp>
+
+#include <set>
+
+namespace nabto {
+
+size_t RtspSessionRegistry::addViewer(const std::string& url,
+                                      const SessionFactory& createSession,
+                                      std::shared_ptr<rtc::Track> videoTrack,
+                                      std::shared_ptr<rtc::Track> audioTrack) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = sessions_.find(url);
+  if (it == sessions_.end()) {
+    Session session;
+    session.port = allocatePort();
+    session.session = createSession(session.port);
+    NPLOGI << "Starting RTSP session on port " << session.port;
+    it = sessions_.emplace(url, session).first;
+  }
+
+  size_t ref = counter_++;
+  viewers_[ref] = {url,
+                   it->second.session->addConnection(videoTrack, audioTrack)};
+  NPLOGD << "RTSP session has " << it->second.session->connectionCount()
+         << " viewers";
+  return ref;
+}
+
+void RtspSessionRegistry::removeViewer(size_t ref) {
+  RtspSessionPtr stopped;
+  uint16_t port = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto viewer = viewers_.find(ref);
+    if (viewer == viewers_.end()) {
+      return;
+    }
+    auto session = sessions_.find(viewer->second.url);
+    if (session != sessions_.end()) {
+      auto rtsp = session->second.session;
+      rtsp->removeConnection(viewer->second.connectionRef);
+      if (rtsp->connectionCount() == 0) {
+        NPLOGI << "Last viewer left, stopping RTSP session on port "
+               << session->second.port;
+        // The ports stay reserved until the session has released them, so
+        // a new session does not try to bind them meanwhile.
+        stopped = rtsp;
+        port = session->second.port;
+        stopping_.insert(port);
+        sessions_.erase(session);
+      }
+    }
+    viewers_.erase(viewer);
+  }
+  if (stopped == nullptr) {
+    return;
+  }
+  // Stopping joins the session threads, which must not wait for viewers
+  // being added or removed on other sessions.
+  stopped->stop();
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_.erase(port);
+}
+
+size_t RtspSessionRegistry::sessionCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sessions_.size();
+}
+
+uint16_t RtspSessionRegistry::allocatePort() {
+  std::set<uint16_t> used = stopping_;
+  for (const auto& s : sessions_) {
+    used.insert(s.second.port);
+  }
+  uint16_t port = basePort_;
+  while (used.count(port) != 0) {
+    port += 4;
+  }
+  return port;
+}
+
+}  // namespace nabto
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <rtc/rtc.hpp>
+
+#include "rtsp_session.hpp"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace nabto {
+
+class RtspSessionRegistry;
+typedef std::shared_ptr<RtspSessionRegistry> RtspSessionRegistryPtr;
+
+/**
+ * Shares one upstream RTSP session per RTSP URL between all viewers.
+ *
+ * The first viewer of a URL starts the RTSP session. Later viewers are added
+ * to the running session, which fans out every received RTP packet to all
+ * attached tracks. The session is stopped when its last viewer is removed.
+ */
+class RtspSessionRegistry {
+ public:
+  // Creates the session for a URL, receiving RTP on the given ports.
+  typedef std::function<RtspSessionPtr(uint16_t port)> SessionFactory;
+
+  static RtspSessionRegistryPtr create(uint16_t basePort = 42222) {
+    return std::make_shared<RtspSessionRegistry>(basePort);
+  }
+
+  // Each session uses 4 UDP ports from basePort and up, see RtspClientConf.
+  RtspSessionRegistry(uint16_t basePort) : basePort_(basePort) {}
+
+  /**
+   * Add a viewer to the session for url, creating the session with
+   * createSession if none exists. The registry gives each session its own
+   * ports.
+   *
+   * @return reference to pass to removeViewer().
+   */
+  size_t addViewer(const std::string& url, const SessionFactory& createSession,
+                   std::shared_ptr<rtc::Track> videoTrack,
+                   std::shared_ptr<rtc::Track> audioTrack);
+
+  /**
+   * Remove a viewer. Stops the session if this was its last viewer.
+   */
+  void removeViewer(size_t ref);
+
+  size_t sessionCount();
+
+ private:
+  struct Session {
+    RtspSessionPtr session;
+    uint16_t port;
+  };
+
+  struct Viewer {
+    std::string url;
+    size_t connectionRef;
+  };
+
+  uint16_t allocatePort();
+
+  std::mutex mutex_;
+  uint16_t basePort_;
+  std::map<std::string, Session> sessions_;
+  std::map<size_t, Viewer> viewers_;
+  // Ports of sessions being stopped, not yet released.
+  std::set<uint16_t> stopping_;
+  size_t counter_ = 0;
+};
+
+}  // namespace nabto
@@ -1,12 +1,23 @@
 #include "tcp_rtp_client.hpp"
 
+#include <arpa/inet.h>
 #include <curl/curl.h>
 
 #include <nabto/webrtc/util/logging.hpp>
 #include <rtc/rtc.hpp>
 
+#include <algorithm>
+
 namespace nabto {
 
+namespace {
+
+const uint8_t RTCP_SENDER_REPORT = 200;
+// Header, sender SSRC and sender info.
+const size_t RTCP_SENDER_REPORT_MIN_SIZE = 28;
+
+}  // namespace
+
 TcpRtpClientPtr TcpRtpClient::create(const TcpRtpClientConf& conf) {
   // THIS IS CALLED FROM THE CURL WORKER THREAD!
   return std::make_shared<TcpRtpClient>(conf);
@@ -27,33 +38,99 @@ TcpRtpClient::TcpRtpClient(const TcpRtpClientConf& conf) {
   videoSsrc_ = conf.videoSsrc;
   audioSrcPt_ = conf.audioPayloadType;
   audioSsrc_ = conf.audioSsrc;
+  if (conf.cacheVideoKeyframes) {
+    videoCache_ = std::make_unique<nabto::example::H264KeyframeCache>();
+  }
+  videoStats_ = conf.videoStats;
+  audioStats_ = conf.audioStats;
+  answerVideoNacks_ = conf.answerVideoNacks;
+  adaptVideoToViewers_ = conf.adaptVideoToViewers;
+  keyframeRequests_ = nabto::example::KeyframeRequestAggregator::create(
+      [this]() { preparePli(); });
 }
 
 TcpRtpClient::~TcpRtpClient() {}
 
-void TcpRtpClient::setConnection(std::shared_ptr<rtc::Track> videoTrack,
-                                 std::shared_ptr<rtc::Track> audioTrack) {
-  NPLOGD << "TcpRtpClient setConnection";
+size_t TcpRtpClient::addConnection(std::shared_ptr<rtc::Track> videoTrack,
+                                   std::shared_ptr<rtc::Track> audioTrack) {
+  NPLOGD << "TcpRtpClient addConnection";
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t ref = counter_++;
   if (videoTrack != nullptr) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    videoTrack_ = std::move(videoTrack);
-    rtc::Description::Media desc = videoTrack_->description();
-    auto pts = desc.payloadTypes();
-    int pt = pts.empty() ? 0 : pts[0];
-    videoRepacketizer_ =
-        videoRepack_->createPacketizer(videoTrack_, videoSsrc_, pt);
-    videoDstPt_ = pt;
+    std::weak_ptr<TcpRtpClient> weak = weak_from_this();
+    videoTrack->onMessage([weak, ref](rtc::message_variant data) {
+      auto self = weak.lock();
+      if (self) {
+        self->handleVideoFeedback(ref, rtc::make_message(data));
+      }
+    });
+    videoTracks_.push_back(
+        createTrack(ref, std::move(videoTrack), videoRepack_, videoSsrc_));
+    if (answerVideoNacks_) {
+      videoTracks_.back().history =
+          std::make_shared<nabto::example::RtpHistory>();
+    }
+    if (adaptVideoToViewers_) {
+      videoTracks_.back().dropper =
+          std::make_shared<nabto::example::FrameDropper>();
+    }
   }
   if (audioTrack != nullptr) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    audioTrack_ = std::move(audioTrack);
-    rtc::Description::Media desc = audioTrack_->description();
-    auto pts = desc.payloadTypes();
-    int pt = pts.empty() ? 0 : pts[0];
-    audioRepacketizer_ =
-        audioRepack_->createPacketizer(audioTrack_, audioSsrc_, pt);
-    audioDstPt_ = pt;
+    audioTracks_.push_back(
+        createTrack(ref, std::move(audioTrack), audioRepack_, audioSsrc_));
   }
+  return ref;
+}
+
+void TcpRtpClient::removeConnection(size_t ref) {
+  NPLOGD << "TcpRtpClient removeConnection";
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto matches = [ref](const TcpRtpTrack& t) { return t.ref == ref; };
+  for (const auto& t : videoTracks_) {
+    if (matches(t) && t.history) {
+      const auto& counters = t.history->counters();
+      NPLOGD << "    NACKs: " << counters.nacks
+             << " packets requested: " << counters.requested
+             << " retransmitted: " << counters.retransmitted;
+    }
+    if (matches(t) && t.dropper) {
+      const auto& counters = t.dropper->counters();
+      NPLOGD << "    Frames dropped: " << counters.framesDropped
+             << " packets dropped: " << counters.packetsDropped
+             << " congestion events: " << counters.escalations
+             << " keyframes requested: " << counters.keyframeRequests;
+    }
+  }
+  videoTracks_.erase(
+      std::remove_if(videoTracks_.begin(), videoTracks_.end(), matches),
+      videoTracks_.end());
+  audioTracks_.erase(
+      std::remove_if(audioTracks_.begin(), audioTracks_.end(), matches),
+      audioTracks_.end());
+}
+
+nabto::example::RtpHistoryCounters TcpRtpClient::nackCounters() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  nabto::example::RtpHistoryCounters sum;
+  for (const auto& t : videoTracks_) {
+    if (t.history) {
+      sum.nacks += t.history->counters().nacks;
+      sum.requested += t.history->counters().requested;
+      sum.retransmitted += t.history->counters().retransmitted;
+    }
+  }
+  return sum;
+}
+
+TcpRtpTrack TcpRtpClient::createTrack(size_t ref,
+                                      std::shared_ptr<rtc::Track> track,
+                                      RtpRepacketizerFactoryPtr repack,
+                                      uint32_t ssrc) {
+  rtc::Description::Media desc = track->description();
+  auto pts = desc.payloadTypes();
+  int pt = pts.empty() ? 0 : pts[0];
+  auto repacketizer = repack->createPacketizer(track, ssrc, pt);
+  return {ref, std::move(track), std::move(repacketizer)};
 }
 
 void TcpRtpClient::run() {
@@ -94,28 +171,41 @@ void TcpRtpClient::run() {
     }
 
     std::lock_guard<std::mutex> lock(mutex_);
+    bool failed = false;
     if (sendRtcp_) {
       sendRtcp_ = false;
-      CURLcode res = CURLE_OK;
-      curl_socket_t sockfd;
-      res = curl_easy_getinfo(curl, CURLINFO_ACTIVESOCKET, &sockfd);
-      if (!res && sockfd != CURL_SOCKET_BAD) {
-        uint16_t len = *(uint16_t*)(rtcpWriteBuf_ + 2) + 4;
-        // NPLOGD << "Sending RR on channel: " << (int)rtcpWriteBuf_[1];
-        auto ret = write(sockfd, rtcpWriteBuf_, len);
-        if (ret < len) {
-          NPLOGE << "Failed to write RTCP RR to TCP socket. ret: " << ret;
-          break;
-        }
-      } else {
-        NPLOGE << "Failed to get active socket: " << curl_easy_strerror(res)
-               << " Sock: " << sockfd;
-      }
+      failed = !writeRtcp(curl, rtcpWriteBuf_);
+    }
+    if (sendPli_ && !failed) {
+      sendPli_ = false;
+      failed = !writeRtcp(curl, pliWriteBuf_);
+    }
+    if (failed) {
+      break;
     }
   }
   NPLOGD << "TcpRtpClient run returning";
 }
 
+bool TcpRtpClient::writeRtcp(CURL* curl, const char* frame) {
+  CURLcode res = CURLE_OK;
+  curl_socket_t sockfd;
+  res = curl_easy_getinfo(curl, CURLINFO_ACTIVESOCKET, &sockfd);
+  if (!res && sockfd != CURL_SOCKET_BAD) {
+    uint16_t len = ntohs(*(uint16_t*)(frame + 2)) + 4;
+    // NPLOGD << "Sending RTCP on channel: " << (int)frame[1];
+    auto ret = write(sockfd, frame, len);
+    if (ret < len) {
+      NPLOGE << "Failed to write RTCP to TCP socket. ret: " << ret;
+      return false;
+    }
+  } else {
+    NPLOGE << "Failed to get active socket: " << curl_easy_strerror(res)
+           << " Sock: " << sockfd;
+  }
+  return true;
+}
+
 size_t TcpRtpClient::rtp_write(void* ptr, size_t size, size_t nmemb,
                                void* userp) {
   TcpRtpClient* self = (TcpRtpClient*)userp;
@@ -137,65 +227,227 @@ size_t TcpRtpClient::rtp_write(void* ptr, size_t size, size_t nmemb,
 
   if (channel == 0) {
     // video RTP
-    std::lock_guard<std::mutex> lock(self->mutex_);
-    if (self->videoTrack_ != nullptr && self->videoTrack_->isOpen()) {
-      uint8_t* buf = ((uint8_t*)ptr) + 4;
-      try {
-        auto packets = self->videoRepacketizer_->handlePacket(
-            std::vector<uint8_t>(buf, buf + dataLen));
-        for (auto p : packets) {
-          self->videoTrack_->send((rtc::byte*)p.data(), p.size());
-        }
-      } catch (std::runtime_error err) {
-        // This was introduced as we observed a runtime error due to the track
-        // being closed. Since we check for isOpen(), this appears to be a race
-        // condition. Both us and libdatachannel have mutex protection, so this
-        // will not be a memory issue. However, libdatachannel can still change
-        // the Open state between the check above and this.
-
-        // We have also observed a runtime error from the repacketizer due to
-        // mistakenly sending H265 data instead of H264. Since the uncaught
-        // exception will crash the device, we need to catch it as well.
-        NPLOGE << "Caught send runtime error: " << err.what();
+    if (self->videoStats_) {
+      self->videoStats_->handlePacket(
+          ((uint8_t*)ptr) + 4, dataLen,
+          nabto::example::RtpReceptionStats::Clock::now());
+    }
+    self->keyframeRequests_->poll(
+        nabto::example::KeyframeRequestAggregator::Clock::now());
+    auto packet = self->pool_->copy(((uint8_t*)ptr) + 4, dataLen);
+    bool keyframeNeeded = false;
+    {
+      std::lock_guard<std::mutex> lock(self->mutex_);
+      if (dataLen >= 12) {
+        uint8_t* ssrc = packet.data() + 8;
+        self->videoSourceSsrc_ =
+            (static_cast<uint32_t>(ssrc[0]) << 24) | (ssrc[1] << 16) |
+            (ssrc[2] << 8) | ssrc[3];
       }
+      keyframeNeeded =
+          self->forward(self->videoTracks_, self->videoCache_.get(), packet);
+    }
+    if (keyframeNeeded) {
+      // The cached keyframe does not help, the frames following it were
+      // dropped.
+      self->keyframeRequests_->request(
+          nabto::example::KeyframeRequestAggregator::Clock::now());
     }
   } else if (channel == 2) {
     // Audio RTP
+    if (self->audioStats_) {
+      self->audioStats_->handlePacket(
+          ((uint8_t*)ptr) + 4, dataLen,
+          nabto::example::RtpReceptionStats::Clock::now());
+    }
+    auto packet = self->pool_->copy(((uint8_t*)ptr) + 4, dataLen);
     std::lock_guard<std::mutex> lock(self->mutex_);
-    if (self->audioTrack_ != nullptr && self->audioTrack_->isOpen()) {
+    self->forward(self->audioTracks_, nullptr, packet);
+  } else {
+    std::lock_guard<std::mutex> lock(self->mutex_);
+    self->prepareReceiverReport(channel, ((uint8_t*)ptr) + 4, dataLen);
+  }
+
+  return len;
+}
+
+void TcpRtpClient::prepareReceiverReport(uint8_t channel,
+                                         const uint8_t* data, size_t size) {
+  // Sender reports are expected first in compound packets.
+  auto sr = reinterpret_cast<const rtc::RtcpSr*>(data);
+  if (size < RTCP_SENDER_REPORT_MIN_SIZE ||
+      sr->header.payloadType() != RTCP_SENDER_REPORT) {
+    return;
+  }
+  // The RTCP channel follows the RTP channel of its stream.
+  auto stats = channel == 1 ? videoStats_ : audioStats_;
+  memset(rtcpWriteBuf_, 0, 64);
+  rtcpWriteBuf_[0] = '$';
+  rtcpWriteBuf_[1] = channel;
+  rtc::RtcpRr* rr = (rtc::RtcpRr*)(rtcpWriteBuf_ + 4);
+  rtc::RtcpReportBlock* rb = rr->getReportBlock(0);
+  if (stats) {
+    auto now = nabto::example::RtpReceptionStats::Clock::now();
+    stats->handleSenderReport(sr->senderSSRC(), sr->ntpTimestamp(), now);
+    stats->prepareReportBlock(sr->senderSSRC(), rb, now);
+  } else {
+    rb->preparePacket(sr->senderSSRC(), 0, 0, 0, 0, 0, sr->ntpTimestamp(), 0);
+  }
+  rr->preparePacket(1, 1);
+  // The interleaved frame length is in network byte order.
+  uint16_t* p = (uint16_t*)&rtcpWriteBuf_[2];
+  *p = htons(rr->header.lengthInBytes());
+  sendRtcp_ = true;
+}
+
+void TcpRtpClient::handleVideoFeedback(size_t ref, rtc::message_ptr msg) {
+  if (msg->type != rtc::Message::Binary) {
+    return;
+  }
+  auto data = reinterpret_cast<const uint8_t*>(msg->data());
+  auto now = nabto::example::KeyframeRequestAggregator::Clock::now();
+  uint64_t bitrate = 0;
+  if (adaptVideoToViewers_ && nabto::example::FrameDropper::parseRemb(
+                                  data, msg->size(), bitrate)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& t : videoTracks_) {
+      if (t.ref == ref && t.dropper) {
+        t.dropper->handleEstimate(bitrate, now);
+      }
+    }
+  }
+  std::vector<uint16_t> nacked;
+  if (answerVideoNacks_ &&
+      nabto::example::RtpHistory::parseNacks(data, msg->size(), nacked)) {
+    retransmit(ref, nacked, now);
+  }
+  if (nabto::example::KeyframeRequestAggregator::isKeyframeRequest(
+          data, msg->size())) {
+    // The cached keyframe cannot serve a viewer which is already watching,
+    // it has seen those frames, so ask the camera.
+    keyframeRequests_->request(now);
+  }
+}
+
+void TcpRtpClient::retransmit(size_t ref, const std::vector<uint16_t>& seqs,
+                              std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& t : videoTracks_) {
+    if (t.ref != ref || !t.history) {
+      continue;
+    }
+    auto send = [&t](const nabto::example::RtpPacket& p) {
       try {
-        uint8_t* buf = ((uint8_t*)ptr) + 4;
-        auto packets = self->audioRepacketizer_->handlePacket(
-            std::vector<uint8_t>(buf, buf + dataLen));
-        for (auto p : packets) {
-          self->audioTrack_->send((rtc::byte*)p.data(), p.size());
+        t.track->send((const rtc::byte*)p.data(), p.size());
+      } catch (std::runtime_error& err) {
+        NPLOGE << "Failed to retransmit: " << err.what();
+      }
+    };
+    t.history->retransmit(seqs, now, send);
+  }
+}
+
+void TcpRtpClient::preparePli() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  memset(pliWriteBuf_, 0, sizeof(pliWriteBuf_));
+  pliWriteBuf_[0] = '$';
+  // The RTCP channel of the video stream.
+  pliWriteBuf_[1] = 1;
+  rtc::RtcpPli* pli = (rtc::RtcpPli*)(pliWriteBuf_ + 4);
+  pli->preparePacket(videoSourceSsrc_);
+  pli->header.setPacketSenderSSRC(1);
+  uint16_t* p = (uint16_t*)&pliWriteBuf_[2];
+  *p = htons(rtc::RtcpPli::Size());
+  sendPli_ = true;
+}
+
+bool TcpRtpClient::forward(std::vector<TcpRtpTrack>& tracks,
+                           nabto::example::H264KeyframeCache* cache,
+                           nabto::example::RtpPacket& packet) {
+  bool keyframeNeeded = false;
+  auto now = nabto::example::FrameDropper::Clock::now();
+  // Every viewer has its own repacketizer, as the repacketizers keep state
+  // per outgoing stream. They also number the packets, so frames dropped for
+  // a viewer leave no gaps.
+  for (auto& t : tracks) {
+    if (!t.track->isOpen()) {
+      continue;
+    }
+    try {
+      if (!t.primed) {
+        if (cache != nullptr && !cache->startsFrame(packet)) {
+          // The rest of a frame the viewer has not seen the start of. Wait
+          // for the next frame and replay ahead of it.
+          continue;
+        }
+        // First frame since the track opened, send the cached keyframe
+        // through the repacketizer ahead of it.
+        t.primed = true;
+        if (cache != nullptr) {
+          for (auto& cached : cache->replay(*pool_)) {
+            send(t, cached);
+          }
+        }
+      }
+      if (t.dropper) {
+        auto level = t.dropper->level();
+        bool keep = t.dropper->forward(packet.data(), packet.size(), now);
+        if (t.dropper->level() != level) {
+          NPLOGD << "Track " << t.ref << " frame drop level " << level << "->"
+                 << t.dropper->level();
+        }
+        if (t.dropper->takeKeyframeRequest()) {
+          keyframeNeeded = true;
+        }
+        if (!keep) {
+          continue;
         }
-      } catch (std::runtime_error err) {
-        // This was introduced as we observed a runtime error due to the track
-        // being closed. Since we check for isOpen(), this appears to be a race
-        // condition. Both us and libdatachannel have mutex protection, so this
-        // will not be a memory issue. However, libdatachannel can still change
-        // the Open state between the check above and this.
-        NPLOGE << "Caught send runtime error: " << err.what();
       }
+      send(t, packet);
+    } catch (std::runtime_error err) {
+      // This was introduced as we observed a runtime error due to the track
+      // being closed. Since we check for isOpen(), this appears to be a race
+      // condition. Both us and libdatachannel have mutex protection, so this
+      // will not be a memory issue. However, libdatachannel can still change
+      // the Open state between the check above and this.
+
+      // We have also observed a runtime error from the repacketizer due to
+      // mistakenly sending H265 data instead of H264. Since the uncaught
+      // exception will crash the device, we need to catch it as well.
+      NPLOGE << "Caught send runtime error: " << err.what();
     }
-  } else {
-    std::lock_guard<std::mutex> lock(self->mutex_);
-    char* buffer = (char*)ptr + 4;
-    auto sr = reinterpret_cast<rtc::RtcpSr*>(buffer);
-    memset(self->rtcpWriteBuf_, 0, 64);
-    self->rtcpWriteBuf_[0] = '$';
-    self->rtcpWriteBuf_[1] = channel;
-    rtc::RtcpRr* rr = (rtc::RtcpRr*)(self->rtcpWriteBuf_ + 4);
-    rtc::RtcpReportBlock* rb = rr->getReportBlock(0);
-    rb->preparePacket(sr->senderSSRC(), 0, 0, 0, 0, 0, sr->ntpTimestamp(), 0);
-    rr->preparePacket(1, 1);
-    uint16_t* p = (uint16_t*)&self->rtcpWriteBuf_[2];
-    *p = rr->header.lengthInBytes();
-    self->sendRtcp_ = true;
   }
+  if (cache != nullptr) {
+    cache->handlePacket(packet);
+  }
+  return keyframeNeeded;
+}
 
-  return len;
+void TcpRtpClient::send(TcpRtpTrack& track,
+                        nabto::example::RtpPacket& packet) {
+  // The packet is shared by all viewers and the keyframe cache, so a
+  // repacketizer which rewrites its input gets a private copy.
+  uint8_t* data = packet.data();
+  if (track.repacketizer->rewritesInPlace()) {
+    scratch_.assign(packet.data(), packet.data() + packet.size());
+    data = scratch_.data();
+  }
+  // The history keeps copies, as the output is specific to the track.
+  auto now = track.history ? std::chrono::steady_clock::now()
+                           : std::chrono::steady_clock::time_point();
+  RtpPacketCallbackSink sink([this, &track, now](const uint8_t* p,
+                                                 size_t size) {
+    if (!track.track->send((const rtc::byte*)p, size) && track.dropper) {
+      // The transport refused the packet, typically because the socket
+      // buffer is full.
+      track.dropper->handleSendFailure(
+          nabto::example::FrameDropper::Clock::now());
+    }
+    if (track.history) {
+      track.history->add(pool_->copy(p, size), now);
+    }
+  });
+  track.repacketizer->handlePacket(data, packet.size(), sink);
 }
 
 }  // namespace nabto
@@ -1,13 +1,35 @@
 #pragma once
 
 #include <nabto/webrtc/util/curl_async.hpp>
+#include <rtp_client/frame_dropper.hpp>
+#include <rtp_client/h264_keyframe_cache.hpp>
+#include <rtp_client/keyframe_request_aggregator.hpp>
+#include <rtp_client/rtp_history.hpp>
+#include <rtp_client/rtp_reception_stats.hpp>
+#include <rtp_packet/rtp_packet.hpp>
 #include <rtp_repacketizer/rtp_repacketizer.hpp>
 
+#include <chrono>
+#include <memory>
+
 namespace nabto {
 
 class TcpRtpClient;
 typedef std::shared_ptr<TcpRtpClient> TcpRtpClientPtr;
 
+class TcpRtpTrack {
+ public:
+  size_t ref;
+  std::shared_ptr<rtc::Track> track;
+  RtpRepacketizerPtr repacketizer;
+  // Set once the keyframe cache has been replayed to the track.
+  bool primed = false;
+  // The packets sent to the track, to answer NACKs. Null if not answered.
+  std::shared_ptr<nabto::example::RtpHistory> history = nullptr;
+  // Drops video frames the viewer cannot keep up with. Null if not adapting.
+  std::shared_ptr<nabto::example::FrameDropper> dropper = nullptr;
+};
+
 class TcpRtpClientConf {
  public:
   nabto::webrtc::util::CurlAsyncPtr curl;
@@ -18,6 +40,23 @@ class TcpRtpClientConf {
   int audioPayloadType;
   uint32_t videoSsrc;
   uint32_t audioSsrc;
+  // Replay the latest video keyframe to new tracks. Only set this for H264
+  // video with a repacketizer which numbers the packets of each track
+  // itself, like H264Repacketizer.
+  bool cacheVideoKeyframes = false;
+  // Reception statistics of the interleaved streams, which the RTCP receiver
+  // reports are filled in from. Optional.
+  nabto::example::RtpReceptionStatsPtr videoStats = nullptr;
+  nabto::example::RtpReceptionStatsPtr audioStats = nullptr;
+  // Keep the video packets sent to each track in the last second to answer
+  // NACKs from the viewer with retransmissions. Advertise nack feedback on
+  // the video tracks if set.
+  bool answerVideoNacks = false;
+  // Drop video frames for viewers which cannot keep up, judged from their
+  // REMB feedback and failing sends, see FrameDropper. Only set this for
+  // H264 video with a repacketizer which numbers the packets of each track
+  // itself, and advertise goog-remb feedback on the video tracks.
+  bool adaptVideoToViewers = false;
 };
 
 class TcpRtpClient : public std::enable_shared_from_this<TcpRtpClient> {
@@ -27,8 +66,14 @@ class TcpRtpClient : public std::enable_shared_from_this<TcpRtpClient> {
 
   ~TcpRtpClient();
 
-  void setConnection(std::shared_ptr<rtc::Track> videoTrack,
-                     std::shared_ptr<rtc::Track> audioTrack);
+  // Forward the interleaved RTP streams to these tracks as well. Either track
+  // may be null. Returns a reference for removeConnection().
+  size_t addConnection(std::shared_ptr<rtc::Track> videoTrack,
+                       std::shared_ptr<rtc::Track> audioTrack);
+  void removeConnection(size_t ref);
+
+  // NACKs answered for the current video tracks.
+  nabto::example::RtpHistoryCounters nackCounters();
 
   void stop() {
     {
@@ -42,28 +87,60 @@ class TcpRtpClient : public std::enable_shared_from_this<TcpRtpClient> {
 
  private:
   static size_t rtp_write(void* ptr, size_t size, size_t nmemb, void* userp);
+  bool writeRtcp(CURL* curl, const char* frame);
+  // Feedback from the viewer. Keyframe requests are sent to the camera as
+  // PLI.
+  void handleVideoFeedback(size_t ref, rtc::message_ptr msg);
+  void retransmit(size_t ref, const std::vector<uint16_t>& seqs,
+                  std::chrono::steady_clock::time_point now);
+  void preparePli();
+  void prepareReceiverReport(uint8_t channel, const uint8_t* data,
+                             size_t size);
+  // Returns true if a viewer recovering from dropped frames needs a keyframe.
+  bool forward(std::vector<TcpRtpTrack>& tracks,
+               nabto::example::H264KeyframeCache* cache,
+               nabto::example::RtpPacket& packet);
+  void send(TcpRtpTrack& track, nabto::example::RtpPacket& packet);
+  static TcpRtpTrack createTrack(size_t ref,
+                                 std::shared_ptr<rtc::Track> track,
+                                 RtpRepacketizerFactoryPtr repack,
+                                 uint32_t ssrc);
 
   nabto::webrtc::util::CurlAsyncPtr curl_;
   std::string url_;
   bool stopped_ = true;
   std::mutex mutex_;
 
+  size_t counter_ = 0;
+
+  // Received packets, shared by all viewers.
+  nabto::example::RtpPacketPoolPtr pool_ =
+      nabto::example::RtpPacketPool::create();
+  // Private copy of a shared packet for the repacketizers which rewrite
+  // their input, reused to avoid allocations.
+  std::vector<uint8_t> scratch_;
+
   RtpRepacketizerFactoryPtr videoRepack_ = RtpRepacketizerFactory::create();
-  RtpRepacketizerPtr videoRepacketizer_ = nullptr;
-  std::shared_ptr<rtc::Track> videoTrack_ = nullptr;
+  std::vector<TcpRtpTrack> videoTracks_;
+  std::unique_ptr<nabto::example::H264KeyframeCache> videoCache_;
+  nabto::example::RtpReceptionStatsPtr videoStats_;
+  nabto::example::KeyframeRequestAggregatorPtr keyframeRequests_;
+  uint32_t videoSourceSsrc_ = 0;
+  bool answerVideoNacks_ = false;
+  bool adaptVideoToViewers_ = false;
   uint32_t videoSsrc_ = 0;
   int videoSrcPt_ = 0;
-  int videoDstPt_ = 0;
 
   RtpRepacketizerFactoryPtr audioRepack_ = RtpRepacketizerFactory::create();
-  RtpRepacketizerPtr audioRepacketizer_ = nullptr;
-  std::shared_ptr<rtc::Track> audioTrack_ = nullptr;
+  std::vector<TcpRtpTrack> audioTracks_;
+  nabto::example::RtpReceptionStatsPtr audioStats_;
   uint32_t audioSsrc_ = 0;
   int audioSrcPt_ = 0;
-  int audioDstPt_ = 0;
 
   char rtcpWriteBuf_[64];
   bool sendRtcp_ = false;
+  char pliWriteBuf_[16];
+  bool sendPli_ = false;
 };
 
 }  // namespace nabto
@@ -0,0 +1,329 @@
+#include <rtp_client/frame_dropper.hpp>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+using nabto::example::FrameDropper;
+using nabto::example::RtpSequenceRewriter;
+using std::chrono::seconds;
+
+typedef std::vector<uint8_t> Bytes;
+
+const uint8_t NAL_SLICE = 1;
+const uint8_t NAL_IDR = 5;
+const uint8_t NAL_SPS = 7;
+const uint8_t NAL_PPS = 8;
+const uint8_t STAP_A = 24;
+const uint8_t FU_A = 28;
+
+const size_t FPS = 30;
+const size_t GOP = 30;
+const size_t IDR_SIZE = 2500;
+const size_t SLICE_SIZE = 500;
+const std::chrono::microseconds FRAME_TIME{1000000 / FPS};
+
+enum FrameType { IDR, REFERENCE, NON_REFERENCE };
+
+Bytes rtpPacket(uint32_t timestamp, const Bytes& payload, size_t size) {
+  Bytes p = {0x80,
+             96,
+             0,
+             0,
+             static_cast<uint8_t>(timestamp >> 24),
+             static_cast<uint8_t>(timestamp >> 16),
+             static_cast<uint8_t>(timestamp >> 8),
+             static_cast<uint8_t>(timestamp),
+             0,
+             0,
+             0,
+             1};
+  p.insert(p.end(), payload.begin(), payload.end());
+  p.resize(std::max(p.size(), size), 0x55);
+  return p;
+}
+
+// The packets of a frame, the way cameras usually packetize them: the IDR
+// frame as a STAP-A with the parameter sets followed by FU-A fragments, the
+// reference frame as FU-A fragments and the non reference frame as two
+// single NAL unit slices.
+std::vector<Bytes> framePackets(FrameType type, uint32_t timestamp) {
+  switch (type) {
+    case IDR:
+      return {rtpPacket(timestamp,
+                        {0x60 | STAP_A, 0x00, 0x02, 0x60 | NAL_SPS, 0x42,
+                         0x00, 0x02, 0x60 | NAL_PPS, 0x43},
+                        0),
+              rtpPacket(timestamp, {0x60 | FU_A, 0x80 | NAL_IDR}, IDR_SIZE),
+              rtpPacket(timestamp, {0x60 | FU_A, 0x40 | NAL_IDR}, IDR_SIZE)};
+    case REFERENCE:
+      return {rtpPacket(timestamp, {0x40 | FU_A, 0x80 | NAL_SLICE}, SLICE_SIZE),
+              rtpPacket(timestamp, {0x40 | FU_A, 0x40 | NAL_SLICE},
+                        SLICE_SIZE)};
+    case NON_REFERENCE:
+      return {rtpPacket(timestamp, {NAL_SLICE}, SLICE_SIZE),
+              rtpPacket(timestamp, {NAL_SLICE}, SLICE_SIZE)};
+  }
+  return {};
+}
+
+class Frame {
+ public:
+  FrameType type;
+  FrameDropper::Clock::time_point time;
+  bool forwarded;
+};
+
+/**
+ * Sends a stream of one IDR frame per second, with reference and non
+ * reference frames alternating in between, of about 40 kbps of IDR frames,
+ * 110 kbps of reference frames and 120 kbps of non reference frames.
+ */
+class FrameDropperTest : public ::testing::Test {
+ protected:
+  std::vector<Frame> run(FrameDropper::Clock::duration duration) {
+    std::vector<Frame> frames;
+    auto end = now_ + duration;
+    while (now_ < end) {
+      FrameType type = frame_ % GOP == 0   ? IDR
+                       : frame_ % 2 == 0 ? REFERENCE
+                                         : NON_REFERENCE;
+      if (estimate_ > 0) {
+        dropper_.handleEstimate(estimate_, now_);
+      }
+      auto packets = framePackets(type, static_cast<uint32_t>(frame_ * 3000));
+      bool first = dropper_.forward(packets[0].data(), packets[0].size(), now_);
+      for (size_t i = 1; i < packets.size(); i++) {
+        // Frames are sent or dropped whole.
+        EXPECT_EQ(
+            dropper_.forward(packets[i].data(), packets[i].size(), now_),
+            first);
+      }
+      frames.push_back({type, now_, first});
+      frame_++;
+      now_ += FRAME_TIME;
+    }
+    return frames;
+  }
+
+  static size_t forwarded(const std::vector<Frame>& frames, FrameType type) {
+    size_t n = 0;
+    for (const auto& f : frames) {
+      n += f.type == type && f.forwarded;
+    }
+    return n;
+  }
+
+  static size_t count(const std::vector<Frame>& frames, FrameType type) {
+    size_t n = 0;
+    for (const auto& f : frames) {
+      n += f.type == type;
+    }
+    return n;
+  }
+
+  FrameDropper dropper_;
+  FrameDropper::Clock::time_point now_ = FrameDropper::Clock::now();
+  size_t frame_ = 0;
+  uint64_t estimate_ = 0;
+};
+
+}  // namespace
+
+TEST_F(FrameDropperTest, forwards_everything_without_congestion) {
+  estimate_ = 1000000;
+  auto frames = run(seconds(5));
+  for (auto type : {IDR, REFERENCE, NON_REFERENCE}) {
+    EXPECT_EQ(forwarded(frames, type), count(frames, type));
+  }
+  EXPECT_EQ(dropper_.level(), FrameDropper::DROP_NONE);
+  EXPECT_EQ(dropper_.counters().packetsDropped, 0);
+}
+
+TEST_F(FrameDropperTest, escalates_one_level_at_a_time) {
+  run(seconds(2));
+  // Not even enough for the reference frames.
+  estimate_ = 50000;
+  run(std::chrono::milliseconds(500));
+  EXPECT_EQ(dropper_.level(), FrameDropper::DROP_NON_REFERENCE);
+  EXPECT_EQ(dropper_.counters().escalations, 1);
+  run(seconds(1));
+  EXPECT_EQ(dropper_.level(), FrameDropper::DROP_ALL_BUT_IDR);
+  EXPECT_EQ(dropper_.counters().escalations, 2);
+
+  auto frames = run(seconds(2));
+  EXPECT_EQ(forwarded(frames, NON_REFERENCE), 0);
+  EXPECT_EQ(forwarded(frames, REFERENCE), 0);
+  EXPECT_EQ(forwarded(frames, IDR), count(frames, IDR));
+  EXPECT_GT(dropper_.counters().framesDropped, 0);
+  EXPECT_EQ(dropper_.counters().packetsDropped,
+            2 * dropper_.counters().framesDropped);
+}
+
+TEST_F(FrameDropperTest, stays_at_level_covered_by_estimate) {
+  run(seconds(2));
+  // Covers the stream without non reference frames.
+  estimate_ = 200000;
+  run(seconds(1));
+  auto frames = run(seconds(2));
+  EXPECT_EQ(dropper_.level(), FrameDropper::DROP_NON_REFERENCE);
+  EXPECT_EQ(dropper_.counters().escalations, 1);
+  EXPECT_EQ(forwarded(frames, NON_REFERENCE), 0);
+  EXPECT_EQ(forwarded(frames, REFERENCE), count(frames, REFERENCE));
+  EXPECT_EQ(forwarded(frames, IDR), count(frames, IDR));
+  EXPECT_FALSE(dropper_.takeKeyframeRequest());
+}
+
+TEST_F(FrameDropperTest, escalates_on_send_failure) {
+  estimate_ = 1000000;
+  run(seconds(2));
+  dropper_.handleSendFailure(now_);
+  run(std::chrono::milliseconds(100));
+  EXPECT_EQ(dropper_.level(), FrameDropper::DROP_NON_REFERENCE);
+  EXPECT_EQ(dropper_.counters().escalations, 1);
+}
+
+TEST_F(FrameDropperTest, waits_for_idr_after_dropping_reference_frames) {
+  run(seconds(2));
+  estimate_ = 50000;
+  run(std::chrono::milliseconds(3500));
+  ASSERT_EQ(dropper_.level(), FrameDropper::DROP_ALL_BUT_IDR);
+
+  // The estimate recovers in the middle of a GOP. The reference frames up to
+  // the next IDR frame cannot be decoded, so a keyframe is requested.
+  estimate_ = 200000;
+  while (dropper_.level() == FrameDropper::DROP_ALL_BUT_IDR) {
+    run(FRAME_TIME);
+  }
+  ASSERT_NE((frame_ - 1) % GOP, 0);
+  EXPECT_EQ(dropper_.level(), FrameDropper::DROP_NON_REFERENCE);
+  EXPECT_TRUE(dropper_.takeKeyframeRequest());
+  EXPECT_FALSE(dropper_.takeKeyframeRequest());
+  EXPECT_EQ(dropper_.counters().keyframeRequests, 1);
+
+  bool idr = false;
+  for (const auto& f : run(seconds(2))) {
+    if (f.type == IDR) {
+      idr = true;
+    }
+    if (f.type == REFERENCE) {
+      EXPECT_EQ(f.forwarded, idr);
+    }
+    if (f.type == NON_REFERENCE) {
+      EXPECT_FALSE(f.forwarded);
+    }
+  }
+  EXPECT_TRUE(idr);
+}
+
+TEST_F(FrameDropperTest, probe_interval_doubles_when_probes_fail) {
+  run(seconds(2));
+  // Covers the current level, never the lower level.
+  estimate_ = 200000;
+  std::vector<FrameDropper::Clock::time_point> probes;
+  FrameDropper::Level level = dropper_.level();
+  for (size_t i = 0; i < 45 * FPS; i++) {
+    run(FRAME_TIME);
+    if (dropper_.level() < level) {
+      probes.push_back(now_);
+    }
+    level = dropper_.level();
+  }
+  // Each failed probe is undone after the escalation hold of a second.
+  ASSERT_EQ(probes.size(), 3);
+  EXPECT_NEAR((probes[1] - probes[0]) / FRAME_TIME, 11 * FPS, 2);
+  EXPECT_NEAR((probes[2] - probes[1]) / FRAME_TIME, 21 * FPS, 2);
+  EXPECT_EQ(dropper_.counters().escalations, 4);
+}
+
+TEST_F(FrameDropperTest, successful_probe_keeps_lower_level) {
+  run(seconds(2));
+  estimate_ = 200000;
+  run(seconds(2));
+  ASSERT_EQ(dropper_.level(), FrameDropper::DROP_NON_REFERENCE);
+  while (dropper_.level() == FrameDropper::DROP_NON_REFERENCE) {
+    run(FRAME_TIME);
+  }
+  // The estimate grows once the viewer receives more.
+  estimate_ = 400000;
+  run(seconds(20));
+  EXPECT_EQ(dropper_.level(), FrameDropper::DROP_NONE);
+  EXPECT_EQ(dropper_.counters().escalations, 1);
+}
+
+TEST(FrameDropper, parses_remb) {
+  // Sender SSRC, media SSRC 0, "REMB", 1 SSRC, exponent 3 and mantissa
+  // 0x12345, and the SSRC.
+  Bytes remb = {0x8f, 206,  0x00, 0x05, 0x00, 0x00, 0x00, 0x01,
+                0x00, 0x00, 0x00, 0x00, 'R',  'E',  'M',  'B',
+                0x01, 0x0d, 0x23, 0x45, 0x00, 0x00, 0x00, 0x02};
+  Bytes rr = {0x80, 201, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01};
+  Bytes compound = rr;
+  compound.insert(compound.end(), remb.begin(), remb.end());
+  uint64_t bitrate = 0;
+  ASSERT_TRUE(
+      FrameDropper::parseRemb(compound.data(), compound.size(), bitrate));
+  EXPECT_EQ(bitrate, 0x12345u << 3);
+
+  ASSERT_FALSE(FrameDropper::parseRemb(rr.data(), rr.size(), bitrate));
+  for (size_t size = 0; size < compound.size(); size++) {
+    EXPECT_FALSE(FrameDropper::parseRemb(compound.data(), size, bitrate))
+        << "size " << size;
+  }
+}
+
+TEST(RtpSequenceRewriter, renumbers_around_dropped_packets) {
+  RtpSequenceRewriter rewriter;
+  uint16_t source;
+  EXPECT_FALSE(rewriter.sourceSeq(0, source));
+  EXPECT_FALSE(rewriter.sourceSeq(100, source));
+
+  EXPECT_EQ(rewriter.forward(100), 100);
+  EXPECT_EQ(rewriter.forward(101), 101);
+  rewriter.drop();
+  rewriter.drop();
+  EXPECT_EQ(rewriter.forward(104), 102);
+  EXPECT_EQ(rewriter.forward(105), 103);
+
+  ASSERT_TRUE(rewriter.sourceSeq(101, source));
+  EXPECT_EQ(source, 101);
+  ASSERT_TRUE(rewriter.sourceSeq(102, source));
+  EXPECT_EQ(source, 104);
+  ASSERT_TRUE(rewriter.sourceSeq(103, source));
+  EXPECT_EQ(source, 105);
+  EXPECT_FALSE(rewriter.sourceSeq(104, source));
+}
+
+TEST(RtpSequenceRewriter, wraps_around) {
+  RtpSequenceRewriter rewriter;
+  EXPECT_EQ(rewriter.forward(65534), 65534);
+  rewriter.drop();
+  EXPECT_EQ(rewriter.forward(0), 65535);
+  EXPECT_EQ(rewriter.forward(1), 0);
+  uint16_t source;
+  ASSERT_TRUE(rewriter.sourceSeq(65535, source));
+  EXPECT_EQ(source, 0);
+  ASSERT_TRUE(rewriter.sourceSeq(0, source));
+  EXPECT_EQ(source, 1);
+}
+
+TEST(RtpSequenceRewriter, forgets_old_packets) {
+  RtpSequenceRewriter rewriter;
+  for (uint16_t seq = 0; seq < 2 * RtpSequenceRewriter::HISTORY; seq++) {
+    rewriter.forward(seq);
+    if (seq % 3 == 0) {
+      rewriter.drop();
+    }
+  }
+  uint16_t source;
+  EXPECT_FALSE(rewriter.sourceSeq(0, source));
+  uint16_t last = rewriter.forward(2 * RtpSequenceRewriter::HISTORY);
+  ASSERT_TRUE(rewriter.sourceSeq(last, source));
+  EXPECT_EQ(source, 2 * RtpSequenceRewriter::HISTORY);
+}
@@ -0,0 +1,236 @@
+#include <rtp_client/h264_keyframe_cache.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+using nabto::example::H264KeyframeCache;
+using nabto::example::H264KeyframeCacheConf;
+using nabto::example::RtpPacket;
+using nabto::example::RtpPacketPool;
+
+typedef std::vector<uint8_t> Bytes;
+
+const uint8_t NAL_SLICE = 1;
+const uint8_t NAL_IDR = 5;
+const uint8_t NAL_SPS = 7;
+const uint8_t NAL_PPS = 8;
+const uint8_t STAP_A = 24;
+const uint8_t FU_A = 28;
+
+const Bytes STAP_SPS_PPS = {0x60 | STAP_A, 0x00, 0x02, 0x60 | NAL_SPS, 0x42,
+                            0x00,          0x02, 0x60 | NAL_PPS, 0x43};
+const Bytes SPS = {0x60 | NAL_SPS, 0x42};
+const Bytes PPS = {0x60 | NAL_PPS, 0x43};
+const Bytes IDR_START = {0x60 | FU_A, 0x80 | NAL_IDR, 0x01};
+const Bytes IDR_END = {0x60 | FU_A, 0x40 | NAL_IDR, 0x02};
+const Bytes SLICE = {0x40 | NAL_SLICE, 0x03};
+
+uint16_t seqOf(const RtpPacket& p) {
+  return static_cast<uint16_t>((p.data()[2] << 8) | p.data()[3]);
+}
+
+uint32_t timestampOf(const RtpPacket& p) {
+  const uint8_t* d = p.data();
+  return (static_cast<uint32_t>(d[4]) << 24) | (d[5] << 16) | (d[6] << 8) |
+         d[7];
+}
+
+Bytes payloadOf(const RtpPacket& p) {
+  return Bytes(p.data() + 12, p.data() + p.size());
+}
+
+class H264KeyframeCacheTest : public ::testing::Test {
+ protected:
+  RtpPacket packet(uint16_t seq, uint32_t timestamp, const Bytes& payload) {
+    Bytes p = {0x80,
+               96,
+               static_cast<uint8_t>(seq >> 8),
+               static_cast<uint8_t>(seq),
+               static_cast<uint8_t>(timestamp >> 24),
+               static_cast<uint8_t>(timestamp >> 16),
+               static_cast<uint8_t>(timestamp >> 8),
+               static_cast<uint8_t>(timestamp),
+               0,
+               0,
+               0,
+               1};
+    p.insert(p.end(), payload.begin(), payload.end());
+    return pool_->copy(p.data(), p.size());
+  }
+
+  // Feed packets with consecutive sequence numbers to the cache.
+  void feed(H264KeyframeCache& cache, uint32_t timestamp,
+            const std::vector<Bytes>& payloads) {
+    for (const auto& payload : payloads) {
+      cache.handlePacket(packet(seq_++, timestamp, payload));
+    }
+  }
+
+  nabto::example::RtpPacketPoolPtr pool_ = RtpPacketPool::create();
+  uint16_t seq_ = 100;
+};
+
+}  // namespace
+
+TEST_F(H264KeyframeCacheTest, empty_before_keyframe) {
+  H264KeyframeCache cache;
+  feed(cache, 1000, {SLICE, SLICE});
+  EXPECT_EQ(cache.packetCount(), 0);
+  EXPECT_TRUE(cache.replay(*pool_).empty());
+}
+
+TEST_F(H264KeyframeCacheTest, replay_ends_at_live_stream) {
+  H264KeyframeCache cache;
+  feed(cache, 1000, {SLICE});
+  feed(cache, 4000, {STAP_SPS_PPS, IDR_START, IDR_END});
+  feed(cache, 7000, {SLICE});
+  feed(cache, 10000, {SLICE, SLICE});
+  ASSERT_EQ(cache.packetCount(), 6);
+  const uint16_t lastSeq = seq_ - 1;
+
+  auto replay = cache.replay(*pool_);
+  ASSERT_EQ(replay.size(), 6);
+  std::vector<Bytes> payloads = {STAP_SPS_PPS, IDR_START, IDR_END,
+                                 SLICE,        SLICE,     SLICE};
+  // Three frames, the last at the timestamp of the last live packet.
+  const uint32_t ticks = H264KeyframeCache::REPLAY_FRAME_TICKS;
+  std::vector<uint32_t> timestamps = {10000 - 2 * ticks, 10000 - 2 * ticks,
+                                      10000 - 2 * ticks, 10000 - ticks,
+                                      10000,             10000};
+  for (size_t i = 0; i < replay.size(); i++) {
+    EXPECT_EQ(seqOf(replay[i]), static_cast<uint16_t>(lastSeq - 5 + i));
+    EXPECT_EQ(timestampOf(replay[i]), timestamps[i]);
+    EXPECT_EQ(payloadOf(replay[i]), payloads[i]);
+  }
+}
+
+TEST_F(H264KeyframeCacheTest, replay_does_not_modify_live_packets) {
+  H264KeyframeCache cache;
+  RtpPacket idr = packet(seq_++, 4000, STAP_SPS_PPS);
+  cache.handlePacket(idr);
+  feed(cache, 4000, {IDR_START, IDR_END});
+  feed(cache, 7000, {SLICE});
+  auto replay = cache.replay(*pool_);
+  ASSERT_EQ(replay.size(), 4);
+  EXPECT_NE(replay[0].data(), idr.data());
+  EXPECT_EQ(seqOf(idr), 100);
+  EXPECT_EQ(timestampOf(idr), 4000);
+}
+
+TEST_F(H264KeyframeCacheTest, replay_wraps_sequence_numbers) {
+  H264KeyframeCache cache;
+  seq_ = 65534;
+  feed(cache, 4000, {STAP_SPS_PPS, IDR_START, IDR_END});
+  auto replay = cache.replay(*pool_);
+  ASSERT_EQ(replay.size(), 3);
+  EXPECT_EQ(seqOf(replay[0]), 65534);
+  EXPECT_EQ(seqOf(replay[1]), 65535);
+  EXPECT_EQ(seqOf(replay[2]), 0);
+}
+
+TEST_F(H264KeyframeCacheTest, prepends_separate_parameter_sets) {
+  H264KeyframeCache cache;
+  feed(cache, 4000, {SPS, PPS});
+  feed(cache, 4000, {IDR_START, IDR_END});
+  auto replay = cache.replay(*pool_);
+  ASSERT_EQ(replay.size(), 4);
+  EXPECT_EQ(payloadOf(replay[0]), SPS);
+  EXPECT_EQ(payloadOf(replay[1]), PPS);
+  EXPECT_EQ(payloadOf(replay[2]), IDR_START);
+  // All in the frame of the IDR.
+  for (const auto& p : replay) {
+    EXPECT_EQ(timestampOf(p), 4000);
+  }
+
+  // Parameter sets sent long before the IDR are prepended as well.
+  H264KeyframeCache early;
+  feed(early, 1000, {SPS, PPS});
+  feed(early, 4000, {IDR_START, IDR_END});
+  replay = early.replay(*pool_);
+  ASSERT_EQ(replay.size(), 4);
+  EXPECT_EQ(payloadOf(replay[0]), SPS);
+  EXPECT_EQ(timestampOf(replay[0]), 4000);
+}
+
+TEST_F(H264KeyframeCacheTest, new_keyframe_replaces_cache) {
+  H264KeyframeCache cache;
+  feed(cache, 4000, {STAP_SPS_PPS, IDR_START, IDR_END});
+  feed(cache, 7000, {SLICE});
+  feed(cache, 10000, {STAP_SPS_PPS, IDR_START, IDR_END});
+  EXPECT_EQ(cache.packetCount(), 3);
+
+  // An IDR of several slices is one keyframe.
+  feed(cache, 10000, {IDR_START, IDR_END});
+  EXPECT_EQ(cache.packetCount(), 5);
+}
+
+TEST_F(H264KeyframeCacheTest, keyframe_only) {
+  H264KeyframeCacheConf conf;
+  conf.keepFollowingFrames = false;
+  H264KeyframeCache cache(conf);
+  feed(cache, 4000, {STAP_SPS_PPS, IDR_START, IDR_END});
+  feed(cache, 7000, {SLICE});
+  feed(cache, 10000, {SLICE});
+  EXPECT_EQ(cache.packetCount(), 3);
+  auto replay = cache.replay(*pool_);
+  ASSERT_EQ(replay.size(), 3);
+  EXPECT_EQ(seqOf(replay.back()), static_cast<uint16_t>(seq_ - 1));
+  EXPECT_EQ(timestampOf(replay.back()), 10000);
+}
+
+TEST_F(H264KeyframeCacheTest, stops_at_packet_limit) {
+  H264KeyframeCacheConf conf;
+  conf.maxPackets = 4;
+  H264KeyframeCache cache(conf);
+  feed(cache, 4000, {STAP_SPS_PPS, IDR_START, IDR_END});
+  feed(cache, 7000, {SLICE});
+  feed(cache, 10000, {SLICE});
+  EXPECT_EQ(cache.packetCount(), 4);
+  // Nothing more is added once full, even if it would fit.
+  feed(cache, 13000, {SLICE});
+  EXPECT_EQ(cache.packetCount(), 4);
+}
+
+TEST_F(H264KeyframeCacheTest, stops_at_byte_limit) {
+  H264KeyframeCacheConf conf;
+  conf.maxBytes = 3 * 12 + STAP_SPS_PPS.size() + IDR_START.size() +
+                  IDR_END.size() + 12 + SLICE.size() - 1;
+  H264KeyframeCache cache(conf);
+  feed(cache, 4000, {STAP_SPS_PPS, IDR_START, IDR_END});
+  feed(cache, 7000, {SLICE});
+  EXPECT_EQ(cache.packetCount(), 3);
+}
+
+TEST_F(H264KeyframeCacheTest, starts_frame) {
+  H264KeyframeCache cache;
+  EXPECT_TRUE(cache.startsFrame(packet(1, 4000, IDR_END)));
+  feed(cache, 4000, {STAP_SPS_PPS, IDR_START});
+  EXPECT_FALSE(cache.startsFrame(packet(seq_, 4000, IDR_END)));
+  EXPECT_TRUE(cache.startsFrame(packet(seq_, 7000, SLICE)));
+  // Not RTP.
+  RtpPacket rtcp = packet(seq_, 7000, SLICE);
+  rtcp.data()[1] = 200;
+  EXPECT_FALSE(cache.startsFrame(rtcp));
+
+  cache.clear();
+  EXPECT_EQ(cache.packetCount(), 0);
+  EXPECT_TRUE(cache.startsFrame(packet(seq_, 4000, IDR_END)));
+}
+
+TEST_F(H264KeyframeCacheTest, ignores_invalid_packets) {
+  H264KeyframeCache cache;
+  RtpPacket idr = packet(seq_++, 4000, IDR_START);
+  // Padding longer than the packet.
+  idr.data()[0] |= 0x20;
+  idr.data()[idr.size() - 1] = 0xff;
+  cache.handlePacket(idr);
+  RtpPacket shortPacket = packet(seq_++, 4000, IDR_START);
+  shortPacket.resize(11);
+  cache.handlePacket(shortPacket);
+  EXPECT_EQ(cache.packetCount(), 0);
+}
@@ -0,0 +1,504 @@
+#include <rtp_repacketizer/h264_repacketizer.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace {
+
+const uint32_t SSRC = 42;
+const int PAYLOAD_TYPE = 96;
+const uint16_t FIRST_SEQ = 1000;
+const size_t MAX_PAYLOAD = nabto::H264Repacketizer::MAX_PAYLOAD_SIZE;
+
+// RFC 6184 NAL unit and payload structure types
+const uint8_t NAL_SLICE = 1;
+const uint8_t NAL_IDR = 5;
+const uint8_t STAP_A = 24;
+const uint8_t STAP_B = 25;
+const uint8_t MTAP16 = 26;
+const uint8_t MTAP24 = 27;
+const uint8_t FU_A = 28;
+const uint8_t FU_B = 29;
+const uint8_t NRI = 0x60;
+const uint8_t FU_START = 0x80;
+const uint8_t FU_END = 0x40;
+
+typedef std::vector<uint8_t> Bytes;
+
+class RtpIn {
+ public:
+  Bytes payload;
+  uint16_t seq = 1;
+  uint32_t timestamp = 90000;
+  bool marker = false;
+  uint8_t payloadType = 100;
+  uint8_t csrcs = 0;
+  uint16_t extensionWords = 0;
+  bool extension = false;
+  uint8_t padding = 0;
+
+  Bytes serialize() const {
+    Bytes p = {
+        static_cast<uint8_t>(0x80 | (padding ? 0x20 : 0) |
+                             (extension ? 0x10 : 0) | csrcs),
+        static_cast<uint8_t>((marker ? 0x80 : 0) | payloadType),
+        static_cast<uint8_t>(seq >> 8),
+        static_cast<uint8_t>(seq),
+        static_cast<uint8_t>(timestamp >> 24),
+        static_cast<uint8_t>(timestamp >> 16),
+        static_cast<uint8_t>(timestamp >> 8),
+        static_cast<uint8_t>(timestamp),
+        0x12,
+        0x34,
+        0x56,
+        0x78};
+    p.insert(p.end(), 4 * csrcs, 0xcc);
+    if (extension) {
+      p.insert(p.end(), {0xbe, 0xde, static_cast<uint8_t>(extensionWords >> 8),
+                         static_cast<uint8_t>(extensionWords)});
+      p.insert(p.end(), 4 * extensionWords, 0xee);
+    }
+    p.insert(p.end(), payload.begin(), payload.end());
+    if (padding) {
+      p.insert(p.end(), padding - 1, 0);
+      p.push_back(padding);
+    }
+    return p;
+  }
+};
+
+class RtpOut {
+ public:
+  bool marker;
+  uint8_t payloadType;
+  uint16_t seq;
+  uint32_t timestamp;
+  uint32_t ssrc;
+  Bytes payload;
+};
+
+// A NAL unit without start codes or zero bytes.
+Bytes nal(uint8_t type, size_t size, uint8_t nri = NRI) {
+  Bytes n = {static_cast<uint8_t>(nri | type)};
+  for (size_t i = 1; i < size; i++) {
+    n.push_back(static_cast<uint8_t>(0x10 + i % 0x70));
+  }
+  return n;
+}
+
+void append(Bytes& to, const Bytes& from) {
+  to.insert(to.end(), from.begin(), from.end());
+}
+
+void appendUint16(Bytes& to, size_t value) {
+  to.push_back(static_cast<uint8_t>(value >> 8));
+  to.push_back(static_cast<uint8_t>(value));
+}
+
+class H264RepacketizerTest : public ::testing::Test {
+ protected:
+  void SetUp() override { repacketizer_ = create(); }
+
+  static std::shared_ptr<nabto::H264Repacketizer> create(
+      uint16_t firstSeq = FIRST_SEQ) {
+    auto rtpConf = std::make_shared<rtc::RtpPacketizationConfig>(
+        SSRC, "", PAYLOAD_TYPE, 90000);
+    rtpConf->sequenceNumber = firstSeq;
+    return std::make_shared<nabto::H264Repacketizer>(rtpConf);
+  }
+
+  std::vector<RtpOut> send(const RtpIn& in) { return send(in.serialize()); }
+
+  std::vector<RtpOut> send(Bytes data) { return send(*repacketizer_, data); }
+
+  // Packets are passed to the repacketizers of all viewers, which must leave
+  // them intact.
+  static std::vector<RtpOut> send(nabto::RtpRepacketizer& repacketizer,
+                                  Bytes& data) {
+    std::vector<RtpOut> out;
+    nabto::RtpPacketCallbackSink sink([&](const uint8_t* p, size_t size) {
+      EXPECT_GE(size, 12);
+      EXPECT_EQ(p[0], 0x80);
+      RtpOut o;
+      o.marker = (p[1] & 0x80) != 0;
+      o.payloadType = p[1] & 0x7f;
+      o.seq = static_cast<uint16_t>((p[2] << 8) | p[3]);
+      o.timestamp = (static_cast<uint32_t>(p[4]) << 24) | (p[5] << 16) |
+                    (p[6] << 8) | p[7];
+      o.ssrc = (static_cast<uint32_t>(p[8]) << 24) | (p[9] << 16) |
+               (p[10] << 8) | p[11];
+      o.payload.assign(p + 12, p + size);
+      out.push_back(o);
+    });
+    repacketizer.handlePacket(data.data(), data.size(), sink);
+    return out;
+  }
+
+  std::shared_ptr<nabto::H264Repacketizer> repacketizer_;
+};
+
+}  // namespace
+
+TEST_F(H264RepacketizerTest, forwards_single_nal_unit) {
+  RtpIn in;
+  in.payload = nal(NAL_IDR, 500);
+  in.marker = true;
+  auto out = send(in);
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].payload, in.payload);
+  EXPECT_TRUE(out[0].marker);
+  EXPECT_EQ(out[0].payloadType, PAYLOAD_TYPE);
+  EXPECT_EQ(out[0].seq, FIRST_SEQ);
+  EXPECT_EQ(out[0].timestamp, in.timestamp);
+  EXPECT_EQ(out[0].ssrc, SSRC);
+
+  in.seq++;
+  in.marker = false;
+  out = send(in);
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_FALSE(out[0].marker);
+  EXPECT_EQ(out[0].seq, FIRST_SEQ + 1);
+}
+
+TEST_F(H264RepacketizerTest, strips_csrcs_extension_and_padding) {
+  RtpIn in;
+  in.payload = nal(NAL_SLICE, 100);
+  in.csrcs = 2;
+  in.extension = true;
+  in.extensionWords = 3;
+  in.padding = 4;
+  auto out = send(in);
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].payload, in.payload);
+}
+
+TEST_F(H264RepacketizerTest, leaves_input_intact) {
+  RtpIn extension;
+  extension.payload = nal(NAL_SLICE, 100);
+  extension.extension = true;
+  extension.extensionWords = 1;
+  RtpIn padding;
+  padding.payload = nal(NAL_SLICE, 100);
+  padding.padding = 4;
+  RtpIn fragment;
+  fragment.payload = {NRI | FU_A, FU_START | NAL_IDR};
+  append(fragment.payload, nal(0, 800, 0x10));
+  fragment.extension = true;
+  fragment.padding = 2;
+
+  for (const auto& in : {extension, padding, fragment}) {
+    Bytes data = in.serialize();
+    const Bytes original = data;
+    auto first = create(FIRST_SEQ);
+    auto second = create(2 * FIRST_SEQ);
+    auto out1 = send(*first, data);
+    ASSERT_EQ(data, original);
+    auto out2 = send(*second, data);
+    ASSERT_EQ(data, original);
+    ASSERT_EQ(out1.size(), 1);
+    ASSERT_EQ(out2.size(), 1);
+    EXPECT_EQ(out1[0].payload, in.payload);
+    EXPECT_EQ(out2[0].payload, in.payload);
+    EXPECT_EQ(out1[0].seq, FIRST_SEQ);
+    EXPECT_EQ(out2[0].seq, 2 * FIRST_SEQ);
+  }
+}
+
+TEST_F(H264RepacketizerTest, shared_input_keeps_fragment_loss_detection) {
+  auto first = create();
+  auto second = create();
+  RtpIn start;
+  start.payload = {NRI | FU_A, FU_START | NAL_IDR, 0x11, 0x00, 0x00, 0x01,
+                   0x41, 0x22};
+  RtpIn end;
+  end.seq = start.seq + 2;
+  end.payload = {NRI | FU_A, FU_END | NAL_IDR, 0x33};
+  for (const auto& in : {start, end}) {
+    Bytes data = in.serialize();
+    ASSERT_TRUE(send(*first, data).empty());
+    ASSERT_TRUE(send(*second, data).empty());
+  }
+}
+
+TEST_F(H264RepacketizerTest, fragments_oversized_nal_unit) {
+  RtpIn in;
+  in.payload = nal(NAL_IDR, 3 * MAX_PAYLOAD);
+  in.marker = true;
+  auto out = send(in);
+  ASSERT_EQ(out.size(), 4);
+
+  Bytes reassembled = {in.payload[0]};
+  for (size_t i = 0; i < out.size(); i++) {
+    const Bytes& p = out[i].payload;
+    ASSERT_LE(p.size(), MAX_PAYLOAD);
+    EXPECT_EQ(p[0], NRI | FU_A);
+    EXPECT_EQ(p[1] & 0x1f, NAL_IDR);
+    EXPECT_EQ((p[1] & FU_START) != 0, i == 0);
+    EXPECT_EQ((p[1] & FU_END) != 0, i == out.size() - 1);
+    EXPECT_EQ(out[i].marker, i == out.size() - 1);
+    EXPECT_EQ(out[i].seq, FIRST_SEQ + i);
+    EXPECT_EQ(out[i].timestamp, in.timestamp);
+    reassembled.insert(reassembled.end(), p.begin() + 2, p.end());
+  }
+  EXPECT_EQ(reassembled, in.payload);
+}
+
+TEST_F(H264RepacketizerTest, forwards_stap_a) {
+  RtpIn in;
+  in.payload = {NRI | STAP_A};
+  for (auto n : {nal(7, 10), nal(8, 4)}) {
+    appendUint16(in.payload, n.size());
+    append(in.payload, n);
+  }
+  auto out = send(in);
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].payload, in.payload);
+}
+
+TEST_F(H264RepacketizerTest, unpacks_stap_b) {
+  Bytes sps = nal(7, 10);
+  Bytes pps = nal(8, 4);
+  RtpIn in;
+  in.payload = {NRI | STAP_B, 0x00, 0x07};
+  for (auto n : {sps, pps}) {
+    appendUint16(in.payload, n.size());
+    append(in.payload, n);
+  }
+  in.marker = true;
+  auto out = send(in);
+  ASSERT_EQ(out.size(), 2);
+  EXPECT_EQ(out[0].payload, sps);
+  EXPECT_FALSE(out[0].marker);
+  EXPECT_EQ(out[1].payload, pps);
+  EXPECT_TRUE(out[1].marker);
+  EXPECT_EQ(out[1].seq, FIRST_SEQ + 1);
+  EXPECT_EQ(out[1].timestamp, in.timestamp);
+}
+
+TEST_F(H264RepacketizerTest, unpacks_mtap16) {
+  Bytes first = nal(NAL_SLICE, 20);
+  Bytes second = nal(NAL_SLICE, 30);
+  RtpIn in;
+  in.payload = {NRI | MTAP16, 0x00, 0x01};
+  appendUint16(in.payload, first.size());
+  in.payload.insert(in.payload.end(), {0x00, 0x00, 0x00});
+  append(in.payload, first);
+  appendUint16(in.payload, second.size());
+  in.payload.insert(in.payload.end(), {0x01, 0x0b, 0xb8});
+  append(in.payload, second);
+  in.marker = true;
+  auto out = send(in);
+  ASSERT_EQ(out.size(), 2);
+  EXPECT_EQ(out[0].payload, first);
+  EXPECT_EQ(out[0].timestamp, in.timestamp);
+  EXPECT_FALSE(out[0].marker);
+  EXPECT_EQ(out[1].payload, second);
+  EXPECT_EQ(out[1].timestamp, in.timestamp + 3000);
+  EXPECT_TRUE(out[1].marker);
+}
+
+TEST_F(H264RepacketizerTest, unpacks_mtap24) {
+  Bytes first = nal(NAL_SLICE, 20);
+  Bytes second = nal(NAL_SLICE, 30);
+  RtpIn in;
+  in.payload = {NRI | MTAP24, 0x00, 0x01};
+  appendUint16(in.payload, first.size());
+  in.payload.insert(in.payload.end(), {0x00, 0x00, 0x00, 0x10});
+  append(in.payload, first);
+  appendUint16(in.payload, second.size());
+  in.payload.insert(in.payload.end(), {0x01, 0x01, 0x00, 0x00});
+  append(in.payload, second);
+  auto out = send(in);
+  ASSERT_EQ(out.size(), 2);
+  EXPECT_EQ(out[0].payload, first);
+  EXPECT_EQ(out[0].timestamp, in.timestamp + 0x10);
+  EXPECT_EQ(out[1].payload, second);
+  EXPECT_EQ(out[1].timestamp, in.timestamp + 0x10000);
+}
+
+TEST_F(H264RepacketizerTest, forwards_fu_a) {
+  RtpIn in;
+  in.payload = {NRI | FU_A, FU_START | NAL_IDR};
+  append(in.payload, nal(0, 800, 0x10));
+  auto out = send(in);
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].payload, in.payload);
+}
+
+TEST_F(H264RepacketizerTest, converts_fu_b_to_fu_a) {
+  Bytes data1 = nal(0, 800, 0x10);
+  Bytes data2 = nal(0, 300, 0x20);
+  RtpIn start;
+  start.payload = {NRI | FU_B, FU_START | NAL_IDR, 0x00, 0x05};
+  append(start.payload, data1);
+  RtpIn end;
+  end.seq = start.seq + 1;
+  end.marker = true;
+  end.payload = {NRI | FU_B, FU_END | NAL_IDR};
+  append(end.payload, data2);
+
+  auto out = send(start);
+  ASSERT_EQ(out.size(), 1);
+  Bytes expected = {NRI | FU_A, FU_START | NAL_IDR};
+  append(expected, data1);
+  EXPECT_EQ(out[0].payload, expected);
+  EXPECT_FALSE(out[0].marker);
+
+  out = send(end);
+  ASSERT_EQ(out.size(), 1);
+  expected = {NRI | FU_A, FU_END | NAL_IDR};
+  append(expected, data2);
+  EXPECT_EQ(out[0].payload, expected);
+  EXPECT_TRUE(out[0].marker);
+}
+
+TEST_F(H264RepacketizerTest, splits_embedded_start_codes) {
+  Bytes sps = nal(7, 10);
+  Bytes pps = nal(8, 4);
+  Bytes idr = nal(NAL_IDR, 200);
+  RtpIn in;
+  in.payload = sps;
+  in.payload.insert(in.payload.end(), {0x00, 0x00, 0x00, 0x01});
+  append(in.payload, pps);
+  in.payload.insert(in.payload.end(), {0x00, 0x00, 0x01});
+  append(in.payload, idr);
+  in.marker = true;
+  auto out = send(in);
+  ASSERT_EQ(out.size(), 3);
+  EXPECT_EQ(out[0].payload, sps);
+  EXPECT_EQ(out[1].payload, pps);
+  EXPECT_EQ(out[2].payload, idr);
+  EXPECT_FALSE(out[0].marker);
+  EXPECT_FALSE(out[1].marker);
+  EXPECT_TRUE(out[2].marker);
+}
+
+TEST_F(H264RepacketizerTest, splits_start_codes_in_fragmented_nal_unit) {
+  Bytes first = nal(0, 50, 0x10);
+  Bytes second = nal(NAL_SLICE, 400);
+  RtpIn start;
+  start.payload = {NRI | FU_A, FU_START | NAL_IDR};
+  append(start.payload, first);
+  start.payload.insert(start.payload.end(), {0x00, 0x00, 0x01});
+  start.payload.insert(start.payload.end(), second.begin(),
+                       second.begin() + 100);
+  RtpIn end;
+  end.seq = start.seq + 1;
+  end.marker = true;
+  end.payload = {NRI | FU_A, FU_END | NAL_IDR};
+  end.payload.insert(end.payload.end(), second.begin() + 100, second.end());
+
+  // Nothing is sent before the NAL unit is reassembled.
+  ASSERT_TRUE(send(start).empty());
+  auto out = send(end);
+  ASSERT_EQ(out.size(), 2);
+  Bytes expected = {NRI | NAL_IDR};
+  append(expected, first);
+  EXPECT_EQ(out[0].payload, expected);
+  EXPECT_FALSE(out[0].marker);
+  EXPECT_EQ(out[1].payload, second);
+  EXPECT_TRUE(out[1].marker);
+}
+
+TEST_F(H264RepacketizerTest, drops_reassembly_after_lost_fragment) {
+  RtpIn start;
+  start.payload = {NRI | FU_A, FU_START | NAL_IDR, 0x11, 0x00, 0x00, 0x01,
+                   0x41, 0x22};
+  RtpIn end;
+  end.seq = start.seq + 2;
+  end.payload = {NRI | FU_A, FU_END | NAL_IDR, 0x33};
+  ASSERT_TRUE(send(start).empty());
+  ASSERT_TRUE(send(end).empty());
+}
+
+TEST_F(H264RepacketizerTest, ignores_rtcp_and_other_versions) {
+  RtpIn in;
+  in.payload = nal(NAL_SLICE, 40);
+  in.payloadType = 72;
+  ASSERT_TRUE(send(in).empty());
+  in.payloadType = 76;
+  ASSERT_TRUE(send(in).empty());
+
+  in.payloadType = 100;
+  Bytes data = in.serialize();
+  data[0] = 0x40;
+  ASSERT_TRUE(send(data).empty());
+}
+
+TEST_F(H264RepacketizerTest, drops_truncated_packets) {
+  RtpIn valid;
+  valid.payload = nal(NAL_SLICE, 40);
+  Bytes full = valid.serialize();
+
+  std::vector<Bytes> packets;
+  packets.push_back({});
+  packets.push_back(Bytes(full.begin(), full.begin() + 11));
+  // Header only.
+  packets.push_back(Bytes(full.begin(), full.begin() + 12));
+  // CSRCs beyond the packet.
+  Bytes csrcs = full;
+  csrcs[0] |= 0x0f;
+  packets.push_back(csrcs);
+  // Extension flag without an extension header.
+  Bytes noExtension(full.begin(), full.begin() + 14);
+  noExtension[0] |= 0x10;
+  packets.push_back(noExtension);
+  // Extension longer than the packet.
+  RtpIn longExtension = valid;
+  longExtension.extension = true;
+  Bytes extension = longExtension.serialize();
+  extension[15] = 0xff;
+  packets.push_back(extension);
+  // Padding longer than the packet, or than the payload.
+  Bytes padding = full;
+  padding[0] |= 0x20;
+  padding.back() = 0xff;
+  packets.push_back(padding);
+  padding.back() = 41;
+  packets.push_back(padding);
+  // FU-A without a FU header, and FU-B without the DON.
+  RtpIn fu = valid;
+  fu.payload = {NRI | FU_A};
+  packets.push_back(fu.serialize());
+  fu.payload = {NRI | FU_B, FU_START | NAL_IDR, 0x00, 0x01};
+  packets.push_back(fu.serialize());
+  // Aggregates too short for their first unit.
+  for (uint8_t type : {STAP_B, MTAP16, MTAP24}) {
+    RtpIn aggregate = valid;
+    aggregate.payload = {static_cast<uint8_t>(NRI | type), 0x00, 0x00, 0x00};
+    packets.push_back(aggregate.serialize());
+  }
+
+  for (const auto& p : packets) {
+    // Exactly sized copies, so reading past the end is caught by sanitizers.
+    EXPECT_TRUE(send(p).empty()) << "packet of " << p.size() << " bytes";
+  }
+}
+
+TEST_F(H264RepacketizerTest, truncated_aggregates_send_complete_units) {
+  Bytes sps = nal(7, 10);
+  RtpIn stapB;
+  stapB.payload = {NRI | STAP_B, 0x00, 0x00};
+  appendUint16(stapB.payload, sps.size());
+  append(stapB.payload, sps);
+  appendUint16(stapB.payload, 100);
+  append(stapB.payload, nal(8, 20));
+  auto out = send(stapB);
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].payload, sps);
+
+  RtpIn mtap;
+  mtap.payload = {NRI | MTAP16, 0x00, 0x00};
+  appendUint16(mtap.payload, sps.size());
+  mtap.payload.insert(mtap.payload.end(), {0x00, 0x00, 0x00});
+  append(mtap.payload, sps);
+  // Half the header of the next unit.
+  mtap.payload.insert(mtap.payload.end(), {0x00, 0x10, 0x00});
+  out = send(mtap);
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].payload, sps);
+}
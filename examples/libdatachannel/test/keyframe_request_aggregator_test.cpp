@@ -0,0 +1,139 @@
+#include <rtp_client/keyframe_request_aggregator.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+using nabto::example::KeyframeRequestAggregator;
+using nabto::example::KeyframeRequestAggregatorPtr;
+using std::chrono_literals::operator""ms;
+
+typedef std::vector<uint8_t> Bytes;
+
+// An RTCP packet with a body of the given number of 32 bit words.
+Bytes rtcp(uint8_t fmt, uint8_t type, uint16_t words) {
+  Bytes p = {static_cast<uint8_t>(0x80 | fmt), type,
+             static_cast<uint8_t>(words >> 8), static_cast<uint8_t>(words)};
+  p.resize(p.size() + 4 * words, 0x11);
+  return p;
+}
+
+const Bytes RR = rtcp(0, 201, 1);
+const Bytes PLI = rtcp(1, 206, 2);
+const Bytes FIR = rtcp(4, 206, 4);
+const Bytes REMB = rtcp(15, 206, 5);
+const Bytes NACK = rtcp(1, 205, 3);
+
+Bytes concat(std::vector<Bytes> packets) {
+  Bytes ret;
+  for (const auto& p : packets) {
+    ret.insert(ret.end(), p.begin(), p.end());
+  }
+  return ret;
+}
+
+bool isKeyframeRequest(const Bytes& data) {
+  return KeyframeRequestAggregator::isKeyframeRequest(data.data(),
+                                                      data.size());
+}
+
+class KeyframeRequestAggregatorTest : public ::testing::Test {
+ protected:
+  size_t upstream_ = 0;
+  KeyframeRequestAggregatorPtr aggregator_ =
+      KeyframeRequestAggregator::create([this]() { upstream_++; }, 1000ms);
+  KeyframeRequestAggregator::Clock::time_point now_ =
+      KeyframeRequestAggregator::Clock::now();
+};
+
+}  // namespace
+
+TEST_F(KeyframeRequestAggregatorTest, first_request_is_sent_at_once) {
+  aggregator_->request(now_);
+  EXPECT_EQ(upstream_, 1);
+  aggregator_->poll(now_ + 5000ms);
+  EXPECT_EQ(upstream_, 1);
+}
+
+TEST_F(KeyframeRequestAggregatorTest, holds_back_requests_within_interval) {
+  aggregator_->request(now_);
+  aggregator_->request(now_ + 100ms);
+  aggregator_->request(now_ + 200ms);
+  EXPECT_EQ(upstream_, 1);
+  aggregator_->poll(now_ + 999ms);
+  EXPECT_EQ(upstream_, 1);
+
+  // The held back requests are sent as one when the interval ends.
+  aggregator_->poll(now_ + 1000ms);
+  EXPECT_EQ(upstream_, 2);
+  aggregator_->poll(now_ + 3000ms);
+  EXPECT_EQ(upstream_, 2);
+  EXPECT_EQ(aggregator_->requestCount(), 3);
+  EXPECT_EQ(aggregator_->upstreamCount(), 2);
+
+  // The interval starts over from the held back request.
+  aggregator_->request(now_ + 1500ms);
+  EXPECT_EQ(upstream_, 2);
+  aggregator_->poll(now_ + 2000ms);
+  EXPECT_EQ(upstream_, 3);
+}
+
+TEST_F(KeyframeRequestAggregatorTest, request_after_interval_is_sent_at_once) {
+  aggregator_->request(now_);
+  aggregator_->request(now_ + 1000ms);
+  EXPECT_EQ(upstream_, 2);
+}
+
+TEST_F(KeyframeRequestAggregatorTest, upstream_is_called_without_lock) {
+  uint64_t seen = 0;
+  KeyframeRequestAggregatorPtr aggregator;
+  aggregator = KeyframeRequestAggregator::create(
+      [&]() { seen = aggregator->upstreamCount(); }, 1000ms);
+  aggregator->request(now_);
+  EXPECT_EQ(seen, 1);
+  aggregator->request(now_ + 10ms);
+  aggregator->poll(now_ + 1000ms);
+  EXPECT_EQ(seen, 2);
+}
+
+TEST(KeyframeRequestParsing, finds_pli_and_fir) {
+  EXPECT_TRUE(isKeyframeRequest(PLI));
+  EXPECT_TRUE(isKeyframeRequest(FIR));
+  EXPECT_TRUE(isKeyframeRequest(concat({RR, NACK, PLI})));
+  EXPECT_TRUE(isKeyframeRequest(concat({RR, REMB, FIR})));
+}
+
+TEST(KeyframeRequestParsing, ignores_other_feedback) {
+  EXPECT_FALSE(isKeyframeRequest({}));
+  EXPECT_FALSE(isKeyframeRequest(RR));
+  EXPECT_FALSE(isKeyframeRequest(REMB));
+  EXPECT_FALSE(isKeyframeRequest(NACK));
+  EXPECT_FALSE(isKeyframeRequest(concat({RR, REMB, NACK})));
+}
+
+TEST(KeyframeRequestParsing, ignores_rtp) {
+  // An RTP packet with payload type 96, with and without the marker bit.
+  Bytes rtp = {0x80, 96, 0x00, 0x01, 0, 0, 0, 0, 0, 0, 0, 1, 0x81, 0xce};
+  EXPECT_FALSE(isKeyframeRequest(rtp));
+  rtp[1] |= 0x80;
+  EXPECT_FALSE(isKeyframeRequest(rtp));
+}
+
+TEST(KeyframeRequestParsing, stops_at_end_of_data) {
+  // Less than a header of the PLI following the receiver report.
+  Bytes data = concat({RR, PLI});
+  for (size_t size = 0; size < RR.size() + 4; size++) {
+    EXPECT_FALSE(
+        KeyframeRequestAggregator::isKeyframeRequest(data.data(), size))
+        << "size " << size;
+  }
+  // A length field pointing past the end.
+  Bytes longRr = RR;
+  longRr[3] = 0xff;
+  EXPECT_FALSE(isKeyframeRequest(concat({longRr, PLI})));
+}
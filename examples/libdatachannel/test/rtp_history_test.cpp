@@ -0,0 +1,232 @@
+#include <rtp_client/rtp_history.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using nabto::example::RtpHistory;
+using nabto::example::RtpHistoryConf;
+using nabto::example::RtpPacket;
+using nabto::example::RtpPacketPool;
+using std::chrono_literals::operator""ms;
+
+typedef std::vector<uint8_t> Bytes;
+typedef std::vector<uint16_t> Seqs;
+
+const uint32_t MEDIA_SSRC = 0x11223344;
+
+void appendUint16(Bytes& to, uint16_t value) {
+  to.push_back(static_cast<uint8_t>(value >> 8));
+  to.push_back(static_cast<uint8_t>(value));
+}
+
+void appendUint32(Bytes& to, uint32_t value) {
+  appendUint16(to, static_cast<uint16_t>(value >> 16));
+  appendUint16(to, static_cast<uint16_t>(value));
+}
+
+// An RTCP packet with the length field set from the body.
+Bytes rtcp(uint8_t fmt, uint8_t type, const Bytes& body) {
+  Bytes p = {static_cast<uint8_t>(0x80 | fmt), type};
+  appendUint16(p, static_cast<uint16_t>(body.size() / 4));
+  p.insert(p.end(), body.begin(), body.end());
+  return p;
+}
+
+// A generic NACK with one FCI per pair of PID and bitmask of lost packets.
+Bytes nack(const std::vector<std::pair<uint16_t, uint16_t>>& fcis) {
+  Bytes body;
+  appendUint32(body, 1);
+  appendUint32(body, MEDIA_SSRC);
+  for (const auto& fci : fcis) {
+    appendUint16(body, fci.first);
+    appendUint16(body, fci.second);
+  }
+  return rtcp(1, 205, body);
+}
+
+Bytes receiverReport() {
+  Bytes body;
+  appendUint32(body, 1);
+  return rtcp(0, 201, body);
+}
+
+Bytes pli() {
+  Bytes body;
+  appendUint32(body, 1);
+  appendUint32(body, MEDIA_SSRC);
+  return rtcp(1, 206, body);
+}
+
+Bytes concat(std::vector<Bytes> packets) {
+  Bytes ret;
+  for (const auto& p : packets) {
+    ret.insert(ret.end(), p.begin(), p.end());
+  }
+  return ret;
+}
+
+Seqs parse(const Bytes& data, bool expectFound = true) {
+  Seqs seqs;
+  EXPECT_EQ(RtpHistory::parseNacks(data.data(), data.size(), seqs),
+            expectFound);
+  return seqs;
+}
+
+class RtpHistoryTest : public ::testing::Test {
+ protected:
+  RtpPacket packet(uint16_t seq) {
+    RtpPacket p = pool_->allocate(100);
+    p.data()[0] = 0x80;
+    p.data()[2] = static_cast<uint8_t>(seq >> 8);
+    p.data()[3] = static_cast<uint8_t>(seq);
+    return p;
+  }
+
+  Seqs retransmit(RtpHistory& history, const Seqs& seqs,
+                  RtpHistory::Clock::time_point now) {
+    Seqs sent;
+    history.retransmit(seqs, now, [&](const RtpPacket& p) {
+      sent.push_back(static_cast<uint16_t>((p.data()[2] << 8) | p.data()[3]));
+    });
+    return sent;
+  }
+
+  nabto::example::RtpPacketPoolPtr pool_ = RtpPacketPool::create();
+  RtpHistory::Clock::time_point now_ = RtpHistory::Clock::now();
+};
+
+}  // namespace
+
+TEST(RtpHistoryNacks, parses_pid_and_bitmask) {
+  EXPECT_EQ(parse(nack({{100, 0}})), Seqs({100}));
+  EXPECT_EQ(parse(nack({{100, 0x8005}})), Seqs({100, 101, 103, 116}));
+  EXPECT_EQ(parse(nack({{100, 1}, {200, 0}})), Seqs({100, 101, 200}));
+}
+
+TEST(RtpHistoryNacks, sequence_numbers_wrap) {
+  EXPECT_EQ(parse(nack({{65535, 0x0003}})), Seqs({65535, 0, 1}));
+}
+
+TEST(RtpHistoryNacks, finds_nacks_in_compound_packet) {
+  auto data = concat({receiverReport(), pli(), nack({{7, 0}}),
+                      nack({{9, 0}})});
+  EXPECT_EQ(parse(data), Seqs({7, 9}));
+}
+
+TEST(RtpHistoryNacks, appends_to_seqs) {
+  auto data = nack({{7, 0}});
+  Seqs seqs = {1};
+  ASSERT_TRUE(RtpHistory::parseNacks(data.data(), data.size(), seqs));
+  EXPECT_EQ(seqs, Seqs({1, 7}));
+}
+
+TEST(RtpHistoryNacks, no_nacks) {
+  EXPECT_TRUE(parse(concat({receiverReport(), pli()}), false).empty());
+  EXPECT_TRUE(parse({}, false).empty());
+  // Another feedback message type of the transport layer.
+  Bytes tmmbr = nack({{7, 0}});
+  tmmbr[0] = 0x83;
+  EXPECT_TRUE(parse(tmmbr, false).empty());
+  // A NACK without an FCI.
+  EXPECT_TRUE(parse(nack({}), false).empty());
+}
+
+TEST(RtpHistoryNacks, stops_at_invalid_or_truncated_packets) {
+  Bytes first = nack({{7, 0}});
+  Bytes second = nack({{9, 0}, {11, 0}});
+
+  // Length beyond the end of the data.
+  Bytes truncated = concat({first, second});
+  truncated.pop_back();
+  EXPECT_EQ(parse(truncated), Seqs({7}));
+
+  // Less than an RTCP header left.
+  Bytes partial = concat({first, Bytes(second.begin(), second.begin() + 3)});
+  EXPECT_EQ(parse(partial), Seqs({7}));
+
+  // Not RTCP.
+  Bytes version = second;
+  version[0] = 0x41;
+  EXPECT_EQ(parse(concat({first, version})), Seqs({7}));
+  Bytes type = second;
+  type[1] = 96;
+  EXPECT_EQ(parse(concat({first, type})), Seqs({7}));
+
+  for (size_t size = 0; size < first.size(); size++) {
+    Bytes prefix(first.begin(), first.begin() + size);
+    EXPECT_TRUE(parse(prefix, false).empty()) << "size " << size;
+  }
+}
+
+TEST_F(RtpHistoryTest, retransmits_in_requested_order) {
+  RtpHistory history;
+  for (uint16_t seq = 10; seq < 20; seq++) {
+    history.add(packet(seq), now_);
+  }
+  EXPECT_EQ(retransmit(history, {15, 12, 30, 19}, now_), Seqs({15, 12, 19}));
+  EXPECT_EQ(history.counters().nacks, 1);
+  EXPECT_EQ(history.counters().requested, 4);
+  EXPECT_EQ(history.counters().retransmitted, 3);
+}
+
+TEST_F(RtpHistoryTest, forgets_packets_older_than_window) {
+  RtpHistoryConf conf;
+  conf.window = 1000ms;
+  RtpHistory history(conf);
+  history.add(packet(1), now_);
+  history.add(packet(2), now_ + 500ms);
+  EXPECT_TRUE(history.contains(1, now_ + 1000ms));
+  EXPECT_FALSE(history.contains(1, now_ + 1001ms));
+  EXPECT_TRUE(history.contains(2, now_ + 1001ms));
+  EXPECT_EQ(retransmit(history, {1, 2}, now_ + 1200ms), Seqs({2}));
+}
+
+TEST_F(RtpHistoryTest, grows_to_hold_the_window) {
+  RtpHistory history;
+  const size_t count = 3 * RtpHistory::INITIAL_CAPACITY;
+  for (size_t i = 0; i < count; i++) {
+    history.add(packet(static_cast<uint16_t>(65000 + i)), now_);
+  }
+  EXPECT_GE(history.capacity(), count);
+  for (size_t i = 0; i < count; i++) {
+    EXPECT_TRUE(history.contains(static_cast<uint16_t>(65000 + i), now_));
+  }
+}
+
+TEST_F(RtpHistoryTest, reuses_slots_of_expired_packets) {
+  RtpHistory history;
+  const size_t count = 3 * RtpHistory::INITIAL_CAPACITY;
+  for (size_t i = 0; i < count; i++) {
+    history.add(packet(static_cast<uint16_t>(i)),
+                now_ + std::chrono::seconds(2 * i));
+  }
+  EXPECT_EQ(history.capacity(), RtpHistory::INITIAL_CAPACITY);
+}
+
+TEST_F(RtpHistoryTest, capacity_is_bounded) {
+  RtpHistoryConf conf;
+  conf.maxPackets = 512;
+  RtpHistory history(conf);
+  for (uint16_t seq = 0; seq < 2048; seq++) {
+    history.add(packet(seq), now_);
+  }
+  EXPECT_EQ(history.capacity(), 512);
+  EXPECT_FALSE(history.contains(0, now_));
+  EXPECT_TRUE(history.contains(2047, now_));
+  EXPECT_TRUE(history.contains(2048 - 512, now_));
+}
+
+TEST_F(RtpHistoryTest, ignores_short_packets) {
+  RtpHistory history;
+  RtpPacket p = packet(3);
+  p.resize(11);
+  history.add(p, now_);
+  EXPECT_FALSE(history.contains(3, now_));
+}
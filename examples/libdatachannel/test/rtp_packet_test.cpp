@@ -0,0 +1,187 @@
+#include <rtp_packet/rtp_packet.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using nabto::example::RtpPacket;
+using nabto::example::RtpPacketPool;
+
+typedef std::vector<uint8_t> Bytes;
+
+Bytes content(const RtpPacket& packet) {
+  return Bytes(packet.data(), packet.data() + packet.size());
+}
+
+}  // namespace
+
+TEST(RtpPacket, empty_handle) {
+  RtpPacket packet;
+  ASSERT_FALSE(packet);
+  ASSERT_TRUE(packet.empty());
+  ASSERT_EQ(packet.data(), nullptr);
+  ASSERT_EQ(packet.size(), 0);
+  ASSERT_EQ(packet.capacity(), 0);
+  packet.reset();
+  ASSERT_FALSE(packet);
+}
+
+TEST(RtpPacket, copy_shares_buffer) {
+  auto pool = RtpPacketPool::create(64, 4);
+  Bytes data = {1, 2, 3, 4};
+  RtpPacket packet = pool->copy(data.data(), data.size());
+  ASSERT_TRUE(packet);
+  ASSERT_EQ(packet.capacity(), 64);
+  ASSERT_EQ(content(packet), data);
+
+  RtpPacket copy(packet);
+  ASSERT_EQ(copy.data(), packet.data());
+  RtpPacket assigned;
+  assigned = packet;
+  ASSERT_EQ(assigned.data(), packet.data());
+  const RtpPacket& self = assigned;
+  assigned = self;
+  ASSERT_EQ(assigned.data(), packet.data());
+
+  // The buffer is recycled once the last handle is gone.
+  const uint8_t* buffer = packet.data();
+  packet.reset();
+  copy.reset();
+  ASSERT_EQ(content(assigned), data);
+  assigned.reset();
+  RtpPacket next = pool->allocate(1);
+  ASSERT_EQ(next.data(), buffer);
+}
+
+TEST(RtpPacket, move_transfers_buffer) {
+  auto pool = RtpPacketPool::create(64, 4);
+  Bytes data = {5, 6, 7};
+  RtpPacket packet = pool->copy(data.data(), data.size());
+  const uint8_t* buffer = packet.data();
+
+  RtpPacket moved(std::move(packet));
+  ASSERT_FALSE(packet);
+  ASSERT_EQ(moved.data(), buffer);
+
+  RtpPacket assigned;
+  assigned = std::move(moved);
+  ASSERT_FALSE(moved);
+  ASSERT_EQ(content(assigned), data);
+
+  // Assigning over a handle releases its old buffer.
+  RtpPacket other = pool->allocate(1);
+  const uint8_t* otherBuffer = other.data();
+  other = std::move(assigned);
+  ASSERT_EQ(other.data(), buffer);
+  RtpPacket next = pool->allocate(1);
+  ASSERT_EQ(next.data(), otherBuffer);
+}
+
+TEST(RtpPacket, resize) {
+  auto pool = RtpPacketPool::create(64, 4);
+  RtpPacket packet = pool->allocate(64);
+  ASSERT_EQ(packet.size(), 64);
+  packet.resize(12);
+  ASSERT_EQ(packet.size(), 12);
+  ASSERT_EQ(packet.capacity(), 64);
+  packet.resize(0);
+  ASSERT_TRUE(packet);
+  ASSERT_TRUE(packet.empty());
+}
+
+TEST(RtpPacketPool, recycles_buffers) {
+  auto pool = RtpPacketPool::create(64, 4);
+  ASSERT_EQ(pool->bufferCount(), 0);
+  std::vector<RtpPacket> packets;
+  for (int i = 0; i < 4; i++) {
+    packets.push_back(pool->allocate(10));
+  }
+  ASSERT_EQ(pool->bufferCount(), 4);
+
+  // A fifth packet in flight takes another slab.
+  packets.push_back(pool->allocate(10));
+  ASSERT_EQ(pool->bufferCount(), 8);
+
+  // Released buffers are reused, the pool does not grow further.
+  for (int round = 0; round < 10; round++) {
+    packets.clear();
+    for (int i = 0; i < 8; i++) {
+      packets.push_back(pool->allocate(10));
+    }
+  }
+  ASSERT_EQ(pool->bufferCount(), 8);
+}
+
+TEST(RtpPacketPool, oversize_packets_are_not_pooled) {
+  auto pool = RtpPacketPool::create(64, 4);
+  Bytes data(100);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>(i);
+  }
+  RtpPacket packet = pool->copy(data.data(), data.size());
+  ASSERT_EQ(packet.size(), 100);
+  ASSERT_EQ(packet.capacity(), 100);
+  ASSERT_EQ(content(packet), data);
+  ASSERT_EQ(pool->bufferCount(), 0);
+
+  RtpPacket copy = packet;
+  packet.reset();
+  ASSERT_EQ(content(copy), data);
+  copy.reset();
+  ASSERT_EQ(pool->bufferCount(), 0);
+
+  // Exactly the capacity is pooled.
+  RtpPacket fits = pool->allocate(64);
+  ASSERT_EQ(pool->bufferCount(), 4);
+}
+
+TEST(RtpPacketPool, empty_copy) {
+  auto pool = RtpPacketPool::create(64, 4);
+  RtpPacket packet = pool->copy(nullptr, 0);
+  ASSERT_TRUE(packet);
+  ASSERT_TRUE(packet.empty());
+}
+
+TEST(RtpPacketPool, packets_outlive_pool) {
+  auto pool = RtpPacketPool::create(64, 4);
+  Bytes data = {9, 8, 7};
+  RtpPacket packet = pool->copy(data.data(), data.size());
+  RtpPacket oversize = pool->allocate(128);
+  RtpPacket copy = packet;
+  pool.reset();
+
+  // The memory stays valid until the last packet is gone.
+  ASSERT_EQ(content(packet), data);
+  packet.reset();
+  ASSERT_EQ(content(copy), data);
+  oversize.reset();
+  copy.reset();
+}
+
+TEST(RtpPacketPool, release_on_other_threads) {
+  auto pool = RtpPacketPool::create(64, 4);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    std::vector<RtpPacket> packets;
+    for (int i = 0; i < 100; i++) {
+      uint8_t value = static_cast<uint8_t>(t);
+      packets.push_back(pool->copy(&value, 1));
+    }
+    threads.emplace_back([packets]() mutable {
+      for (auto& packet : packets) {
+        RtpPacket copy = packet;
+        packet.reset();
+      }
+    });
+  }
+  pool.reset();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
@@ -0,0 +1,198 @@
+#include <rtp_client/rtp_reception_stats.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+using nabto::example::RtpReceptionMetrics;
+using nabto::example::RtpReceptionStats;
+using std::chrono_literals::operator""ms;
+
+const uint32_t SSRC = 0x11223344;
+const uint32_t CLOCK_RATE = 90000;
+const size_t PACKET_SIZE = 100;
+
+std::vector<uint8_t> rtpPacket(uint32_t ssrc, uint16_t seq,
+                               uint32_t timestamp) {
+  std::vector<uint8_t> p(PACKET_SIZE);
+  p[0] = 0x80;
+  p[1] = 96;
+  p[2] = static_cast<uint8_t>(seq >> 8);
+  p[3] = static_cast<uint8_t>(seq);
+  p[4] = static_cast<uint8_t>(timestamp >> 24);
+  p[5] = static_cast<uint8_t>(timestamp >> 16);
+  p[6] = static_cast<uint8_t>(timestamp >> 8);
+  p[7] = static_cast<uint8_t>(timestamp);
+  p[8] = static_cast<uint8_t>(ssrc >> 24);
+  p[9] = static_cast<uint8_t>(ssrc >> 16);
+  p[10] = static_cast<uint8_t>(ssrc >> 8);
+  p[11] = static_cast<uint8_t>(ssrc);
+  return p;
+}
+
+class RtpReceptionStatsTest : public ::testing::Test {
+ protected:
+  void receive(uint16_t seq, uint32_t ssrc = SSRC) {
+    receiveAt(seq, 0, now_, ssrc);
+  }
+
+  void receiveAt(uint16_t seq, uint32_t timestamp,
+                 RtpReceptionStats::Clock::time_point arrival,
+                 uint32_t ssrc = SSRC) {
+    auto p = rtpPacket(ssrc, seq, timestamp);
+    stats_.handlePacket(p.data(), p.size(), arrival);
+  }
+
+  RtpReceptionMetrics metrics() {
+    auto all = stats_.metrics();
+    EXPECT_EQ(all.size(), 1);
+    return all.empty() ? RtpReceptionMetrics() : all[0];
+  }
+
+  RtpReceptionStats stats_{CLOCK_RATE};
+  RtpReceptionStats::Clock::time_point now_ =
+      RtpReceptionStats::Clock::now() + std::chrono::seconds(1);
+};
+
+}  // namespace
+
+TEST_F(RtpReceptionStatsTest, source_is_valid_after_probation) {
+  receive(10);
+  auto m = metrics();
+  EXPECT_EQ(m.packetsReceived, 0);
+  EXPECT_EQ(m.extendedHighestSequence, 0);
+  EXPECT_EQ(m.cumulativeLost, 0);
+
+  receive(11);
+  m = metrics();
+  EXPECT_EQ(m.packetsReceived, 1);
+  EXPECT_EQ(m.bytesReceived, PACKET_SIZE);
+  EXPECT_EQ(m.extendedHighestSequence, 11);
+  EXPECT_EQ(m.cumulativeLost, 0);
+}
+
+TEST_F(RtpReceptionStatsTest, probation_restarts_on_gap) {
+  receive(10);
+  receive(20);
+  EXPECT_EQ(metrics().packetsReceived, 0);
+  receive(21);
+  receive(22);
+  auto m = metrics();
+  EXPECT_EQ(m.packetsReceived, 2);
+  EXPECT_EQ(m.extendedHighestSequence, 22);
+  EXPECT_EQ(m.cumulativeLost, 0);
+}
+
+TEST_F(RtpReceptionStatsTest, counts_losses_and_duplicates) {
+  for (uint16_t seq : {100, 101, 102, 104, 105}) {
+    receive(seq);
+  }
+  auto m = metrics();
+  EXPECT_EQ(m.packetsReceived, 4);
+  EXPECT_EQ(m.extendedHighestSequence, 105);
+  EXPECT_EQ(m.cumulativeLost, 1);
+
+  rtc::RtcpReportBlock block;
+  stats_.prepareReportBlock(SSRC, &block, now_);
+  // 1 of the 5 expected packets in the interval, in 1/256.
+  EXPECT_EQ(metrics().fractionLost, 256 / 5);
+
+  receive(105);
+  receive(104);
+  m = metrics();
+  EXPECT_EQ(m.packetsReceived, 6);
+  EXPECT_EQ(m.cumulativeLost, -1);
+  stats_.prepareReportBlock(SSRC, &block, now_);
+  EXPECT_EQ(metrics().fractionLost, 0);
+}
+
+TEST_F(RtpReceptionStatsTest, sequence_wraps_around) {
+  for (uint16_t seq : {65533, 65534, 65535, 0, 1}) {
+    receive(seq);
+  }
+  auto m = metrics();
+  EXPECT_EQ(m.packetsReceived, 4);
+  EXPECT_EQ(m.extendedHighestSequence, (1u << 16) + 1);
+  EXPECT_EQ(m.cumulativeLost, 0);
+
+  // A packet from before the wrap is late, not a new cycle.
+  receive(65535);
+  m = metrics();
+  EXPECT_EQ(m.extendedHighestSequence, (1u << 16) + 1);
+  EXPECT_EQ(m.cumulativeLost, -1);
+}
+
+TEST_F(RtpReceptionStatsTest, single_jump_is_ignored) {
+  for (uint16_t seq = 1000; seq <= 1010; seq++) {
+    receive(seq);
+  }
+  receive(40000);
+  receive(1011);
+  auto m = metrics();
+  EXPECT_EQ(m.packetsReceived, 11);
+  EXPECT_EQ(m.extendedHighestSequence, 1011);
+  EXPECT_EQ(m.cumulativeLost, 0);
+}
+
+TEST_F(RtpReceptionStatsTest, source_restarts_after_sequential_jump) {
+  for (uint16_t seq = 1000; seq <= 1010; seq++) {
+    receive(seq);
+  }
+  receive(40000);
+  receive(40001);
+  auto m = metrics();
+  EXPECT_EQ(m.packetsReceived, 1);
+  EXPECT_EQ(m.extendedHighestSequence, 40001);
+  EXPECT_EQ(m.cumulativeLost, 0);
+
+  receive(40003);
+  EXPECT_EQ(metrics().cumulativeLost, 1);
+}
+
+TEST_F(RtpReceptionStatsTest, jitter) {
+  // 30 frames per second, arriving in step with their timestamps.
+  const uint32_t frameTicks = CLOCK_RATE / 30;
+  const auto frameTime = std::chrono::microseconds(1000000 / 30);
+  uint16_t seq = 0;
+  for (; seq < 10; seq++) {
+    receiveAt(seq, seq * frameTicks, now_ + seq * frameTime);
+  }
+  EXPECT_LE(metrics().jitter, 1);
+
+  // One frame arrives 10 ms late.
+  receiveAt(seq, seq * frameTicks, now_ + seq * frameTime + 10ms);
+  auto m = metrics();
+  const uint32_t late = CLOCK_RATE / 100;
+  EXPECT_NEAR(m.jitter, late / 16, 2);
+  EXPECT_NEAR(m.jitterMs(), 10.0 / 16, 0.05);
+}
+
+TEST_F(RtpReceptionStatsTest, ignores_invalid_packets) {
+  auto p = rtpPacket(SSRC, 1, 0);
+  stats_.handlePacket(p.data(), 11, now_);
+  p[0] = 0x40;
+  stats_.handlePacket(p.data(), p.size(), now_);
+  EXPECT_TRUE(stats_.metrics().empty());
+}
+
+TEST_F(RtpReceptionStatsTest, forgets_least_recently_heard_source) {
+  for (uint32_t ssrc = 1; ssrc <= RtpReceptionStats::MAX_SOURCES; ssrc++) {
+    receiveAt(0, 0, now_ + std::chrono::milliseconds(ssrc), ssrc);
+  }
+  // Source 1 is heard again, so source 2 is the least recently heard.
+  receiveAt(1, 0, now_ + 100ms, 1);
+  receiveAt(0, 0, now_ + 200ms, 100);
+  auto all = stats_.metrics();
+  ASSERT_EQ(all.size(), RtpReceptionStats::MAX_SOURCES);
+  for (const auto& m : all) {
+    EXPECT_NE(m.ssrc, 2);
+  }
+
+  stats_.reset();
+  EXPECT_TRUE(stats_.metrics().empty());
+}
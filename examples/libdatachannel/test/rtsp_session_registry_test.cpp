@@ -0,0 +1,189 @@
+#include <rtsp-client/rtsp_session_registry.hpp>
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using nabto::RtspSessionRegistry;
+
+class FakeSession : public nabto::RtspSession {
+ public:
+  explicit FakeSession(uint16_t port) : port_(port) {}
+
+  size_t addConnection(std::shared_ptr<rtc::Track> /*videoTrack*/,
+                       std::shared_ptr<rtc::Track> /*audioTrack*/) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    connections_.push_back(next_);
+    return next_++;
+  }
+
+  void removeConnection(size_t ref) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = connections_.begin(); it != connections_.end(); ++it) {
+      if (*it == ref) {
+        connections_.erase(it);
+        return;
+      }
+    }
+  }
+
+  size_t connectionCount() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return connections_.size();
+  }
+
+  void stop() override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+    cv_.notify_all();
+    cv_.wait(lock, [this]() { return !blockStop_; });
+    stopped_++;
+  }
+
+  // Make stop() wait for unblockStop().
+  void blockStop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    blockStop_ = true;
+  }
+
+  void unblockStop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    blockStop_ = false;
+    cv_.notify_all();
+  }
+
+  void waitStopping() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return stopping_; });
+  }
+
+  int stopped() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stopped_;
+  }
+
+  uint16_t port_;
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<size_t> connections_;
+  size_t next_ = 0;
+  bool stopping_ = false;
+  bool blockStop_ = false;
+  int stopped_ = 0;
+};
+
+class RtspSessionRegistryTest : public ::testing::Test {
+ protected:
+  size_t addViewer(const std::string& url) {
+    return registry_->addViewer(
+        url,
+        [this](uint16_t port) {
+          auto session = std::make_shared<FakeSession>(port);
+          std::lock_guard<std::mutex> lock(mutex_);
+          created_.push_back(session);
+          return session;
+        },
+        nullptr, nullptr);
+  }
+
+  std::shared_ptr<FakeSession> created(size_t index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return created_.at(index);
+  }
+
+  size_t createdCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return created_.size();
+  }
+
+  nabto::RtspSessionRegistryPtr registry_ = RtspSessionRegistry::create(5000);
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<FakeSession>> created_;
+};
+
+}  // namespace
+
+TEST_F(RtspSessionRegistryTest, viewers_of_a_url_share_session) {
+  size_t a = addViewer("rtsp://camera/1");
+  size_t b = addViewer("rtsp://camera/1");
+  ASSERT_NE(a, b);
+  ASSERT_EQ(createdCount(), 1);
+  ASSERT_EQ(registry_->sessionCount(), 1);
+  ASSERT_EQ(created(0)->connectionCount(), 2);
+}
+
+TEST_F(RtspSessionRegistryTest, urls_get_own_ports) {
+  addViewer("rtsp://camera/1");
+  addViewer("rtsp://camera/2");
+  addViewer("rtsp://camera/3");
+  ASSERT_EQ(registry_->sessionCount(), 3);
+  ASSERT_EQ(created(0)->port_, 5000);
+  ASSERT_EQ(created(1)->port_, 5004);
+  ASSERT_EQ(created(2)->port_, 5008);
+}
+
+TEST_F(RtspSessionRegistryTest, stops_when_last_viewer_leaves) {
+  size_t a = addViewer("rtsp://camera/1");
+  size_t b = addViewer("rtsp://camera/1");
+  auto session = created(0);
+
+  registry_->removeViewer(a);
+  ASSERT_EQ(session->stopped(), 0);
+  ASSERT_EQ(session->connectionCount(), 1);
+  ASSERT_EQ(registry_->sessionCount(), 1);
+
+  registry_->removeViewer(b);
+  ASSERT_EQ(session->stopped(), 1);
+  ASSERT_EQ(registry_->sessionCount(), 0);
+
+  // Removing again is ignored.
+  registry_->removeViewer(b);
+  ASSERT_EQ(session->stopped(), 1);
+}
+
+TEST_F(RtspSessionRegistryTest, reuses_ports_of_stopped_sessions) {
+  size_t a = addViewer("rtsp://camera/1");
+  addViewer("rtsp://camera/2");
+  registry_->removeViewer(a);
+
+  addViewer("rtsp://camera/3");
+  ASSERT_EQ(created(2)->port_, 5000);
+
+  // A new viewer of a stopped URL starts a new session.
+  addViewer("rtsp://camera/1");
+  ASSERT_EQ(createdCount(), 4);
+  ASSERT_EQ(created(3)->port_, 5008);
+}
+
+TEST_F(RtspSessionRegistryTest, stops_session_without_lock) {
+  size_t a = addViewer("rtsp://camera/1");
+  auto session = created(0);
+  session->blockStop();
+  std::thread remover([this, a]() { registry_->removeViewer(a); });
+  session->waitStopping();
+
+  // The registry is usable while the session stops, and its ports stay
+  // reserved until it has stopped.
+  addViewer("rtsp://camera/2");
+  addViewer("rtsp://camera/1");
+  ASSERT_EQ(createdCount(), 3);
+  ASSERT_EQ(created(1)->port_, 5004);
+  ASSERT_EQ(created(2)->port_, 5008);
+  ASSERT_EQ(registry_->sessionCount(), 2);
+
+  session->unblockStop();
+  remover.join();
+  ASSERT_EQ(session->stopped(), 1);
+  addViewer("rtsp://camera/3");
+  ASSERT_EQ(created(3)->port_, 5000);
+}
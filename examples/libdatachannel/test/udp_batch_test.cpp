@@ -0,0 +1,216 @@
+#include <rtp_client/udp_batch.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+using nabto::example::RtpPacket;
+using nabto::example::RtpPacketPool;
+using nabto::example::UdpBatchReceiver;
+
+typedef std::vector<uint8_t> Bytes;
+
+// A pair of UDP sockets on the loopback interface, the sender connected to
+// the receiver.
+class UdpBatchTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    receiver_ = socket(AF_INET, SOCK_DGRAM, 0);
+    sender_ = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(receiver_, 0);
+    ASSERT_GE(sender_, 0);
+    addr_.sin_family = AF_INET;
+    addr_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr_.sin_port = 0;
+    ASSERT_EQ(bind(receiver_, reinterpret_cast<struct sockaddr*>(&addr_),
+                   sizeof(addr_)),
+              0);
+    socklen_t len = sizeof(addr_);
+    ASSERT_EQ(getsockname(receiver_, reinterpret_cast<struct sockaddr*>(&addr_),
+                          &len),
+              0);
+  }
+
+  void TearDown() override {
+    close(receiver_);
+    close(sender_);
+  }
+
+  // Packets of the given sizes, each filled with its index.
+  std::vector<RtpPacket> makePackets(const std::vector<size_t>& sizes) {
+    std::vector<RtpPacket> packets;
+    for (size_t i = 0; i < sizes.size(); i++) {
+      Bytes data(sizes[i], static_cast<uint8_t>(i));
+      packets.push_back(pool_->copy(data.data(), data.size()));
+    }
+    return packets;
+  }
+
+  int receiver_ = -1;
+  int sender_ = -1;
+  struct sockaddr_in addr_ = {};
+  nabto::example::RtpPacketPoolPtr pool_ = RtpPacketPool::create();
+};
+
+}  // namespace
+
+TEST_F(UdpBatchTest, receives_in_batches) {
+  std::vector<size_t> sizes;
+  for (size_t i = 0; i < 20; i++) {
+    sizes.push_back(12 + i);
+  }
+  auto packets = makePackets(sizes);
+  ASSERT_EQ(nabto::example::sendBatch(sender_, addr_, packets), 20);
+
+  UdpBatchReceiver receiver(receiver_, 8, false, pool_);
+  std::vector<RtpPacket> received;
+  std::vector<size_t> batches;
+  while (received.size() < 20) {
+    ASSERT_TRUE(receiver.receive());
+    batches.push_back(receiver.packets().size());
+    for (auto& packet : receiver.packets()) {
+      received.push_back(std::move(packet));
+    }
+  }
+  ASSERT_EQ(batches, std::vector<size_t>({8, 8, 4}));
+  for (size_t i = 0; i < received.size(); i++) {
+    ASSERT_EQ(received[i].size(), sizes[i]);
+    ASSERT_EQ(received[i].data()[0], i);
+  }
+}
+
+TEST_F(UdpBatchTest, send_more_than_one_chunk) {
+  std::vector<size_t> sizes(150, 100);
+  auto packets = makePackets(sizes);
+  ASSERT_EQ(nabto::example::sendBatch(sender_, addr_, packets), 150);
+
+  UdpBatchReceiver receiver(receiver_, 64, false, pool_);
+  size_t count = 0;
+  while (count < 150) {
+    ASSERT_TRUE(receiver.receive());
+    for (auto& packet : receiver.packets()) {
+      ASSERT_EQ(packet.size(), 100);
+      ASSERT_EQ(packet.data()[0], static_cast<uint8_t>(count));
+      count++;
+    }
+  }
+}
+
+TEST_F(UdpBatchTest, partial_send_stops_at_failing_packet) {
+  // The third packet is too large for a UDP datagram, sendmmsg() sends the
+  // first two and the batch stops there.
+  auto packets = makePackets({20, 30, 70000, 40});
+  ASSERT_EQ(nabto::example::sendBatch(sender_, addr_, packets), 2);
+
+  UdpBatchReceiver receiver(receiver_, 8, false, pool_);
+  ASSERT_TRUE(receiver.receive());
+  ASSERT_EQ(receiver.packets().size(), 2);
+  ASSERT_EQ(receiver.packets()[0].size(), 20);
+  ASSERT_EQ(receiver.packets()[1].size(), 30);
+}
+
+TEST_F(UdpBatchTest, receive_fails_on_shutdown) {
+  UdpBatchReceiver receiver(receiver_, 8, false, pool_);
+  shutdown(receiver_, SHUT_RDWR);
+  ASSERT_FALSE(receiver.receive());
+}
+
+TEST_F(UdpBatchTest, gro_receive_splits_segments) {
+#if defined(UDP_SEGMENT) && defined(UDP_GRO)
+  int segment = 100;
+  if (setsockopt(sender_, IPPROTO_UDP, UDP_SEGMENT, &segment,
+                 sizeof(segment)) != 0) {
+    GTEST_SKIP() << "UDP GSO not supported";
+  }
+  UdpBatchReceiver receiver(receiver_, 4, true, pool_);
+
+  // Sent as one buffer of 100 byte datagrams, which the kernel may deliver
+  // coalesced or one by one. Callers see the datagrams either way.
+  Bytes data(350);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>(i / 100);
+  }
+  ASSERT_EQ(sendto(sender_, data.data(), data.size(), 0,
+                   reinterpret_cast<struct sockaddr*>(&addr_), sizeof(addr_)),
+            350);
+
+  std::vector<RtpPacket> received;
+  while (received.size() < 4) {
+    ASSERT_TRUE(receiver.receive());
+    for (auto& packet : receiver.packets()) {
+      received.push_back(std::move(packet));
+    }
+  }
+  ASSERT_EQ(received.size(), 4);
+  for (size_t i = 0; i < received.size(); i++) {
+    ASSERT_EQ(received[i].size(), i < 3 ? 100 : 50);
+    ASSERT_EQ(received[i].data()[0], i);
+  }
+#else
+  GTEST_SKIP() << "UDP GSO not supported";
+#endif
+}
+
+TEST(SplitGroSegments, splits_at_segment_size) {
+  auto pool = RtpPacketPool::create();
+  Bytes data(250);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>(i);
+  }
+  std::vector<RtpPacket> packets;
+  nabto::example::splitGroSegments(data.data(), data.size(), 100, *pool,
+                                   packets);
+  ASSERT_EQ(packets.size(), 3);
+  ASSERT_EQ(packets[0].size(), 100);
+  ASSERT_EQ(packets[1].size(), 100);
+  ASSERT_EQ(packets[2].size(), 50);
+  ASSERT_EQ(packets[1].data()[0], 100);
+  ASSERT_EQ(packets[2].data()[49], 249);
+}
+
+TEST(SplitGroSegments, exact_multiple) {
+  auto pool = RtpPacketPool::create();
+  Bytes data(300);
+  std::vector<RtpPacket> packets;
+  nabto::example::splitGroSegments(data.data(), data.size(), 100, *pool,
+                                   packets);
+  ASSERT_EQ(packets.size(), 3);
+  for (const auto& packet : packets) {
+    ASSERT_EQ(packet.size(), 100);
+  }
+}
+
+TEST(SplitGroSegments, single_datagram) {
+  auto pool = RtpPacketPool::create();
+  Bytes data(80, 7);
+  std::vector<RtpPacket> packets;
+  // Without a segment size, or with one at least the buffer size, the
+  // buffer is one datagram.
+  nabto::example::splitGroSegments(data.data(), data.size(), 0, *pool,
+                                   packets);
+  nabto::example::splitGroSegments(data.data(), data.size(), 80, *pool,
+                                   packets);
+  ASSERT_EQ(packets.size(), 2);
+  ASSERT_EQ(packets[0].size(), 80);
+  ASSERT_EQ(packets[1].size(), 80);
+}
+
+TEST(SplitGroSegments, appends_to_packets) {
+  auto pool = RtpPacketPool::create();
+  Bytes data(30);
+  std::vector<RtpPacket> packets;
+  packets.push_back(pool->copy(data.data(), 5));
+  nabto::example::splitGroSegments(data.data(), data.size(), 10, *pool,
+                                   packets);
+  ASSERT_EQ(packets.size(), 4);
+  ASSERT_EQ(packets[0].size(), 5);
+}
@@ -0,0 +1,102 @@
+#include "../src/signaling_device/src/channel_table.hpp"
+#include "../src/signaling_device/src/signaling_channel_impl.hpp"
+
+#include <nabto/webrtc/util/uuid.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Compare channel lookups in the ChannelTable against the std::map previously
+ * used by the SignalingDeviceImpl. The lookups mimic handleWsMessage, where
+ * the channel ID is parsed from the incoming JSON as a std::string.
+ */
+
+namespace {
+
+const size_t CHANNEL_COUNT = 10000;
+const size_t LOOKUP_ROUNDS = 100;
+
+using Clock = std::chrono::steady_clock;
+
+double nsPerOp(Clock::time_point start, Clock::time_point end, size_t ops) {
+  return static_cast<double>(
+             std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                 .count()) /
+         static_cast<double>(ops);
+}
+
+}  // namespace
+
+int main() {
+  std::vector<std::string> ids;
+  std::vector<nabto::webrtc::SignalingChannelImplPtr> chans;
+  for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+    ids.push_back(nabto::webrtc::util::generate_uuid_v4());
+    chans.push_back(
+        nabto::webrtc::SignalingChannelImpl::create(nullptr, ids[i]));
+  }
+
+  std::map<std::string, nabto::webrtc::SignalingChannelImplPtr> map;
+  nabto::webrtc::ChannelTable table;
+
+  auto start = Clock::now();
+  for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+    map.insert({ids[i], chans[i]});
+  }
+  auto end = Clock::now();
+  std::cout << "std::map insert:      " << nsPerOp(start, end, CHANNEL_COUNT)
+            << " ns/op" << std::endl;
+
+  start = Clock::now();
+  for (size_t i = 0; i < CHANNEL_COUNT; i++) {
+    table.insert(nabto::webrtc::ChannelKey(ids[i]), chans[i]);
+  }
+  end = Clock::now();
+  std::cout << "ChannelTable insert:  " << nsPerOp(start, end, CHANNEL_COUNT)
+            << " ns/op" << std::endl;
+
+  size_t hits = 0;
+  start = Clock::now();
+  for (size_t r = 0; r < LOOKUP_ROUNDS; r++) {
+    for (const auto& id : ids) {
+      auto it = map.find(id);
+      if (it != map.end()) {
+        hits++;
+      }
+    }
+  }
+  end = Clock::now();
+  std::cout << "std::map find:        "
+            << nsPerOp(start, end, CHANNEL_COUNT * LOOKUP_ROUNDS) << " ns/op"
+            << std::endl;
+
+  start = Clock::now();
+  for (size_t r = 0; r < LOOKUP_ROUNDS; r++) {
+    for (const auto& id : ids) {
+      if (table.find(nabto::webrtc::ChannelKey(id)) != nullptr) {
+        hits++;
+      }
+    }
+  }
+  end = Clock::now();
+  std::cout << "ChannelTable find:    "
+            << nsPerOp(start, end, CHANNEL_COUNT * LOOKUP_ROUNDS) << " ns/op"
+            << std::endl;
+
+  start = Clock::now();
+  auto copy = map;
+  end = Clock::now();
+  std::cout << "std::map copy (old close()): " << nsPerOp(start, end, 1)
+            << " ns" << std::endl;
+
+  if (hits != 2 * CHANNEL_COUNT * LOOKUP_ROUNDS || copy.size() != map.size()) {
+    std::cout << "Unexpected lookup result" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,227 @@
+#include <nabto/webrtc/device.hpp>
+#include <nabto/webrtc/util/coroutine.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Count heap allocations of the callback style and the coroutine style for
+ * the same signaling flow: request ICE servers, then receive a number of
+ * messages on a channel and send an acknowledged reply to each of them.
+ *
+ * The device and channel are minimal in-process fakes which complete
+ * requests synchronously, so only allocations made by the two application
+ * styles and the coroutine layer are counted.
+ */
+
+namespace {
+
+std::atomic<size_t> allocations{0};
+
+}  // namespace
+
+void* operator new(size_t size) {
+  allocations++;
+  void* ptr = std::malloc(size);  // NOLINT(cppcoreguidelines-no-malloc)
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);  // NOLINT(cppcoreguidelines-no-malloc)
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept {
+  std::free(ptr);  // NOLINT(cppcoreguidelines-no-malloc)
+}
+
+namespace {
+
+const size_t MESSAGES = 1000;
+
+class FakeChannel : public nabto::webrtc::SignalingChannel {
+ public:
+  nabto::webrtc::MessageListenerId addMessageListener(
+      nabto::webrtc::SignalingMessageHandler handler) override {
+    messageHandlers_[nextId_] = std::move(handler);
+    return nextId_++;
+  }
+  void removeMessageListener(nabto::webrtc::MessageListenerId id) override {
+    messageHandlers_.erase(id);
+  }
+  nabto::webrtc::ChannelStateListenerId addStateChangeListener(
+      nabto::webrtc::SignalingChannelStateHandler handler) override {
+    stateHandlers_[nextId_] = std::move(handler);
+    return nextId_++;
+  }
+  void removeStateChangeListener(
+      nabto::webrtc::ChannelStateListenerId id) override {
+    stateHandlers_.erase(id);
+  }
+  nabto::webrtc::ChannelErrorListenerId addErrorListener(
+      nabto::webrtc::SignalingErrorHandler /*handler*/) override {
+    return 0;
+  }
+  void removeErrorListener(
+      nabto::webrtc::ChannelErrorListenerId /*id*/) override {}
+  void sendMessage(const nlohmann::json& /*message*/) override { sent_++; }
+  void sendMessageWithAck(
+      const nlohmann::json& /*message*/,
+      nabto::webrtc::SignalingMessageAckHandler ackHandler) override {
+    sent_++;
+    ackHandler(true);
+  }
+  void sendError(const nabto::webrtc::SignalingError& /*error*/) override {}
+  void close() override {
+    auto handlers = stateHandlers_;
+    for (const auto& [id, handler] : handlers) {
+      handler(nabto::webrtc::SignalingChannelState::CLOSED);
+    }
+  }
+  std::string getChannelId() override { return "bench"; }
+
+  void deliver(const nlohmann::json& message) {
+    auto handlers = messageHandlers_;
+    for (const auto& [id, handler] : handlers) {
+      handler(message);
+    }
+  }
+
+  size_t sent_ = 0;
+
+ private:
+  uint32_t nextId_ = 0;
+  std::map<uint32_t, nabto::webrtc::SignalingMessageHandler> messageHandlers_;
+  std::map<uint32_t, nabto::webrtc::SignalingChannelStateHandler>
+      stateHandlers_;
+};
+
+class FakeDevice : public nabto::webrtc::SignalingDevice {
+ public:
+  void start() override {}
+  void close() override {}
+  void checkAlive() override {}
+  void requestIceServers(nabto::webrtc::IceServersResponse callback) override {
+    callback(servers_);
+  }
+  nabto::webrtc::NewChannelListenerId addNewChannelListener(
+      nabto::webrtc::NewSignalingChannelHandler /*handler*/) override {
+    return 0;
+  }
+  void removeNewChannelListener(
+      nabto::webrtc::NewChannelListenerId /*id*/) override {}
+  nabto::webrtc::ConnectionStateListenerId addStateChangeListener(
+      nabto::webrtc::SignalingDeviceStateHandler /*handler*/) override {
+    return 0;
+  }
+  void removeStateChangeListener(
+      nabto::webrtc::ConnectionStateListenerId /*id*/) override {}
+  nabto::webrtc::ReconnectListenerId addReconnectListener(
+      nabto::webrtc::SignalingReconnectHandler /*handler*/) override {
+    return 0;
+  }
+  void removeReconnectListener(
+      nabto::webrtc::ReconnectListenerId /*id*/) override {}
+
+  std::vector<nabto::webrtc::IceServer> servers_ = {
+      {"", "", {"stun:stun.nabto.net"}}};
+};
+
+/**
+ * Callback style as used in the examples: a context object owned through
+ * shared_ptr captured by each listener.
+ */
+class CallbackSession : public std::enable_shared_from_this<CallbackSession> {
+ public:
+  CallbackSession(nabto::webrtc::SignalingDevicePtr device,
+                  nabto::webrtc::SignalingChannelPtr channel)
+      : device_(std::move(device)), channel_(std::move(channel)) {}
+
+  void start() {
+    auto self = shared_from_this();
+    device_->requestIceServers(
+        [self](const std::vector<nabto::webrtc::IceServer>& servers) {
+          self->servers_ = servers.size();
+          self->channel_->addMessageListener(
+              [self](const nlohmann::json& message) {
+                self->channel_->sendMessageWithAck(
+                    message, [self](bool acked) {
+                      if (acked) {
+                        self->acked_++;
+                      }
+                    });
+              });
+        });
+  }
+
+  size_t servers_ = 0;
+  size_t acked_ = 0;
+
+ private:
+  nabto::webrtc::SignalingDevicePtr device_;
+  nabto::webrtc::SignalingChannelPtr channel_;
+};
+
+nabto::webrtc::util::Task<> coroutineSession(
+    nabto::webrtc::SignalingDevicePtr device,
+    nabto::webrtc::SignalingChannelPtr channel, size_t& acked) {
+  auto servers = co_await nabto::webrtc::util::requestIceServersAsync(device);
+  nabto::webrtc::util::ChannelMessageStream stream(channel);
+  while (auto message = co_await stream.nextMessage()) {
+    if (co_await nabto::webrtc::util::sendMessageAsync(channel,
+                                                       std::move(*message))) {
+      acked++;
+    }
+  }
+}
+
+void report(const std::string& name, size_t count, size_t acked) {
+  std::cout << name << count << " allocations, "
+            << static_cast<double>(count) / static_cast<double>(MESSAGES)
+            << " per message, " << acked << " acked" << std::endl;
+}
+
+}  // namespace
+
+int main() {
+  auto device = std::make_shared<FakeDevice>();
+  const nlohmann::json message = "ping";
+
+  {
+    auto channel = std::make_shared<FakeChannel>();
+    const size_t start = allocations;
+    auto session = std::make_shared<CallbackSession>(device, channel);
+    session->start();
+    for (size_t i = 0; i < MESSAGES; i++) {
+      channel->deliver(message);
+    }
+    channel->close();
+    report("callbacks:  ", allocations - start, session->acked_);
+  }
+
+  {
+    auto channel = std::make_shared<FakeChannel>();
+    size_t acked = 0;
+    const size_t start = allocations;
+    coroutineSession(device, channel, acked).start();
+    for (size_t i = 0; i < MESSAGES; i++) {
+      channel->deliver(message);
+    }
+    channel->close();
+    report("coroutines: ", allocations - start, acked);
+  }
+  return 0;
+}
@@ -0,0 +1,160 @@
+#include "../src/signaling_device/src/reconnect_backoff.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Simulate the attach load a fleet of devices puts on the backend when it
+ * restarts. All devices lose their websocket at time 0, the backend rejects
+ * attach requests during the outage, and afterwards accepts a limited number
+ * per second, answering the rest with 503 and a Retry-After header.
+ *
+ * The previous deterministic backoff is compared with the decorrelated
+ * jitter of ReconnectBackoff, with and without a reconnect hint sent by the
+ * backend before the planned restart. Time is simulated, so the run takes
+ * milliseconds.
+ */
+
+namespace {
+
+const size_t DEVICES = 10000;
+const uint64_t OUTAGE_MS = 30000;
+const size_t CAPACITY_PER_SECOND = 1000;
+const uint32_t RETRY_AFTER_MS = 5000;
+const uint32_t HINT_SPREAD_MS = 30000;
+const uint64_t BUCKET_MS = 5000;
+const uint64_t PROFILE_MS = 180000;
+const uint64_t MS_PER_SECOND = 1000;
+
+enum class Strategy { FIXED, JITTER, JITTER_HINT };
+
+/**
+ * The backoff used before ReconnectBackoff: 1s << n capped at 60s, the
+ * counter is never reset.
+ */
+class FixedBackoff {
+ public:
+  uint32_t nextDelayMs() {
+    const uint32_t oneMinuteInMs = 60000;
+    const size_t exponentialBackoffCap = 6;
+    uint32_t delay = oneMinuteInMs;
+    if (counter_ < exponentialBackoffCap) {
+      delay = MS_PER_SECOND * (static_cast<uint32_t>(1) << counter_);
+    }
+    counter_++;
+    return delay;
+  }
+
+ private:
+  size_t counter_ = 0;
+};
+
+struct Result {
+  std::map<uint64_t, size_t> attemptsPerBucket;
+  size_t peakPerSecond = 0;
+  size_t attempts = 0;
+  uint64_t allConnectedMs = 0;
+};
+
+Result simulate(Strategy strategy) {
+  std::vector<FixedBackoff> fixed(DEVICES);
+  std::vector<nabto::webrtc::ReconnectBackoff> jitter;
+  jitter.reserve(DEVICES);
+  // Each device seeds from its own random_device, emulated by a seed
+  // generator so runs are reproducible.
+  std::mt19937 seeds(1);
+  for (size_t i = 0; i < DEVICES; i++) {
+    jitter.emplace_back(static_cast<uint32_t>(seeds()));
+    if (strategy == Strategy::JITTER_HINT) {
+      jitter.back().setServerHint(OUTAGE_MS, HINT_SPREAD_MS);
+    }
+  }
+
+  using Event = std::pair<uint64_t, size_t>;
+  std::priority_queue<Event, std::vector<Event>, std::greater<>> events;
+  auto schedule = [&](uint64_t now, size_t device) {
+    const uint32_t delay = strategy == Strategy::FIXED
+                               ? fixed[device].nextDelayMs()
+                               : jitter[device].nextDelayMs();
+    events.emplace(now + delay, device);
+  };
+  for (size_t i = 0; i < DEVICES; i++) {
+    schedule(0, i);
+  }
+
+  Result result;
+  std::map<uint64_t, size_t> perSecond;
+  while (!events.empty()) {
+    auto [now, device] = events.top();
+    events.pop();
+    result.attempts++;
+    result.attemptsPerBucket[now / BUCKET_MS]++;
+    const size_t second = ++perSecond[now / MS_PER_SECOND];
+    result.peakPerSecond = std::max(result.peakPerSecond, second);
+
+    if (now < OUTAGE_MS) {
+      schedule(now, device);
+    } else if (second > CAPACITY_PER_SECOND) {
+      if (strategy != Strategy::FIXED) {
+        jitter[device].setServerHint(RETRY_AFTER_MS, RETRY_AFTER_MS / 2);
+      }
+      schedule(now, device);
+    } else {
+      result.allConnectedMs = now;
+    }
+  }
+  return result;
+}
+
+void report(const std::string& name, const Result& result) {
+  std::cout << name << ": " << result.attempts << " attach attempts, peak "
+            << result.peakPerSecond << "/s, all connected after "
+            << result.allConnectedMs / MS_PER_SECOND << " s" << std::endl;
+}
+
+}  // namespace
+
+int main() {
+  const std::vector<std::pair<std::string, Strategy>> strategies = {
+      {"fixed      ", Strategy::FIXED},
+      {"jitter     ", Strategy::JITTER},
+      {"jitter+hint", Strategy::JITTER_HINT}};
+
+  std::cout << DEVICES << " devices, " << OUTAGE_MS / MS_PER_SECOND
+            << " s outage, backend accepts " << CAPACITY_PER_SECOND
+            << " attaches/s" << std::endl;
+  std::vector<Result> results;
+  for (const auto& [name, strategy] : strategies) {
+    results.push_back(simulate(strategy));
+    report(name, results.back());
+  }
+
+  std::cout << std::endl << "attach attempts per " << BUCKET_MS / MS_PER_SECOND
+            << " s" << std::endl;
+  std::cout << "   time";
+  for (const auto& [name, strategy] : strategies) {
+    std::cout << std::setw(13) << name;
+  }
+  std::cout << std::endl;
+  for (uint64_t bucket = 0; bucket < PROFILE_MS / BUCKET_MS; bucket++) {
+    std::cout << std::setw(6) << bucket * BUCKET_MS / MS_PER_SECOND << "s";
+    for (const auto& result : results) {
+      auto it = result.attemptsPerBucket.find(bucket);
+      const size_t count =
+          it == result.attemptsPerBucket.end() ? 0 : it->second;
+      std::cout << std::setw(13) << count;
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
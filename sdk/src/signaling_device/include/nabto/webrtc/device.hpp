@@ -4,10 +4,15 @@
 
 #include <nlohmann/json.hpp>
 
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace nabto {
 namespace webrtc {
@@ -23,6 +28,9 @@ using SignalingChannelPtr = std::shared_ptr<SignalingChannel>;
 class SignalingWebsocket;
 using SignalingWebsocketPtr = std::shared_ptr<SignalingWebsocket>;
 
+class SignalingWebsocketServer;
+using SignalingWebsocketServerPtr = std::shared_ptr<SignalingWebsocketServer>;
+
 class SignalingHttpClient;
 using SignalingHttpClientPtr = std::shared_ptr<SignalingHttpClient>;
 
@@ -35,6 +43,72 @@ using SignalingTimerFactoryPtr = std::shared_ptr<SignalingTimerFactory>;
 class SignalingTokenGenerator;
 using SignalingTokenGeneratorPtr = std::shared_ptr<SignalingTokenGenerator>;
 
+class SignalingCallbackExecutor;
+using SignalingCallbackExecutorPtr =
+    std::shared_ptr<SignalingCallbackExecutor>;
+
+class SignalingStateStore;
+using SignalingStateStorePtr = std::shared_ptr<SignalingStateStore>;
+
+class SignalingCancellationToken;
+using SignalingCancellationTokenPtr =
+    std::shared_ptr<SignalingCancellationToken>;
+
+using CancelHandlerId = uint32_t;
+
+/**
+ * Token used to cancel an operation which is in progress, eg. a HTTP request.
+ * A token can be shared between several operations, cancelling it cancels all
+ * of them.
+ */
+class SignalingCancellationToken {
+ public:
+  /**
+   * Create a new token which is not cancelled.
+   *
+   * @return Smart pointer to the created token.
+   */
+  static SignalingCancellationTokenPtr create();
+
+  /**
+   * Cancel the token. Registered cancel handlers are invoked from this call.
+   * Calling cancel on a cancelled token does nothing.
+   */
+  void cancel();
+
+  /**
+   * Check if the token has been cancelled.
+   *
+   * @return true iff cancel() has been called.
+   */
+  bool isCancelled();
+
+  /**
+   * Add a handler to be invoked when the token is cancelled. If the token is
+   * already cancelled, the handler is invoked before this function returns.
+   *
+   * Operations must remove their handler once they finish so handlers do not
+   * accumulate on long lived tokens.
+   *
+   * @param handler The handler to invoke.
+   * @return ID of the handler, used to remove it again.
+   */
+  CancelHandlerId addCancelHandler(std::function<void()> handler);
+
+  /**
+   * Remove a cancel handler.
+   *
+   * @param id The ID of the handler to remove.
+   */
+  void removeCancelHandler(CancelHandlerId id);
+
+ private:
+  std::mutex mutex_;
+  bool cancelled_ = false;
+  CancelHandlerId nextId_ = 0;
+  std::vector<std::pair<CancelHandlerId, std::function<void()> > > handlers_;
+};
+
 /**
  * HTTP Request abstraction used by the SDK.
  */
@@ -58,6 +132,24 @@ class SignalingHttpRequest {
    * The body of the HTTP request.
    */
   std::string body;
+
+  /**
+   * Maximum time in milliseconds to spend establishing the connection,
+   * including DNS and TLS. 0 uses the default of the HTTP client.
+   */
+  uint32_t connectTimeoutMs = 0;
+
+  /**
+   * Maximum time in milliseconds the whole request may take. 0 uses the
+   * default of the HTTP client.
+   */
+  uint32_t timeoutMs = 0;
+
+  /**
+   * Optional token cancelling the request. Once the token is cancelled the
+   * client should abort the request and resolve its callback with nullptr.
+   */
+  SignalingCancellationTokenPtr cancellationToken;
 };
 
 /**
@@ -189,6 +281,10 @@ class SignalingHttpClient {
    * failed without a response. When statusCode = 0, the response string can be
    * empty or be an error message.
    *
+   * Clients should honor the timeouts and the cancellation token of the
+   * request. The callback must still be invoked exactly once for a request
+   * which timed out or was cancelled.
+   *
    * @param request The request to send.
    * @param callback callback to be invoked when the request is resolved.
    * @return true if the request was accepted.
@@ -258,6 +354,58 @@ class SignalingWebsocket {
    * @param url the URL to connect to.
    */
   virtual void open(const std::string& url) = 0;
+
+  /**
+   * Get the number of bytes queued for sending on the websocket.
+   *
+   * Together with onBufferedAmountLow() this lets the SDK keep the websocket
+   * send buffer short, so keep alive replies and acknowledgements are not
+   * queued behind large messages. The default reports an empty buffer, in
+   * which case all data is passed to send() at once.
+   *
+   * @return The number of bytes queued.
+   */
+  virtual size_t bufferedAmount() { return 0; }
+
+  /**
+   * set callback to be invoked when the number of bytes queued for sending
+   * drops to or below threshold. Must be implemented if bufferedAmount() is,
+   * and the callback must not be invoked from within send().
+   *
+   * @param threshold the number of bytes.
+   * @param callback the callback to set.
+   */
+  virtual void onBufferedAmountLow(size_t /*threshold*/,
+                                   std::function<void()> /*callback*/) {}
+};
+
+/**
+ * Websocket server abstraction for the optional local signaling listener, see
+ * SignalingDeviceConfig::localServer.
+ */
+class SignalingWebsocketServer {
+ public:
+  virtual ~SignalingWebsocketServer() = default;
+  SignalingWebsocketServer() = default;
+  SignalingWebsocketServer(const SignalingWebsocketServer&) = delete;
+  SignalingWebsocketServer& operator=(const SignalingWebsocketServer&) = delete;
+  SignalingWebsocketServer(SignalingWebsocketServer&&) = delete;
+  SignalingWebsocketServer& operator=(SignalingWebsocketServer&&) = delete;
+
+  /**
+   * set callback to be invoked when a client has connected. The websocket
+   * passed to the callback is open, the SDK never calls open() or onOpen() on
+   * it.
+   *
+   * @param callback the callback to set.
+   */
+  virtual void onConnection(
+      std::function<void(SignalingWebsocketPtr websocket)> callback) = 0;
+
+  /**
+   * Stop accepting connections.
+   */
+  virtual void close() = 0;
 };
 
 /**
@@ -278,6 +426,17 @@ class SignalingTimerFactory {
    * @return signaling timer pointer.
    */
   virtual SignalingTimerPtr createTimer() = 0;
+
+  /**
+   * Get the current time on the clock the timers run on. The SDK uses it to
+   * measure round trip times and idle periods. Override this together with
+   * createTimer() to run the SDK on a simulated clock.
+   *
+   * @return The current time.
+   */
+  virtual std::chrono::steady_clock::time_point now() {
+    return std::chrono::steady_clock::now();
+  }
 };
 
 /**
@@ -293,7 +452,9 @@ class SignalingTimer {
   SignalingTimer& operator=(SignalingTimer&&) = delete;
 
   /**
-   * Set a timeout in ms at which the callback should be invoked.
+   * Set a timeout in ms at which the callback should be invoked. Setting a
+   * new timeout on a timer with a pending timeout replaces the pending
+   * timeout. This may be called from within the callback.
    *
    * @param timeoutMs The timeout in milliseconds.
    * @param callback The callback to be invoked once the timeout has passed.
@@ -302,11 +463,37 @@ class SignalingTimer {
                           std::function<void()> callback) = 0;
 
   /**
-   * Cancel a started timer.
+   * Cancel a started timer. The SDK does not call this while holding locks
+   * its timer callbacks take, so implementations may wait for a running
+   * callback to finish.
    */
   virtual void cancel() = 0;
 };
 
+/**
+ * Executor the SDK uses to invoke listeners and callbacks registered by the
+ * application.
+ */
+class SignalingCallbackExecutor {
+ public:
+  virtual ~SignalingCallbackExecutor() = default;
+  SignalingCallbackExecutor() = default;
+  SignalingCallbackExecutor(const SignalingCallbackExecutor&) = delete;
+  SignalingCallbackExecutor& operator=(const SignalingCallbackExecutor&) =
+      delete;
+  SignalingCallbackExecutor(SignalingCallbackExecutor&&) = delete;
+  SignalingCallbackExecutor& operator=(SignalingCallbackExecutor&&) = delete;
+
+  /**
+   * Run a callback. The SDK posts callbacks in the order the events occurred.
+   * Implementations must run them in the order they are posted, and must not
+   * run them concurrently. Callbacks may be run from within post().
+   *
+   * @param callback The callback to run.
+   */
+  virtual void post(std::function<void()> callback) = 0;
+};
+
 /**
  * Token generator to create JWT tokens suitable for connecting to the Nabto
  * Backend.
@@ -329,6 +516,44 @@ class SignalingTokenGenerator {
   virtual bool generateToken(std::string& token) = 0;
 };
 
+/**
+ * Storage for the state a SignalingDevice reuses when the device process is
+ * restarted, eg. after a crash or an upgrade. The state holds the signaling
+ * URL of the last attach, the last access token and the last ICE servers with
+ * their expiry. With it a restarted device skips the attach and the token
+ * creation while they are still valid, and answers the first
+ * requestIceServers() call without a request to the backend.
+ *
+ * The state contains credentials, so it must be stored where only the device
+ * can read it.
+ */
+class SignalingStateStore {
+ public:
+  virtual ~SignalingStateStore() = default;
+  SignalingStateStore() = default;
+  SignalingStateStore(const SignalingStateStore&) = delete;
+  SignalingStateStore& operator=(const SignalingStateStore&) = delete;
+  SignalingStateStore(SignalingStateStore&&) = delete;
+  SignalingStateStore& operator=(SignalingStateStore&&) = delete;
+
+  /**
+   * Load the state saved by a previous run. Called once from
+   * SignalingDevice::start().
+   *
+   * @return The saved state or the empty string if nothing has been saved.
+   */
+  virtual std::string load() = 0;
+
+  /**
+   * Save the state, replacing the previously saved state. The SDK calls this
+   * each time the state changes, so the latest state is saved even if the
+   * process is not shut down cleanly.
+   *
+   * @param state The opaque state to save.
+   */
+  virtual void save(const std::string& state) = 0;
+};
+
 /**
  * States signaling device can be in.
  *
@@ -384,6 +609,18 @@ enum class SignalingChannelState : std::uint8_t {
  */
 std::string signalingChannelStateToString(SignalingChannelState state);
 
+/**
+ * Priority of a signaling message sent on a channel.
+ *
+ *  - NORMAL: The message is queued behind other channels' messages when the
+ *    websocket is congested.
+ *  - HIGH: The message is sent ahead of NORMAL messages, eg. the first offer
+ *    of a channel so connection setup is not delayed by other channels.
+ *    Messages of a channel are always delivered in order, so earlier queued
+ *    messages of the same channel are sent along with it.
+ */
+enum class SignalingMessagePriority : std::uint8_t { NORMAL, HIGH };
+
 /**
  * struct representing an ICE server returned by the Nabto Backend.
  */
@@ -452,6 +689,15 @@ using SignalingReconnectHandler = std::function<void(void)>;
  */
 using SignalingErrorHandler = std::function<void(const SignalingError& error)>;
 
+/**
+ * Callback function definition when a message sent with
+ * SignalingChannel::sendMessageWithAck() is resolved.
+ *
+ * @param acked True if the client acknowledged the message. False if the
+ * channel was closed or failed before the message was acknowledged.
+ */
+using SignalingMessageAckHandler = std::function<void(bool acked)>;
+
 /**
  * Callback function definition when a new ICE servers response is received.
  *
@@ -510,6 +756,59 @@ struct SignalingDeviceConfig {
    * Timer factory implementation the SDK can use to create timers.
    */
   SignalingTimerFactoryPtr timerFactory;
+
+  /**
+   * Optional keep alive interval in milliseconds. If non-zero, the SDK pings
+   * the Nabto Signaling Service when no messages have been received on the
+   * websocket for this long. The pong timeout is derived from the measured
+   * round trip time. If zero (default), liveness is only checked when
+   * SignalingDevice::checkAlive() is called.
+   */
+  uint32_t keepAliveIntervalMs = 0;
+
+  /**
+   * Optional executor used to invoke all device and channel listeners and the
+   * requestIceServers() callback. This allows an application to have all SDK
+   * events delivered on its own event loop. If not set, callbacks are invoked
+   * directly on the thread which produced the event.
+   */
+  SignalingCallbackExecutorPtr callbackExecutor;
+
+  /**
+   * Optional store for state which speeds up connecting after the device
+   * process is restarted. See SignalingStateStore.
+   */
+  SignalingStateStorePtr stateStore;
+
+  /**
+   * Optional list of signaling URLs, eg. one per region. If not empty, it is
+   * used instead of signalingUrl. The SDK attaches to the endpoints in
+   * parallel with a staggered start and connects through the first one to
+   * answer. While connected, the round trip time to each endpoint is measured
+   * every few minutes, and the SDK reconnects through another endpoint if it
+   * has become markedly faster than the one in use.
+   */
+  std::vector<std::string> signalingUrls;
+
+  /**
+   * Optional local signaling listener. If set, viewers on the same network
+   * can connect directly to the device instead of through the Nabto
+   * Signaling Service. Clients send the same MESSAGE and ERROR messages as
+   * the service and can send PING to check the connection.
+   *
+   * When a channel is created the device sends the client a PEER_CONNECTED
+   * message with a reconnectToken for the channel. A client which lost its
+   * connection continues the channel on a new one by including the token in
+   * its messages. Messages for a channel connected through another
+   * connection, or without the right token, are answered with an
+   * ACCESS_DENIED error.
+   *
+   * Channels from local clients are passed to the new channel listeners with
+   * authorized set to false, as they have not been authorized by the Nabto
+   * backend, and SignalingChannel::isLocal() returning true. Use shared
+   * secret message signing to authorize them.
+   */
+  SignalingWebsocketServerPtr localServer;
 };
 
 /**
@@ -526,6 +825,33 @@ class SignalingDeviceFactory {
   static SignalingDevicePtr create(const SignalingDeviceConfig& conf);
 };
 
+/**
+ * Round trip time statistics of the websocket connection to the Nabto
+ * Signaling Service measured from PING/PONG exchanges.
+ */
+struct SignalingRttStats {
+  /**
+   * Smoothed round trip time in milliseconds.
+   */
+  uint32_t srttMs = 0;
+
+  /**
+   * Round trip time variance in milliseconds.
+   */
+  uint32_t rttVarMs = 0;
+
+  /**
+   * Most recent round trip time sample in milliseconds.
+   */
+  uint32_t lastRttMs = 0;
+
+  /**
+   * Number of samples measured on the current connection. If zero, the other
+   * fields are not valid.
+   */
+  size_t samples = 0;
+};
+
 using NewChannelListenerId = uint32_t;
 using ConnectionStateListenerId = uint32_t;
 using ReconnectListenerId = uint32_t;
@@ -563,6 +889,16 @@ class SignalingDevice {
    */
   virtual void checkAlive() = 0;
 
+  /**
+   * Get the round trip time statistics of the current websocket connection.
+   *
+   * The default implementation returns empty statistics.
+   *
+   * @return The statistics, samples is zero if no PONG has been received on
+   * the current connection.
+   */
+  virtual SignalingRttStats getRttStats() { return {}; }
+
   /**
    * Request ICE servers from the Nabto Backend.
    *
@@ -694,6 +1030,38 @@ class SignalingChannel {
    */
   virtual void sendMessage(const nlohmann::json& message) = 0;
 
+  /**
+   * Send a signaling message to the client and get notified when the client
+   * has acknowledged it.
+   *
+   * The default implementation is for channels which do not track
+   * acknowledgements. It sends the message with sendMessage() and invokes the
+   * handler with true at once.
+   *
+   * @param message The message to send.
+   * @param ackHandler Handler invoked once when the message is acknowledged
+   * or can no longer be delivered.
+   */
+  virtual void sendMessageWithAck(const nlohmann::json& message,
+                                  SignalingMessageAckHandler ackHandler) {
+    sendMessage(message);
+    if (ackHandler) {
+      ackHandler(true);
+    }
+  }
+
+  /**
+   * Send a signaling message to the client with the given priority, see
+   * SignalingMessagePriority.
+   *
+   * @param message The message to send.
+   * @param priority The priority of the message.
+   */
+  virtual void sendMessageWithPriority(
+      const nlohmann::json& message, SignalingMessagePriority /*priority*/) {
+    sendMessage(message);
+  }
+
   /**
    * Send a signaling error to the client.
    *
@@ -715,6 +1083,14 @@ class SignalingChannel {
    * @return The channel ID string.
    */
   virtual std::string getChannelId() = 0;
+
+  /**
+   * Check if the client connected through the local signaling listener, see
+   * SignalingDeviceConfig::localServer.
+   *
+   * @return True if the channel is local.
+   */
+  virtual bool isLocal() { return false; }
 };
 
 }  // namespace webrtc
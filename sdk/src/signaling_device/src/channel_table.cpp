@@ -0,0 +1,132 @@
+#include "channel_table.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nabto {
+namespace webrtc {
+
+ChannelKey::ChannelKey(const std::string& id)
+    : hash_(hashBytes(id.data(), id.size())), size_(id.size()) {
+  if (size_ <= INLINE_CAPACITY) {
+    std::memcpy(inline_.data(), id.data(), size_);
+  } else {
+    heap_ = id;
+  }
+}
+
+bool ChannelKey::operator==(const ChannelKey& other) const {
+  return hash_ == other.hash_ && size_ == other.size_ &&
+         std::memcmp(data(), other.data(), size_) == 0;
+}
+
+uint64_t ChannelKey::hashBytes(const char* data, size_t size) {
+  // 64 bit FNV-1a
+  const uint64_t fnvOffsetBasis = 14695981039346656037ULL;
+  const uint64_t fnvPrime = 1099511628211ULL;
+  uint64_t hash = fnvOffsetBasis;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= fnvPrime;
+  }
+  return hash;
+}
+
+bool ChannelTable::insert(const ChannelKey& key,
+                          SignalingChannelImplPtr channel) {
+  // Keep the load factor below 3/4
+  const size_t loadNumerator = 4;
+  const size_t loadDenominator = 3;
+  if ((size_ + 1) * loadNumerator > slots_.size() * loadDenominator) {
+    grow();
+  }
+  size_t index = key.hash() & mask();
+  while (slots_[index].channel) {
+    if (slots_[index].key == key) {
+      return false;
+    }
+    index = (index + 1) & mask();
+  }
+  slots_[index].key = key;
+  slots_[index].channel = std::move(channel);
+  size_++;
+  return true;
+}
+
+SignalingChannelImplPtr ChannelTable::find(const ChannelKey& key) const {
+  const size_t index = findSlot(key);
+  if (index == slots_.size()) {
+    return nullptr;
+  }
+  return slots_[index].channel;
+}
+
+bool ChannelTable::erase(const ChannelKey& key) {
+  size_t hole = findSlot(key);
+  if (hole == slots_.size()) {
+    return false;
+  }
+  // Backward shift deletion: move following entries of the probe sequence
+  // into the hole until we reach an empty slot or an entry which already is
+  // at its ideal position.
+  size_t next = hole;
+  while (true) {
+    next = (next + 1) & mask();
+    if (!slots_[next].channel) {
+      break;
+    }
+    const size_t ideal = slots_[next].key.hash() & mask();
+    const bool idealInRange = (hole <= next) ? (hole < ideal && ideal <= next)
+                                             : (hole < ideal || ideal <= next);
+    if (!idealInRange) {
+      slots_[hole] = std::move(slots_[next]);
+      hole = next;
+    }
+  }
+  slots_[hole] = Slot();
+  size_--;
+  return true;
+}
+
+void ChannelTable::clear() {
+  slots_.clear();
+  size_ = 0;
+}
+
+size_t ChannelTable::findSlot(const ChannelKey& key) const {
+  if (size_ == 0) {
+    return slots_.size();
+  }
+  size_t index = key.hash() & mask();
+  while (slots_[index].channel) {
+    if (slots_[index].key == key) {
+      return index;
+    }
+    index = (index + 1) & mask();
+  }
+  return slots_.size();
+}
+
+void ChannelTable::grow() {
+  const size_t capacity = slots_.empty() ? MIN_CAPACITY : slots_.size() * 2;
+  std::vector<Slot> old(capacity);
+  old.swap(slots_);
+  size_ = 0;
+  for (auto& slot : old) {
+    if (slot.channel) {
+      size_t index = slot.key.hash() & mask();
+      while (slots_[index].channel) {
+        index = (index + 1) & mask();
+      }
+      slots_[index] = std::move(slot);
+      size_++;
+    }
+  }
+}
+
+}  // namespace webrtc
+}  // namespace nabto
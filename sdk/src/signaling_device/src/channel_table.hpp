@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nabto {
+namespace webrtc {
+
+class SignalingChannelImpl;
+using SignalingChannelImplPtr = std::shared_ptr<SignalingChannelImpl>;
+
+/**
+ * Channel ID used as key in the ChannelTable.
+ *
+ * The hash is computed once when the key is created, so build one key per
+ * incoming message and reuse it for the lookup and any insert. Each channel
+ * keeps its own key for removing it from the table when it closes. IDs up to
+ * INLINE_CAPACITY bytes (which covers the UUID sized IDs used by the backend)
+ * are stored inline, longer IDs fall back to a heap allocated string.
+ */
+class ChannelKey {
+ public:
+  static constexpr size_t INLINE_CAPACITY = 47;
+
+  ChannelKey() = default;
+  explicit ChannelKey(const std::string& id);
+
+  uint64_t hash() const { return hash_; }
+  size_t size() const { return size_; }
+  const char* data() const {
+    return size_ <= INLINE_CAPACITY ? inline_.data() : heap_.data();
+  }
+  std::string str() const { return {data(), size_}; }
+
+  bool operator==(const ChannelKey& other) const;
+  bool operator!=(const ChannelKey& other) const { return !(*this == other); }
+
+  static uint64_t hashBytes(const char* data, size_t size);
+
+ private:
+  uint64_t hash_ = 0;
+  size_t size_ = 0;
+  std::array<char, INLINE_CAPACITY> inline_{};
+  std::string heap_;
+};
+
+/**
+ * Open addressing hash table mapping channel IDs to channels.
+ *
+ * Linear probing with backward shift deletion, so lookups never have to skip
+ * tombstones. The table is not synchronized, the owner must guard it with its
+ * own mutex. Lookups return a copy of the channel pointer so the channel can
+ * be used after the lock has been released.
+ */
+class ChannelTable {
+ public:
+  ChannelTable() = default;
+
+  /**
+   * Insert a channel. Returns false if the ID is already in the table.
+   */
+  bool insert(const ChannelKey& key, SignalingChannelImplPtr channel);
+
+  /**
+   * Find a channel. Returns nullptr if the ID is not in the table.
+   */
+  SignalingChannelImplPtr find(const ChannelKey& key) const;
+
+  /**
+   * Remove a channel. Returns false if the ID was not in the table.
+   */
+  bool erase(const ChannelKey& key);
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  void clear();
+
+  /**
+   * Invoke fn(const ChannelKey&, const SignalingChannelImplPtr&) for each
+   * channel in the table. The table must not be modified from fn.
+   */
+  template <typename F>
+  void forEach(F fn) const {
+    for (const auto& slot : slots_) {
+      if (slot.channel) {
+        fn(slot.key, slot.channel);
+      }
+    }
+  }
+
+ private:
+  struct Slot {
+    ChannelKey key;
+    SignalingChannelImplPtr channel;
+  };
+
+  static constexpr size_t MIN_CAPACITY = 16;
+  std::vector<Slot> slots_;
+  size_t size_ = 0;
+
+  size_t mask() const { return slots_.size() - 1; }
+  size_t findSlot(const ChannelKey& key) const;
+  void grow();
+};
+
+}  // namespace webrtc
+}  // namespace nabto
@@ -0,0 +1,124 @@
+#include "endpoint_selector.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Weight of a new sample in the smoothed round trip time, as probes are
+// minutes apart old samples are given less weight than in RFC 6298.
+const uint32_t SAMPLE_WEIGHT_INV = 4;
+const uint32_t PERCENT = 100;
+
+}  // namespace
+
+namespace nabto {
+namespace webrtc {
+
+EndpointSelector::EndpointSelector(const std::vector<std::string>& urls) {
+  for (const auto& url : urls) {
+    endpoints_.push_back({url, std::nullopt});
+  }
+}
+
+std::vector<std::string> EndpointSelector::raceOrder() const {
+  std::vector<const Endpoint*> sorted;
+  sorted.reserve(endpoints_.size());
+  for (const auto& endpoint : endpoints_) {
+    sorted.push_back(&endpoint);
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Endpoint* a, const Endpoint* b) {
+                     if (a->srttMs.has_value() && b->srttMs.has_value()) {
+                       return *a->srttMs < *b->srttMs;
+                     }
+                     return a->srttMs.has_value() && !b->srttMs.has_value();
+                   });
+  std::vector<std::string> result;
+  result.reserve(sorted.size());
+  for (const auto* endpoint : sorted) {
+    result.push_back(endpoint->url);
+  }
+  return result;
+}
+
+void EndpointSelector::setCurrent(const std::string& url) {
+  for (size_t i = 0; i < endpoints_.size(); i++) {
+    if (endpoints_[i].url == url) {
+      current_ = i;
+      return;
+    }
+  }
+}
+
+void EndpointSelector::addSample(const std::string& url, uint32_t rttMs) {
+  auto* endpoint = find(url);
+  if (endpoint == nullptr) {
+    return;
+  }
+  if (endpoint->srttMs.has_value()) {
+    const uint32_t srtt = *endpoint->srttMs;
+    endpoint->srttMs =
+        srtt - (srtt / SAMPLE_WEIGHT_INV) + (rttMs / SAMPLE_WEIGHT_INV);
+  } else {
+    endpoint->srttMs = rttMs;
+  }
+}
+
+void EndpointSelector::addFailure(const std::string& url) {
+  auto* endpoint = find(url);
+  if (endpoint != nullptr) {
+    endpoint->srttMs.reset();
+  }
+}
+
+std::optional<uint32_t> EndpointSelector::rttMs(const std::string& url) const {
+  for (const auto& endpoint : endpoints_) {
+    if (endpoint.url == url) {
+      return endpoint.srttMs;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<std::string> EndpointSelector::fasterEndpoint() const {
+  const auto& current = endpoints_[current_];
+  if (!current.srttMs.has_value()) {
+    return std::nullopt;
+  }
+  const uint32_t currentMs = *current.srttMs;
+  const Endpoint* best = nullptr;
+  for (const auto& endpoint : endpoints_) {
+    if (!endpoint.srttMs.has_value() || &endpoint == &current) {
+      continue;
+    }
+    if (best == nullptr || *endpoint.srttMs < *best->srttMs) {
+      best = &endpoint;
+    }
+  }
+  if (best == nullptr || *best->srttMs >= currentMs) {
+    return std::nullopt;
+  }
+  const uint32_t gain = currentMs - *best->srttMs;
+  if (gain < FAILOVER_MIN_GAIN_MS ||
+      gain * PERCENT < currentMs * FAILOVER_MIN_GAIN_PERCENT) {
+    return std::nullopt;
+  }
+  return best->url;
+}
+
+EndpointSelector::Endpoint* EndpointSelector::find(const std::string& url) {
+  for (auto& endpoint : endpoints_) {
+    if (endpoint.url == url) {
+      return &endpoint;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace webrtc
+}  // namespace nabto
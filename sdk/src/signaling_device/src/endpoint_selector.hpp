@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace nabto {
+namespace webrtc {
+
+/**
+ * Round trip times of the candidate signaling endpoints, used to race the
+ * attach against the endpoints and to fail over to an endpoint which has
+ * become markedly faster than the one in use.
+ *
+ * Not thread safe, the SignalingDeviceImpl uses it under its mutex.
+ */
+class EndpointSelector {
+ public:
+  // Delay between starting the attach against one endpoint and the next,
+  // unless the previous attach fails first.
+  static constexpr uint32_t STAGGER_MS = 250;
+  // Interval between round trip probes of all endpoints while connected.
+  static constexpr uint32_t PROBE_INTERVAL_MS = 300000;
+  // Another endpoint is only switched to when it is faster by both of these,
+  // so jitter does not make the device move back and forth.
+  static constexpr uint32_t FAILOVER_MIN_GAIN_MS = 50;
+  static constexpr uint32_t FAILOVER_MIN_GAIN_PERCENT = 30;
+
+  explicit EndpointSelector(const std::vector<std::string>& urls);
+
+  size_t size() const { return endpoints_.size(); }
+
+  /**
+   * Get the endpoints in the order an attach should try them. Endpoints with
+   * a measured round trip time come first, fastest first, the others keep
+   * their configured order.
+   */
+  std::vector<std::string> raceOrder() const;
+
+  const std::string& current() const { return endpoints_[current_].url; }
+  void setCurrent(const std::string& url);
+
+  /**
+   * Add a round trip time measured against an endpoint.
+   */
+  void addSample(const std::string& url, uint32_t rttMs);
+
+  /**
+   * The endpoint could not be reached, forget its round trip time.
+   */
+  void addFailure(const std::string& url);
+
+  std::optional<uint32_t> rttMs(const std::string& url) const;
+
+  /**
+   * Get an endpoint which is markedly faster than the current endpoint.
+   *
+   * @return The endpoint to fail over to or std::nullopt.
+   */
+  std::optional<std::string> fasterEndpoint() const;
+
+ private:
+  struct Endpoint {
+    std::string url;
+    std::optional<uint32_t> srttMs;
+  };
+
+  Endpoint* find(const std::string& url);
+
+  std::vector<Endpoint> endpoints_;
+  size_t current_ = 0;
+};
+
+}  // namespace webrtc
+}  // namespace nabto
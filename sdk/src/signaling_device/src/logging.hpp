@@ -4,10 +4,22 @@
 
 #include <nabto/webrtc/device.hpp>
 
-#define NABTO_SIGNALING_LOGV PLOGV_(nabto::webrtc::SIGNALING_LOGGER_INSTANCE_ID)
-#define NABTO_SIGNALING_LOGD PLOGD_(nabto::webrtc::SIGNALING_LOGGER_INSTANCE_ID)
-#define NABTO_SIGNALING_LOGI PLOGI_(nabto::webrtc::SIGNALING_LOGGER_INSTANCE_ID)
-#define NABTO_SIGNALING_LOGW PLOGW_(nabto::webrtc::SIGNALING_LOGGER_INSTANCE_ID)
-#define NABTO_SIGNALING_LOGE PLOGE_(nabto::webrtc::SIGNALING_LOGGER_INSTANCE_ID)
-#define NABTO_SIGNALING_LOGF PLOGF_(nabto::webrtc::SIGNALING_LOGGER_INSTANCE_ID)
-#define NABTO_SIGNALING_LOGN PLOGN_(nabto::webrtc::SIGNALING_LOGGER_INSTANCE_ID)
+// Log statements less severe than this plog::Severity are compiled out. Set
+// from the NABTO_SIGNALING_MIN_LOG_LEVEL CMake option.
+#ifndef NABTO_SIGNALING_MIN_LOG_LEVEL
+#define NABTO_SIGNALING_MIN_LOG_LEVEL 6
+#endif
+
+#define NABTO_SIGNALING_LOG_(severity)                                 \
+  if constexpr (static_cast<int>(severity) >                           \
+                NABTO_SIGNALING_MIN_LOG_LEVEL) {                       \
+  } else                                                               \
+    PLOG_(nabto::webrtc::SIGNALING_LOGGER_INSTANCE_ID, severity)
+
+#define NABTO_SIGNALING_LOGV NABTO_SIGNALING_LOG_(plog::verbose)
+#define NABTO_SIGNALING_LOGD NABTO_SIGNALING_LOG_(plog::debug)
+#define NABTO_SIGNALING_LOGI NABTO_SIGNALING_LOG_(plog::info)
+#define NABTO_SIGNALING_LOGW NABTO_SIGNALING_LOG_(plog::warning)
+#define NABTO_SIGNALING_LOGE NABTO_SIGNALING_LOG_(plog::error)
+#define NABTO_SIGNALING_LOGF NABTO_SIGNALING_LOG_(plog::fatal)
+#define NABTO_SIGNALING_LOGN NABTO_SIGNALING_LOG_(plog::none)
@@ -0,0 +1,59 @@
+#include "outbound_queue.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nabto {
+namespace webrtc {
+
+void OutboundQueue::push(SendPriority priority, std::string data,
+                         const std::string& channel, bool ordered) {
+  const auto lane = static_cast<size_t>(priority);
+  if (ordered && !channel.empty()) {
+    // Move earlier frames of the channel up from the lower lanes, oldest
+    // first, so the channel is still delivered in order.
+    std::vector<Frame> earlier;
+    for (size_t i = lane + 1; i < LANES; i++) {
+      auto& frames = lanes_[i];
+      auto moved = std::stable_partition(
+          frames.begin(), frames.end(),
+          [&channel](const Frame& frame) { return frame.channel != channel; });
+      std::move(moved, frames.end(), std::back_inserter(earlier));
+      frames.erase(moved, frames.end());
+    }
+    std::sort(earlier.begin(), earlier.end(),
+              [](const Frame& a, const Frame& b) { return a.seq < b.seq; });
+    for (auto& frame : earlier) {
+      lanes_[lane].push_back(std::move(frame));
+    }
+  }
+  lanes_[lane].push_back({nextSeq_++, std::move(data), channel});
+  size_++;
+}
+
+std::optional<std::string> OutboundQueue::pop() {
+  for (auto& frames : lanes_) {
+    if (!frames.empty()) {
+      auto data = std::move(frames.front().data);
+      frames.pop_front();
+      size_--;
+      return data;
+    }
+  }
+  return std::nullopt;
+}
+
+void OutboundQueue::clear() {
+  for (auto& frames : lanes_) {
+    frames.clear();
+  }
+  size_ = 0;
+}
+
+}  // namespace webrtc
+}  // namespace nabto
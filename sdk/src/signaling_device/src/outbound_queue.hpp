@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+
+namespace nabto {
+namespace webrtc {
+
+/**
+ * Lanes of the outbound websocket queue, highest priority first.
+ *
+ *  - CONTROL: PING, PONG and ERROR, the backend times the device out if keep
+ *    alive replies are late.
+ *  - ACK: Acknowledgements, and channel messages sent with high priority.
+ *  - DATA: Channel messages, eg. SDP.
+ */
+enum class SendPriority : std::uint8_t { CONTROL, ACK, DATA };
+
+/**
+ * Frames waiting for room in the websocket send buffer, sent in priority
+ * order.
+ *
+ * Frames of a channel can be ordered, an ordered frame never overtakes
+ * earlier frames of the same channel. When an ordered frame is pushed to a
+ * lane above such earlier frames, they are moved along to the same lane ahead
+ * of it. Acknowledgements are unordered, the receiver accepts them at any
+ * time.
+ *
+ * Not thread safe, the WebsocketConnection uses it under its mutex.
+ */
+class OutboundQueue {
+ public:
+  void push(SendPriority priority, std::string data,
+            const std::string& channel, bool ordered);
+
+  /**
+   * Get the next frame to send.
+   *
+   * @return The frame or std::nullopt if the queue is empty.
+   */
+  std::optional<std::string> pop();
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  void clear();
+
+ private:
+  struct Frame {
+    uint64_t seq;
+    std::string data;
+    std::string channel;
+  };
+
+  static constexpr size_t LANES = 3;
+  std::array<std::deque<Frame>, LANES> lanes_;
+  size_t size_ = 0;
+  uint64_t nextSeq_ = 0;
+};
+
+}  // namespace webrtc
+}  // namespace nabto
@@ -0,0 +1,89 @@
+#include "reconnect_backoff.hpp"
+
+#include <nabto/webrtc/device.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <random>
+#include <string>
+
+namespace {
+
+const int HTTP_TOO_MANY_REQUESTS = 429;
+const int HTTP_SERVICE_UNAVAILABLE = 503;
+const uint32_t MS_PER_SECOND = 1000;
+
+bool equalsIgnoreCase(const std::string& a, const std::string& b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           return std::tolower(static_cast<unsigned char>(x)) ==
+                  std::tolower(static_cast<unsigned char>(y));
+         });
+}
+
+}  // namespace
+
+namespace nabto {
+namespace webrtc {
+
+uint32_t ReconnectBackoff::nextDelayMs() {
+  uint32_t delay = 0;
+  if (hintMinMs_.has_value()) {
+    // Both parts are capped by setServerHint, so the sum cannot overflow.
+    delay = uniform(*hintMinMs_, *hintMinMs_ + hintSpreadMs_);
+    hintMinMs_.reset();
+  } else {
+    delay = uniform(BASE_DELAY_MS, std::min(previousMs_ * 3, MAX_DELAY_MS));
+  }
+  previousMs_ = std::clamp(delay, BASE_DELAY_MS, MAX_DELAY_MS);
+  return delay;
+}
+
+void ReconnectBackoff::reset() { previousMs_ = BASE_DELAY_MS; }
+
+void ReconnectBackoff::setServerHint(uint32_t minDelayMs, uint32_t spreadMs) {
+  hintMinMs_ = std::min(minDelayMs, MAX_SERVER_DELAY_MS);
+  hintSpreadMs_ = std::min(spreadMs, MAX_DELAY_MS);
+}
+
+std::optional<uint32_t> ReconnectBackoff::retryAfterMs(
+    const SignalingHttpResponse& response) {
+  if (response.statusCode != HTTP_TOO_MANY_REQUESTS &&
+      response.statusCode != HTTP_SERVICE_UNAVAILABLE) {
+    return std::nullopt;
+  }
+  for (const auto& [name, value] : response.headers) {
+    if (!equalsIgnoreCase(name, "Retry-After")) {
+      continue;
+    }
+    if (value.empty() || !std::all_of(value.begin(), value.end(), [](char c) {
+          return std::isdigit(static_cast<unsigned char>(c)) != 0;
+        })) {
+      // HTTP-date values are not supported.
+      return std::nullopt;
+    }
+    try {
+      const uint64_t seconds = std::min<uint64_t>(
+          std::stoull(value), MAX_SERVER_DELAY_MS / MS_PER_SECOND);
+      return static_cast<uint32_t>(seconds * MS_PER_SECOND);
+    } catch (std::exception& ex) {
+      // Out of range, the backend wants the longest delay we honor.
+      return MAX_SERVER_DELAY_MS;
+    }
+  }
+  return std::nullopt;
+}
+
+uint32_t ReconnectBackoff::uniform(uint32_t low, uint32_t high) {
+  if (high <= low) {
+    return low;
+  }
+  std::uniform_int_distribution<uint32_t> dist(low, high);
+  return dist(rng_);
+}
+
+}  // namespace webrtc
+}  // namespace nabto
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <nabto/webrtc/device.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <random>
+
+namespace nabto {
+namespace webrtc {
+
+/**
+ * Delay between reconnect attempts using decorrelated jitter, each delay is
+ * drawn uniformly between the base delay and three times the previous delay,
+ * capped at the max delay. Devices disconnected at the same time, eg. by a
+ * backend restart, thereby spread their attempts instead of reconnecting in
+ * synchronized waves.
+ *
+ * The backend can ask for a minimum delay through a Retry-After header on the
+ * attach response or a reconnect hint on the websocket. The next delay then
+ * honors the minimum and adds a random part so the devices are still spread.
+ *
+ * Not thread safe, the SignalingDeviceImpl uses it under its mutex.
+ */
+class ReconnectBackoff {
+ public:
+  static constexpr uint32_t BASE_DELAY_MS = 1000;
+  static constexpr uint32_t MAX_DELAY_MS = 60000;
+  // Longest server requested delay which is honored.
+  static constexpr uint32_t MAX_SERVER_DELAY_MS = 3600000;
+  // Spread used when the backend does not specify one.
+  static constexpr uint32_t DEFAULT_SPREAD_MS = 10000;
+
+  ReconnectBackoff() : ReconnectBackoff(std::random_device()()) {}
+  explicit ReconnectBackoff(uint32_t seed) : rng_(seed) {}
+
+  /**
+   * Get the delay before the next reconnect attempt. Consumes a pending
+   * server hint.
+   */
+  uint32_t nextDelayMs();
+
+  /**
+   * The device connected, the next delay starts over from the base delay.
+   */
+  void reset();
+
+  /**
+   * Set a delay requested by the backend for the next attempt.
+   *
+   * @param minDelayMs The next attempt is made no earlier than this.
+   * @param spreadMs Window after minDelayMs the attempt is spread randomly
+   * over.
+   */
+  void setServerHint(uint32_t minDelayMs, uint32_t spreadMs);
+
+  /**
+   * Get the delay requested by a Retry-After header on a 429 or 503 response.
+   * Only the delay-seconds form of the header is supported.
+   *
+   * @param response The response to inspect.
+   * @return The delay in milliseconds if the response had one.
+   */
+  static std::optional<uint32_t> retryAfterMs(
+      const SignalingHttpResponse& response);
+
+ private:
+  uint32_t uniform(uint32_t low, uint32_t high);
+
+  std::minstd_rand rng_;
+  uint32_t previousMs_ = BASE_DELAY_MS;
+  std::optional<uint32_t> hintMinMs_;
+  uint32_t hintSpreadMs_ = 0;
+};
+
+}  // namespace webrtc
+}  // namespace nabto
@@ -0,0 +1,62 @@
+#include <nabto/webrtc/device.hpp>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace nabto {
+namespace webrtc {
+
+SignalingCancellationTokenPtr SignalingCancellationToken::create() {
+  return std::make_shared<SignalingCancellationToken>();
+}
+
+void SignalingCancellationToken::cancel() {
+  std::vector<std::pair<CancelHandlerId, std::function<void()> > > handlers;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (cancelled_) {
+      return;
+    }
+    cancelled_ = true;
+    std::swap(handlers, handlers_);
+  }
+  for (const auto& [id, handler] : handlers) {
+    handler();
+  }
+}
+
+bool SignalingCancellationToken::isCancelled() {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return cancelled_;
+}
+
+CancelHandlerId SignalingCancellationToken::addCancelHandler(
+    std::function<void()> handler) {
+  CancelHandlerId id = 0;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    id = nextId_++;
+    if (!cancelled_) {
+      handlers_.emplace_back(id, std::move(handler));
+      return id;
+    }
+  }
+  handler();
+  return id;
+}
+
+void SignalingCancellationToken::removeCancelHandler(CancelHandlerId id) {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = handlers_.begin(); it != handlers_.end(); it++) {
+    if (it->first == id) {
+      handlers_.erase(it);
+      return;
+    }
+  }
+}
+
+}  // namespace webrtc
+}  // namespace nabto
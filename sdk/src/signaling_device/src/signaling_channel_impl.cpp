@@ -9,23 +9,38 @@
 
 #include <cstdint>
 #include <exception>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace nabto {
 namespace webrtc {
 
 SignalingChannelImplPtr SignalingChannelImpl::create(
     SignalingDeviceImplPtr signaler, const std::string& channelId) {
-  return std::make_shared<SignalingChannelImpl>(std::move(signaler), channelId);
+  return std::make_shared<SignalingChannelImpl>(std::move(signaler), channelId,
+                                                channelId, false);
+}
+
+SignalingChannelImplPtr SignalingChannelImpl::createLocal(
+    SignalingDeviceImplPtr signaler, const std::string& channelId,
+    const std::string& key) {
+  return std::make_shared<SignalingChannelImpl>(std::move(signaler), channelId,
+                                                key, true);
 }
 
 SignalingChannelImpl::SignalingChannelImpl(SignalingDeviceImplPtr signaler,
-                                           std::string channelId)
-    : signaler_(std::move(signaler)), channelId_(std::move(channelId)) {}
+                                           std::string channelId,
+                                           std::string key, bool local)
+    : signaler_(std::move(signaler)),
+      channelId_(std::move(channelId)),
+      key_(std::move(key)),
+      tableKey_(key_),
+      local_(local) {}
 
 void SignalingChannelImpl::handleMessage(const nlohmann::json& msg) {
   try {
@@ -34,14 +49,17 @@ void SignalingChannelImpl::handleMessage(const nlohmann::json& msg) {
       NABTO_SIGNALING_LOGD << "Handling DATA";
       sendAck(msg);
       const auto& str = msg.at("data");
-      std::map<MessageListenerId, SignalingMessageHandler> messageHandlers;
-      {
-        const std::lock_guard<std::mutex> lock(mutex_);
-        messageHandlers = messageHandlers_;
-      }
-      for (const auto& [id, handler] : messageHandlers) {
-        handler(str);
-      }
+      auto self = shared_from_this();
+      postCallback([self, str]() {
+        std::map<MessageListenerId, SignalingMessageHandler> messageHandlers;
+        {
+          const std::lock_guard<std::mutex> lock(self->mutex_);
+          messageHandlers = self->messageHandlers_;
+        }
+        for (const auto& [id, handler] : messageHandlers) {
+          handler(str);
+        }
+      });
     } else if (type == "ACK") {
       NABTO_SIGNALING_LOGD << "Handling ACK";
       handleAck(msg);
@@ -56,23 +74,43 @@ void SignalingChannelImpl::handleMessage(const nlohmann::json& msg) {
 
 void SignalingChannelImpl::wsClosed() {
   changeState(SignalingChannelState::CLOSED);
-  const std::lock_guard<std::mutex> lock(mutex_);
-  messageHandlers_.clear();
-  stateHandlers_.clear();
-  errorHandlers_.clear();
+  clearHandlers();
 }
 
 void SignalingChannelImpl::sendMessage(const nlohmann::json& message) {
-  const std::lock_guard<std::mutex> lock(mutex_);
-  if (stateIsEnded()) {
-    NABTO_SIGNALING_LOGE << "sendMessage called from invalid state";
-    return;
+  sendMessageWithAck(message, nullptr);
+}
+
+void SignalingChannelImpl::sendMessageWithAck(
+    const nlohmann::json& message, SignalingMessageAckHandler ackHandler) {
+  send(message, std::move(ackHandler), SendPriority::DATA);
+}
+
+void SignalingChannelImpl::sendMessageWithPriority(
+    const nlohmann::json& message, SignalingMessagePriority priority) {
+  send(message, nullptr,
+       priority == SignalingMessagePriority::HIGH ? SendPriority::ACK
+                                                  : SendPriority::DATA);
+}
+
+void SignalingChannelImpl::send(const nlohmann::json& message,
+                                SignalingMessageAckHandler ackHandler,
+                                SendPriority priority) {
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (!stateIsEnded()) {
+      const nlohmann::json root = {
+          {"type", "DATA"}, {"seq", sendSeq_}, {"data", message}};
+      sendSeq_++;
+      unackedMessages_.push_back({root, std::move(ackHandler), priority});
+      signaler_->websocketSendMessage(key_, root, priority, true);
+      return;
+    }
+  }
+  NABTO_SIGNALING_LOGE << "sendMessage called from invalid state";
+  if (ackHandler) {
+    postCallback([ackHandler]() { ackHandler(false); });
   }
-  const nlohmann::json root = {
-      {"type", "DATA"}, {"seq", sendSeq_}, {"data", message}};
-  sendSeq_++;
-  unackedMessages_.push_back(root);
-  signaler_->websocketSendMessage(channelId_, root);
 }
 
 void SignalingChannelImpl::sendError(const SignalingError& error) {
@@ -82,7 +120,7 @@ void SignalingChannelImpl::sendError(const SignalingError& error) {
       NABTO_SIGNALING_LOGE << "sendError called from invalid state";
       return;
     }
-    signaler_->websocketSendError(channelId_, error);
+    signaler_->websocketSendError(key_, error);
   }
   changeState(SignalingChannelState::FAILED);
 }
@@ -91,28 +129,36 @@ void SignalingChannelImpl::sendAck(const nlohmann::json& msg) {
   const nlohmann::json ack = {{"type", "ACK"},
                               {"seq", msg.at("seq").get<uint32_t>()}};
   const std::lock_guard<std::mutex> lock(mutex_);
-  signaler_->websocketSendMessage(channelId_, ack);
+  signaler_->websocketSendMessage(key_, ack, SendPriority::ACK, false);
 }
 
 void SignalingChannelImpl::handleAck(const nlohmann::json& msg) {
-  const std::lock_guard<std::mutex> lock(mutex_);
-  if (unackedMessages_.empty()) {
-    NABTO_SIGNALING_LOGE << "Got an ack but we have no unacked messages";
-    return;
-  }
-  auto firstItem = unackedMessages_[0];
-  try {
-    if (firstItem.at("seq").get<uint32_t>() != msg.at("seq").get<uint32_t>()) {
-      NABTO_SIGNALING_LOGE << "Got an ack for seq "
-                           << msg.at("seq").get<uint32_t>()
-                           << " but the first item in unacked was seq: "
-                           << firstItem.at("seq").get<uint32_t>();
+  SignalingMessageAckHandler ackHandler;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (unackedMessages_.empty()) {
+      NABTO_SIGNALING_LOGE << "Got an ack but we have no unacked messages";
       return;
     }
-    unackedMessages_.erase(unackedMessages_.begin());
-  } catch (std::exception& ex) {
-    NABTO_SIGNALING_LOGE << "Failed to handle ACK: " << msg.dump()
-                         << " with: " << ex.what();
+    const auto& firstItem = unackedMessages_[0].message;
+    try {
+      if (firstItem.at("seq").get<uint32_t>() !=
+          msg.at("seq").get<uint32_t>()) {
+        NABTO_SIGNALING_LOGE << "Got an ack for seq "
+                             << msg.at("seq").get<uint32_t>()
+                             << " but the first item in unacked was seq: "
+                             << firstItem.at("seq").get<uint32_t>();
+        return;
+      }
+      ackHandler = std::move(unackedMessages_[0].ackHandler);
+      unackedMessages_.erase(unackedMessages_.begin());
+    } catch (std::exception& ex) {
+      NABTO_SIGNALING_LOGE << "Failed to handle ACK: " << msg.dump()
+                           << " with: " << ex.what();
+    }
+  }
+  if (ackHandler) {
+    postCallback([ackHandler]() { ackHandler(true); });
   }
 }
 
@@ -120,8 +166,9 @@ void SignalingChannelImpl::peerConnected() {
   {
     const std::lock_guard<std::mutex> lock(mutex_);
 
-    for (auto const& message : unackedMessages_) {
-      signaler_->websocketSendMessage(channelId_, message);
+    for (auto const& unacked : unackedMessages_) {
+      signaler_->websocketSendMessage(key_, unacked.message,
+                                      unacked.priority, true);
     }
   }
   changeState(SignalingChannelState::CONNECTED);
@@ -137,7 +184,6 @@ void SignalingChannelImpl::peerOffline() {
 }
 
 void SignalingChannelImpl::handleError(const SignalingError& error) {
-  std::map<ChannelErrorListenerId, SignalingErrorHandler> errorHandlers;
   {
     const std::lock_guard<std::mutex> lock(mutex_);
     NABTO_SIGNALING_LOGI << "Got error: (" << error.errorCode() << ") "
@@ -146,13 +192,20 @@ void SignalingChannelImpl::handleError(const SignalingError& error) {
     if (stateIsEnded()) {
       NABTO_SIGNALING_LOGI
           << "Got error while in error state. Not reinvoking handlers";
-    } else {
-      errorHandlers = errorHandlers_;
+      return;
     }
   }
-  for (const auto& [id, handler] : errorHandlers) {
-    handler(error);
-  }
+  auto self = shared_from_this();
+  postCallback([self, error]() {
+    std::map<ChannelErrorListenerId, SignalingErrorHandler> errorHandlers;
+    {
+      const std::lock_guard<std::mutex> lock(self->mutex_);
+      errorHandlers = self->errorHandlers_;
+    }
+    for (const auto& [id, handler] : errorHandlers) {
+      handler(error);
+    }
+  });
 }
 
 void SignalingChannelImpl::close() {
@@ -165,11 +218,9 @@ void SignalingChannelImpl::close() {
   changeState(SignalingChannelState::CLOSED);
   {
     const std::lock_guard<std::mutex> lock(mutex_);
-    signaler_->channelClosed(channelId_);
-    messageHandlers_.clear();
-    stateHandlers_.clear();
-    errorHandlers_.clear();
+    signaler_->channelClosed(tableKey_);
   }
+  clearHandlers();
 }
 
 bool SignalingChannelImpl::isInitialMessage(const nlohmann::json& msg) {
@@ -188,16 +239,61 @@ std::string SignalingChannelImpl::getChannelId() {
 }
 
 void SignalingChannelImpl::changeState(SignalingChannelState state) {
-  std::map<ChannelStateListenerId, SignalingChannelStateHandler> stateHandlers;
+  std::vector<SignalingMessageAckHandler> ackHandlers;
   {
     const std::lock_guard<std::mutex> lock(mutex_);
-    if (state != state_) {
-      stateHandlers = stateHandlers_;
-      state_ = state;
+    if (state == state_) {
+      return;
     }
+    state_ = state;
+    if (stateIsEnded()) {
+      // Messages can no longer be acknowledged once the channel has ended.
+      for (auto& unacked : unackedMessages_) {
+        if (unacked.ackHandler) {
+          ackHandlers.push_back(std::move(unacked.ackHandler));
+        }
+      }
+      unackedMessages_.clear();
+    }
+  }
+  auto self = shared_from_this();
+  postCallback([self, state]() {
+    std::map<ChannelStateListenerId, SignalingChannelStateHandler>
+        stateHandlers;
+    {
+      const std::lock_guard<std::mutex> lock(self->mutex_);
+      stateHandlers = self->stateHandlers_;
+    }
+    for (const auto& [id, handler] : stateHandlers) {
+      handler(state);
+    }
+  });
+  if (!ackHandlers.empty()) {
+    postCallback([ackHandlers]() {
+      for (const auto& handler : ackHandlers) {
+        handler(false);
+      }
+    });
   }
-  for (const auto& [id, handler] : stateHandlers) {
-    handler(state);
+}
+
+void SignalingChannelImpl::clearHandlers() {
+  // Cleared on the executor so listeners still see the events posted before
+  // the channel was closed.
+  auto self = shared_from_this();
+  postCallback([self]() {
+    const std::lock_guard<std::mutex> lock(self->mutex_);
+    self->messageHandlers_.clear();
+    self->stateHandlers_.clear();
+    self->errorHandlers_.clear();
+  });
+}
+
+void SignalingChannelImpl::postCallback(std::function<void()> callback) {
+  if (signaler_) {
+    signaler_->postCallback(std::move(callback));
+  } else {
+    callback();
   }
 }
 
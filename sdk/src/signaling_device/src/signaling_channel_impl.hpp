@@ -1,4 +1,6 @@
 #pragma once
+#include "channel_table.hpp"
+#include "outbound_queue.hpp"
 #include "signaling_impl.hpp"
 
 #include <nabto/webrtc/device.hpp>
@@ -6,9 +8,11 @@
 #include <nlohmann/json.hpp>
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
 namespace nabto {
 namespace webrtc {
@@ -18,7 +22,7 @@ using SignalingChannelImplPtr = std::shared_ptr<SignalingChannelImpl>;
 
 class SignalingChannelImpl
     : public SignalingChannel,
-      public std::enable_shared_from_this<SignalingChannel> {
+      public std::enable_shared_from_this<SignalingChannelImpl> {
  public:
   /*
    * SignalingChannels are created by the Signaler and received by its channel
@@ -26,7 +30,16 @@ class SignalingChannelImpl
    */
   static SignalingChannelImplPtr create(SignalingDeviceImplPtr signaler,
                                         const std::string& channelId);
-  SignalingChannelImpl(SignalingDeviceImplPtr signaler, std::string channelId);
+
+  /*
+   * Create a channel to a client of the local signaling listener. The key
+   * routes the messages of the channel in the signaler.
+   */
+  static SignalingChannelImplPtr createLocal(SignalingDeviceImplPtr signaler,
+                                             const std::string& channelId,
+                                             const std::string& key);
+  SignalingChannelImpl(SignalingDeviceImplPtr signaler, std::string channelId,
+                       std::string key, bool local);
 
   // #### SDK FUNCTIONS ####
   /**
@@ -93,6 +106,26 @@ class SignalingChannelImpl
    */
   void sendMessage(const nlohmann::json& message) override;
 
+  /**
+   * Send a signaling message to the client and invoke the handler when the
+   * client has acknowledged it.
+   *
+   * @param message The message to send
+   * @param ackHandler The handler to invoke
+   */
+  void sendMessageWithAck(const nlohmann::json& message,
+                          SignalingMessageAckHandler ackHandler) override;
+
+  /**
+   * Send a signaling message to the client with the given priority. HIGH
+   * messages share the lane of acknowledgements.
+   *
+   * @param message The message to send
+   * @param priority The priority of the message
+   */
+  void sendMessageWithPriority(const nlohmann::json& message,
+                               SignalingMessagePriority priority) override;
+
   /**
    * Send a signaling error to the client
    *
@@ -107,6 +140,8 @@ class SignalingChannelImpl
 
   std::string getChannelId() override;
 
+  bool isLocal() override { return local_; }
+
   // #### END OF SDK FUNCTIONS ####
 
   // #### INTERNAL FUNCTIONS ####
@@ -121,6 +156,10 @@ class SignalingChannelImpl
  private:
   SignalingDeviceImplPtr signaler_;
   std::string channelId_;
+  std::string key_;
+  // The key_ hashed once, so closing the channel does not hash it again.
+  ChannelKey tableKey_;
+  bool local_ = false;
 
   std::map<MessageListenerId, SignalingMessageHandler> messageHandlers_;
   std::map<ChannelStateListenerId, SignalingChannelStateHandler> stateHandlers_;
@@ -132,13 +171,23 @@ class SignalingChannelImpl
 
   uint32_t recvSeq_ = 0;
   uint32_t sendSeq_ = 0;
-  std::vector<nlohmann::json> unackedMessages_;
+  struct UnackedMessage {
+    nlohmann::json message;
+    SignalingMessageAckHandler ackHandler;
+    // Resent with the priority it was sent with when the peer reconnects.
+    SendPriority priority;
+  };
+  std::vector<UnackedMessage> unackedMessages_;
   std::mutex mutex_;
   SignalingChannelState state_ = SignalingChannelState::NEW;
 
+  void send(const nlohmann::json& message,
+            SignalingMessageAckHandler ackHandler, SendPriority priority);
   void sendAck(const nlohmann::json& msg);
   void handleAck(const nlohmann::json& msg);
   void changeState(SignalingChannelState state);
+  void clearHandlers();
+  void postCallback(std::function<void()> callback);
 
   bool stateIsEnded() {
     return (state_ == SignalingChannelState::CLOSED ||
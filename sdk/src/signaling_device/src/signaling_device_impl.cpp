@@ -1,6 +1,7 @@
 
 #include "signaling_device_impl.hpp"
 
+#include "channel_table.hpp"
 #include "logging.hpp"
 #include "signaling_channel_impl.hpp"
 #include "signaling_impl.hpp"
@@ -10,17 +11,64 @@
 
 #include <nlohmann/json_fwd.hpp>
 
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <exception>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <random>
 #include <string>
 #include <utility>
 #include <vector>
 
 namespace {
+
+// Bounds on the HTTP requests to the backend, so a hung request cannot keep
+// the device in CONNECTING forever.
+const uint32_t HTTP_CONNECT_TIMEOUT_MS = 10000;
+const uint32_t HTTP_TIMEOUT_MS = 30000;
+
+// Channels of local listener clients are keyed by this prefix and the
+// channel ID, so they cannot collide with channels from the Nabto Signaling
+// Service.
+const std::string LOCAL_KEY_PREFIX = "local:";
+
+bool isLocalKey(const std::string& key) {
+  return key.compare(0, LOCAL_KEY_PREFIX.size(), LOCAL_KEY_PREFIX) == 0;
+}
+
+std::string createReconnectToken() {
+  const char* hex = "0123456789abcdef";
+  const size_t words = 4;
+  const uint32_t nibbleMask = 0xf;
+  std::random_device random;
+  std::string token;
+  for (size_t i = 0; i < words; i++) {
+    uint32_t word = random();
+    for (size_t j = 0; j < 2 * sizeof(word); j++) {
+      token.push_back(hex[word & nibbleMask]);
+      word >>= 4;
+    }
+  }
+  return token;
+}
+
+// Compares without returning early, so the time taken does not tell a
+// client how much of a guessed token was right.
+bool tokenEquals(const std::string& a, const std::string& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  unsigned char diff = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    diff |= static_cast<unsigned char>(a[i] ^ b[i]);
+  }
+  return diff == 0;
+}
+
 nlohmann::json signalingErrorToJson(const nabto::webrtc::SignalingError& err) {
   nlohmann::json error = {{"code", err.errorCode()},
                           {"message", err.errorMessage()}};
@@ -53,12 +101,27 @@ SignalingDeviceImpl::SignalingDeviceImpl(const SignalingDeviceConfig& conf)
       deviceId_(conf.deviceId),
       productId_(conf.productId),
       tokenProvider_(conf.tokenProvider),
-      httpHost_(conf.signalingUrl),
+      endpoints_(conf.signalingUrls),
       ws_(WebsocketConnection::create(wsImpl_, conf.timerFactory)),
-      timerFactory_(conf.timerFactory) {
-  if (httpHost_.empty()) {
-    httpHost_ = "https://" + productId_ + DEFAULT_SIGNALING_DOMAIN;
+      timerFactory_(conf.timerFactory),
+      keepAliveIntervalMs_(conf.keepAliveIntervalMs),
+      callbackExecutor_(conf.callbackExecutor),
+      stateStore_(conf.stateStore),
+      localServer_(conf.localServer) {
+  if (endpoints_.size() == 0) {
+    std::string url = conf.signalingUrl;
+    if (url.empty()) {
+      url = "https://" + productId_ + DEFAULT_SIGNALING_DOMAIN;
+    }
+    endpoints_ = EndpointSelector({url});
   }
+  if (!callbackExecutor_) {
+    callbackExecutor_ = InlineCallbackExecutor::create();
+  }
+}
+
+void SignalingDeviceImpl::postCallback(std::function<void()> callback) {
+  callbackExecutor_->post(std::move(callback));
 }
 
 void SignalingDeviceImpl::start() {
@@ -66,6 +129,20 @@ void SignalingDeviceImpl::start() {
   NABTO_SIGNALING_LOGI << "Signaling Device started in version: " << version();
   if (state_ == SignalingDeviceState::NEW) {
     mutex_.unlock();
+    if (localServer_) {
+      // Local clients can connect while the device is not connected to the
+      // Nabto Signaling Service.
+      const std::weak_ptr<SignalingDeviceImpl> weak = shared_from_this();
+      localServer_->onConnection([weak](SignalingWebsocketPtr websocket) {
+        auto self = weak.lock();
+        if (self) {
+          self->acceptLocal(websocket);
+        } else {
+          websocket->close();
+        }
+      });
+    }
+    loadState();
     doConnect();
   } else {
     NABTO_SIGNALING_LOGE << "Connect called from invalid state: "
@@ -86,14 +163,18 @@ void SignalingDeviceImpl::doConnect() {
   changeState(SignalingDeviceState::CONNECTING);
   mutex_.lock();
 
-  const std::string method = "POST";
-  const std::string url = httpHost_ + "/v1/device/connect";
+  if (std::exchange(useSavedUrl_, false)) {
+    NABTO_SIGNALING_LOGI << "Connecting to the saved signaling URL";
+    wsUrl_ = warmState_.signalingUrl;
+    mutex_.unlock();
+    connectWs();
+    return;
+  }
 
   SignalingHttpRequest req;
-  req.method = method;
-  req.url = url;
+  req.method = "POST";
   std::string token;
-  if (!tokenProvider_->generateToken(token)) {
+  if (!getToken(token)) {
     NABTO_SIGNALING_LOGE
         << "Cannot create an access token using the provided token provider.";
     mutex_.unlock();
@@ -105,76 +186,313 @@ void SignalingDeviceImpl::doConnect() {
   req.body =
       nlohmann::json({{"deviceId", deviceId_}, {"productId", productId_}})
           .dump();
+  req.connectTimeoutMs = HTTP_CONNECT_TIMEOUT_MS;
+  req.timeoutMs = HTTP_TIMEOUT_MS;
+  auto cancel = SignalingCancellationToken::create();
+  req.cancellationToken = cancel;
+  auto previous = std::exchange(connectCancel_, cancel);
+
+  auto race = std::make_shared<AttachRace>();
+  race->request = std::move(req);
+  race->urls = endpoints_.raceOrder();
+  auto previousRace = std::exchange(race_, race);
+  mutex_.unlock();
+  if (previous) {
+    previous->cancel();
+  }
+  if (previousRace && previousRace->staggerTimer) {
+    previousRace->staggerTimer->cancel();
+  }
+  // A new token may have been created for the request.
+  saveState();
+  startAttach(race);
+}
 
+void SignalingDeviceImpl::startAttach(const AttachRacePtr& race) {
+  SignalingHttpRequest req;
+  std::string endpoint;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (race != race_ || race->started >= race->urls.size() ||
+        race->request.cancellationToken->isCancelled()) {
+      return;
+    }
+    endpoint = race->urls[race->started];
+    race->started++;
+    req = race->request;
+    req.url = endpoint + "/v1/device/connect";
+    if (race->started < race->urls.size()) {
+      // Happy eyeballs: give the endpoint a head start before the attach to
+      // the next endpoint is started in parallel.
+      if (!race->staggerTimer) {
+        race->staggerTimer = timerFactory_->createTimer();
+      }
+      auto self = shared_from_this();
+      race->staggerTimer->setTimeout(
+          EndpointSelector::STAGGER_MS,
+          [self, race]() { self->startAttach(race); });
+    }
+  }
+  NABTO_SIGNALING_LOGD << "Attaching to " << endpoint;
   auto self = shared_from_this();
+  const auto sentAt = now();
   httpCli_->sendRequest(
-      req, [self](const std::unique_ptr<SignalingHttpResponse>& response) {
-        const int httpOkStartRange = 200;
-        const int httpOkEndRange = 299;
-        if (response == nullptr) {
-          NABTO_SIGNALING_LOGE << "HTTP request failed ";
-          self->waitReconnect();
-        } else if (response->statusCode < httpOkStartRange ||
-                   response->statusCode > httpOkEndRange) {
-          NABTO_SIGNALING_LOGE << "HTTP request failed with status: "
-                               << response->statusCode;
-          self->waitReconnect();
-        } else {
-          self->parseAttachResponse(response->body);
-          self->connectWs();
-        }
+      req, [self, race, endpoint,
+            sentAt](const std::unique_ptr<SignalingHttpResponse>& response) {
+        self->handleAttachResponse(race, endpoint, sentAt, response);
       });
-  mutex_.unlock();
 }
 
-void SignalingDeviceImpl::websocketSendMessage(const std::string& channelId,
-                                               const nlohmann::json& message) {
+void SignalingDeviceImpl::handleAttachResponse(
+    const AttachRacePtr& race, const std::string& endpoint,
+    std::chrono::steady_clock::time_point sentAt,
+    const std::unique_ptr<SignalingHttpResponse>& response) {
+  const int httpOkStartRange = 200;
+  const int httpOkEndRange = 299;
+  const int httpUnauthorized = 401;
+  const auto& cancel = race->request.cancellationToken;
+  if (cancel->isCancelled()) {
+    // The device was closed, has moved on to another attempt or another
+    // endpoint won the race.
+    NABTO_SIGNALING_LOGD << "Ignoring response to cancelled request";
+    return;
+  }
+  if (response != nullptr && response->statusCode >= httpOkStartRange &&
+      response->statusCode <= httpOkEndRange) {
+    SignalingTimerPtr staggerTimer;
+    {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      endpoints_.addSample(endpoint, msSince(sentAt));
+      // Two endpoints can answer at the same time, both passing the check
+      // above. The race is claimed here, so only one of them connects.
+      if (race_ != race || cancel->isCancelled()) {
+        NABTO_SIGNALING_LOGD << "Attach to " << endpoint
+                             << " lost the race";
+        return;
+      }
+      race_ = nullptr;
+      endpoints_.setCurrent(endpoint);
+      staggerTimer = race->staggerTimer;
+    }
+    NABTO_SIGNALING_LOGD << "Attached to " << endpoint;
+    if (staggerTimer) {
+      staggerTimer->cancel();
+    }
+    // The attach requests to the other endpoints lost the race. Cancelled
+    // outside the lock as the cancel handlers can call back into the device.
+    cancel->cancel();
+    parseAttachResponse(response->body);
+    saveState();
+    connectWs();
+    return;
+  }
+
+  if (response == nullptr) {
+    NABTO_SIGNALING_LOGE << "HTTP request to " << endpoint << " failed";
+  } else {
+    NABTO_SIGNALING_LOGE << "HTTP request to " << endpoint
+                         << " failed with status: " << response->statusCode;
+  }
+  bool allFailed = false;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    endpoints_.addFailure(endpoint);
+    if (response != nullptr) {
+      auto retryAfter = ReconnectBackoff::retryAfterMs(*response);
+      if (retryAfter.has_value()) {
+        backoff_.setServerHint(*retryAfter, *retryAfter / 2);
+      }
+      if (response->statusCode == httpUnauthorized) {
+        // Do not retry with a reused token the backend has rejected.
+        warmState_.token.clear();
+      }
+    }
+    race->failed++;
+    allFailed = race->failed == race->urls.size();
+  }
+  if (allFailed) {
+    waitReconnect();
+  } else {
+    // Do not wait for the stagger delay when an endpoint has failed.
+    startAttach(race);
+  }
+}
+
+uint32_t SignalingDeviceImpl::msSince(
+    std::chrono::steady_clock::time_point from) {
+  const auto elapsed = now() - from;
+  return static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+}
+
+std::chrono::steady_clock::time_point SignalingDeviceImpl::now() {
+  if (timerFactory_) {
+    return timerFactory_->now();
+  }
+  return std::chrono::steady_clock::now();
+}
+
+void SignalingDeviceImpl::scheduleProbe() {
   const std::lock_guard<std::mutex> lock(mutex_);
-  if (state_ == SignalingDeviceState::CONNECTED) {
-    const nlohmann::json msg = {
-        {"type", "MESSAGE"}, {"channelId", channelId}, {"message", message}};
-    NABTO_SIGNALING_LOGD << "Sending WS msg: " << msg.dump();
-    ws_->send(msg.dump());
+  if (endpoints_.size() < 2 || state_ != SignalingDeviceState::CONNECTED) {
+    return;
+  }
+  if (!probeTimer_) {
+    probeTimer_ = timerFactory_->createTimer();
+  }
+  auto self = shared_from_this();
+  probeTimer_->setTimeout(EndpointSelector::PROBE_INTERVAL_MS,
+                          [self]() { self->probeEndpoints(); });
+}
+
+void SignalingDeviceImpl::probeEndpoints() {
+  std::vector<std::string> urls;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ != SignalingDeviceState::CONNECTED) {
+      return;
+    }
+    urls = endpoints_.raceOrder();
+  }
+  // Any HTTP response, whatever the status, proves the endpoint is
+  // reachable and gives a round trip sample.
+  auto pending = std::make_shared<size_t>(urls.size());
+  auto self = shared_from_this();
+  for (const auto& url : urls) {
+    SignalingHttpRequest req;
+    req.method = "GET";
+    req.url = url;
+    req.connectTimeoutMs = HTTP_CONNECT_TIMEOUT_MS;
+    req.timeoutMs = HTTP_TIMEOUT_MS;
+    req.cancellationToken = closeCancel_;
+    const auto sentAt = now();
+    httpCli_->sendRequest(
+        req, [self, url, sentAt,
+              pending](const std::unique_ptr<SignalingHttpResponse>& response) {
+          self->handleProbeResponse(url, sentAt, response != nullptr,
+                                    pending);
+        });
+  }
+}
+
+void SignalingDeviceImpl::handleProbeResponse(
+    const std::string& url, std::chrono::steady_clock::time_point sentAt,
+    bool reachable, const std::shared_ptr<size_t>& pending) {
+  WebsocketConnectionPtr failoverWs;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (reachable) {
+      endpoints_.addSample(url, msSince(sentAt));
+    } else {
+      endpoints_.addFailure(url);
+    }
+    (*pending)--;
+    if (*pending > 0 || state_ != SignalingDeviceState::CONNECTED) {
+      return;
+    }
+    auto faster = endpoints_.fasterEndpoint();
+    if (faster.has_value()) {
+      NABTO_SIGNALING_LOGI << "Signaling endpoint " << *faster
+                           << " is faster than " << endpoints_.current()
+                           << ", reconnecting";
+      failoverWs = ws_;
+    }
+  }
+  if (failoverWs) {
+    // The reconnect races the endpoints fastest first.
+    failoverWs->close();
   } else {
-    NABTO_SIGNALING_LOGD << "Tried to send message but WS not connected";
+    scheduleProbe();
   }
 }
 
-void SignalingDeviceImpl::websocketSendError(const std::string& channelId,
+void SignalingDeviceImpl::websocketSendMessage(const std::string& key,
+                                               const nlohmann::json& message,
+                                               SendPriority priority,
+                                               bool ordered) {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  const nlohmann::json msg = {{"type", "MESSAGE"}, {"message", message}};
+  sendToClient(key, msg, priority, ordered);
+}
+
+void SignalingDeviceImpl::websocketSendError(const std::string& key,
                                              const SignalingError& error) {
   const std::lock_guard<std::mutex> lock(mutex_);
-  if (state_ == SignalingDeviceState::CONNECTED) {
-    nlohmann::json const msg = {{"type", "ERROR"},
-                                {"channelId", channelId},
-                                {"error", signalingErrorToJson(error)}};
-    NABTO_SIGNALING_LOGD << "Sending WS Error: " << msg.dump();
-    ws_->send(msg.dump());
+  const nlohmann::json msg = {{"type", "ERROR"},
+                              {"error", signalingErrorToJson(error)}};
+  sendToClient(key, msg, SendPriority::CONTROL, true);
+}
+
+void SignalingDeviceImpl::sendToClient(const std::string& key,
+                                       nlohmann::json msg,
+                                       SendPriority priority, bool ordered) {
+  if (isLocalKey(key)) {
+    auto route = localRoutes_.find(key);
+    if (route == localRoutes_.end() ||
+        localConnections_.count(route->second) == 0) {
+      NABTO_SIGNALING_LOGD << "Tried to send " << msg.at("type")
+                           << " but local client of " << key
+                           << " not connected";
+      return;
+    }
+    msg["channelId"] = key.substr(LOCAL_KEY_PREFIX.size());
+    NABTO_SIGNALING_LOGD << "Sending local WS msg: " << msg.dump();
+    localConnections_.at(route->second)
+        ->send(msg.dump(), priority, key, ordered);
+  } else if (state_ == SignalingDeviceState::CONNECTED) {
+    msg["channelId"] = key;
+    NABTO_SIGNALING_LOGD << "Sending WS msg: " << msg.dump();
+    ws_->send(msg.dump(), priority, key, ordered);
   } else {
-    NABTO_SIGNALING_LOGD << "Tried to send error but WS not connected";
+    NABTO_SIGNALING_LOGD << "Tried to send " << msg.at("type")
+                         << " but WS not connected";
   }
 }
 
 void SignalingDeviceImpl::close() {
-  std::map<std::string, nabto::webrtc::SignalingChannelImplPtr> chans;
+  ChannelTable chans;
+  SignalingCancellationTokenPtr connectCancel;
   {
     {
       const std::lock_guard<std::mutex> lock(mutex_);
-      chans = channels_;
+      // Take over the table instead of copying it, channels closed below are
+      // no longer reachable from incoming websocket messages.
+      std::swap(chans, channels_);
+      connectCancel = std::exchange(connectCancel_, nullptr);
       closed_ = true;
     }
     changeState(SignalingDeviceState::CLOSED);
   }
-  for (auto const& channel : chans) {
-    channel.second->wsClosed();
-    channelClosed(channel.first);
+  // Abort in-flight HTTP requests so close does not wait for them to time
+  // out. Cancelled outside the lock as clients may resolve the requests from
+  // the cancel handlers.
+  if (connectCancel) {
+    connectCancel->cancel();
   }
+  closeCancel_->cancel();
+  chans.forEach([this](const ChannelKey& key,
+                       const SignalingChannelImplPtr& channel) {
+    channel->wsClosed();
+    channelClosed(key);
+  });
   nabto::webrtc::WebsocketConnectionPtr ws;
+  std::map<uint64_t, WebsocketConnectionPtr> localConnections;
   {
     const std::lock_guard<std::mutex> lock(mutex_);
     channels_.clear();
+    // Taken after the channels are closed, so the local clients are told.
+    std::swap(localConnections, localConnections_);
+    localRoutes_.clear();
+    localTokens_.clear();
 
     ws = ws_;
   }
+  if (localServer_) {
+    localServer_->close();
+  }
+  for (const auto& [id, connection] : localConnections) {
+    connection->close();
+  }
   if (ws) {
     ws->close();
   }
@@ -193,32 +511,50 @@ void SignalingDeviceImpl::deinit() {
   if (timer) {
     timer->cancel();
   }
-  const std::lock_guard<std::mutex> lock(mutex_);
-  chanHandlers_.clear();
-  stateHandlers_.clear();
-  reconnHandlers_.clear();
+  stopEndpointTimers();
+  // Cleared on the executor so listeners still see the events posted before
+  // the device was closed.
+  auto self = shared_from_this();
+  postCallback([self]() {
+    const std::lock_guard<std::mutex> lock(self->mutex_);
+    self->chanHandlers_.clear();
+    self->stateHandlers_.clear();
+    self->reconnHandlers_.clear();
+  });
 }
 
 void SignalingDeviceImpl::connectWs() {
   const std::lock_guard<std::mutex> lock(mutex_);
   auto self = shared_from_this();
-  ws_ = WebsocketConnection::create(wsImpl_, timerFactory_);
+  ws_ = WebsocketConnection::create(wsImpl_, timerFactory_,
+                                    keepAliveIntervalMs_);
   ws_->onOpen([self]() {
     NABTO_SIGNALING_LOGI << "WebSocket open";
-    std::map<ReconnectListenerId, SignalingReconnectHandler> reconnHandlers;
+    bool reconnected = false;
     {
       const std::lock_guard<std::mutex> lock(self->mutex_);
       if (self->firstConnect_) {
         self->firstConnect_ = false;
       } else {
-        reconnHandlers = self->reconnHandlers_;
+        reconnected = true;
       }
+      self->backoff_.reset();
     }
-    // if firstConnect the map will be empty
-    for (const auto& [id, handler] : reconnHandlers) {
-      handler();
+    if (reconnected) {
+      self->postCallback([self]() {
+        std::map<ReconnectListenerId, SignalingReconnectHandler>
+            reconnHandlers;
+        {
+          const std::lock_guard<std::mutex> lock(self->mutex_);
+          reconnHandlers = self->reconnHandlers_;
+        }
+        for (const auto& [id, handler] : reconnHandlers) {
+          handler();
+        }
+      });
     }
     self->changeState(SignalingDeviceState::CONNECTED);
+    self->scheduleProbe();
   });
 
   ws_->onMessage([self](SignalingMessageType type, nlohmann::json& message) {
@@ -258,38 +594,65 @@ void SignalingDeviceImpl::handleWsMessage(SignalingMessageType type,
     mutex_.unlock();
     return;
   }
+  if (type == SignalingMessageType::RECONNECT) {
+    handleReconnectHint(message);
+    mutex_.unlock();
+    return;
+  }
+  std::string channelId;
+  try {
+    channelId = message.at("channelId").get<std::string>();
+  } catch (std::exception& exception) {
+    NABTO_SIGNALING_LOGE << "Invalid channel ID in websocket message: "
+                         << message.dump() << " error: " << exception.what();
+    mutex_.unlock();
+    return;
+  }
+  handleChannelMessage(type, message, ChannelKey(channelId), false);
+}
+
+void SignalingDeviceImpl::handleChannelMessage(SignalingMessageType type,
+                                               const nlohmann::json& message,
+                                               const ChannelKey& connKey,
+                                               bool local) {
   SignalingChannelImplPtr chan = nullptr;
   try {
-    const std::string connId = message.at("channelId").get<std::string>();
-    try {
-      chan = channels_.at(connId);
-      if (type == SignalingMessageType::PEER_OFFLINE) {
-        mutex_.unlock();
-        chan->peerOffline();
-        return;
-      }
-      if (type == SignalingMessageType::PEER_CONNECTED) {
-        mutex_.unlock();
-        chan->peerConnected();
-        return;
-      }
-      if (type == SignalingMessageType::ERROR) {
-        mutex_.unlock();
-        chan->handleError(signalingErrorFromJson(message.at("error")));
-        return;
-      }
-    } catch (std::exception& exception) {
+    const std::string key = connKey.str();
+    const std::string connId =
+        local ? key.substr(LOCAL_KEY_PREFIX.size()) : key;
+    chan = channels_.find(connKey);
+    if (chan == nullptr) {
       NABTO_SIGNALING_LOGD << "Got websocket channel for unknown channel ID: "
                            << connId;
       // if message type is MESSAGE, we will create a connection below,
       // otherwise we ignore the message
+    } else if (type == SignalingMessageType::PEER_OFFLINE) {
+      mutex_.unlock();
+      chan->peerOffline();
+      return;
+    } else if (type == SignalingMessageType::PEER_CONNECTED) {
+      mutex_.unlock();
+      chan->peerConnected();
+      return;
+    } else if (type == SignalingMessageType::ERROR) {
+      mutex_.unlock();
+      try {
+        chan->handleError(signalingErrorFromJson(message.at("error")));
+      } catch (std::exception& exception) {
+        NABTO_SIGNALING_LOGE << "Invalid error in websocket message: "
+                             << message.dump()
+                             << " error: " << exception.what();
+      }
+      return;
     }
 
     if (type == SignalingMessageType::MESSAGE) {
+      // Local clients have not been authorized by the backend, whatever they
+      // claim.
       bool authorized = false;
-      if (message.contains("authorized")) {
+      if (!local && message.contains("authorized")) {
         authorized = message.at("authorized").get<bool>();
-      } else {
+      } else if (!local) {
         NABTO_SIGNALING_LOGD
             << "authorized bit not contained in incoming message"
             << message.dump();
@@ -303,30 +666,49 @@ void SignalingDeviceImpl::handleWsMessage(SignalingMessageType type,
                  "not an initial message. Discarding the message";
           mutex_.unlock();
           websocketSendError(
-              connId, SignalingError(SignalingErrorCode::CHANNEL_NOT_FOUND,
+              key, SignalingError(SignalingErrorCode::CHANNEL_NOT_FOUND,
                                      "Got a message for a signaling channel "
                                      "which does not exist."));
           return;
         }
         auto self = shared_from_this();
-        chan = SignalingChannelImpl::create(self, connId);
-        channels_.insert(std::make_pair(connId, chan));
+        if (local) {
+          chan = SignalingChannelImpl::createLocal(self, connId, key);
+        } else {
+          chan = SignalingChannelImpl::create(self, connId);
+        }
+        channels_.insert(connKey, chan);
 
         if (chanHandlers_.empty()) {
+          // Nobody uses the channel, so it must not hold the channel ID. For
+          // a local client this also means no reconnect token is issued.
+          channels_.erase(connKey);
           mutex_.unlock();
           websocketSendError(
-              connId,
+              key,
               SignalingError(
                   SignalingErrorCode::INTERNAL_ERROR,
                   "No NewChannelHandler was set, dropping the channel."));
           return;
         }
-        auto chanHandlers = chanHandlers_;
         mutex_.unlock();
 
-        for (const auto& [id, handler] : chanHandlers) {
-          handler(chan, authorized);
-        }
+        // The handlers are looked up when the callback runs, and the message
+        // below is posted after this callback, so a message listener added by
+        // a new channel handler receives the initial message.
+        postCallback([self, chan, authorized]() {
+          std::map<NewChannelListenerId, NewSignalingChannelHandler>
+              chanHandlers;
+          {
+            const std::lock_guard<std::mutex> lock(self->mutex_);
+            chanHandlers = self->chanHandlers_;
+          }
+          for (const auto& [id, handler] : chanHandlers) {
+            handler(chan, authorized);
+          }
+        });
+        chan->handleMessage(msg);
+        return;
       }
       mutex_.unlock();
       chan->handleMessage(msg);
@@ -348,10 +730,192 @@ void SignalingDeviceImpl::handleWsMessage(SignalingMessageType type,
   mutex_.unlock();
 }
 
+void SignalingDeviceImpl::acceptLocal(const SignalingWebsocketPtr& websocket) {
+  WebsocketConnectionPtr connection;
+  uint64_t id = 0;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (!closed_) {
+      id = nextLocalConnection_++;
+      connection = WebsocketConnection::create(websocket, timerFactory_);
+      localConnections_.insert({id, connection});
+    }
+  }
+  if (!connection) {
+    websocket->close();
+    return;
+  }
+  NABTO_SIGNALING_LOGI << "Local signaling client " << id << " connected";
+  auto self = shared_from_this();
+  connection->onMessage(
+      [self, id](SignalingMessageType type, nlohmann::json& message) {
+        self->handleLocalMessage(id, type, message);
+      });
+  connection->onClosed([self, id]() { self->localClosed(id); });
+  connection->onError([self, id](const std::string& error) {
+    NABTO_SIGNALING_LOGD << "Local websocket " << id << " error: " << error;
+    self->localClosed(id);
+  });
+}
+
+void SignalingDeviceImpl::handleLocalMessage(uint64_t connection,
+                                             SignalingMessageType type,
+                                             const nlohmann::json& message) {
+  NABTO_SIGNALING_LOGD << "handleLocalMessage from " << connection
+                       << " of type: " << type
+                       << " message: " << message.dump();
+  mutex_.lock();
+  auto conn = localConnections_.find(connection);
+  if (conn == localConnections_.end()) {
+    mutex_.unlock();
+    return;
+  }
+  if (type == SignalingMessageType::PING) {
+    const nlohmann::json pong = {{"type", "PONG"}};
+    conn->second->send(pong.dump(), SendPriority::CONTROL);
+    mutex_.unlock();
+    return;
+  }
+  if (type != SignalingMessageType::MESSAGE &&
+      type != SignalingMessageType::ERROR) {
+    // Peer state is derived from the local connection itself.
+    NABTO_SIGNALING_LOGE << "Unexpected message from local client: "
+                         << message.dump();
+    mutex_.unlock();
+    return;
+  }
+  // A client which reconnects continues its channels on the new connection,
+  // like a client reconnecting to the Nabto Signaling Service does. A channel
+  // is only moved once its previous connection has closed, and only by a
+  // client presenting the reconnect token issued when the channel was
+  // created. Anyone else on the network could otherwise take it over.
+  std::string channelId;
+  try {
+    channelId = message.at("channelId").get<std::string>();
+  } catch (std::exception& exception) {
+    NABTO_SIGNALING_LOGE << "Invalid channel ID in local websocket message: "
+                         << message.dump() << " error: " << exception.what();
+    mutex_.unlock();
+    return;
+  }
+  const std::string key = LOCAL_KEY_PREFIX + channelId;
+  const ChannelKey tableKey(key);
+  SignalingChannelImplPtr returned = nullptr;
+  bool created = false;
+  auto route = localRoutes_.find(key);
+  if (route == localRoutes_.end()) {
+    returned = channels_.find(tableKey);
+    created = !returned;
+    const auto token = localTokens_.find(key);
+    const auto presented = message.find("reconnectToken");
+    if (returned &&
+        (token == localTokens_.end() || presented == message.end() ||
+         !presented->is_string() ||
+         !tokenEquals(token->second, presented->get<std::string>()))) {
+      NABTO_SIGNALING_LOGE << "Local client " << connection
+                           << " tried to continue " << key
+                           << " without its reconnect token";
+    } else {
+      route = localRoutes_.insert({key, connection}).first;
+    }
+  }
+  if (route == localRoutes_.end() || route->second != connection) {
+    const nlohmann::json error = {
+        {"type", "ERROR"},
+        {"channelId", channelId},
+        {"error", signalingErrorToJson(SignalingError(
+                      SignalingErrorCode::ACCESS_DENIED,
+                      "The signaling channel belongs to another client."))}};
+    conn->second->send(error.dump(), SendPriority::CONTROL);
+    mutex_.unlock();
+    return;
+  }
+  if (returned) {
+    mutex_.unlock();
+    returned->peerConnected();
+    mutex_.lock();
+  }
+  handleChannelMessage(type, message, tableKey, true);
+  if (created) {
+    issueReconnectToken(connection, tableKey);
+  }
+}
+
+void SignalingDeviceImpl::issueReconnectToken(uint64_t connection,
+                                              const ChannelKey& tableKey) {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  const std::string key = tableKey.str();
+  auto route = localRoutes_.find(key);
+  if (route == localRoutes_.end() || route->second != connection) {
+    return;
+  }
+  if (!channels_.find(tableKey)) {
+    // The message did not create a channel, do not hold the ID for the
+    // connection.
+    localRoutes_.erase(route);
+    return;
+  }
+  if (localTokens_.count(key) != 0) {
+    return;
+  }
+  auto token = createReconnectToken();
+  localTokens_[key] = token;
+  const nlohmann::json msg = {{"type", "PEER_CONNECTED"},
+                              {"reconnectToken", token}};
+  sendToClient(key, msg, SendPriority::CONTROL, true);
+}
+
+void SignalingDeviceImpl::localClosed(uint64_t connection) {
+  std::vector<SignalingChannelImplPtr> offline;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (localConnections_.erase(connection) == 0) {
+      return;
+    }
+    for (auto it = localRoutes_.begin(); it != localRoutes_.end();) {
+      if (it->second == connection) {
+        auto chan = channels_.find(ChannelKey(it->first));
+        if (chan) {
+          offline.push_back(chan);
+        }
+        it = localRoutes_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  NABTO_SIGNALING_LOGI << "Local signaling client " << connection
+                       << " disconnected";
+  for (const auto& chan : offline) {
+    chan->peerOffline();
+  }
+}
+
 void SignalingDeviceImpl::sendPong() {
   const nlohmann::json pong = {{"type", "PONG"}};
-  NABTO_SIGNALING_LOGI << "Sending WS msg: " << pong.dump();
-  ws_->send(pong.dump());
+  NABTO_SIGNALING_LOGD << "Sending WS msg: " << pong.dump();
+  ws_->send(pong.dump(), SendPriority::CONTROL);
+}
+
+void SignalingDeviceImpl::handleReconnectHint(const nlohmann::json& message) {
+  // Sent by the backend before a planned close, eg. a deploy, telling the
+  // device when to come back so the fleet does not reconnect all at once.
+  try {
+    uint32_t delayMs = 0;
+    uint32_t spreadMs = ReconnectBackoff::DEFAULT_SPREAD_MS;
+    if (message.contains("delayMs")) {
+      delayMs = message.at("delayMs").get<uint32_t>();
+    }
+    if (message.contains("spreadMs")) {
+      spreadMs = message.at("spreadMs").get<uint32_t>();
+    }
+    NABTO_SIGNALING_LOGD << "Reconnect hint, delay: " << delayMs
+                         << " ms spread: " << spreadMs << " ms";
+    backoff_.setServerHint(delayMs, spreadMs);
+  } catch (std::exception& exception) {
+    NABTO_SIGNALING_LOGE << "Invalid reconnect hint: " << message.dump()
+                         << " error: " << exception.what();
+  }
 }
 
 void SignalingDeviceImpl::parseAttachResponse(const std::string& response) {
@@ -359,6 +923,8 @@ void SignalingDeviceImpl::parseAttachResponse(const std::string& response) {
     const std::lock_guard<std::mutex> lock(mutex_);
     auto root = nlohmann::json::parse(response);
     wsUrl_ = root.at("signalingUrl").get<std::string>();
+    warmState_.signalingUrl = wsUrl_;
+    warmState_.signalingUrlReceivedAt = WarmStartState::unixNow();
 
   } catch (std::exception& exception) {
     NABTO_SIGNALING_LOGE << "Failed parse attach response: "
@@ -366,10 +932,65 @@ void SignalingDeviceImpl::parseAttachResponse(const std::string& response) {
   }
 }
 
+bool SignalingDeviceImpl::getToken(std::string& token) {
+  // Tokens are only reused with a state store, as that is where a reused
+  // token saves the most: a restarted process skips loading the key.
+  const int64_t now = WarmStartState::unixNow();
+  if (stateStore_ && warmState_.hasToken(now)) {
+    token = warmState_.token;
+    return true;
+  }
+  if (!tokenProvider_->generateToken(token)) {
+    return false;
+  }
+  if (stateStore_) {
+    warmState_.token = token;
+    warmState_.tokenExpiresAt = WarmStartState::tokenExpiry(token).value_or(0);
+  }
+  return true;
+}
+
+void SignalingDeviceImpl::loadState() {
+  if (!stateStore_) {
+    return;
+  }
+  auto state = WarmStartState::parse(stateStore_->load());
+  if (!state.has_value()) {
+    return;
+  }
+  const int64_t now = WarmStartState::unixNow();
+  const std::lock_guard<std::mutex> lock(mutex_);
+  warmState_ = *state;
+  useSavedUrl_ = warmState_.hasSignalingUrl(now);
+  NABTO_SIGNALING_LOGD << "Loaded saved state, signaling URL: "
+                       << (useSavedUrl_ ? "valid" : "expired")
+                       << " token: "
+                       << (warmState_.hasToken(now) ? "valid" : "expired")
+                       << " ICE servers: "
+                       << (warmState_.hasIceServers(now) ? "valid"
+                                                         : "expired");
+}
+
+void SignalingDeviceImpl::saveState() {
+  if (!stateStore_) {
+    return;
+  }
+  std::string data;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    data = warmState_.dump();
+    if (data == savedState_) {
+      return;
+    }
+    savedState_ = data;
+  }
+  stateStore_->save(data);
+}
+
 void SignalingDeviceImpl::checkAlive() {
   const std::lock_guard<std::mutex> lock(mutex_);
   if (state_ != SignalingDeviceState::CLOSED &&
-      state_ != SignalingDeviceState::FAILED) {
+      state_ != SignalingDeviceState::FAILED && ws_) {
     ws_->checkAlive();
   } else {
     NABTO_SIGNALING_LOGE << "checkAlive called from invalid state: "
@@ -377,6 +998,14 @@ void SignalingDeviceImpl::checkAlive() {
   }
 }
 
+SignalingRttStats SignalingDeviceImpl::getRttStats() {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  if (ws_) {
+    return ws_->getRttStats();
+  }
+  return {};
+}
+
 void SignalingDeviceImpl::waitReconnect() {
   {
     const std::lock_guard<std::mutex> lock(mutex_);
@@ -393,30 +1022,57 @@ void SignalingDeviceImpl::waitReconnect() {
   }
   changeState(SignalingDeviceState::WAIT_RETRY);
 
+  SignalingCancellationTokenPtr connectCancel;
   {
     const std::lock_guard<std::mutex> lock(mutex_);
     ws_ = nullptr;
-    const uint32_t oneMinuteInMs = 60000;
-    const uint32_t msPrSecond = 1000;
-    const size_t exponentialBackoffCap = 6;
-    uint32_t reconnectWait = oneMinuteInMs;
-    if (reconnectCounter_ < exponentialBackoffCap) {
-      reconnectWait =
-          msPrSecond * (static_cast<uint32_t>(1) << reconnectCounter_);
-    }
-    reconnectCounter_++;
+    connectCancel = std::exchange(connectCancel_, nullptr);
+    const uint32_t reconnectWait = backoff_.nextDelayMs();
+    NABTO_SIGNALING_LOGD << "Reconnecting in " << reconnectWait << " ms";
     timer_ = timerFactory_->createTimer();
     auto self = shared_from_this();
     timer_->setTimeout(reconnectWait, [self]() { self->doConnect(); });
   }
+  // A still running attach request from the failed attempt must not start a
+  // websocket connection behind the new attempt.
+  if (connectCancel) {
+    connectCancel->cancel();
+  }
+  stopEndpointTimers();
+}
+
+void SignalingDeviceImpl::stopEndpointTimers() {
+  SignalingTimerPtr staggerTimer;
+  SignalingTimerPtr probeTimer;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (race_) {
+      staggerTimer = race_->staggerTimer;
+      race_ = nullptr;
+    }
+    probeTimer = probeTimer_;
+  }
+  if (staggerTimer) {
+    staggerTimer->cancel();
+  }
+  if (probeTimer) {
+    probeTimer->cancel();
+  }
 }
 
 void SignalingDeviceImpl::requestIceServers(IceServersResponse callback) {
-  const std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (stateStore_ && warmState_.hasIceServers(WarmStartState::unixNow())) {
+    auto servers = warmState_.iceServers;
+    lock.unlock();
+    NABTO_SIGNALING_LOGD << "Using saved ICE servers";
+    postCallback([callback, servers]() { callback(servers); });
+    return;
+  }
   const std::string method = "POST";
-  const std::string url = httpHost_ + "/v1/ice-servers";
+  const std::string url = endpoints_.current() + "/v1/ice-servers";
   std::string token;
-  if (!tokenProvider_->generateToken(token)) {
+  if (!getToken(token)) {
     NABTO_SIGNALING_LOGE
         << "Cannot create an access token using the provided token provider.";
   }
@@ -428,33 +1084,50 @@ void SignalingDeviceImpl::requestIceServers(IceServersResponse callback) {
   req.body =
       nlohmann::json({{"deviceId", deviceId_}, {"productId", productId_}})
           .dump();
+  req.connectTimeoutMs = HTTP_CONNECT_TIMEOUT_MS;
+  req.timeoutMs = HTTP_TIMEOUT_MS;
+  req.cancellationToken = closeCancel_;
+  // Clients may resolve the request before sendRequest returns, and the
+  // callback takes the lock.
+  lock.unlock();
+  // A new token may have been created for the request.
+  saveState();
 
   auto self = shared_from_this();
   httpCli_->sendRequest(
       req,
       [self, callback](const std::unique_ptr<SignalingHttpResponse>& response) {
-        if (response == nullptr) {
-          callback({});
-        } else {
-          const int httpOkStartRange = 200;
-          const int httpOkEndRange = 299;
-          if (response->statusCode >= httpOkStartRange &&
-              response->statusCode <= httpOkEndRange) {
-            callback(SignalingDeviceImpl::parseIceServers(response->body));
-          } else {
-            callback({});
+        std::vector<struct IceServer> servers;
+        const int httpOkStartRange = 200;
+        const int httpOkEndRange = 299;
+        if (response != nullptr && response->statusCode >= httpOkStartRange &&
+            response->statusCode <= httpOkEndRange) {
+          servers = SignalingDeviceImpl::parseIceServers(response->body);
+          if (self->stateStore_ && !servers.empty()) {
+            {
+              const std::lock_guard<std::mutex> lock(self->mutex_);
+              self->warmState_.iceServers = servers;
+              self->warmState_.iceServersExpireAt =
+                  WarmStartState::unixNow() +
+                  WarmStartState::iceServersTtl(response->body);
+            }
+            self->saveState();
           }
         }
+        self->postCallback([callback, servers]() { callback(servers); });
       });
 }
 
-void SignalingDeviceImpl::channelClosed(const std::string& channelId) {
+void SignalingDeviceImpl::channelClosed(const ChannelKey& key) {
+  const std::string str = key.str();
   websocketSendError(
-      channelId,
+      str,
       SignalingError(SignalingErrorCode::CHANNEL_CLOSED,
                      "The signaling channel has been closed in the device."));
   const std::lock_guard<std::mutex> lock(mutex_);
-  channels_.erase(channelId);
+  channels_.erase(key);
+  localRoutes_.erase(str);
+  localTokens_.erase(str);
 }
 
 std::vector<struct IceServer> SignalingDeviceImpl::parseIceServers(
@@ -490,10 +1163,22 @@ std::vector<struct IceServer> SignalingDeviceImpl::parseIceServers(
 }
 
 void SignalingDeviceImpl::changeState(SignalingDeviceState state) {
-  state_ = state;
-  for (const auto& [id, handler] : stateHandlers_) {
-    handler(state);
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    state_ = state;
   }
+  auto self = shared_from_this();
+  postCallback([self, state]() {
+    std::map<ConnectionStateListenerId, SignalingDeviceStateHandler>
+        stateHandlers;
+    {
+      const std::lock_guard<std::mutex> lock(self->mutex_);
+      stateHandlers = self->stateHandlers_;
+    }
+    for (const auto& [id, handler] : stateHandlers) {
+      handler(state);
+    }
+  });
 }
 
 }  // namespace webrtc
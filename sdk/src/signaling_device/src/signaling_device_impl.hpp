@@ -1,13 +1,23 @@
 #pragma once
+#include "channel_table.hpp"
+#include "endpoint_selector.hpp"
+#include "outbound_queue.hpp"
+#include "reconnect_backoff.hpp"
 #include "signaling_impl.hpp"
+#include "warm_start_state.hpp"
 #include "websocket_connection.hpp"
 
 #include <nabto/webrtc/device.hpp>
 
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
 namespace nabto {
 namespace webrtc {
@@ -32,6 +42,7 @@ class SignalingDeviceImpl
   void start() override;
   void close() override;
   void checkAlive() override;
+  SignalingRttStats getRttStats() override;
   void requestIceServers(IceServersResponse callback) override;
 
   NewChannelListenerId addNewChannelListener(
@@ -79,18 +90,36 @@ class SignalingDeviceImpl
   // #### END OF SDK FUNCTIONS ####
 
   // #### INTERNAL FUNCTIONS ####
-  void websocketSendMessage(const std::string& channelId,
-                            const nlohmann::json& message);
-  void websocketSendError(const std::string& channelId,
-                          const SignalingError& error);
+  /**
+   * Send a message to the client of a channel. The key is the one passed to
+   * the channel when it was created, it routes the message to the local
+   * listener client or the Nabto Signaling Service. See
+   * WebsocketConnection::send() for priority and ordered.
+   */
+  void websocketSendMessage(const std::string& key,
+                            const nlohmann::json& message,
+                            SendPriority priority, bool ordered);
+  void websocketSendError(const std::string& key, const SignalingError& error);
+
+  void channelClosed(const ChannelKey& key);
+
+  /**
+   * Invoke an application callback through the configured callback executor.
+   */
+  void postCallback(std::function<void()> callback);
 
-  void channelClosed(const std::string& channelId);
+  /**
+   * The signaling endpoint the device attached through last.
+   */
+  std::string currentEndpoint() {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return endpoints_.current();
+  }
 
  private:
   SignalingWebsocketPtr wsImpl_;
   SignalingHttpClientPtr httpCli_;
-  std::map<std::string, SignalingChannelImplPtr>
-      channels_;  // channel ID to channel impl
+  ChannelTable channels_;  // channel ID to channel impl
 
   std::map<NewChannelListenerId, NewSignalingChannelHandler> chanHandlers_;
   std::map<ConnectionStateListenerId, SignalingDeviceStateHandler>
@@ -104,7 +133,7 @@ class SignalingDeviceImpl
   std::string deviceId_;
   std::string productId_;
   SignalingTokenGeneratorPtr tokenProvider_;
-  std::string httpHost_;
+  EndpointSelector endpoints_;
   bool closed_ = false;
   bool firstConnect_ = true;
   SignalingDeviceState state_ = SignalingDeviceState::NEW;
@@ -114,9 +143,11 @@ class SignalingDeviceImpl
 
   // WS STUFF
   WebsocketConnectionPtr ws_;
-  size_t reconnectCounter_ = 0;
+  ReconnectBackoff backoff_;
   SignalingTimerFactoryPtr timerFactory_;
   SignalingTimerPtr timer_;
+  uint32_t keepAliveIntervalMs_ = 0;
+  SignalingCallbackExecutorPtr callbackExecutor_;
 
   std::string wsUrl_;
 
@@ -124,14 +155,87 @@ class SignalingDeviceImpl
   void connectWs();
   void handleWsMessage(SignalingMessageType type,
                        const nlohmann::json& message);
+  // Handle a message for the channel with the key, called with mutex_
+  // locked, returns with it unlocked.
+  void handleChannelMessage(SignalingMessageType type,
+                            const nlohmann::json& message,
+                            const ChannelKey& key, bool local);
 
   void sendPong();
+  // Called with mutex_ locked.
+  void sendToClient(const std::string& key, nlohmann::json msg,
+                    SendPriority priority, bool ordered);
+  void handleReconnectHint(const nlohmann::json& message);
   void waitReconnect();
   void changeState(SignalingDeviceState state);
 
   // HTTP STUFF
+  // Cancels the attach request of the current connect attempt.
+  SignalingCancellationTokenPtr connectCancel_;
+  // Cancels all other requests when the device is closed.
+  SignalingCancellationTokenPtr closeCancel_ =
+      SignalingCancellationToken::create();
+
+  // An attach raced against the signaling endpoints. All requests of a race
+  // share the cancellation token of the request template.
+  struct AttachRace {
+    SignalingHttpRequest request;
+    std::vector<std::string> urls;
+    size_t started = 0;
+    size_t failed = 0;
+    SignalingTimerPtr staggerTimer;
+  };
+  using AttachRacePtr = std::shared_ptr<AttachRace>;
+  AttachRacePtr race_;
+  SignalingTimerPtr probeTimer_;
+
+  void startAttach(const AttachRacePtr& race);
+  void handleAttachResponse(
+      const AttachRacePtr& race, const std::string& endpoint,
+      std::chrono::steady_clock::time_point sentAt,
+      const std::unique_ptr<SignalingHttpResponse>& response);
+  std::chrono::steady_clock::time_point now();
+  uint32_t msSince(std::chrono::steady_clock::time_point from);
+  void scheduleProbe();
+  void probeEndpoints();
+  void handleProbeResponse(const std::string& url,
+                           std::chrono::steady_clock::time_point sentAt,
+                           bool reachable,
+                           const std::shared_ptr<size_t>& pending);
+  void stopEndpointTimers();
 
   void parseAttachResponse(const std::string& response);
+  bool getToken(std::string& token);
+
+  // WARM START
+  SignalingStateStorePtr stateStore_;
+  WarmStartState warmState_;
+  // The first connect attempt after start goes directly to the saved
+  // signaling URL, later attempts attach as usual.
+  bool useSavedUrl_ = false;
+  // The last state passed to the store, to not save unchanged state.
+  std::string savedState_;
+
+  void loadState();
+  void saveState();
+
+  // LOCAL SIGNALING
+  SignalingWebsocketServerPtr localServer_;
+  std::map<uint64_t, WebsocketConnectionPtr> localConnections_;
+  uint64_t nextLocalConnection_ = 0;
+  // Channel key to the local connection the client of the channel is
+  // currently connected through.
+  std::map<std::string, uint64_t> localRoutes_;
+  // Channel key to the token a client must present to move the channel to
+  // a new connection.
+  std::map<std::string, std::string> localTokens_;
+
+  void acceptLocal(const SignalingWebsocketPtr& websocket);
+  void handleLocalMessage(uint64_t connection, SignalingMessageType type,
+                          const nlohmann::json& message);
+  void issueReconnectToken(uint64_t connection, const ChannelKey& key);
+  void localClosed(uint64_t connection);
+
   std::string DEFAULT_SIGNALING_DOMAIN = ".webrtc.nabto.net";
 
  public:
@@ -5,6 +5,7 @@
 #include <nlohmann/json.hpp>
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 
 namespace nabto {
@@ -26,6 +27,19 @@ enum SignalingMessageType : std::uint8_t {
   PEER_CONNECTED,
   PING,
   PONG,
+  RECONNECT,
+};
+
+/**
+ * Executor used when the application has not configured one. Callbacks are
+ * run directly on the calling thread.
+ */
+class InlineCallbackExecutor : public SignalingCallbackExecutor {
+ public:
+  static SignalingCallbackExecutorPtr create() {
+    return std::make_shared<InlineCallbackExecutor>();
+  }
+  void post(std::function<void()> callback) override { callback(); }
 };
 
 }  // namespace webrtc
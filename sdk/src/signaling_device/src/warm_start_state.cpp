@@ -0,0 +1,160 @@
+#include "warm_start_state.hpp"
+
+#include "logging.hpp"
+
+#include <nabto/webrtc/device.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int STATE_VERSION = 1;
+const std::string BASE64URL_ALPHABET =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+std::optional<std::string> base64UrlDecode(const std::string& in) {
+  const uint32_t bitsPerChar = 6;
+  const uint32_t bitsPerByte = 8;
+  const uint32_t byteMask = 0xff;
+  std::string out;
+  uint32_t buffer = 0;
+  uint32_t bits = 0;
+  for (const char c : in) {
+    if (c == '=') {
+      break;
+    }
+    const size_t value = BASE64URL_ALPHABET.find(c);
+    if (value == std::string::npos) {
+      return std::nullopt;
+    }
+    buffer = (buffer << bitsPerChar) | static_cast<uint32_t>(value);
+    bits += bitsPerChar;
+    if (bits >= bitsPerByte) {
+      bits -= bitsPerByte;
+      out.push_back(static_cast<char>((buffer >> bits) & byteMask));
+    }
+  }
+  return out;
+}
+
+}  // namespace
+
+namespace nabto {
+namespace webrtc {
+
+std::optional<WarmStartState> WarmStartState::parse(const std::string& data) {
+  if (data.empty()) {
+    return std::nullopt;
+  }
+  try {
+    auto root = nlohmann::json::parse(data);
+    if (root.at("version").get<int>() != STATE_VERSION) {
+      NABTO_SIGNALING_LOGD << "Ignoring saved state of another version";
+      return std::nullopt;
+    }
+    WarmStartState state;
+    state.signalingUrl = root.value("signalingUrl", "");
+    state.signalingUrlReceivedAt =
+        root.value("signalingUrlReceivedAt", int64_t{0});
+    state.token = root.value("token", "");
+    state.tokenExpiresAt = root.value("tokenExpiresAt", int64_t{0});
+    if (root.contains("iceServers")) {
+      for (const auto& server : root.at("iceServers")) {
+        state.iceServers.push_back(
+            {server.at("username").get<std::string>(),
+             server.at("credential").get<std::string>(),
+             server.at("urls").get<std::vector<std::string>>()});
+      }
+    }
+    state.iceServersExpireAt = root.value("iceServersExpireAt", int64_t{0});
+    return state;
+  } catch (std::exception& exception) {
+    NABTO_SIGNALING_LOGE << "Failed to parse saved state: "
+                         << exception.what();
+  }
+  return std::nullopt;
+}
+
+std::string WarmStartState::dump() const {
+  nlohmann::json servers = nlohmann::json::array();
+  for (const auto& server : iceServers) {
+    servers.push_back({{"username", server.username},
+                       {"credential", server.credential},
+                       {"urls", server.urls}});
+  }
+  return nlohmann::json({{"version", STATE_VERSION},
+                         {"signalingUrl", signalingUrl},
+                         {"signalingUrlReceivedAt", signalingUrlReceivedAt},
+                         {"token", token},
+                         {"tokenExpiresAt", tokenExpiresAt},
+                         {"iceServers", servers},
+                         {"iceServersExpireAt", iceServersExpireAt}})
+      .dump();
+}
+
+std::optional<int64_t> WarmStartState::tokenExpiry(const std::string& jwt) {
+  const size_t first = jwt.find('.');
+  if (first == std::string::npos) {
+    return std::nullopt;
+  }
+  const size_t second = jwt.find('.', first + 1);
+  if (second == std::string::npos) {
+    return std::nullopt;
+  }
+  auto payload = base64UrlDecode(jwt.substr(first + 1, second - first - 1));
+  if (!payload.has_value()) {
+    return std::nullopt;
+  }
+  try {
+    auto claims = nlohmann::json::parse(*payload);
+    if (claims.contains("exp")) {
+      return claims.at("exp").get<int64_t>();
+    }
+  } catch (std::exception& exception) {
+    NABTO_SIGNALING_LOGD << "Token payload is not JSON: " << exception.what();
+  }
+  return std::nullopt;
+}
+
+int64_t WarmStartState::iceServersTtl(const std::string& response) {
+  try {
+    auto root = nlohmann::json::parse(response);
+    if (root.contains("ttl")) {
+      return root.at("ttl").get<int64_t>();
+    }
+  } catch (std::exception& exception) {
+    NABTO_SIGNALING_LOGD << "Failed to parse ICE servers ttl: "
+                         << exception.what();
+  }
+  return DEFAULT_ICE_SERVERS_TTL_S;
+}
+
+int64_t WarmStartState::unixNow() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+bool WarmStartState::hasSignalingUrl(int64_t now) const {
+  return !signalingUrl.empty() && signalingUrlReceivedAt <= now &&
+         now - signalingUrlReceivedAt < SIGNALING_URL_MAX_AGE_S;
+}
+
+bool WarmStartState::hasToken(int64_t now) const {
+  return !token.empty() && tokenExpiresAt - TOKEN_MIN_REMAINING_S > now;
+}
+
+bool WarmStartState::hasIceServers(int64_t now) const {
+  return !iceServers.empty() && iceServersExpireAt > now;
+}
+
+}  // namespace webrtc
+}  // namespace nabto
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <nabto/webrtc/device.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace nabto {
+namespace webrtc {
+
+/**
+ * State the device saves through a SignalingStateStore, so a restarted
+ * device process can skip the work it did before the restart. All times are
+ * unix time in seconds, as the state must survive the process.
+ */
+class WarmStartState {
+ public:
+  // The signaling URL from an attach is only reused by a restart shortly
+  // after it was received, an older URL most likely points to a signaling
+  // server which has moved on.
+  static const int64_t SIGNALING_URL_MAX_AGE_S = 600;
+  // A token is not reused if it expires within this margin, the backend may
+  // reject it before the request arrives.
+  static const int64_t TOKEN_MIN_REMAINING_S = 60;
+  // Lifetime of ICE servers when the backend does not include a ttl.
+  static const int64_t DEFAULT_ICE_SERVERS_TTL_S = 600;
+
+  /**
+   * Parse a saved state.
+   *
+   * @return The state or std::nullopt if the data is empty or invalid.
+   */
+  static std::optional<WarmStartState> parse(const std::string& data);
+  std::string dump() const;
+
+  /**
+   * Get the exp claim of a JWT.
+   *
+   * @return The expiry or std::nullopt if the token is not a JWT with an exp
+   * claim.
+   */
+  static std::optional<int64_t> tokenExpiry(const std::string& jwt);
+
+  /**
+   * Get the ttl in seconds of an ICE servers response.
+   */
+  static int64_t iceServersTtl(const std::string& response);
+
+  static int64_t unixNow();
+
+  bool hasSignalingUrl(int64_t now) const;
+  bool hasToken(int64_t now) const;
+  bool hasIceServers(int64_t now) const;
+
+  std::string signalingUrl;
+  int64_t signalingUrlReceivedAt = 0;
+  std::string token;
+  int64_t tokenExpiresAt = 0;
+  std::vector<struct IceServer> iceServers;
+  int64_t iceServersExpireAt = 0;
+};
+
+}  // namespace webrtc
+}  // namespace nabto
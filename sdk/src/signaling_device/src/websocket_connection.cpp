@@ -5,9 +5,13 @@
 
 #include <nlohmann/json_fwd.hpp>
 
-#include <cstddef>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <exception>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -15,14 +19,121 @@
 namespace nabto {
 namespace webrtc {
 
-bool WebsocketConnection::send(const std::string& data) {
-  return ws_->send(data);
+namespace {
+
+uint32_t msBetween(std::chrono::steady_clock::time_point from,
+                   std::chrono::steady_clock::time_point to) {
+  if (to <= from) {
+    return 0;
+  }
+  return static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(to - from)
+          .count());
+}
+
+uint32_t absDiff(uint32_t a, uint32_t b) { return a > b ? a - b : b - a; }
+
+}  // namespace
+
+bool WebsocketConnection::send(const std::string& data,
+                               SendPriority priority,
+                               const std::string& channel, bool ordered) {
+  // Read without the lock, the websocket may hold its own lock while calling
+  // the buffered amount low callback, which takes ours.
+  const size_t buffered = ws_->bufferedAmount();
+  bool direct = false;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (sending_) {
+      // The thread sending picks it up.
+      queue_.push(priority, data, channel, ordered);
+      drainRequested_ = true;
+      return true;
+    }
+    sending_ = true;
+    if (queue_.empty() && buffered < SEND_BUFFER_HIGH_BYTES) {
+      direct = true;
+    } else {
+      queue_.push(priority, data, channel, ordered);
+    }
+  }
+  bool ok = true;
+  if (direct) {
+    ok = ws_->send(data);
+  }
+  sendQueued();
+  return ok;
 }
 
-void WebsocketConnection::close() { ws_->close(); }
+void WebsocketConnection::drain() {
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (sending_) {
+      drainRequested_ = true;
+      return;
+    }
+    sending_ = true;
+  }
+  sendQueued();
+}
+
+void WebsocketConnection::sendQueued() {
+  bool watch = false;
+  std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+  while (true) {
+    const size_t buffered = ws_->bufferedAmount();
+    lock.lock();
+    if (queue_.empty() || buffered >= SEND_BUFFER_HIGH_BYTES) {
+      if (drainRequested_) {
+        // Frames were queued or the buffer drained meanwhile, look again.
+        drainRequested_ = false;
+        lock.unlock();
+        continue;
+      }
+      sending_ = false;
+      watch = !queue_.empty() && !std::exchange(watchingBuffer_, true);
+      break;
+    }
+    auto data = queue_.pop();
+    lock.unlock();
+    ws_->send(*data);
+  }
+  lock.unlock();
+  if (watch) {
+    const std::weak_ptr<WebsocketConnection> weak = shared_from_this();
+    ws_->onBufferedAmountLow(SEND_BUFFER_LOW_BYTES, [weak]() {
+      auto self = weak.lock();
+      if (self) {
+        self->drain();
+      }
+    });
+    // The buffer may have drained before the callback was set.
+    drain();
+  }
+}
+
+void WebsocketConnection::close() {
+  SignalingTimerPtr timer;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    queue_.clear();
+    timer = timer_;
+  }
+  // Cancelled outside the lock, timers may wait for a running callback which
+  // takes it.
+  if (timer) {
+    timer->cancel();
+  }
+  ws_->close();
+}
 
 void WebsocketConnection::onOpen(std::function<void()> callback) {
-  ws_->onOpen(std::move(callback));
+  auto self = shared_from_this();
+  ws_->onOpen([self, callback]() {
+    self->handleOpen();
+    callback();
+  });
 }
 
 void WebsocketConnection::onMessage(
@@ -30,6 +141,10 @@ void WebsocketConnection::onMessage(
                              nlohmann::json& message)>& callback) {
   auto self = shared_from_this();
   ws_->onMessage([self, callback](const std::string& msg) {
+    {
+      const std::lock_guard<std::mutex> lock(self->mutex_);
+      self->lastReceived_ = self->now();
+    }
     try {
       auto root = nlohmann::json::parse(msg);
       auto type = parseWsMsgType(root.at("type").get<std::string>());
@@ -46,36 +161,173 @@ void WebsocketConnection::onMessage(
 }
 
 void WebsocketConnection::onClosed(std::function<void()> callback) {
-  ws_->onClosed(std::move(callback));
+  auto self = shared_from_this();
+  ws_->onClosed([self, callback]() {
+    self->handleClosed();
+    callback();
+  });
 }
 
 void WebsocketConnection::open(const std::string& url) { ws_->open(url); }
 
 void WebsocketConnection::onError(
     std::function<void(const std::string& error)> callback) {
-  ws_->onError(std::move(callback));
+  auto self = shared_from_this();
+  ws_->onError([self, callback](const std::string& error) {
+    self->handleClosed();
+    callback(error);
+  });
 }
 
 void WebsocketConnection::checkAlive() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (closed_) {
+    return;
+  }
+  if (pingOutstanding_) {
+    NABTO_SIGNALING_LOGD << "checkAlive called with a PING outstanding";
+    return;
+  }
+  sendPing(lock);
+}
+
+SignalingRttStats WebsocketConnection::getRttStats() {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return rttStats_;
+}
+
+uint32_t WebsocketConnection::pongTimeoutMs() {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return pongTimeoutMsLocked();
+}
+
+void WebsocketConnection::handleOpen() {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  lastReceived_ = now();
+  if (keepAliveIntervalMs_ > 0) {
+    scheduleTimeout(keepAliveIntervalMs_);
+  }
+}
+
+void WebsocketConnection::handleClosed() {
+  SignalingTimerPtr timer;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    timer = timer_;
+  }
+  if (timer) {
+    timer->cancel();
+  }
+}
+
+void WebsocketConnection::handlePong() {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  if (!pingOutstanding_) {
+    NABTO_SIGNALING_LOGD << "WS handle unsolicited PONG";
+    return;
+  }
+  pingOutstanding_ = false;
+  const uint32_t rtt = msBetween(pingSentAt_, now());
+  addRttSample(rtt);
+  NABTO_SIGNALING_LOGD << "WS handle PONG, rtt: " << rtt
+                       << "ms srtt: " << rttStats_.srttMs
+                       << "ms rttvar: " << rttStats_.rttVarMs << "ms";
+}
+
+void WebsocketConnection::handleTimeout() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (closed_) {
+    return;
+  }
+  const auto current = now();
+  if (pingOutstanding_) {
+    const uint32_t waited = msBetween(pingSentAt_, current);
+    const uint32_t timeout = pongTimeoutMsLocked();
+    if (waited < timeout) {
+      scheduleTimeout(timeout - waited);
+      return;
+    }
+    NABTO_SIGNALING_LOGE << "Alive Timeout, no PONG received within "
+                         << timeout << "ms";
+    pingOutstanding_ = false;
+    closed_ = true;
+    lock.unlock();
+    ws_->close();
+    return;
+  }
+  if (keepAliveIntervalMs_ == 0) {
+    return;
+  }
+  // Only ping if nothing has been received for a full interval, incoming
+  // traffic already proves the connection is alive.
+  const uint32_t idle = msBetween(lastReceived_, current);
+  if (idle >= keepAliveIntervalMs_) {
+    sendPing(lock);
+  } else {
+    scheduleTimeout(keepAliveIntervalMs_ - idle);
+  }
+}
+
+void WebsocketConnection::sendPing(std::unique_lock<std::mutex>& lock) {
   const nlohmann::json ping = {{"type", "PING"}};
-  const size_t timeout = 1000;  // 1s
-  const size_t currentPongs = pongCounter_;
+  pingOutstanding_ = true;
+  pingSentAt_ = now();
+  scheduleTimeout(pongTimeoutMsLocked());
+  lock.unlock();
   auto msg = ping.dump();
   NABTO_SIGNALING_LOGD << "WS sending PING: " << msg;
-  ws_->send(msg);
-  auto self = shared_from_this();
-  timer_ = timerFactory_->createTimer();
-  timer_->setTimeout(timeout, [currentPongs, self]() {
-    if (self->pongCounter_ == currentPongs) {
-      NABTO_SIGNALING_LOGE << "Alive Timeout";
-      self->ws_->close();
+  send(msg, SendPriority::CONTROL);
+}
+
+WebsocketConnection::Clock::time_point WebsocketConnection::now() const {
+  if (timerFactory_) {
+    return timerFactory_->now();
+  }
+  return Clock::now();
+}
+
+void WebsocketConnection::scheduleTimeout(uint32_t timeoutMs) {
+  if (!timer_) {
+    timer_ = timerFactory_->createTimer();
+  }
+  // The timer must not keep the connection alive after the device has moved
+  // on to a new connection.
+  const std::weak_ptr<WebsocketConnection> weak = shared_from_this();
+  timer_->setTimeout(timeoutMs, [weak]() {
+    auto self = weak.lock();
+    if (self) {
+      self->handleTimeout();
     }
   });
 }
 
-void WebsocketConnection::handlePong() {
-  NABTO_SIGNALING_LOGD << "WS handle PONG";
-  pongCounter_++;
+void WebsocketConnection::addRttSample(uint32_t rttMs) {
+  // RFC 6298 section 2 with alpha = 1/8 and beta = 1/4.
+  const uint32_t alphaInv = 8;
+  const uint32_t betaInv = 4;
+  if (rttStats_.samples == 0) {
+    rttStats_.srttMs = rttMs;
+    rttStats_.rttVarMs = rttMs / 2;
+  } else {
+    rttStats_.rttVarMs =
+        rttStats_.rttVarMs - (rttStats_.rttVarMs / betaInv) +
+        (absDiff(rttStats_.srttMs, rttMs) / betaInv);
+    rttStats_.srttMs =
+        rttStats_.srttMs - (rttStats_.srttMs / alphaInv) + (rttMs / alphaInv);
+  }
+  rttStats_.lastRttMs = rttMs;
+  rttStats_.samples++;
+}
+
+uint32_t WebsocketConnection::pongTimeoutMsLocked() const {
+  if (rttStats_.samples == 0) {
+    return INITIAL_PONG_TIMEOUT_MS;
+  }
+  const uint32_t k = 4;
+  const uint32_t timeout =
+      rttStats_.srttMs + (k * rttStats_.rttVarMs) + PONG_TIMEOUT_MARGIN_MS;
+  return std::clamp(timeout, MIN_PONG_TIMEOUT_MS, MAX_PONG_TIMEOUT_MS);
 }
 
 SignalingMessageType WebsocketConnection::parseWsMsgType(
@@ -98,6 +350,9 @@ SignalingMessageType WebsocketConnection::parseWsMsgType(
   if (str == "PONG") {
     return SignalingMessageType::PONG;
   }
+  if (str == "RECONNECT") {
+    return SignalingMessageType::RECONNECT;
+  }
   throw std::invalid_argument("Invalid message type: " + str);
 }
 }  // namespace webrtc
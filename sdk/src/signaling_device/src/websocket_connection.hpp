@@ -1,14 +1,18 @@
 #pragma once
 
+#include "outbound_queue.hpp"
 #include "signaling_impl.hpp"
 
 #include <nabto/webrtc/device.hpp>
 
 #include <nlohmann/json.hpp>
 
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 
 namespace nabto {
@@ -20,15 +24,24 @@ using WebsocketConnectionPtr = std::shared_ptr<WebsocketConnection>;
 class WebsocketConnection
     : public std::enable_shared_from_this<WebsocketConnection> {
  public:
+  /**
+   * Create a websocket connection. If keepAliveIntervalMs is non-zero, a PING
+   * is sent when nothing has been received for that long once the websocket
+   * is open.
+   */
   static WebsocketConnectionPtr create(SignalingWebsocketPtr websocket,
-                                       SignalingTimerFactoryPtr timerFactory) {
-    return std::make_shared<WebsocketConnection>(std::move(websocket),
-                                                 std::move(timerFactory));
+                                       SignalingTimerFactoryPtr timerFactory,
+                                       uint32_t keepAliveIntervalMs = 0) {
+    return std::make_shared<WebsocketConnection>(
+        std::move(websocket), std::move(timerFactory), keepAliveIntervalMs);
   }
 
   WebsocketConnection(SignalingWebsocketPtr websocket,
-                      SignalingTimerFactoryPtr timerFactory)
-      : ws_(std::move(websocket)), timerFactory_(std::move(timerFactory)) {}
+                      SignalingTimerFactoryPtr timerFactory,
+                      uint32_t keepAliveIntervalMs = 0)
+      : ws_(std::move(websocket)),
+        timerFactory_(std::move(timerFactory)),
+        keepAliveIntervalMs_(keepAliveIntervalMs) {}
 
   ~WebsocketConnection() {
     if (timer_) {
@@ -42,7 +55,21 @@ class WebsocketConnection
   WebsocketConnection(WebsocketConnection&&) = delete;
   WebsocketConnection& operator=(WebsocketConnection&&) = delete;
 
-  bool send(const std::string& data);
+  /**
+   * Send a frame. Frames are passed to the websocket at once while its send
+   * buffer is short, otherwise they are queued and sent in priority order as
+   * the buffer drains, see OutboundQueue. The websocket is called without
+   * holding the connection lock.
+   *
+   * @param data The frame.
+   * @param priority The lane of the frame.
+   * @param channel Channel the frame belongs to, if any.
+   * @param ordered The frame must not overtake earlier frames of the channel.
+   * @return false if the websocket did not accept the frame. Queued frames
+   * are reported as accepted.
+   */
+  bool send(const std::string& data, SendPriority priority,
+            const std::string& channel = {}, bool ordered = false);
   void close();
   void onOpen(std::function<void()> callback);
   void onMessage(const std::function<void(SignalingMessageType type,
@@ -54,13 +81,61 @@ class WebsocketConnection
 
   void checkAlive();
 
+  SignalingRttStats getRttStats();
+
+  /**
+   * Timeout to wait for a PONG before the connection is considered dead.
+   * Computed as in RFC 6298 from the smoothed RTT and its variance plus a
+   * margin. Before the first sample INITIAL_PONG_TIMEOUT_MS is used.
+   */
+  uint32_t pongTimeoutMs();
+
+  static constexpr uint32_t INITIAL_PONG_TIMEOUT_MS = 1000;
+  static constexpr uint32_t MIN_PONG_TIMEOUT_MS = 200;
+  static constexpr uint32_t MAX_PONG_TIMEOUT_MS = 10000;
+  static constexpr uint32_t PONG_TIMEOUT_MARGIN_MS = 100;
+
+  // Frames are queued in the connection instead of the websocket once this
+  // many bytes are buffered in the websocket, so a PONG waits for at most
+  // this much data ahead of it.
+  static constexpr size_t SEND_BUFFER_HIGH_BYTES = 16384;
+  // Queued frames are sent when the websocket buffer drains below this.
+  static constexpr size_t SEND_BUFFER_LOW_BYTES = 4096;
+
  private:
+  using Clock = std::chrono::steady_clock;
+
   SignalingWebsocketPtr ws_;
   SignalingTimerFactoryPtr timerFactory_;
-  size_t pongCounter_ = 0;
+  uint32_t keepAliveIntervalMs_ = 0;
   SignalingTimerPtr timer_ = nullptr;
 
+  std::mutex mutex_;
+  bool closed_ = false;
+  bool pingOutstanding_ = false;
+  Clock::time_point pingSentAt_;
+  Clock::time_point lastReceived_;
+  SignalingRttStats rttStats_;
+  OutboundQueue queue_;
+  bool watchingBuffer_ = false;
+  // A thread is passing frames to the websocket. Only one thread sends at a
+  // time, so frames reach the websocket in queue order while it is called
+  // without the lock.
+  bool sending_ = false;
+  // Frames were queued, or the buffer drained, while a thread was sending.
+  bool drainRequested_ = false;
+
+  void handleOpen();
+  void handleClosed();
   void handlePong();
+  void handleTimeout();
+  void drain();
+  void sendQueued();
+  void sendPing(std::unique_lock<std::mutex>& lock);
+  void scheduleTimeout(uint32_t timeoutMs);
+  Clock::time_point now() const;
+  void addRttSample(uint32_t rttMs);
+  uint32_t pongTimeoutMsLocked() const;
   static SignalingMessageType parseWsMsgType(const std::string& str);
 };
 
@@ -0,0 +1,411 @@
+#pragma once
+
+#include <nabto/webrtc/device.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+/**
+ * C++20 coroutine layer on top of the callback based SignalingDevice and
+ * SignalingChannel interfaces.
+ *
+ * Awaiting coroutines are resumed on the thread which invokes the underlying
+ * SDK callback. Configure a SignalingCallbackExecutor on the device to have
+ * them resumed on the application event loop.
+ */
+
+namespace nabto {
+namespace webrtc {
+namespace util {
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+class TaskPromiseBase {
+ public:
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> handle) noexcept {
+      auto& promise = handle.promise();
+      if (promise.continuation_) {
+        return promise.continuation_;
+      }
+      if (promise.detached_) {
+        handle.destroy();
+      }
+      return std::noop_coroutine();
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() {
+    if (detached_) {
+      // Nobody can observe the exception, same behavior as std::thread.
+      std::terminate();
+    }
+    exception_ = std::current_exception();
+  }
+
+  std::coroutine_handle<> continuation_;
+  bool detached_ = false;
+  std::exception_ptr exception_;
+
+ protected:
+  void rethrowIfFailed() const {
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+  }
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+ public:
+  Task<T> get_return_object();
+  void return_value(T value) { value_ = std::move(value); }
+  T result() {
+    rethrowIfFailed();
+    return std::move(*value_);
+  }
+
+ private:
+  std::optional<T> value_;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+ public:
+  Task<void> get_return_object();
+  void return_void() {}
+  void result() { rethrowIfFailed(); }
+};
+
+/**
+ * State shared between an awaiting coroutine and the SDK callback which
+ * completes it. The state lives in the awaiter, which lives in the suspended
+ * coroutine frame, so no allocation is needed. The callback may run on
+ * another thread before, during or after the coroutine suspends. Whichever of
+ * complete() and suspend() runs last continues the coroutine.
+ */
+template <typename T>
+class CallbackState {
+ public:
+  void complete(T value) {
+    value_ = std::move(value);
+    if (done_.exchange(true, std::memory_order_acq_rel)) {
+      // The coroutine has suspended. This object is destroyed once the
+      // coroutine continues, so it must not be touched after resume().
+      auto handle = handle_;
+      handle.resume();
+    }
+  }
+
+  /**
+   * Returns false if complete() has already run and the coroutine should not
+   * suspend.
+   */
+  bool suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    return !done_.exchange(true, std::memory_order_acq_rel);
+  }
+
+  T take() { return std::move(*value_); }
+
+ private:
+  std::optional<T> value_;
+  std::coroutine_handle<> handle_;
+  std::atomic<bool> done_{false};
+};
+
+/**
+ * Awaitable for a one shot callback operation. start is invoked with a
+ * pointer to the state when the coroutine suspends and must arrange for
+ * state->complete() to be called exactly once. The SDK resolves every
+ * callback it accepts, so the awaiting coroutine is always resumed.
+ */
+template <typename T, typename Start>
+class CallbackAwaitable {
+ public:
+  explicit CallbackAwaitable(Start start) : start_(std::move(start)) {}
+
+  bool await_ready() noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    start_(&state_);
+    return state_.suspend(handle);
+  }
+
+  T await_resume() { return state_.take(); }
+
+ private:
+  Start start_;
+  CallbackState<T> state_;
+};
+
+template <typename T, typename Start>
+CallbackAwaitable<T, Start> makeCallbackAwaitable(Start start) {
+  return CallbackAwaitable<T, Start>(std::move(start));
+}
+
+}  // namespace detail
+
+/**
+ * Lazily started coroutine task. A task starts running when it is awaited
+ * with `co_await`, or when start() is called on it. Exceptions thrown from an
+ * awaited task are rethrown in the awaiting coroutine.
+ *
+ * The awaitables in this file keep their state in the suspended coroutine
+ * frame, so a suspended task must not be destroyed. Started tasks destroy
+ * themselves when they finish.
+ */
+template <typename T>
+class [[nodiscard]] Task {
+ public:
+  using promise_type = detail::TaskPromise<T>;
+
+  explicit Task(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {}
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+  Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+
+  auto operator co_await() && noexcept {
+    struct Awaiter {
+      std::coroutine_handle<promise_type> handle;
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(
+          std::coroutine_handle<> continuation) noexcept {
+        handle.promise().continuation_ = continuation;
+        return handle;
+      }
+      T await_resume() { return handle.promise().result(); }
+    };
+    return Awaiter{handle_};
+  }
+
+  /**
+   * Start the task without awaiting it. The coroutine frame is destroyed when
+   * the coroutine finishes. Exceptions escaping a started task terminate the
+   * program.
+   */
+  void start() && {
+    auto handle = std::exchange(handle_, {});
+    handle.promise().detached_ = true;
+    handle.resume();
+  }
+
+ private:
+  std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+  return Task<void>(
+      std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+}  // namespace detail
+
+/**
+ * Request ICE servers from the Nabto Backend.
+ *
+ * `auto servers = co_await requestIceServersAsync(device);`
+ *
+ * @param device The device to request ICE servers with.
+ * @return Awaitable resolving to the ICE servers. The list is empty if the
+ * request failed.
+ */
+inline auto requestIceServersAsync(SignalingDevicePtr device) {
+  using Servers = std::vector<struct IceServer>;
+  return detail::makeCallbackAwaitable<Servers>(
+      [device = std::move(device)](detail::CallbackState<Servers>* state) {
+        device->requestIceServers(
+            [state](const Servers& servers) { state->complete(servers); });
+      });
+}
+
+/**
+ * Send a message on a signaling channel.
+ *
+ * `bool acked = co_await sendMessageAsync(channel, message);`
+ *
+ * @param channel The channel to send the message on.
+ * @param message The message to send.
+ * @return Awaitable resolving to true once the client has acknowledged the
+ * message, or false if the channel ended before that.
+ */
+inline auto sendMessageAsync(SignalingChannelPtr channel,
+                             nlohmann::json message) {
+  return detail::makeCallbackAwaitable<bool>(
+      [channel = std::move(channel),
+       message = std::move(message)](detail::CallbackState<bool>* state) {
+        channel->sendMessageWithAck(
+            message, [state](bool acked) { state->complete(acked); });
+      });
+}
+
+/**
+ * Stream of the messages received on a signaling channel.
+ *
+ * ```
+ * ChannelMessageStream stream(channel);
+ * while (auto msg = co_await stream.nextMessage()) {
+ *   ...
+ * }
+ * ```
+ *
+ * Messages received while no coroutine is waiting are buffered. The stream
+ * must be created before the first message can arrive, eg. from the new
+ * channel listener, to not miss it.
+ */
+class ChannelMessageStream {
+ public:
+  explicit ChannelMessageStream(SignalingChannelPtr channel)
+      : channel_(std::move(channel)), state_(std::make_shared<State>()) {
+    auto state = state_;
+    messageListener_ =
+        channel_->addMessageListener([state](const nlohmann::json& message) {
+          state->push(message);
+        });
+    stateListener_ = channel_->addStateChangeListener(
+        [state](SignalingChannelState channelState) {
+          if (channelState == SignalingChannelState::CLOSED ||
+              channelState == SignalingChannelState::FAILED) {
+            state->end();
+          }
+        });
+  }
+
+  ~ChannelMessageStream() {
+    channel_->removeMessageListener(messageListener_);
+    channel_->removeStateChangeListener(stateListener_);
+  }
+
+  ChannelMessageStream(const ChannelMessageStream&) = delete;
+  ChannelMessageStream& operator=(const ChannelMessageStream&) = delete;
+  ChannelMessageStream(ChannelMessageStream&&) = delete;
+  ChannelMessageStream& operator=(ChannelMessageStream&&) = delete;
+
+  /**
+   * Await the next message. Only one coroutine may await the stream at a
+   * time.
+   *
+   * @return Awaitable resolving to the next message, or std::nullopt once the
+   * channel is closed or failed and all buffered messages have been read.
+   */
+  auto nextMessage() { return Awaiter{state_}; }
+
+ private:
+  class State {
+   public:
+    void push(const nlohmann::json& message) {
+      std::coroutine_handle<> handle;
+      {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        messages_.push_back(message);
+        handle = std::exchange(waiter_, {});
+      }
+      if (handle) {
+        handle.resume();
+      }
+    }
+
+    void end() {
+      std::coroutine_handle<> handle;
+      {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        ended_ = true;
+        handle = std::exchange(waiter_, {});
+      }
+      if (handle) {
+        handle.resume();
+      }
+    }
+
+    bool ready() {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      return !messages_.empty() || ended_;
+    }
+
+    bool suspend(std::coroutine_handle<> handle) {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      if (!messages_.empty() || ended_) {
+        return false;
+      }
+      waiter_ = handle;
+      return true;
+    }
+
+    std::optional<nlohmann::json> pop() {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      if (messages_.empty()) {
+        return std::nullopt;
+      }
+      auto message = std::move(messages_.front());
+      messages_.pop_front();
+      return message;
+    }
+
+   private:
+    std::mutex mutex_;
+    std::deque<nlohmann::json> messages_;
+    bool ended_ = false;
+    std::coroutine_handle<> waiter_;
+  };
+
+  struct Awaiter {
+    std::shared_ptr<State> state;
+    bool await_ready() { return state->ready(); }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      return state->suspend(handle);
+    }
+    std::optional<nlohmann::json> await_resume() { return state->pop(); }
+  };
+
+  SignalingChannelPtr channel_;
+  std::shared_ptr<State> state_;
+  MessageListenerId messageListener_ = 0;
+  ChannelStateListenerId stateListener_ = 0;
+};
+
+}  // namespace util
+}  // namespace webrtc
+}  // namespace nabto
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <nabto/webrtc/device.hpp>
+#include <nabto/webrtc/util/coroutine.hpp>
+#include <nabto/webrtc/util/message_transport.hpp>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace nabto {
+namespace webrtc {
+namespace util {
+
+/**
+ * Wait for a MessageTransport to complete its setup phase.
+ *
+ * `auto iceServers = co_await setupDone(transport);`
+ *
+ * The setup done event is only emitted once, so this must be awaited before
+ * the transport can complete the setup, eg. from the new channel listener
+ * where the transport is created.
+ *
+ * @param transport The transport to wait for.
+ * @return Awaitable resolving to the ICE servers the transport requested
+ * during setup.
+ */
+inline auto setupDone(MessageTransportPtr transport) {
+  using Servers = std::vector<struct IceServer>;
+  return detail::makeCallbackAwaitable<Servers>(
+      [transport = std::move(transport)](
+          detail::CallbackState<Servers>* state) {
+        auto listenerId = std::make_shared<SetupDoneListenerId>(0);
+        const std::weak_ptr<MessageTransport> weak = transport;
+        *listenerId = transport->addSetupDoneListener(
+            [state, listenerId, weak](const Servers& servers) {
+              auto transport = weak.lock();
+              if (transport) {
+                transport->removeSetupDoneListener(*listenerId);
+              }
+              state->complete(servers);
+            });
+      });
+}
+
+}  // namespace util
+}  // namespace webrtc
+}  // namespace nabto
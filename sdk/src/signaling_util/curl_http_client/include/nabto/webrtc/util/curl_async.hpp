@@ -17,6 +17,8 @@ namespace util {
 class CurlAsync;
 using CurlAsyncPtr = std::shared_ptr<CurlAsync>;
 
+class CurlResponseBuffer;
+
 /**
  * Curl based HTTP client implementing the SignalingHttpClient interface used by
  * the SDK.
@@ -45,16 +47,14 @@ class CurlHttpClient : public nabto::webrtc::SignalingHttpClient,
 
  private:
   CurlAsyncPtr curl_ = nullptr;
-  std::string readBuffer_;
-  std::string writeBuffer_;
+  std::string requestBody_;
+  std::unique_ptr<CurlResponseBuffer> response_;
   std::string authHeader_;
   std::string ctHeader_;
   std::optional<std::string> caBundle_;
+  nabto::webrtc::SignalingCancellationTokenPtr cancellationToken_;
 
   struct curl_slist* curlReqHeaders_ = nullptr;
-
-  static size_t readFunc(void* ptr, size_t size, size_t nmemb, void* s);
-  static size_t writeFunc(void* ptr, size_t size, size_t nmemb, void* s);
 };
 
 /**
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <nabto/webrtc/device.hpp>
+
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace nabto {
+namespace webrtc {
+namespace util {
+
+/**
+ * Curl multi based HTTP client implementing the SignalingHttpClient interface
+ * used by the SDK.
+ *
+ * Each request has its own curl easy handle and buffers, so any number of
+ * requests can be in flight at the same time. All requests in the process are
+ * driven by a single shared curl multi thread, which is also the thread
+ * response callbacks are invoked from.
+ *
+ * Connections are kept open and reused between requests to the same host,
+ * and DNS results and TLS sessions are shared with the other curl clients of
+ * the process, so requests after the first one to the signaling service
+ * usually complete in a single round trip.
+ */
+class CurlMultiHttpClient : public nabto::webrtc::SignalingHttpClient {
+ public:
+  /**
+   * Create an instance of the SignalingHttpClient.
+   *
+   * @param caBundle optional path to a custom CA bundle to use
+   * @param http2 Negotiate HTTP/2 with servers supporting it, so concurrent
+   * requests are multiplexed on a single connection.
+   * @return Smart pointer to the created SignalingHttpClient.
+   */
+  static nabto::webrtc::SignalingHttpClientPtr create(
+      std::optional<std::string> caBundle, bool http2 = false);
+
+  explicit CurlMultiHttpClient(std::optional<std::string> caBundle,
+                               bool http2 = false);
+  ~CurlMultiHttpClient() override = default;
+  CurlMultiHttpClient(const CurlMultiHttpClient&) = delete;
+  CurlMultiHttpClient& operator=(const CurlMultiHttpClient&) = delete;
+  CurlMultiHttpClient(CurlMultiHttpClient&&) = delete;
+  CurlMultiHttpClient& operator=(CurlMultiHttpClient&&) = delete;
+
+  bool sendRequest(const nabto::webrtc::SignalingHttpRequest& request,
+                   nabto::webrtc::HttpResponseCallback callback) override;
+
+ private:
+  std::optional<std::string> caBundle_;
+  bool http2_;
+};
+
+}  // namespace util
+}  // namespace webrtc
+}  // namespace nabto
@@ -1,3 +1,6 @@
+#include "curl_global.hpp"
+#include "curl_response_buffer.hpp"
+
 #include <curl/curl.h>
 #include <curl/easy.h>
 
@@ -7,8 +10,6 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <cstring>
-#include <exception>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -20,13 +21,28 @@ namespace nabto {
 namespace webrtc {
 namespace util {
 
+namespace {
+
+// Called by curl at least once per second while a request is running, so a
+// cancelled request is aborted within a second.
+int xferInfoFunc(void* clientp, curl_off_t /*dltotal*/, curl_off_t /*dlnow*/,
+                 curl_off_t /*ultotal*/, curl_off_t /*ulnow*/) {
+  auto* token =
+      static_cast<nabto::webrtc::SignalingCancellationToken*>(clientp);
+  return token->isCancelled() ? 1 : 0;
+}
+
+}  // namespace
+
 nabto::webrtc::SignalingHttpClientPtr CurlHttpClient::create(
     std::optional<std::string> caBundle) {
   return std::make_shared<CurlHttpClient>(caBundle);
 }
 
 CurlHttpClient::CurlHttpClient(std::optional<std::string>& caBundle)
-    : curl_(CurlAsync::create()), caBundle_(caBundle) {}
+    : curl_(CurlAsync::create()),
+      response_(std::make_unique<CurlResponseBuffer>()),
+      caBundle_(caBundle) {}
 
 CurlHttpClient::~CurlHttpClient() {
   if (curlReqHeaders_ != nullptr) {
@@ -38,8 +54,8 @@ CurlHttpClient::~CurlHttpClient() {
 bool CurlHttpClient::sendRequest(
     const nabto::webrtc::SignalingHttpRequest& request,
     nabto::webrtc::HttpResponseCallback cb) {
-  readBuffer_ = request.body;
-  writeBuffer_.clear();
+  requestBody_ = request.body;
+  response_->reset();
 
   CURLcode res = CURLE_OK;
   CURL* curl = curl_->getCurl();
@@ -53,17 +69,7 @@ bool CurlHttpClient::sendRequest(
     return false;
   }
 
-  res = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeFunc);
-  if (res != CURLE_OK) {
-    NPLOGE << "Failed to initialize Curl request with CURLE: "
-           << curl_easy_strerror(res);
-    return false;
-  }
-
-  res = curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&writeBuffer_);
-  if (res != CURLE_OK) {
-    NPLOGE << "Failed to initialize Curl request with CURLE: "
-           << curl_easy_strerror(res);
+  if (!response_->attach(curl)) {
     return false;
   }
 
@@ -75,31 +81,52 @@ bool CurlHttpClient::sendRequest(
     }
   }
 
-  res = curl_easy_setopt(curl, CURLOPT_READFUNCTION, readFunc);
-
+  // The handle is reused, so the options are set on every request to clear
+  // the ones of the previous request. A timeout of 0 means no timeout.
+  res = curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS,
+                         static_cast<long>(  // NOLINT(google-runtime-int)
+                             request.connectTimeoutMs));
+  if (res == CURLE_OK) {
+    res = curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS,
+                           static_cast<long>(  // NOLINT(google-runtime-int)
+                               request.timeoutMs));
+  }
+  cancellationToken_ = request.cancellationToken;
+  if (res == CURLE_OK && cancellationToken_) {
+    res = curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferInfoFunc);
+    if (res == CURLE_OK) {
+      res = curl_easy_setopt(curl, CURLOPT_XFERINFODATA,
+                             static_cast<void*>(cancellationToken_.get()));
+    }
+  }
+  if (res == CURLE_OK) {
+    res = curl_easy_setopt(curl, CURLOPT_NOPROGRESS,
+                           cancellationToken_ ? 0L : 1L);
+  }
   if (res != CURLE_OK) {
     NPLOGE << "Failed to initialize Curl request with CURLE: "
            << curl_easy_strerror(res);
     return false;
   }
 
-  res = curl_easy_setopt(curl, CURLOPT_READDATA, (void*)&readBuffer_);
-
+  if (request.method == "POST") {
+    // The body is kept in requestBody_ until the request is resolved, so curl
+    // can send it in place.
+    res = curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE,
+                           static_cast<curl_off_t>(requestBody_.size()));
+    if (res == CURLE_OK) {
+      res = curl_easy_setopt(curl, CURLOPT_POSTFIELDS, requestBody_.c_str());
+    }
+  } else {
+    // The handle is reused, reset the method of a previous POST request.
+    res = curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+  }
   if (res != CURLE_OK) {
     NPLOGE << "Failed to initialize Curl request with CURLE: "
            << curl_easy_strerror(res);
     return false;
   }
 
-  if (request.method == "POST") {
-    res = curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    if (res != CURLE_OK) {
-      NPLOGE << "Failed to initialize Curl request with CURLE: "
-             << curl_easy_strerror(res);
-      return false;
-    }
-  }
-
   if (curlReqHeaders_ != nullptr) {
     curl_slist_free_all(curlReqHeaders_);
     curlReqHeaders_ = nullptr;
@@ -121,53 +148,13 @@ bool CurlHttpClient::sendRequest(
       cb(nullptr);
       return;
     }
-    NPLOGI << "Response data: " << self->writeBuffer_;
-    auto response = std::make_unique<nabto::webrtc::SignalingHttpResponse>();
-    response->body = self->writeBuffer_;
-    response->statusCode = statusCode;
-
-    // TODO(tk) read the headers
+    auto response = self->response_->take(statusCode);
+    NPLOGD << "Response data: " << response->body;
     cb(std::move(response));
   });
   return true;
 }
 
-size_t CurlHttpClient::readFunc(void* ptr, size_t size, size_t nmemb, void* s) {
-  try {
-    auto* buf = static_cast<std::string*>(s);
-    size_t ncpy = size * nmemb;
-    if (size * nmemb > buf->size()) {
-      ncpy = buf->size();
-    }
-    // NPLOGI << "size: " << size << " nmemb: " << nmemb << " buf size: " <<
-    // buf->size(); NPLOGI << "Copying " << ncpy << "bytes from: " << buf;
-    memcpy(ptr, buf->data(), ncpy);
-    *buf = buf->substr(ncpy);
-    return ncpy;
-  } catch (std::exception& ex) {
-    NPLOGE << "readFunc failure";
-    return 0;
-  }
-}
-
-size_t CurlHttpClient::writeFunc(void* ptr, size_t size, size_t nmemb,
-                                 void* s) {
-  if (s == stdout) {
-    // NPLOGI << "s was stdout, this is header data";
-    const std::string data(static_cast<char*>(ptr), size * nmemb);
-    NPLOGI << data;
-    return size * nmemb;
-  }
-  try {
-    auto* str = static_cast<std::string*>(s);
-    str->append(static_cast<char*>(ptr), size * nmemb);
-  } catch (std::exception& ex) {
-    NPLOGE << "WriteFunc failure";
-    return size * nmemb;
-  }
-  return size * nmemb;
-}
-
 CurlAsyncPtr CurlAsync::create() {
   auto c = std::make_shared<CurlAsync>();
   if (c->init()) {
@@ -181,22 +168,22 @@ CurlAsync::~CurlAsync() {
     stop();
   }
   curl_easy_cleanup(curl_);
-  curl_global_cleanup();
 }
 
 bool CurlAsync::init() {
-  CURLcode res = curl_global_init(CURL_GLOBAL_ALL);
-  if (res != CURLE_OK) {
-    NPLOGE << "Failed to initialize Curl global with: "
-           << curl_easy_strerror(res);
+  if (!curlGlobalInit()) {
     return false;
   }
+  CURLcode res = CURLE_OK;
   curl_ = curl_easy_init();
   if (curl_ == nullptr) {
     NPLOGE << "Failed to initialize Curl easy with: "
            << curl_easy_strerror(res);
     return false;
   }
+  if (!curlApplyCommonOptions(curl_)) {
+    return false;
+  }
 
   res = curl_easy_setopt(curl_, CURLOPT_VERBOSE, 0L);
   if (res != CURLE_OK) {
@@ -0,0 +1,105 @@
+#include "curl_global.hpp"
+
+#include <curl/curl.h>
+
+#include <nabto/webrtc/util/logging.hpp>
+
+#include <array>
+#include <mutex>
+
+namespace nabto {
+namespace webrtc {
+namespace util {
+
+namespace {
+
+// Seconds a connection is idle before keep alive probes are sent, and the
+// interval between probes.
+const long KEEP_ALIVE_IDLE_S = 30;      // NOLINT(google-runtime-int)
+const long KEEP_ALIVE_INTERVAL_S = 15;  // NOLINT(google-runtime-int)
+
+std::array<std::mutex, CURL_LOCK_DATA_LAST> shareLocks;
+
+void shareLock(CURL* /*handle*/, curl_lock_data data,
+               curl_lock_access /*access*/, void* /*userptr*/) {
+  shareLocks.at(data).lock();
+}
+
+void shareUnlock(CURL* /*handle*/, curl_lock_data data, void* /*userptr*/) {
+  shareLocks.at(data).unlock();
+}
+
+CURLSH* createShare() {
+  CURLSH* share = curl_share_init();
+  if (share == nullptr) {
+    NPLOGE << "Failed to initialize Curl share";
+    return nullptr;
+  }
+  CURLSHcode res = curl_share_setopt(share, CURLSHOPT_LOCKFUNC, shareLock);
+  if (res == CURLSHE_OK) {
+    res = curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, shareUnlock);
+  }
+  if (res == CURLSHE_OK) {
+    res = curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  }
+  if (res == CURLSHE_OK) {
+    res = curl_share_setopt(share, CURLSHOPT_SHARE,
+                            CURL_LOCK_DATA_SSL_SESSION);
+  }
+  if (res != CURLSHE_OK) {
+    NPLOGE << "Failed to configure Curl share with: "
+           << curl_share_strerror(res);
+    curl_share_cleanup(share);
+    return nullptr;
+  }
+  return share;
+}
+
+}  // namespace
+
+bool curlGlobalInit() {
+  static std::once_flag once;
+  static CURLcode result = CURLE_OK;
+  std::call_once(once, []() {
+    result = curl_global_init(CURL_GLOBAL_ALL);
+    if (result != CURLE_OK) {
+      NPLOGE << "Failed to initialize Curl global with: "
+             << curl_easy_strerror(result);
+    }
+  });
+  return result == CURLE_OK;
+}
+
+CURLSH* curlShare() {
+  // Like the global state the share lives until the process exits, easy
+  // handles using it may be cleaned up from static destructors.
+  static CURLSH* share = curlGlobalInit() ? createShare() : nullptr;
+  return share;
+}
+
+bool curlApplyCommonOptions(CURL* easy) {
+  CURLcode res = CURLE_OK;
+  CURLSH* share = curlShare();
+  if (share != nullptr) {
+    res = curl_easy_setopt(easy, CURLOPT_SHARE, share);
+  }
+  if (res == CURLE_OK) {
+    res = curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+  }
+  if (res == CURLE_OK) {
+    res = curl_easy_setopt(easy, CURLOPT_TCP_KEEPIDLE, KEEP_ALIVE_IDLE_S);
+  }
+  if (res == CURLE_OK) {
+    res = curl_easy_setopt(easy, CURLOPT_TCP_KEEPINTVL, KEEP_ALIVE_INTERVAL_S);
+  }
+  if (res != CURLE_OK) {
+    NPLOGE << "Failed to set Curl connection options with: "
+           << curl_easy_strerror(res);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace util
+}  // namespace webrtc
+}  // namespace nabto
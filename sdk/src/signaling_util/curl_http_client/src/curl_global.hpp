@@ -0,0 +1,44 @@
+#pragma once
+
+#include <curl/curl.h>
+
+namespace nabto {
+namespace webrtc {
+namespace util {
+
+/**
+ * Initialize libcurl for the process. curl_global_init is not thread safe and
+ * must only be called once, so every curl based client calls this instead.
+ * The global state is kept until the process exits.
+ *
+ * @return false if libcurl could not be initialized.
+ */
+bool curlGlobalInit();
+
+/**
+ * Get the process wide curl share handle. Easy handles using it share the DNS
+ * cache and TLS sessions, so requests to a host which has been contacted
+ * before skip the DNS lookup and resume the TLS session instead of doing a
+ * full handshake.
+ *
+ * Connections are not shared through this handle since libcurl does not
+ * support using a shared connection pool from several threads at once.
+ * Requests sent through the same multi handle share its connection pool.
+ *
+ * @return The share handle or nullptr if it could not be created.
+ */
+CURLSH* curlShare();
+
+/**
+ * Apply the options common to all easy handles made by the curl util: the
+ * process wide share handle and TCP keep alive, so idle connections to the
+ * signaling service survive NAT timeouts.
+ *
+ * @param easy The handle to configure.
+ * @return false if an option could not be set.
+ */
+bool curlApplyCommonOptions(CURL* easy);
+
+}  // namespace util
+}  // namespace webrtc
+}  // namespace nabto
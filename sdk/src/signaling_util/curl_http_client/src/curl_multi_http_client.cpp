@@ -0,0 +1,138 @@
+#include "curl_global.hpp"
+#include "curl_multi_loop.hpp"
+
+#include <curl/curl.h>
+
+#include <nabto/webrtc/device.hpp>
+#include <nabto/webrtc/util/curl_multi_http_client.hpp>
+#include <nabto/webrtc/util/logging.hpp>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace nabto {
+namespace webrtc {
+namespace util {
+
+namespace {
+
+template <typename T>
+bool setOption(CURL* easy, CURLoption option, T value) {
+  const CURLcode res = curl_easy_setopt(easy, option, value);
+  if (res != CURLE_OK) {
+    NPLOGE << "Failed to initialize Curl request with CURLE: "
+           << curl_easy_strerror(res);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+nabto::webrtc::SignalingHttpClientPtr CurlMultiHttpClient::create(
+    std::optional<std::string> caBundle, bool http2) {
+  return std::make_shared<CurlMultiHttpClient>(std::move(caBundle), http2);
+}
+
+CurlMultiHttpClient::CurlMultiHttpClient(std::optional<std::string> caBundle,
+                                         bool http2)
+    : caBundle_(std::move(caBundle)), http2_(http2) {}
+
+bool CurlMultiHttpClient::sendRequest(
+    const nabto::webrtc::SignalingHttpRequest& request,
+    nabto::webrtc::HttpResponseCallback callback) {
+  auto* loop = CurlMultiLoop::instance();
+  if (loop == nullptr) {
+    return false;
+  }
+
+  auto req = std::make_unique<CurlMultiRequest>();
+  req->easy_ = curl_easy_init();
+  if (req->easy_ == nullptr) {
+    NPLOGE << "Failed to initialize Curl easy";
+    return false;
+  }
+  CURL* easy = req->easy_;
+  req->body_ = request.body;
+
+  NPLOGD << "Sending HTTP request";
+
+  if (!setOption(easy, CURLOPT_URL, request.url.c_str()) ||
+      !setOption(easy, CURLOPT_NOPROGRESS, 1L) ||
+      // Signals cannot be used for timeouts with multiple threads.
+      !setOption(easy, CURLOPT_NOSIGNAL, 1L) ||
+      !req->response_.attach(easy)) {
+    return false;
+  }
+
+  if (!curlApplyCommonOptions(easy)) {
+    return false;
+  }
+
+  if (request.connectTimeoutMs > 0 &&
+      !setOption(easy, CURLOPT_CONNECTTIMEOUT_MS,
+                 static_cast<long>(  // NOLINT(google-runtime-int)
+                     request.connectTimeoutMs))) {
+    return false;
+  }
+  if (request.timeoutMs > 0 &&
+      !setOption(easy, CURLOPT_TIMEOUT_MS,
+                 static_cast<long>(  // NOLINT(google-runtime-int)
+                     request.timeoutMs))) {
+    return false;
+  }
+
+  // Negotiated through ALPN, servers without HTTP/2 support get HTTP/1.1.
+  // Waiting for the pipe makes concurrent requests share the first
+  // connection instead of each opening their own.
+  if (http2_ &&
+      (!setOption(easy, CURLOPT_HTTP_VERSION,
+                  static_cast<long>(  // NOLINT(google-runtime-int)
+                      CURL_HTTP_VERSION_2TLS)) ||
+       !setOption(easy, CURLOPT_PIPEWAIT, 1L))) {
+    return false;
+  }
+
+  if (caBundle_.has_value() &&
+      !setOption(easy, CURLOPT_CAINFO, caBundle_.value().c_str())) {
+    return false;
+  }
+
+  if (request.method == "POST") {
+    // The body is owned by the request state, so curl can send it in place.
+    if (!setOption(easy, CURLOPT_POSTFIELDSIZE_LARGE,
+                   static_cast<curl_off_t>(req->body_.size())) ||
+        !setOption(easy, CURLOPT_POSTFIELDS, req->body_.c_str())) {
+      return false;
+    }
+  }
+
+  for (const auto& h : request.headers) {
+    const std::string combined = h.first + ": " + h.second;
+    struct curl_slist* headers =
+        curl_slist_append(req->headers_, combined.c_str());
+    if (headers == nullptr) {
+      NPLOGE << "Failed to add HTTP header";
+      return false;
+    }
+    req->headers_ = headers;
+  }
+  if (!setOption(easy, CURLOPT_HTTPHEADER, req->headers_)) {
+    return false;
+  }
+
+  req->callback_ = std::move(callback);
+  if (request.cancellationToken) {
+    req->cancellationToken_ = request.cancellationToken;
+    req->cancelHandlerId_ = request.cancellationToken->addCancelHandler(
+        [loop]() { loop->checkCancelled(); });
+  }
+  loop->add(std::move(req));
+  return true;
+}
+
+}  // namespace util
+}  // namespace webrtc
+}  // namespace nabto
@@ -0,0 +1,191 @@
+#include "curl_multi_loop.hpp"
+
+#include "curl_global.hpp"
+
+#include <curl/curl.h>
+
+#include <nabto/webrtc/device.hpp>
+#include <nabto/webrtc/util/logging.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace nabto {
+namespace webrtc {
+namespace util {
+
+// Upper bound on how long the loop sleeps if curl has no timers pending. New
+// requests wake the loop up explicitly, so this is only a safety net.
+const int POLL_TIMEOUT_MS = 1000;
+
+CurlMultiRequest::~CurlMultiRequest() {
+  if (cancellationToken_) {
+    cancellationToken_->removeCancelHandler(cancelHandlerId_);
+  }
+  if (easy_ != nullptr) {
+    curl_easy_cleanup(easy_);
+  }
+  if (headers_ != nullptr) {
+    curl_slist_free_all(headers_);
+  }
+}
+
+CurlMultiLoop* CurlMultiLoop::instance() {
+  // The loop thread is detached and may be running when static destructors
+  // run, so the loop is intentionally never destroyed.
+  static CurlMultiLoop* loop = []() -> CurlMultiLoop* {
+    auto l = std::make_unique<CurlMultiLoop>();
+    if (!l->init()) {
+      return nullptr;
+    }
+    return l.release();
+  }();
+  return loop;
+}
+
+CurlMultiLoop::~CurlMultiLoop() {
+  if (multi_ != nullptr) {
+    curl_multi_cleanup(multi_);
+  }
+}
+
+bool CurlMultiLoop::init() {
+  if (!curlGlobalInit()) {
+    return false;
+  }
+  multi_ = curl_multi_init();
+  if (multi_ == nullptr) {
+    NPLOGE << "Failed to initialize Curl multi";
+    return false;
+  }
+  // Concurrent requests to a HTTP/2 host are multiplexed on one connection.
+  const CURLMcode mc =
+      curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  if (mc != CURLM_OK) {
+    NPLOGE << "Failed to enable Curl multiplexing with: "
+           << curl_multi_strerror(mc);
+    return false;
+  }
+  return true;
+}
+
+void CurlMultiLoop::add(CurlMultiRequestPtr request) {
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    pending_.push_back(std::move(request));
+    if (!started_) {
+      started_ = true;
+      std::thread([this]() { run(); }).detach();
+    }
+  }
+  curl_multi_wakeup(multi_);
+}
+
+void CurlMultiLoop::checkCancelled() {
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    checkCancelled_ = true;
+  }
+  curl_multi_wakeup(multi_);
+}
+
+void CurlMultiLoop::run() {
+  while (true) {
+    if (addPending()) {
+      removeCancelled();
+    }
+
+    int running = 0;
+    CURLMcode mc = curl_multi_perform(multi_, &running);
+    if (mc != CURLM_OK) {
+      NPLOGE << "curl_multi_perform failed with: " << curl_multi_strerror(mc);
+    }
+
+    int queued = 0;
+    CURLMsg* msg = nullptr;
+    while ((msg = curl_multi_info_read(multi_, &queued)) != nullptr) {
+      if (msg->msg == CURLMSG_DONE) {
+        finish(msg->easy_handle, msg->data.result);
+      }
+    }
+
+    mc = curl_multi_poll(multi_, nullptr, 0, POLL_TIMEOUT_MS, nullptr);
+    if (mc != CURLM_OK) {
+      NPLOGE << "curl_multi_poll failed with: " << curl_multi_strerror(mc);
+    }
+  }
+}
+
+bool CurlMultiLoop::addPending() {
+  std::vector<CurlMultiRequestPtr> pending;
+  bool checkCancelled = false;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    pending.swap(pending_);
+    checkCancelled = std::exchange(checkCancelled_, false);
+  }
+  for (auto& request : pending) {
+    CURL* easy = request->easy_;
+    const CURLMcode mc = curl_multi_add_handle(multi_, easy);
+    if (mc != CURLM_OK) {
+      NPLOGE << "Failed to add Curl request with: "
+             << curl_multi_strerror(mc);
+      request->callback_(nullptr);
+      continue;
+    }
+    if (request->cancellationToken_) {
+      // The token may have been cancelled before the request was added.
+      checkCancelled = true;
+    }
+    active_[easy] = std::move(request);
+  }
+  return checkCancelled;
+}
+
+void CurlMultiLoop::removeCancelled() {
+  std::vector<CurlMultiRequestPtr> cancelled;
+  for (auto it = active_.begin(); it != active_.end();) {
+    const auto& token = it->second->cancellationToken_;
+    if (token && token->isCancelled()) {
+      curl_multi_remove_handle(multi_, it->first);
+      cancelled.push_back(std::move(it->second));
+      it = active_.erase(it);
+    } else {
+      it++;
+    }
+  }
+  for (auto& request : cancelled) {
+    NPLOGD << "HTTP request cancelled";
+    request->callback_(nullptr);
+  }
+}
+
+void CurlMultiLoop::finish(CURL* easy, CURLcode result) {
+  auto it = active_.find(easy);
+  if (it == active_.end()) {
+    return;
+  }
+  auto request = std::move(it->second);
+  active_.erase(it);
+  curl_multi_remove_handle(multi_, easy);
+
+  if (result != CURLE_OK) {
+    NPLOGE << "HTTP request failed with: " << curl_easy_strerror(result);
+    request->callback_(nullptr);
+    return;
+  }
+  int64_t statusCode = 0;
+  curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &statusCode);
+  NPLOGD << "HTTP request completed with status: " << statusCode;
+
+  request->callback_(
+      request->response_.take(static_cast<int>(statusCode)));
+}
+
+}  // namespace util
+}  // namespace webrtc
+}  // namespace nabto
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "curl_response_buffer.hpp"
+
+#include <curl/curl.h>
+
+#include <nabto/webrtc/device.hpp>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace nabto {
+namespace webrtc {
+namespace util {
+
+/**
+ * State of a single HTTP request. Everything curl reads from or writes to
+ * while the request is running lives here, so requests never share buffers.
+ */
+class CurlMultiRequest {
+ public:
+  CurlMultiRequest() = default;
+  ~CurlMultiRequest();
+  CurlMultiRequest(const CurlMultiRequest&) = delete;
+  CurlMultiRequest& operator=(const CurlMultiRequest&) = delete;
+  CurlMultiRequest(CurlMultiRequest&&) = delete;
+  CurlMultiRequest& operator=(CurlMultiRequest&&) = delete;
+
+  CURL* easy_ = nullptr;
+  std::string body_;
+  CurlResponseBuffer response_;
+  struct curl_slist* headers_ = nullptr;
+  nabto::webrtc::HttpResponseCallback callback_;
+  nabto::webrtc::SignalingCancellationTokenPtr cancellationToken_;
+  nabto::webrtc::CancelHandlerId cancelHandlerId_ = 0;
+};
+
+using CurlMultiRequestPtr = std::unique_ptr<CurlMultiRequest>;
+
+/**
+ * Process wide curl multi event loop. All requests are driven by a single
+ * thread which is started on the first request and lives until the process
+ * exits. Response callbacks are invoked from this thread and must not block.
+ */
+class CurlMultiLoop {
+ public:
+  /**
+   * Get the loop of the process.
+   *
+   * @return The loop, or nullptr if libcurl could not be initialized.
+   */
+  static CurlMultiLoop* instance();
+
+  CurlMultiLoop() = default;
+  ~CurlMultiLoop();
+  CurlMultiLoop(const CurlMultiLoop&) = delete;
+  CurlMultiLoop& operator=(const CurlMultiLoop&) = delete;
+  CurlMultiLoop(CurlMultiLoop&&) = delete;
+  CurlMultiLoop& operator=(CurlMultiLoop&&) = delete;
+
+  /**
+   * Hand a prepared request to the loop. The callback of the request is
+   * invoked exactly once from the loop thread.
+   *
+   * @param request The request with a fully configured easy handle.
+   */
+  void add(CurlMultiRequestPtr request);
+
+  /**
+   * Wake up the loop to abort the requests whose cancellation token has been
+   * cancelled.
+   */
+  void checkCancelled();
+
+ private:
+  bool init();
+  void run();
+  bool addPending();
+  void removeCancelled();
+  void finish(CURL* easy, CURLcode result);
+
+  CURLM* multi_ = nullptr;
+
+  std::mutex mutex_;
+  std::vector<CurlMultiRequestPtr> pending_;
+  bool started_ = false;
+  bool checkCancelled_ = false;
+
+  // Only accessed from the loop thread.
+  std::map<CURL*, CurlMultiRequestPtr> active_;
+};
+
+}  // namespace util
+}  // namespace webrtc
+}  // namespace nabto
@@ -0,0 +1,143 @@
+#include "curl_response_buffer.hpp"
+
+#include <curl/curl.h>
+
+#include <nabto/webrtc/device.hpp>
+#include <nabto/webrtc/util/logging.hpp>
+
+#include <cctype>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace nabto {
+namespace webrtc {
+namespace util {
+
+namespace {
+
+// Limit on the memory reserved up front from a Content-Length header, larger
+// bodies grow the buffer as data arrives.
+const size_t MAX_BODY_RESERVE = 1024 * 1024;
+
+std::string trim(const std::string& str) {
+  size_t begin = 0;
+  size_t end = str.size();
+  auto isSpace = [](char c) {
+    return std::isspace(static_cast<unsigned char>(c)) != 0;
+  };
+  while (begin < end && isSpace(str[begin])) {
+    begin++;
+  }
+  while (end > begin && isSpace(str[end - 1])) {
+    end--;
+  }
+  return str.substr(begin, end - begin);
+}
+
+bool equalsIgnoreCase(const std::string& a, const std::string& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (std::tolower(static_cast<unsigned char>(a[i])) !=
+        std::tolower(static_cast<unsigned char>(b[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool CurlResponseBuffer::attach(CURL* easy) {
+  CURLcode res = curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, writeFunc);
+  if (res == CURLE_OK) {
+    res = curl_easy_setopt(easy, CURLOPT_WRITEDATA, static_cast<void*>(this));
+  }
+  if (res == CURLE_OK) {
+    res = curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, headerFunc);
+  }
+  if (res == CURLE_OK) {
+    res = curl_easy_setopt(easy, CURLOPT_HEADERDATA, static_cast<void*>(this));
+  }
+  if (res != CURLE_OK) {
+    NPLOGE << "Failed to initialize Curl request with CURLE: "
+           << curl_easy_strerror(res);
+    return false;
+  }
+  return true;
+}
+
+void CurlResponseBuffer::reset() {
+  response_ = nabto::webrtc::SignalingHttpResponse();
+}
+
+std::unique_ptr<nabto::webrtc::SignalingHttpResponse> CurlResponseBuffer::take(
+    int statusCode) {
+  response_.statusCode = statusCode;
+  auto response = std::make_unique<nabto::webrtc::SignalingHttpResponse>(
+      std::move(response_));
+  reset();
+  return response;
+}
+
+size_t CurlResponseBuffer::writeFunc(char* ptr, size_t size, size_t nmemb,
+                                     void* s) {
+  auto* self = static_cast<CurlResponseBuffer*>(s);
+  try {
+    self->response_.body.append(ptr, size * nmemb);
+  } catch (std::exception& ex) {
+    NPLOGE << "writeFunc failure";
+    return 0;
+  }
+  return size * nmemb;
+}
+
+void CurlResponseBuffer::reserveBody(const std::string& contentLength) {
+  size_t length = 0;
+  try {
+    length = std::stoull(contentLength);
+  } catch (std::exception& ex) {
+    // Curl reports an invalid Content-Length as a failed request.
+    return;
+  }
+  response_.body.reserve(length < MAX_BODY_RESERVE ? length : MAX_BODY_RESERVE);
+}
+
+size_t CurlResponseBuffer::headerFunc(char* ptr, size_t size, size_t nmemb,
+                                      void* s) {
+  auto* self = static_cast<CurlResponseBuffer*>(s);
+  const size_t length = size * nmemb;
+  try {
+    const std::string line(ptr, length);
+    if (line.rfind("HTTP/", 0) == 0) {
+      // Status line of a new response, eg. after a redirect or a 100
+      // Continue. Only the headers of the final response are kept.
+      self->response_.headers.clear();
+      self->response_.body.clear();
+      return length;
+    }
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+      // The empty line ending the headers.
+      return length;
+    }
+    auto name = trim(line.substr(0, colon));
+    auto value = trim(line.substr(colon + 1));
+    if (equalsIgnoreCase(name, "Content-Length")) {
+      self->reserveBody(value);
+    }
+    self->response_.headers.emplace_back(std::move(name), std::move(value));
+  } catch (std::exception& ex) {
+    NPLOGE << "headerFunc failure";
+    return 0;
+  }
+  return length;
+}
+
+}  // namespace util
+}  // namespace webrtc
+}  // namespace nabto
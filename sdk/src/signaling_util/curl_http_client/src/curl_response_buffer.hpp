@@ -0,0 +1,54 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <nabto/webrtc/device.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace nabto {
+namespace webrtc {
+namespace util {
+
+/**
+ * Collects the headers and body of a HTTP response directly into a
+ * SignalingHttpResponse, so the result can be handed to the SDK without
+ * copying it.
+ */
+class CurlResponseBuffer {
+ public:
+  /**
+   * Make curl write the response of the next request on the handle into
+   * this buffer.
+   *
+   * @param easy The handle to configure.
+   * @return false if an option could not be set.
+   */
+  bool attach(CURL* easy);
+
+  /**
+   * Clear any data from a previous response.
+   */
+  void reset();
+
+  /**
+   * Move the collected response out of the buffer.
+   *
+   * @param statusCode The status code of the response.
+   * @return The response.
+   */
+  std::unique_ptr<nabto::webrtc::SignalingHttpResponse> take(int statusCode);
+
+ private:
+  static size_t writeFunc(char* ptr, size_t size, size_t nmemb, void* s);
+  static size_t headerFunc(char* ptr, size_t size, size_t nmemb, void* s);
+  void reserveBody(const std::string& contentLength);
+
+  nabto::webrtc::SignalingHttpResponse response_;
+};
+
+}  // namespace util
+}  // namespace webrtc
+}  // namespace nabto
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <nabto/webrtc/device.hpp>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+
+namespace nabto {
+namespace webrtc {
+namespace util {
+
+/**
+ * SignalingStateStore implementation which keeps the state in a file.
+ *
+ * The state is written to a temporary file next to the file, synced to disk
+ * and renamed into place, so a crash or power loss while saving leaves
+ * either the previous or the new state, never a truncated file. The file is
+ * only readable by the owner as the state contains an access token.
+ */
+class FileStateStore : public nabto::webrtc::SignalingStateStore {
+ public:
+  /**
+   * Create a FileStateStore.
+   *
+   * @param path The file to keep the state in. The directory must exist.
+   * @return SignalingStateStorePtr pointing to the created object.
+   */
+  static nabto::webrtc::SignalingStateStorePtr create(std::string path) {
+    return std::make_shared<FileStateStore>(std::move(path));
+  }
+
+  explicit FileStateStore(std::string path) : path_(std::move(path)) {}
+
+  std::string load() override {
+    std::ifstream file(path_, std::ios::binary);
+    if (!file) {
+      return "";
+    }
+    std::stringstream data;
+    data << file.rdbuf();
+    return data.str();
+  }
+
+  void save(const std::string& state) override {
+    const std::string tmp = path_ + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                          S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+      return;
+    }
+    // The mode of open() only applies to new files.
+    bool ok = ::fchmod(fd, S_IRUSR | S_IWUSR) == 0 &&
+              writeAll(fd, state) && ::fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if (!ok || std::rename(tmp.c_str(), path_.c_str()) != 0) {
+      std::remove(tmp.c_str());
+      return;
+    }
+    // Sync the directory so the rename itself survives a power loss.
+    std::string dir = std::filesystem::path(path_).parent_path().string();
+    if (dir.empty()) {
+      dir = ".";
+    }
+    const int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0) {
+      ::fsync(dirFd);
+      ::close(dirFd);
+    }
+  }
+
+ private:
+  static bool writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+      const ssize_t n =
+          ::write(fd, data.data() + written, data.size() - written);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      written += static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  std::string path_;
+};
+
+}  // namespace util
+}  // namespace webrtc
+}  // namespace nabto
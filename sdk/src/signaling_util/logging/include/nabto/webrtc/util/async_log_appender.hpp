@@ -0,0 +1,254 @@
+#pragma once
+
+#include <plog/Appenders/IAppender.h>
+#include <plog/Record.h>
+#include <plog/Severity.h>
+#include <plog/Util.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace nabto {
+namespace webrtc {
+namespace util {
+
+/**
+ * plog appender which moves formatting and output off the logging thread.
+ *
+ * write() copies the record into a fixed-size slot of a bounded lock-free ring
+ * buffer and returns. A background thread formats the records like
+ * plog::TxtFormatter and writes them to the output stream. Messages longer
+ * than MESSAGE_BYTES are truncated. If the ring is full the record is dropped
+ * rather than blocking the caller, and the number of dropped records is
+ * written to the output once there is room again.
+ *
+ * The appender must outlive the loggers using it. Records still in the ring
+ * are written when the appender is destroyed.
+ */
+class AsyncLogAppender : public plog::IAppender {
+ public:
+  static constexpr size_t DEFAULT_CAPACITY = 1024;
+  static constexpr size_t MESSAGE_BYTES = 512;
+  static constexpr size_t FUNC_BYTES = 64;
+  // The background thread also checks for records at this interval, so a
+  // missed wakeup only delays output.
+  static constexpr uint32_t IDLE_WAIT_MS = 10;
+
+  /**
+   * @param out The stream to write formatted records to.
+   * @param capacity The number of records the ring holds, rounded up to a
+   * power of two.
+   */
+  explicit AsyncLogAppender(std::FILE* out = stdout,
+                            size_t capacity = DEFAULT_CAPACITY)
+      : out_(out),
+        capacity_(roundUpPow2(capacity)),
+        slots_(new Slot[capacity_]) {
+    for (size_t i = 0; i < capacity_; i++) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    thread_ = std::thread([this]() { run(); });
+  }
+
+  AsyncLogAppender(const AsyncLogAppender&) = delete;
+  AsyncLogAppender& operator=(const AsyncLogAppender&) = delete;
+
+  ~AsyncLogAppender() override {
+    stop_.store(true, std::memory_order_release);
+    cv_.notify_one();
+    thread_.join();
+  }
+
+  void write(const plog::Record& record) override {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    for (;;) {
+      slot = &slots_[pos & (capacity_ - 1)];
+      const size_t seq = slot->seq.load(std::memory_order_acquire);
+      const auto diff =
+          static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+
+    slot->severity = record.getSeverity();
+    slot->time = record.getTime().time;
+    slot->millitm = record.getTime().millitm;
+    slot->tid = record.getTid();
+    slot->line = record.getLine();
+    copyTruncated(slot->func, FUNC_BYTES, record.getFunc());
+    copyTruncated(slot->message, MESSAGE_BYTES, record.getMessage());
+    slot->seq.store(pos + 1, std::memory_order_release);
+
+    if (waiting_.load(std::memory_order_seq_cst)) {
+      cv_.notify_one();
+    }
+  }
+
+  /**
+   * Block until every record written before this call has been output.
+   */
+  void flush() {
+    const size_t target = head_.load(std::memory_order_acquire);
+    cv_.notify_one();
+    std::unique_lock<std::mutex> lock(mutex_);
+    drained_.wait(lock, [this, target]() { return written_ >= target; });
+  }
+
+  /**
+   * The total number of records dropped because the ring was full.
+   */
+  size_t droppedRecords() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> seq{0};
+    plog::Severity severity = plog::none;
+    std::time_t time = 0;
+    uint16_t millitm = 0;
+    unsigned int tid = 0;
+    size_t line = 0;
+    char func[FUNC_BYTES] = {};
+    char message[MESSAGE_BYTES] = {};
+  };
+
+  std::FILE* out_;
+  const size_t capacity_;
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<size_t> head_{0};
+  std::atomic<size_t> consumed_{0};
+  std::atomic<size_t> dropped_{0};
+  std::atomic<bool> waiting_{false};
+  std::atomic<bool> stop_{false};
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable drained_;
+  // Records output so far. Guarded by mutex_.
+  size_t written_ = 0;
+  std::thread thread_;
+
+  static size_t roundUpPow2(size_t n) {
+    size_t result = 2;
+    while (result < n) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  static void copyTruncated(char* dst, size_t size, const char* src) {
+    if (src == nullptr) {
+      dst[0] = '\0';
+      return;
+    }
+    const size_t len = std::min(std::strlen(src), size - 1);
+    std::memcpy(dst, src, len);
+    dst[len] = '\0';
+  }
+
+  void run() {
+    size_t reportedDrops = 0;
+    std::string text;
+    for (;;) {
+      // Read stop_ before draining so records written before the destructor
+      // ran are not left behind.
+      const bool stopping = stop_.load(std::memory_order_acquire);
+      const size_t drops = dropped_.load(std::memory_order_relaxed);
+      if (drops != reportedDrops) {
+        text += "[AsyncLogAppender dropped " +
+                std::to_string(drops - reportedDrops) + " log records]\n";
+        reportedDrops = drops;
+      }
+      const bool any = drain(text);
+      if (!text.empty()) {
+        std::fwrite(text.data(), 1, text.size(), out_);
+        std::fflush(out_);
+        text.clear();
+      }
+      {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        written_ = consumed_.load(std::memory_order_relaxed);
+      }
+      drained_.notify_all();
+      if (any) {
+        continue;
+      }
+      if (stopping) {
+        return;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      waiting_.store(true, std::memory_order_seq_cst);
+      if (!ready() && !stop_.load(std::memory_order_acquire)) {
+        cv_.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT_MS));
+      }
+      waiting_.store(false, std::memory_order_seq_cst);
+    }
+  }
+
+  bool ready() const {
+    const size_t pos = consumed_.load(std::memory_order_relaxed);
+    return slots_[pos & (capacity_ - 1)].seq.load(std::memory_order_acquire) ==
+           pos + 1;
+  }
+
+  // Format every published record into text. Returns false if there were
+  // none.
+  bool drain(std::string& text) {
+    bool any = false;
+    while (ready()) {
+      const size_t pos = consumed_.load(std::memory_order_relaxed);
+      Slot& slot = slots_[pos & (capacity_ - 1)];
+      format(slot, text);
+      slot.seq.store(pos + capacity_, std::memory_order_release);
+      consumed_.store(pos + 1, std::memory_order_release);
+      any = true;
+    }
+    return any;
+  }
+
+  static void format(const Slot& slot, std::string& text) {
+    std::tm t{};
+    plog::util::localtime_s(&t, &slot.time);
+    std::ostringstream ss;
+    ss << t.tm_year + 1900 << "-" << std::setfill('0') << std::setw(2)
+       << t.tm_mon + 1 << "-" << std::setfill('0') << std::setw(2)
+       << t.tm_mday << " ";
+    ss << std::setfill('0') << std::setw(2) << t.tm_hour << ":"
+       << std::setfill('0') << std::setw(2) << t.tm_min << ":"
+       << std::setfill('0') << std::setw(2) << t.tm_sec << "."
+       << std::setfill('0') << std::setw(3) << slot.millitm << " ";
+    ss << std::setfill(' ') << std::setw(5) << std::left
+       << plog::severityToString(slot.severity) << " ";
+    ss << "[" << slot.tid << "] ";
+    ss << "[" << slot.func << "@" << slot.line << "] ";
+    ss << slot.message << "\n";
+    text += ss.str();
+  }
+};
+
+}  // namespace util
+}  // namespace webrtc
+}  // namespace nabto
@@ -5,13 +5,24 @@
 
 constexpr int NABTO_LOG_ID = 42;
 
-#define NPLOGV PLOGV_(NABTO_LOG_ID)
-#define NPLOGD PLOGD_(NABTO_LOG_ID)
-#define NPLOGI PLOGI_(NABTO_LOG_ID)
-#define NPLOGW PLOGW_(NABTO_LOG_ID)
-#define NPLOGE PLOGE_(NABTO_LOG_ID)
-#define NPLOGF PLOGF_(NABTO_LOG_ID)
-#define NPLOGN PLOGN_(NABTO_LOG_ID)
+// Log statements less severe than this plog::Severity are compiled out. Set
+// from the NABTO_SIGNALING_MIN_LOG_LEVEL CMake option.
+#ifndef NABTO_SIGNALING_MIN_LOG_LEVEL
+#define NABTO_SIGNALING_MIN_LOG_LEVEL 6
+#endif
+
+#define NPLOG_(severity)                                                      \
+  if constexpr (static_cast<int>(severity) > NABTO_SIGNALING_MIN_LOG_LEVEL) { \
+  } else                                                                      \
+    PLOG_(NABTO_LOG_ID, severity)
+
+#define NPLOGV NPLOG_(plog::verbose)
+#define NPLOGD NPLOG_(plog::debug)
+#define NPLOGI NPLOG_(plog::info)
+#define NPLOGW NPLOG_(plog::warning)
+#define NPLOGE NPLOG_(plog::error)
+#define NPLOGF NPLOG_(plog::fatal)
+#define NPLOGN NPLOG_(plog::none)
 
 namespace nabto {
 namespace webrtc {
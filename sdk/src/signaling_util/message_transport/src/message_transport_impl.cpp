@@ -84,10 +84,10 @@ void MessageTransportImpl::handleMessage(const nlohmann::json& msgIn) {
     return;
   }
   try {
-    NPLOGI << "Webrtc got signaling message IN: " << msgIn.dump();
+    NPLOGD << "Webrtc got signaling message IN: " << msgIn.dump();
     auto msg = signer_->verifyMessage(msgIn);
 
-    NPLOGI << "Webrtc got signaling message: " << msg.dump();
+    NPLOGD << "Webrtc got signaling message: " << msg.dump();
     auto type = msg.at("type").get<std::string>();
     if (type == "SETUP_REQUEST") {
       requestIceServers();
@@ -169,15 +169,21 @@ TransportErrorListenerId MessageTransportImpl::addErrorListener(
 void MessageTransportImpl::sendMessage(const WebrtcSignalingMessage& message) {
   try {
     nlohmann::json jsonMsg;
+    auto priority = nabto::webrtc::SignalingMessagePriority::NORMAL;
     if (message.isDescription()) {
       auto desc = message.getDescription();
       jsonMsg = desc.toJson();
+      // The first description starts the connection setup, do not let it
+      // wait behind other channels' messages.
+      if (!descriptionSent_.exchange(true)) {
+        priority = nabto::webrtc::SignalingMessagePriority::HIGH;
+      }
     } else if (message.isCandidate()) {
       auto cand = message.getCandidate();
       jsonMsg = cand.toJson();
     }
     auto signedMessage = signer_->signMessage(jsonMsg);
-    channel_->sendMessage(signedMessage);
+    channel_->sendMessageWithPriority(signedMessage, priority);
   } catch (std::exception& e) {
     NPLOGE << "Failed to sign the message with error: " << e.what();
     auto err = nabto::webrtc::SignalingError(
@@ -2,6 +2,7 @@
 
 #include <nabto/webrtc/util/message_transport.hpp>
 
+#include <atomic>
 #include <map>
 #include <mutex>
 
@@ -84,6 +85,7 @@ class MessageTransportImpl
   std::mutex handlerLock_;
 
   enum SigningMode mode_;
+  std::atomic<bool> descriptionSent_{false};
 
   void init();
   void setupSigner(const nlohmann::json& msg);
@@ -3,7 +3,13 @@
 #include <nabto/webrtc/device.hpp>
 
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <utility>
 
 namespace nabto {
 namespace webrtc {
@@ -12,34 +18,118 @@ namespace util {
 /**
  * Implementation of the SignalingTimer interface used by the SDK. This is based
  * on std thread and std chrono libs.
+ *
+ * Each timer runs its callbacks on one thread, started by the first
+ * setTimeout() and reused for every later timeout, so a timer which is
+ * rescheduled often does not create a thread each time.
+ *
+ * Calling setTimeout() while a timeout is pending replaces the pending
+ * timeout. setTimeout() does not block, so it may be called from within the
+ * timer callback or while holding locks the callback takes.
+ *
+ * Once cancel() returns, the callback is not running and will not start,
+ * unless the timer is set again. To give that guarantee cancel() waits for a
+ * callback already running on the timer thread, so do not call it while
+ * holding a lock the callback takes. Calling cancel() from within the
+ * callback does not wait.
  */
 class StdTimer : public nabto::webrtc::SignalingTimer,
                  public std::enable_shared_from_this<StdTimer> {
  public:
-  ~StdTimer() {
-    if (timer_.joinable()) {
-      timer_.join();
-      timer_ = std::thread();
+  StdTimer() : state_(std::make_shared<State>()) {}
+
+  ~StdTimer() override {
+    std::function<void()> callback;
+    bool join = false;
+    {
+      const std::lock_guard<std::mutex> lock(state_->mutex);
+      state_->stopped = true;
+      state_->pending = false;
+      callback = std::move(state_->callback);
+      // Do not block on a running callback, the thread owns the state and
+      // exits when the callback returns. This also covers the callback
+      // releasing the last reference to the timer.
+      join = !state_->running;
+    }
+    state_->cv.notify_all();
+    if (thread_.joinable()) {
+      if (join && thread_.get_id() != std::this_thread::get_id()) {
+        thread_.join();
+      } else {
+        thread_.detach();
+      }
     }
   }
 
   void setTimeout(uint32_t timeoutMs, std::function<void()> cb) override {
-    auto self = shared_from_this();
-    timer_ = std::thread([timeoutMs, self, cb]() {
-      std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
-      cb();
-    });
+    std::function<void()> replaced;
+    {
+      const std::lock_guard<std::mutex> lock(state_->mutex);
+      state_->deadline = std::chrono::steady_clock::now() +
+                         std::chrono::milliseconds(timeoutMs);
+      replaced = std::move(state_->callback);
+      state_->callback = std::move(cb);
+      state_->pending = true;
+      if (!thread_.joinable()) {
+        thread_ = std::thread(run, state_);
+      }
+    }
+    state_->cv.notify_all();
   }
 
   void cancel() override {
-    if (timer_.joinable()) {
-      timer_.join();
-      timer_ = std::thread();
+    std::function<void()> callback;
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    state_->pending = false;
+    callback = std::move(state_->callback);
+    if (thread_.get_id() != std::this_thread::get_id()) {
+      state_->cv.wait(lock, [this]() { return !state_->running; });
     }
+    lock.unlock();
   }
 
  private:
-  std::thread timer_;
+  // Shared with the timer thread, which may outlive the timer.
+  struct State {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::chrono::steady_clock::time_point deadline;
+    std::function<void()> callback;
+    bool pending = false;
+    bool running = false;
+    bool stopped = false;
+  };
+
+  std::shared_ptr<State> state_;
+  std::thread thread_;
+
+  static void run(const std::shared_ptr<State>& state) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (!state->stopped) {
+      if (!state->pending) {
+        state->cv.wait(lock);
+        continue;
+      }
+      if (std::chrono::steady_clock::now() < state->deadline) {
+        // Woken early when the timeout is replaced or cancelled, in which
+        // case the loop picks up the new state.
+        state->cv.wait_until(lock, state->deadline);
+        continue;
+      }
+      // Taken and marked running under the lock, so a concurrent cancel()
+      // either prevents the callback or waits for it.
+      std::function<void()> callback = std::move(state->callback);
+      state->pending = false;
+      state->running = true;
+      lock.unlock();
+      callback();
+      // Released without the lock, it may own the last timer reference.
+      callback = nullptr;
+      lock.lock();
+      state->running = false;
+      state->cv.notify_all();
+    }
+  }
 };
 
 /**
@@ -0,0 +1,147 @@
+#include <plog/Log.h>
+#include <plog/Logger.h>
+
+#include <nabto/webrtc/util/async_log_appender.hpp>
+#include <nabto/webrtc/util/logging.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using nabto::webrtc::util::AsyncLogAppender;
+
+// Instance ids not used by the SDK.
+constexpr int ORDER_LOG_ID = 9001;
+constexpr int TRUNCATE_LOG_ID = 9002;
+constexpr int THREADS_LOG_ID = 9003;
+
+struct FileCloser {
+  void operator()(std::FILE* file) const { std::fclose(file); }
+};
+using FilePtr = std::unique_ptr<std::FILE, FileCloser>;
+
+std::vector<std::string> readLines(std::FILE* file) {
+  std::rewind(file);
+  std::string content;
+  char buffer[4096];
+  size_t read = 0;
+  while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    content.append(buffer, read);
+  }
+  std::vector<std::string> lines;
+  std::istringstream stream(content);
+  std::string line;
+  while (std::getline(stream, line)) {
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+bool endsWith(const std::string& str, const std::string& suffix) {
+  return str.size() >= suffix.size() &&
+         str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int evaluated = 0;
+
+std::string countEvaluation(const std::string& str) {
+  evaluated++;
+  return str;
+}
+
+}  // namespace
+
+TEST(AsyncLogAppender, writes_records_in_order) {
+  FilePtr file(std::tmpfile());
+  AsyncLogAppender appender(file.get());
+  plog::Logger<ORDER_LOG_ID> logger(plog::verbose);
+  logger.addAppender(&appender);
+
+  PLOGI_(ORDER_LOG_ID) << "first " << 1;
+  PLOGW_(ORDER_LOG_ID) << "second " << 2;
+  appender.flush();
+
+  auto lines = readLines(file.get());
+  ASSERT_EQ(lines.size(), 2);
+  ASSERT_TRUE(endsWith(lines[0], "first 1"));
+  ASSERT_NE(lines[0].find("INFO"), std::string::npos);
+  ASSERT_TRUE(endsWith(lines[1], "second 2"));
+  ASSERT_NE(lines[1].find("WARN"), std::string::npos);
+}
+
+TEST(AsyncLogAppender, truncates_long_messages) {
+  FilePtr file(std::tmpfile());
+  AsyncLogAppender appender(file.get());
+  plog::Logger<TRUNCATE_LOG_ID> logger(plog::verbose);
+  logger.addAppender(&appender);
+
+  const std::string message(4 * AsyncLogAppender::MESSAGE_BYTES, 'x');
+  PLOGI_(TRUNCATE_LOG_ID) << message;
+  appender.flush();
+
+  auto lines = readLines(file.get());
+  ASSERT_EQ(lines.size(), 1);
+  ASSERT_TRUE(endsWith(
+      lines[0], "] " + std::string(AsyncLogAppender::MESSAGE_BYTES - 1, 'x')));
+}
+
+TEST(AsyncLogAppender, many_threads) {
+  FilePtr file(std::tmpfile());
+  size_t written = 0;
+  {
+    AsyncLogAppender appender(file.get(), 64);
+    plog::Logger<THREADS_LOG_ID> logger(plog::verbose);
+    logger.addAppender(&appender);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+      threads.emplace_back([t]() {
+        for (int i = 0; i < 1000; i++) {
+          PLOGD_(THREADS_LOG_ID) << "thread " << t << " record " << i;
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    written = 4 * 1000 - appender.droppedRecords();
+    // The destructor writes the records left in the ring.
+  }
+
+  size_t records = 0;
+  size_t dropReports = 0;
+  for (const auto& line : readLines(file.get())) {
+    if (line.find("dropped") != std::string::npos) {
+      dropReports++;
+    } else if (line.find("record") != std::string::npos) {
+      records++;
+    }
+  }
+  ASSERT_EQ(records, written);
+  ASSERT_EQ(dropReports > 0, written < 4 * 1000);
+}
+
+// Lower the compile time minimum level for the rest of this file.
+#undef NABTO_SIGNALING_MIN_LOG_LEVEL
+#define NABTO_SIGNALING_MIN_LOG_LEVEL 4  // plog::info
+
+TEST(MinLogLevel, statements_below_min_level_are_compiled_out) {
+  auto* logger = plog::get<NABTO_LOG_ID>();
+  ASSERT_NE(logger, nullptr);
+  const auto severity = logger->getMaxSeverity();
+  logger->setMaxSeverity(plog::verbose);
+
+  evaluated = 0;
+  NPLOGV << countEvaluation("verbose statement compiled in");
+  NPLOGD << countEvaluation("debug statement compiled in");
+  NPLOGI << countEvaluation("info statement compiled in");
+  NPLOGW << countEvaluation("warning statement compiled in");
+  logger->setMaxSeverity(severity);
+  ASSERT_EQ(evaluated, 2);
+}
@@ -0,0 +1,112 @@
+#include "../src/signaling_device/src/signaling_device_impl.hpp"
+#include "fakes.hpp"
+
+#include <nabto/webrtc/device.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using nabto::test::FakeHttpClient;
+using nabto::test::FakeTokenGenerator;
+using nabto::test::FakeWebsocket;
+using nabto::test::QueueExecutor;
+
+class CallbackExecutorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ws_ = std::make_shared<FakeWebsocket>();
+    http_ = std::make_shared<FakeHttpClient>();
+    executor_ = std::make_shared<QueueExecutor>();
+    nabto::webrtc::SignalingDeviceConfig conf;
+    conf.deviceId = "de-test";
+    conf.productId = "pr-test";
+    conf.signalingUrl = "https://signaling.test";
+    conf.tokenProvider = std::make_shared<FakeTokenGenerator>();
+    conf.wsImpl = ws_;
+    conf.httpCli = http_;
+    conf.callbackExecutor = executor_;
+    device_ = nabto::webrtc::SignalingDeviceImpl::create(conf);
+  }
+
+  void connect() {
+    device_->start();
+    http_->respond(
+        200, nlohmann::json({{"signalingUrl", "wss://ws.test"}}).dump());
+    ws_->openCb_();
+  }
+
+  std::shared_ptr<FakeWebsocket> ws_;
+  std::shared_ptr<FakeHttpClient> http_;
+  std::shared_ptr<QueueExecutor> executor_;
+  nabto::webrtc::SignalingDeviceImplPtr device_;
+};
+
+}  // namespace
+
+TEST_F(CallbackExecutorTest, state_changes_are_posted_in_order) {
+  std::vector<nabto::webrtc::SignalingDeviceState> states;
+  device_->addStateChangeListener(
+      [&states](nabto::webrtc::SignalingDeviceState state) {
+        states.push_back(state);
+      });
+  connect();
+  ASSERT_EQ(ws_->url_, "wss://ws.test");
+  ASSERT_TRUE(states.empty());
+  executor_->runAll();
+  std::vector<nabto::webrtc::SignalingDeviceState> expected = {
+      nabto::webrtc::SignalingDeviceState::CONNECTING,
+      nabto::webrtc::SignalingDeviceState::CONNECTED};
+  ASSERT_EQ(states, expected);
+}
+
+TEST_F(CallbackExecutorTest, initial_message_reaches_new_channel) {
+  connect();
+  executor_->runAll();
+
+  nabto::webrtc::SignalingChannelPtr channel;
+  std::vector<nlohmann::json> messages;
+  device_->addNewChannelListener(
+      [&channel, &messages](const nabto::webrtc::SignalingChannelPtr& chan,
+                            bool authorized) {
+        channel = chan;
+        chan->addMessageListener([&messages](const nlohmann::json& msg) {
+          messages.push_back(msg);
+        });
+      });
+
+  const nlohmann::json data = {
+      {"type", "DATA"}, {"seq", 0}, {"data", "hello"}};
+  ws_->messageCb_(nlohmann::json({{"type", "MESSAGE"},
+                                  {"channelId", "ch-1"},
+                                  {"authorized", true},
+                                  {"message", data}})
+                      .dump());
+  ASSERT_EQ(channel, nullptr);
+  ASSERT_EQ(executor_->runAll(), 2);
+  ASSERT_NE(channel, nullptr);
+  ASSERT_EQ(messages.size(), 1);
+  ASSERT_EQ(messages[0], "hello");
+}
+
+TEST_F(CallbackExecutorTest, ice_servers_callback_is_posted) {
+  connect();
+  executor_->runAll();
+  bool called = false;
+  device_->requestIceServers(
+      [&called](const std::vector<nabto::webrtc::IceServer>& servers) {
+        called = true;
+        ASSERT_EQ(servers.size(), 1);
+      });
+  http_->respond(200, R"({"iceServers": [{"urls": ["stun:stun.test"]}]})");
+  ASSERT_FALSE(called);
+  executor_->runAll();
+  ASSERT_TRUE(called);
+}
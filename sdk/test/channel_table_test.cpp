@@ -0,0 +1,77 @@
+#include "../src/signaling_device/src/channel_table.hpp"
+#include "../src/signaling_device/src/signaling_channel_impl.hpp"
+
+#include <nabto/webrtc/util/uuid.hpp>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+nabto::webrtc::SignalingChannelImplPtr makeChannel(const std::string& id) {
+  return nabto::webrtc::SignalingChannelImpl::create(nullptr, id);
+}
+
+}  // namespace
+
+TEST(channel_table, insert_find_erase) {
+  nabto::webrtc::ChannelTable table;
+  auto chan = makeChannel("foo");
+  ASSERT_TRUE(table.insert(nabto::webrtc::ChannelKey("foo"), chan));
+  ASSERT_FALSE(table.insert(nabto::webrtc::ChannelKey("foo"), chan));
+  ASSERT_EQ(table.size(), 1);
+  ASSERT_EQ(table.find(nabto::webrtc::ChannelKey("foo")), chan);
+  ASSERT_EQ(table.find(nabto::webrtc::ChannelKey("bar")), nullptr);
+  ASSERT_TRUE(table.erase(nabto::webrtc::ChannelKey("foo")));
+  ASSERT_FALSE(table.erase(nabto::webrtc::ChannelKey("foo")));
+  ASSERT_TRUE(table.empty());
+}
+
+TEST(channel_table, long_channel_id) {
+  nabto::webrtc::ChannelTable table;
+  std::string longId(nabto::webrtc::ChannelKey::INLINE_CAPACITY + 10, 'x');
+  auto chan = makeChannel(longId);
+  nabto::webrtc::ChannelKey key(longId);
+  ASSERT_EQ(key.str(), longId);
+  ASSERT_TRUE(table.insert(key, chan));
+  ASSERT_EQ(table.find(nabto::webrtc::ChannelKey(longId)), chan);
+  ASSERT_EQ(table.find(nabto::webrtc::ChannelKey(longId + "y")), nullptr);
+}
+
+TEST(channel_table, ten_thousand_channels) {
+  const size_t count = 10000;
+  nabto::webrtc::ChannelTable table;
+  std::vector<std::string> ids;
+  std::vector<nabto::webrtc::SignalingChannelImplPtr> chans;
+  for (size_t i = 0; i < count; i++) {
+    ids.push_back(nabto::webrtc::util::generate_uuid_v4());
+    chans.push_back(makeChannel(ids.back()));
+    ASSERT_TRUE(table.insert(nabto::webrtc::ChannelKey(ids.back()),
+                             chans.back()));
+  }
+  ASSERT_EQ(table.size(), count);
+
+  // Remove every other channel, this exercises the backward shift deletion.
+  for (size_t i = 0; i < count; i += 2) {
+    ASSERT_TRUE(table.erase(nabto::webrtc::ChannelKey(ids[i])));
+  }
+  ASSERT_EQ(table.size(), count / 2);
+  for (size_t i = 0; i < count; i++) {
+    auto found = table.find(nabto::webrtc::ChannelKey(ids[i]));
+    if (i % 2 == 0) {
+      ASSERT_EQ(found, nullptr);
+    } else {
+      ASSERT_EQ(found, chans[i]);
+    }
+  }
+
+  size_t visited = 0;
+  table.forEach([&visited](const nabto::webrtc::ChannelKey& key,
+                           const nabto::webrtc::SignalingChannelImplPtr& chan) {
+    ASSERT_EQ(key.str(), chan->getChannelId());
+    visited++;
+  });
+  ASSERT_EQ(visited, count / 2);
+}
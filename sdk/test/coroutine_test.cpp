@@ -0,0 +1,153 @@
+#include "../src/signaling_device/src/signaling_device_impl.hpp"
+#include "fakes.hpp"
+
+#include <nabto/webrtc/device.hpp>
+#include <nabto/webrtc/util/coroutine.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using nabto::webrtc::util::ChannelMessageStream;
+using nabto::webrtc::util::Task;
+
+class CoroutineTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ws_ = std::make_shared<nabto::test::FakeWebsocket>();
+    http_ = std::make_shared<nabto::test::FakeHttpClient>();
+    nabto::webrtc::SignalingDeviceConfig conf;
+    conf.deviceId = "de-test";
+    conf.productId = "pr-test";
+    conf.signalingUrl = "https://signaling.test";
+    conf.tokenProvider = std::make_shared<nabto::test::FakeTokenGenerator>();
+    conf.wsImpl = ws_;
+    conf.httpCli = http_;
+    device_ = nabto::webrtc::SignalingDeviceImpl::create(conf);
+    device_->start();
+    http_->respond(
+        200, nlohmann::json({{"signalingUrl", "wss://ws.test"}}).dump());
+    ws_->openCb_();
+  }
+
+  void receive(const nlohmann::json& message) {
+    ws_->messageCb_(nlohmann::json({{"type", "MESSAGE"},
+                                    {"channelId", "ch-1"},
+                                    {"authorized", true},
+                                    {"message", message}})
+                        .dump());
+  }
+
+  void receiveData(uint32_t seq, const std::string& data) {
+    receive({{"type", "DATA"}, {"seq", seq}, {"data", data}});
+  }
+
+  std::shared_ptr<nabto::test::FakeWebsocket> ws_;
+  std::shared_ptr<nabto::test::FakeHttpClient> http_;
+  nabto::webrtc::SignalingDeviceImplPtr device_;
+};
+
+Task<std::vector<std::string>> readAll(ChannelMessageStream& stream) {
+  std::vector<std::string> result;
+  while (auto msg = co_await stream.nextMessage()) {
+    result.push_back(msg->get<std::string>());
+  }
+  co_return result;
+}
+
+Task<> countIceServers(nabto::webrtc::SignalingDevicePtr device,
+                       std::optional<size_t>& count) {
+  auto servers = co_await nabto::webrtc::util::requestIceServersAsync(device);
+  count = servers.size();
+}
+
+Task<> collectMessages(ChannelMessageStream& stream,
+                       std::optional<std::vector<std::string>>& messages) {
+  messages = co_await readAll(stream);
+}
+
+Task<> sendAndRecord(nabto::webrtc::SignalingChannelPtr channel,
+                     std::vector<bool>& results) {
+  results.push_back(
+      co_await nabto::webrtc::util::sendMessageAsync(channel, "reply"));
+}
+
+Task<int> throwing() {
+  throw std::runtime_error("failed");
+  co_return 0;
+}
+
+Task<> catchException(bool& caught) {
+  try {
+    co_await throwing();
+  } catch (std::runtime_error& ex) {
+    caught = true;
+  }
+}
+
+}  // namespace
+
+TEST_F(CoroutineTest, request_ice_servers) {
+  std::optional<size_t> count;
+  countIceServers(device_, count).start();
+  ASSERT_FALSE(count.has_value());
+  http_->respond(200, R"({"iceServers": [{"urls": ["stun:stun.test"]}]})");
+  ASSERT_EQ(count, 1);
+}
+
+TEST_F(CoroutineTest, message_stream) {
+  std::unique_ptr<ChannelMessageStream> stream;
+  nabto::webrtc::SignalingChannelPtr channel;
+  std::optional<std::vector<std::string>> messages;
+  device_->addNewChannelListener(
+      [&](const nabto::webrtc::SignalingChannelPtr& chan, bool authorized) {
+        channel = chan;
+        stream = std::make_unique<ChannelMessageStream>(chan);
+        collectMessages(*stream, messages).start();
+      });
+  receiveData(0, "first");
+  receiveData(1, "second");
+  ASSERT_NE(channel, nullptr);
+  ASSERT_FALSE(messages.has_value());
+  channel->close();
+  ASSERT_TRUE(messages.has_value());
+  std::vector<std::string> expected = {"first", "second"};
+  ASSERT_EQ(messages, expected);
+}
+
+TEST_F(CoroutineTest, send_message_completes_on_ack) {
+  nabto::webrtc::SignalingChannelPtr channel;
+  device_->addNewChannelListener(
+      [&](const nabto::webrtc::SignalingChannelPtr& chan, bool authorized) {
+        channel = chan;
+      });
+  receiveData(0, "hello");
+  ASSERT_NE(channel, nullptr);
+
+  std::vector<bool> results;
+  sendAndRecord(channel, results).start();
+  sendAndRecord(channel, results).start();
+  ASSERT_TRUE(results.empty());
+
+  receive({{"type", "ACK"}, {"seq", 0}});
+  ASSERT_EQ(results, std::vector<bool>{true});
+
+  // The second message is not acked before the channel is closed.
+  channel->close();
+  std::vector<bool> expected = {true, false};
+  ASSERT_EQ(results, expected);
+}
+
+TEST_F(CoroutineTest, exception_propagates_to_awaiter) {
+  bool caught = false;
+  catchException(caught).start();
+  ASSERT_TRUE(caught);
+}
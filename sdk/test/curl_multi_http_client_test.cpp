@@ -0,0 +1,196 @@
+#include <nabto/webrtc/device.hpp>
+#include <nabto/webrtc/util/curl_async.hpp>
+#include <nabto/webrtc/util/curl_multi_http_client.hpp>
+
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+const size_t REQUESTS = 32;
+const std::chrono::seconds WAIT_TIMEOUT(10);
+
+/**
+ * Collects responses delivered from the curl loop thread.
+ */
+class Responses {
+ public:
+  explicit Responses(size_t count) : results_(count) {}
+
+  nabto::webrtc::HttpResponseCallback callback(size_t index) {
+    return [this, index](
+               std::unique_ptr<nabto::webrtc::SignalingHttpResponse> resp) {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      if (resp) {
+        results_[index] = resp->body;
+        for (const auto& [name, value] : resp->headers) {
+          if (name == "Content-Length") {
+            contentLengths_.push_back(value);
+          }
+        }
+      } else {
+        results_[index] = "<failed>";
+      }
+      done_++;
+      cv_.notify_all();
+    };
+  }
+
+  bool wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, WAIT_TIMEOUT,
+                        [this]() { return done_ == results_.size(); });
+  }
+
+  std::vector<std::string> results_;
+  std::vector<std::string> contentLengths_;
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t done_ = 0;
+};
+
+std::string writeFile(const std::string& name, const std::string& content) {
+  auto path = std::filesystem::temp_directory_path() / name;
+  std::ofstream(path) << content;
+  return path.string();
+}
+
+/**
+ * TCP listener which accepts connections into its backlog but never
+ * responds, so requests to it hang until they time out or are cancelled.
+ */
+class SilentServer {
+ public:
+  SilentServer() {
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    listen(fd_, SOMAXCONN);
+    socklen_t len = sizeof(addr);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+  }
+  ~SilentServer() { close(fd_); }
+  SilentServer(const SilentServer&) = delete;
+  SilentServer& operator=(const SilentServer&) = delete;
+  SilentServer(SilentServer&&) = delete;
+  SilentServer& operator=(SilentServer&&) = delete;
+
+  std::string url() const {
+    return "http://127.0.0.1:" + std::to_string(port_) + "/";
+  }
+
+ private:
+  int fd_ = -1;
+  uint16_t port_ = 0;
+};
+
+}  // namespace
+
+TEST(CurlMultiHttpClient, concurrent_requests_keep_separate_state) {
+  auto client = nabto::webrtc::util::CurlMultiHttpClient::create(std::nullopt);
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < REQUESTS; i++) {
+    paths.push_back(writeFile("nabto_curl_multi_" + std::to_string(i),
+                              "body " + std::to_string(i)));
+  }
+
+  Responses responses(REQUESTS);
+  for (size_t i = 0; i < REQUESTS; i++) {
+    nabto::webrtc::SignalingHttpRequest req;
+    req.method = "GET";
+    req.url = "file://" + paths[i];
+    ASSERT_TRUE(client->sendRequest(req, responses.callback(i)));
+  }
+  ASSERT_TRUE(responses.wait());
+  for (size_t i = 0; i < REQUESTS; i++) {
+    EXPECT_EQ(responses.results_[i], "body " + std::to_string(i));
+    std::filesystem::remove(paths[i]);
+  }
+}
+
+TEST(CurlMultiHttpClient, failed_request_resolves_with_null) {
+  auto client = nabto::webrtc::util::CurlMultiHttpClient::create(std::nullopt);
+  Responses responses(1);
+  nabto::webrtc::SignalingHttpRequest req;
+  req.method = "GET";
+  req.url = "file:///nonexistent/nabto_curl_multi";
+  ASSERT_TRUE(client->sendRequest(req, responses.callback(0)));
+  ASSERT_TRUE(responses.wait());
+  EXPECT_EQ(responses.results_[0], "<failed>");
+}
+
+TEST(CurlMultiHttpClient, response_headers_are_captured) {
+  auto path = writeFile("nabto_curl_multi_headers", "hello");
+  nabto::webrtc::SignalingHttpRequest req;
+  req.method = "GET";
+  req.url = "file://" + path;
+
+  // The blocking client shares the response parsing with the multi client.
+  std::vector<nabto::webrtc::SignalingHttpClientPtr> clients = {
+      nabto::webrtc::util::CurlMultiHttpClient::create(std::nullopt),
+      nabto::webrtc::util::CurlHttpClient::create(std::nullopt)};
+  for (const auto& client : clients) {
+    Responses responses(1);
+    ASSERT_TRUE(client->sendRequest(req, responses.callback(0)));
+    ASSERT_TRUE(responses.wait());
+    EXPECT_EQ(responses.results_[0], "hello");
+    EXPECT_EQ(responses.contentLengths_, std::vector<std::string>{"5"});
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(CurlMultiHttpClient, request_times_out) {
+  SilentServer server;
+  auto client = nabto::webrtc::util::CurlMultiHttpClient::create(std::nullopt);
+  Responses responses(1);
+  nabto::webrtc::SignalingHttpRequest req;
+  req.method = "GET";
+  req.url = server.url();
+  req.timeoutMs = 200;
+  ASSERT_TRUE(client->sendRequest(req, responses.callback(0)));
+  ASSERT_TRUE(responses.wait());
+  EXPECT_EQ(responses.results_[0], "<failed>");
+}
+
+TEST(CurlMultiHttpClient, cancel_request) {
+  SilentServer server;
+  auto token = nabto::webrtc::SignalingCancellationToken::create();
+  std::vector<nabto::webrtc::SignalingHttpClientPtr> clients = {
+      nabto::webrtc::util::CurlMultiHttpClient::create(std::nullopt),
+      nabto::webrtc::util::CurlHttpClient::create(std::nullopt)};
+  Responses responses(clients.size());
+  for (size_t i = 0; i < clients.size(); i++) {
+    nabto::webrtc::SignalingHttpRequest req;
+    req.method = "GET";
+    req.url = server.url();
+    req.cancellationToken = token;
+    ASSERT_TRUE(clients[i]->sendRequest(req, responses.callback(i)));
+  }
+  token->cancel();
+  ASSERT_TRUE(responses.wait());
+  EXPECT_EQ(responses.results_[0], "<failed>");
+  EXPECT_EQ(responses.results_[1], "<failed>");
+}
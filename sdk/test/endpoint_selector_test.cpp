@@ -0,0 +1,195 @@
+#include "../src/signaling_device/src/endpoint_selector.hpp"
+#include "../src/signaling_device/src/signaling_device_impl.hpp"
+#include "fakes.hpp"
+#include "virtual_time.hpp"
+
+#include <nabto/webrtc/device.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using nabto::webrtc::EndpointSelector;
+using nabto::webrtc::SignalingDeviceState;
+
+const std::string EU = "https://eu.signaling.test";
+const std::string US = "https://us.signaling.test";
+const std::string AP = "https://ap.signaling.test";
+
+class EndpointRaceTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    clock_ = std::make_shared<nabto::test::VirtualClock>();
+    backend_ = nabto::test::SimulatedBackend::create(clock_);
+  }
+
+  void TearDown() override {
+    device_->close();
+    clock_->advance(EndpointSelector::PROBE_INTERVAL_MS);
+  }
+
+  void start() {
+    nabto::webrtc::SignalingDeviceConfig conf;
+    conf.deviceId = "de-test";
+    conf.productId = "pr-test";
+    conf.signalingUrls = {EU, US, AP};
+    conf.tokenProvider = std::make_shared<nabto::test::FakeTokenGenerator>();
+    conf.wsImpl = backend_->createWebsocket();
+    conf.httpCli = backend_->httpClient();
+    conf.timerFactory =
+        std::make_shared<nabto::test::VirtualTimerFactory>(clock_);
+    device_ = nabto::webrtc::SignalingDeviceImpl::create(conf);
+    recorder_ = std::make_unique<nabto::test::StateRecorder>(device_, clock_);
+    device_->start();
+  }
+
+  nabto::test::VirtualClockPtr clock_;
+  std::shared_ptr<nabto::test::SimulatedBackend> backend_;
+  nabto::webrtc::SignalingDeviceImplPtr device_;
+  std::unique_ptr<nabto::test::StateRecorder> recorder_;
+};
+
+}  // namespace
+
+TEST(EndpointSelector, race_order) {
+  EndpointSelector selector({EU, US, AP});
+  std::vector<std::string> expected = {EU, US, AP};
+  ASSERT_EQ(selector.raceOrder(), expected);
+
+  selector.addSample(AP, 100);
+  selector.addSample(US, 50);
+  expected = {US, AP, EU};
+  ASSERT_EQ(selector.raceOrder(), expected);
+
+  selector.addFailure(US);
+  expected = {AP, EU, US};
+  ASSERT_EQ(selector.raceOrder(), expected);
+}
+
+TEST(EndpointSelector, fails_over_only_when_markedly_faster) {
+  EndpointSelector selector({EU, US});
+  selector.setCurrent(EU);
+  ASSERT_FALSE(selector.fasterEndpoint().has_value());
+
+  selector.addSample(EU, 100);
+  selector.addSample(US, 60);
+  // Faster by 40%, but only by 40 ms.
+  ASSERT_FALSE(selector.fasterEndpoint().has_value());
+
+  selector.addFailure(EU);
+  selector.addSample(EU, 1000);
+  selector.addFailure(US);
+  selector.addSample(US, 900);
+  // Faster by 100 ms, but only by 10%.
+  ASSERT_FALSE(selector.fasterEndpoint().has_value());
+
+  selector.addFailure(US);
+  selector.addSample(US, 500);
+  ASSERT_EQ(selector.fasterEndpoint(), US);
+}
+
+TEST(EndpointSelector, smooths_samples) {
+  EndpointSelector selector({EU});
+  selector.addSample(EU, 100);
+  selector.addSample(EU, 500);
+  ASSERT_EQ(selector.rttMs(EU), 200);
+}
+
+TEST_F(EndpointRaceTest, fastest_endpoint_wins) {
+  auto& eu = backend_->addEndpoint(EU, 400);
+  auto& us = backend_->addEndpoint(US, 40);
+  auto& ap = backend_->addEndpoint(AP, 300);
+  start();
+  clock_->advance(2000);
+
+  ASSERT_EQ(recorder_->last(), SignalingDeviceState::CONNECTED);
+  ASSERT_EQ(device_->currentEndpoint(), US);
+  ASSERT_EQ(eu.attachRequests, 1);
+  ASSERT_EQ(us.attachRequests, 1);
+  // The race was decided before the third attach was due.
+  ASSERT_EQ(ap.attachRequests, 0);
+}
+
+TEST_F(EndpointRaceTest, fast_first_endpoint_is_not_raced) {
+  auto& eu = backend_->addEndpoint(EU, 50);
+  auto& us = backend_->addEndpoint(US, 10);
+  auto& ap = backend_->addEndpoint(AP, 10);
+  start();
+  clock_->advance(2000);
+
+  ASSERT_EQ(recorder_->last(), SignalingDeviceState::CONNECTED);
+  ASSERT_EQ(device_->currentEndpoint(), EU);
+  ASSERT_EQ(eu.attachRequests, 1);
+  ASSERT_EQ(us.attachRequests, 0);
+  ASSERT_EQ(ap.attachRequests, 0);
+}
+
+TEST_F(EndpointRaceTest, simultaneous_answers_connect_once) {
+  // The attach to US starts after the stagger delay and is answered in the
+  // same tick as the attach to EU.
+  backend_->addEndpoint(EU, 150);
+  backend_->addEndpoint(US, 25);
+  backend_->addEndpoint(AP, 1000);
+  start();
+  clock_->advance(2 * 150);
+  ASSERT_EQ(backend_->attachRequests_, 2);
+  clock_->advance(2000);
+
+  ASSERT_EQ(recorder_->last(), SignalingDeviceState::CONNECTED);
+  ASSERT_EQ(device_->currentEndpoint(), EU);
+  ASSERT_EQ(backend_->websocketOpens_, 1);
+  ASSERT_EQ(recorder_->timesOf(SignalingDeviceState::CONNECTED).size(), 1);
+}
+
+TEST_F(EndpointRaceTest, failed_endpoint_starts_next_at_once) {
+  auto& eu = backend_->addEndpoint(EU, 20);
+  eu.available = false;
+  auto& us = backend_->addEndpoint(US, 40);
+  backend_->addEndpoint(AP, 40);
+  start();
+
+  // The attach to EU fails after 40 ms, well before the stagger delay.
+  clock_->advance(2 * 20);
+  ASSERT_EQ(us.attachRequests, 1);
+  clock_->advance(2 * 40);
+  ASSERT_EQ(device_->currentEndpoint(), US);
+  clock_->advance(1000);
+  ASSERT_EQ(recorder_->last(), SignalingDeviceState::CONNECTED);
+}
+
+TEST_F(EndpointRaceTest, all_endpoints_failing_waits_for_retry) {
+  for (const auto& url : {EU, US, AP}) {
+    backend_->addEndpoint(url, 20).available = false;
+  }
+  start();
+  clock_->advance(500);
+  ASSERT_EQ(recorder_->last(), SignalingDeviceState::WAIT_RETRY);
+}
+
+TEST_F(EndpointRaceTest, fails_over_to_markedly_faster_endpoint) {
+  auto& eu = backend_->addEndpoint(EU, 50);
+  auto& us = backend_->addEndpoint(US, 200);
+  backend_->addEndpoint(AP, 300);
+  start();
+  clock_->advance(2000);
+  ASSERT_EQ(device_->currentEndpoint(), EU);
+
+  // EU degrades, probes notice and the device moves to US.
+  eu.latencyMs = 1000;
+  clock_->advance(3 * EndpointSelector::PROBE_INTERVAL_MS);
+  ASSERT_GT(us.probes, 0);
+  ASSERT_EQ(device_->currentEndpoint(), US);
+  ASSERT_EQ(recorder_->last(), SignalingDeviceState::CONNECTED);
+  ASSERT_EQ(recorder_->timesOf(SignalingDeviceState::WAIT_RETRY).size(), 1);
+
+  // No further moves while the latencies are stable.
+  const size_t attaches = backend_->attachRequests_;
+  clock_->advance(10 * EndpointSelector::PROBE_INTERVAL_MS);
+  ASSERT_EQ(backend_->attachRequests_, attaches);
+  ASSERT_EQ(device_->currentEndpoint(), US);
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <nabto/webrtc/device.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nabto {
+namespace test {
+
+/**
+ * Websocket which records sent data. Events are triggered by invoking the
+ * stored callbacks from the test.
+ */
+class FakeWebsocket : public nabto::webrtc::SignalingWebsocket {
+ public:
+  bool send(const std::string& data) override {
+    sent_.push_back(data);
+    return true;
+  }
+  void close() override { closed_ = true; }
+  void onOpen(std::function<void()> callback) override {
+    openCb_ = std::move(callback);
+  }
+  void onMessage(
+      std::function<void(const std::string& message)> callback) override {
+    messageCb_ = std::move(callback);
+  }
+  void onClosed(std::function<void()> callback) override {
+    closedCb_ = std::move(callback);
+  }
+  void onError(
+      std::function<void(const std::string& error)> callback) override {
+    errorCb_ = std::move(callback);
+  }
+  void open(const std::string& url) override { url_ = url; }
+
+  size_t countSent(const std::string& type) {
+    size_t count = 0;
+    for (const auto& msg : sent_) {
+      if (nlohmann::json::parse(msg).at("type") == type) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  size_t pings() { return countSent("PING"); }
+
+  std::string url_;
+  std::vector<std::string> sent_;
+  bool closed_ = false;
+  std::function<void()> openCb_;
+  std::function<void(const std::string& message)> messageCb_;
+  std::function<void()> closedCb_;
+  std::function<void(const std::string& error)> errorCb_;
+};
+
+/**
+ * Websocket server where the test connects clients. The device side of each
+ * connection is a FakeWebsocket, the test plays the client by invoking its
+ * message callback and reading what the device sent.
+ */
+class FakeWebsocketServer : public nabto::webrtc::SignalingWebsocketServer {
+ public:
+  void onConnection(
+      std::function<void(nabto::webrtc::SignalingWebsocketPtr websocket)>
+          callback) override {
+    connectionCb_ = std::move(callback);
+  }
+  void close() override { closed_ = true; }
+
+  std::shared_ptr<FakeWebsocket> connect() {
+    auto ws = std::make_shared<FakeWebsocket>();
+    connectionCb_(ws);
+    return ws;
+  }
+
+  bool closed_ = false;
+  std::function<void(nabto::webrtc::SignalingWebsocketPtr websocket)>
+      connectionCb_;
+};
+
+/**
+ * HTTP client which queues requests until the test responds to them.
+ */
+class FakeHttpClient : public nabto::webrtc::SignalingHttpClient {
+ public:
+  bool sendRequest(const nabto::webrtc::SignalingHttpRequest& request,
+                   nabto::webrtc::HttpResponseCallback callback) override {
+    requests_.push_back(request);
+    callbacks_.push_back(std::move(callback));
+    return true;
+  }
+
+  void respond(int statusCode, const std::string& body) {
+    ASSERT_FALSE(callbacks_.empty());
+    auto cb = callbacks_.front();
+    callbacks_.erase(callbacks_.begin());
+    auto response = std::make_unique<nabto::webrtc::SignalingHttpResponse>();
+    response->statusCode = statusCode;
+    response->body = body;
+    cb(std::move(response));
+  }
+
+  std::vector<nabto::webrtc::SignalingHttpRequest> requests_;
+  std::vector<nabto::webrtc::HttpResponseCallback> callbacks_;
+};
+
+class FakeTokenGenerator : public nabto::webrtc::SignalingTokenGenerator {
+ public:
+  bool generateToken(std::string& token) override {
+    token = "token";
+    return true;
+  }
+};
+
+/**
+ * Timer which only fires when the test calls fire().
+ */
+class ManualTimer : public nabto::webrtc::SignalingTimer {
+ public:
+  void setTimeout(uint32_t timeoutMs, std::function<void()> cb) override {
+    timeoutMs_ = timeoutMs;
+    cb_ = std::move(cb);
+  }
+  void cancel() override { cb_ = nullptr; }
+
+  void fire() {
+    auto cb = std::move(cb_);
+    cb_ = nullptr;
+    ASSERT_TRUE(cb);
+    cb();
+  }
+
+  uint32_t timeoutMs_ = 0;
+  std::function<void()> cb_;
+};
+
+/**
+ * Factory for ManualTimers. Its clock only moves when the test calls
+ * advance().
+ */
+class ManualTimerFactory : public nabto::webrtc::SignalingTimerFactory {
+ public:
+  nabto::webrtc::SignalingTimerPtr createTimer() override {
+    timer_ = std::make_shared<ManualTimer>();
+    return timer_;
+  }
+  std::chrono::steady_clock::time_point now() override { return now_; }
+
+  void advance(uint32_t ms) { now_ += std::chrono::milliseconds(ms); }
+
+  std::shared_ptr<ManualTimer> timer_;
+  std::chrono::steady_clock::time_point now_;
+};
+
+/**
+ * Executor which queues callbacks until the test runs them, like an
+ * application event loop would.
+ */
+class QueueExecutor : public nabto::webrtc::SignalingCallbackExecutor {
+ public:
+  void post(std::function<void()> callback) override {
+    queue_.push_back(std::move(callback));
+  }
+
+  size_t runAll() {
+    size_t count = 0;
+    while (!queue_.empty()) {
+      auto cb = std::move(queue_.front());
+      queue_.erase(queue_.begin());
+      cb();
+      count++;
+    }
+    return count;
+  }
+
+  std::vector<std::function<void()>> queue_;
+};
+
+}  // namespace test
+}  // namespace nabto
@@ -0,0 +1,254 @@
+#include "../src/signaling_device/src/signaling_device_impl.hpp"
+#include "fakes.hpp"
+
+#include <nabto/webrtc/device.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using nabto::webrtc::SignalingChannelState;
+
+std::string dataMessage(const std::string& channelId, uint32_t seq,
+                        const nlohmann::json& data,
+                        const std::string& reconnectToken = "") {
+  nlohmann::json msg = {{"type", "MESSAGE"},
+                        {"channelId", channelId},
+                        {"authorized", true},
+                        {"message", {{"type", "DATA"},
+                                     {"seq", seq},
+                                     {"data", data}}}};
+  if (!reconnectToken.empty()) {
+    msg["reconnectToken"] = reconnectToken;
+  }
+  return msg.dump();
+}
+
+std::vector<nlohmann::json> sentOfType(
+    const std::shared_ptr<nabto::test::FakeWebsocket>& ws,
+    const std::string& type) {
+  std::vector<nlohmann::json> result;
+  for (const auto& sent : ws->sent_) {
+    auto msg = nlohmann::json::parse(sent);
+    if (msg.at("type") == type) {
+      result.push_back(msg);
+    }
+  }
+  return result;
+}
+
+class LocalSignalingTest : public ::testing::Test {
+ protected:
+  struct NewChannel {
+    nabto::webrtc::SignalingChannelPtr channel;
+    bool authorized;
+  };
+
+  void SetUp() override {
+    ws_ = std::make_shared<nabto::test::FakeWebsocket>();
+    http_ = std::make_shared<nabto::test::FakeHttpClient>();
+    server_ = std::make_shared<nabto::test::FakeWebsocketServer>();
+    nabto::webrtc::SignalingDeviceConfig conf;
+    conf.deviceId = "de-test";
+    conf.productId = "pr-test";
+    conf.signalingUrl = "https://signaling.test";
+    conf.tokenProvider = std::make_shared<nabto::test::FakeTokenGenerator>();
+    conf.wsImpl = ws_;
+    conf.httpCli = http_;
+    conf.timerFactory = std::make_shared<nabto::test::ManualTimerFactory>();
+    conf.localServer = server_;
+    device_ = nabto::webrtc::SignalingDeviceImpl::create(conf);
+    listenerId_ = device_->addNewChannelListener(
+        [this](nabto::webrtc::SignalingChannelPtr channel, bool authorized) {
+          channels_.push_back({channel, authorized});
+          channel->addStateChangeListener([this](SignalingChannelState state) {
+            states_.push_back(state);
+          });
+        });
+    device_->start();
+  }
+
+  void TearDown() override { device_->close(); }
+
+  void connectCloud() {
+    http_->respond(200, R"({"signalingUrl": "wss://signaling.test"})");
+    ws_->openCb_();
+  }
+
+  std::shared_ptr<nabto::test::FakeWebsocket> ws_;
+  std::shared_ptr<nabto::test::FakeHttpClient> http_;
+  std::shared_ptr<nabto::test::FakeWebsocketServer> server_;
+  nabto::webrtc::SignalingDeviceImplPtr device_;
+  nabto::webrtc::NewChannelListenerId listenerId_ = 0;
+  std::vector<NewChannel> channels_;
+  std::vector<SignalingChannelState> states_;
+};
+
+}  // namespace
+
+TEST_F(LocalSignalingTest, local_channel_is_not_authorized) {
+  auto client = server_->connect();
+  client->messageCb_(dataMessage("c1", 0, "hello"));
+
+  ASSERT_EQ(channels_.size(), 1);
+  ASSERT_FALSE(channels_[0].authorized);
+  ASSERT_TRUE(channels_[0].channel->isLocal());
+  ASSERT_EQ(channels_[0].channel->getChannelId(), "c1");
+}
+
+TEST_F(LocalSignalingTest, messages_are_routed_to_the_local_client) {
+  auto client = server_->connect();
+  client->messageCb_(dataMessage("c1", 0, "hello"));
+  ASSERT_EQ(channels_.size(), 1);
+
+  auto acks = sentOfType(client, "MESSAGE");
+  ASSERT_EQ(acks.size(), 1);
+  ASSERT_EQ(acks[0].at("channelId"), "c1");
+  ASSERT_EQ(acks[0].at("message").at("type"), "ACK");
+
+  channels_[0].channel->sendMessage("world");
+  auto sent = sentOfType(client, "MESSAGE");
+  ASSERT_EQ(sent.size(), 2);
+  ASSERT_EQ(sent[1].at("message").at("type"), "DATA");
+  ASSERT_EQ(sent[1].at("message").at("data"), "world");
+  // Nothing goes through the Nabto Signaling Service.
+  ASSERT_TRUE(ws_->sent_.empty());
+}
+
+TEST_F(LocalSignalingTest, ping_is_answered_locally) {
+  auto client = server_->connect();
+  client->messageCb_(R"({"type": "PING"})");
+  ASSERT_EQ(client->countSent("PONG"), 1);
+  ASSERT_TRUE(ws_->sent_.empty());
+}
+
+TEST_F(LocalSignalingTest, local_and_cloud_channels_are_separate) {
+  connectCloud();
+  ws_->messageCb_(dataMessage("c1", 0, "cloud"));
+  auto client = server_->connect();
+  client->messageCb_(dataMessage("c1", 0, "local"));
+
+  ASSERT_EQ(channels_.size(), 2);
+  ASSERT_TRUE(channels_[0].authorized);
+  ASSERT_FALSE(channels_[0].channel->isLocal());
+  ASSERT_TRUE(channels_[1].channel->isLocal());
+
+  channels_[0].channel->sendMessage("to cloud");
+  channels_[1].channel->sendMessage("to local");
+  auto cloudSent = sentOfType(ws_, "MESSAGE");
+  auto localSent = sentOfType(client, "MESSAGE");
+  ASSERT_EQ(cloudSent.back().at("message").at("data"), "to cloud");
+  ASSERT_EQ(localSent.back().at("message").at("data"), "to local");
+}
+
+TEST_F(LocalSignalingTest, reconnecting_client_continues_channel) {
+  auto first = server_->connect();
+  first->messageCb_(dataMessage("c1", 0, "hello"));
+  ASSERT_EQ(channels_.size(), 1);
+  auto channel = channels_[0].channel;
+  auto connected = sentOfType(first, "PEER_CONNECTED");
+  ASSERT_EQ(connected.size(), 1);
+  ASSERT_EQ(connected[0].at("channelId"), "c1");
+  const std::string token = connected[0].at("reconnectToken");
+
+  first->closedCb_();
+  ASSERT_EQ(states_.back(), SignalingChannelState::DISCONNECTED);
+  channel->sendMessage("while away");
+
+  auto second = server_->connect();
+  second->messageCb_(dataMessage("c1", 1, "back", token));
+  ASSERT_EQ(states_.back(), SignalingChannelState::CONNECTED);
+  ASSERT_EQ(channels_.size(), 1);
+
+  // The unacknowledged message is resent on the new connection.
+  bool resent = false;
+  for (const auto& msg : sentOfType(second, "MESSAGE")) {
+    if (msg.at("message").at("type") == "DATA") {
+      resent = msg.at("message").at("data") == "while away";
+    }
+  }
+  ASSERT_TRUE(resent);
+}
+
+TEST_F(LocalSignalingTest, other_client_cannot_take_over_channel) {
+  auto owner = server_->connect();
+  owner->messageCb_(dataMessage("c1", 0, "hello"));
+  const std::string token =
+      sentOfType(owner, "PEER_CONNECTED")[0].at("reconnectToken");
+
+  const size_t stateChanges = states_.size();
+
+  // Even with the token, a channel is not moved while its connection is
+  // open.
+  auto intruder = server_->connect();
+  intruder->messageCb_(dataMessage("c1", 1, "mine now", token));
+  auto errors = sentOfType(intruder, "ERROR");
+  ASSERT_EQ(errors.size(), 1);
+  ASSERT_EQ(errors[0].at("error").at("code"), "ACCESS_DENIED");
+  ASSERT_EQ(states_.size(), stateChanges);
+
+  channels_[0].channel->sendMessage("to owner");
+  ASSERT_EQ(sentOfType(owner, "MESSAGE").back().at("message").at("data"),
+            "to owner");
+  ASSERT_EQ(sentOfType(intruder, "MESSAGE").size(), 0);
+}
+
+TEST_F(LocalSignalingTest, reconnect_requires_token) {
+  auto first = server_->connect();
+  first->messageCb_(dataMessage("c1", 0, "hello"));
+  first->closedCb_();
+
+  for (const std::string& token : {std::string(), std::string("guess")}) {
+    auto other = server_->connect();
+    other->messageCb_(dataMessage("c1", 1, "mine now", token));
+    auto errors = sentOfType(other, "ERROR");
+    ASSERT_EQ(errors.size(), 1);
+    ASSERT_EQ(errors[0].at("error").at("code"), "ACCESS_DENIED");
+  }
+  ASSERT_EQ(states_.back(), SignalingChannelState::DISCONNECTED);
+  ASSERT_EQ(channels_.size(), 1);
+}
+
+TEST_F(LocalSignalingTest, channel_without_listener_is_dropped) {
+  device_->removeNewChannelListener(listenerId_);
+  auto first = server_->connect();
+  first->messageCb_(dataMessage("c1", 0, "hello"));
+  auto errors = sentOfType(first, "ERROR");
+  ASSERT_EQ(errors.size(), 1);
+  ASSERT_EQ(errors[0].at("error").at("code"), "INTERNAL_ERROR");
+  ASSERT_EQ(sentOfType(first, "PEER_CONNECTED").size(), 0);
+
+  // Neither the channel nor the connection holds the channel ID.
+  device_->addNewChannelListener(
+      [this](nabto::webrtc::SignalingChannelPtr channel, bool authorized) {
+        channels_.push_back({channel, authorized});
+      });
+  auto second = server_->connect();
+  second->messageCb_(dataMessage("c1", 0, "hello"));
+  ASSERT_EQ(sentOfType(second, "ERROR").size(), 0);
+  ASSERT_EQ(sentOfType(second, "PEER_CONNECTED").size(), 1);
+  ASSERT_EQ(channels_.size(), 1);
+}
+
+TEST_F(LocalSignalingTest, close_closes_local_connections) {
+  auto client = server_->connect();
+  client->messageCb_(dataMessage("c1", 0, "hello"));
+
+  device_->close();
+  ASSERT_TRUE(server_->closed_);
+  ASSERT_TRUE(client->closed_);
+  auto errors = sentOfType(client, "ERROR");
+  ASSERT_EQ(errors.size(), 1);
+  ASSERT_EQ(errors[0].at("error").at("code"), "CHANNEL_CLOSED");
+
+  // Clients connecting after close are rejected.
+  auto late = server_->connect();
+  ASSERT_TRUE(late->closed_);
+}
@@ -210,3 +210,19 @@ TEST(message_transport, missing_signer_type) {
   ASSERT_EQ(mock->errors_[0].errorMessage(),
             "Could not decode the incoming signaling message");
 }
+
+TEST(signaling_channel, default_send_message_with_ack) {
+  // Channels implemented before sendMessageWithAck() existed still work.
+  auto mock = std::make_shared<nabto::test::MockSignaling>();
+  nlohmann::json message = {{"type", "ANSWER"}};
+  int acks = 0;
+  mock->sendMessageWithAck(message, [&acks](bool acked) {
+    ASSERT_TRUE(acked);
+    acks++;
+  });
+  ASSERT_EQ(acks, 1);
+  ASSERT_EQ(mock->messages_.size(), 1);
+  ASSERT_EQ(mock->messages_[0], message);
+  mock->sendMessageWithAck(message, nullptr);
+  ASSERT_EQ(mock->messages_.size(), 2);
+}
@@ -0,0 +1,130 @@
+#include "../src/signaling_device/src/reconnect_backoff.hpp"
+#include "../src/signaling_device/src/signaling_device_impl.hpp"
+#include "fakes.hpp"
+
+#include <nabto/webrtc/device.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <set>
+
+namespace {
+
+using nabto::webrtc::ReconnectBackoff;
+
+const size_t ROUNDS = 1000;
+
+}  // namespace
+
+TEST(ReconnectBackoff, delays_stay_within_bounds) {
+  ReconnectBackoff backoff(42);
+  uint32_t previous = ReconnectBackoff::BASE_DELAY_MS;
+  for (size_t i = 0; i < ROUNDS; i++) {
+    const uint32_t delay = backoff.nextDelayMs();
+    ASSERT_GE(delay, ReconnectBackoff::BASE_DELAY_MS);
+    ASSERT_LE(delay, ReconnectBackoff::MAX_DELAY_MS);
+    ASSERT_LE(delay, previous * 3);
+    previous = delay;
+  }
+}
+
+TEST(ReconnectBackoff, devices_do_not_retry_in_lockstep) {
+  // Devices disconnected at the same time should pick different delays.
+  std::set<uint32_t> delays;
+  for (uint32_t seed = 0; seed < 100; seed++) {
+    ReconnectBackoff backoff(seed);
+    backoff.nextDelayMs();
+    delays.insert(backoff.nextDelayMs());
+  }
+  ASSERT_GT(delays.size(), 50);
+}
+
+TEST(ReconnectBackoff, reset_starts_over) {
+  ReconnectBackoff backoff(1);
+  for (size_t i = 0; i < 20; i++) {
+    backoff.nextDelayMs();
+  }
+  backoff.reset();
+  ASSERT_LE(backoff.nextDelayMs(), ReconnectBackoff::BASE_DELAY_MS * 3);
+}
+
+TEST(ReconnectBackoff, server_hint_is_honored_once) {
+  ReconnectBackoff backoff(7);
+  backoff.setServerHint(120000, 5000);
+  const uint32_t delay = backoff.nextDelayMs();
+  ASSERT_GE(delay, 120000);
+  ASSERT_LE(delay, 125000);
+  ASSERT_LE(backoff.nextDelayMs(), ReconnectBackoff::MAX_DELAY_MS);
+}
+
+TEST(ReconnectBackoff, retry_after) {
+  nabto::webrtc::SignalingHttpResponse response;
+  response.statusCode = 503;
+  response.headers = {{"retry-after", "30"}};
+  ASSERT_EQ(ReconnectBackoff::retryAfterMs(response), 30000);
+
+  response.headers = {{"Retry-After", "Wed, 21 Oct 2015 07:28:00 GMT"}};
+  ASSERT_EQ(ReconnectBackoff::retryAfterMs(response), std::nullopt);
+
+  response.headers = {{"Retry-After", "99999999999999999999999"}};
+  ASSERT_EQ(ReconnectBackoff::retryAfterMs(response),
+            ReconnectBackoff::MAX_SERVER_DELAY_MS);
+
+  response.statusCode = 500;
+  response.headers = {{"Retry-After", "30"}};
+  ASSERT_EQ(ReconnectBackoff::retryAfterMs(response), std::nullopt);
+}
+
+class ReconnectHintTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ws_ = std::make_shared<nabto::test::FakeWebsocket>();
+    http_ = std::make_shared<nabto::test::FakeHttpClient>();
+    timers_ = std::make_shared<nabto::test::ManualTimerFactory>();
+    nabto::webrtc::SignalingDeviceConfig conf;
+    conf.deviceId = "de-test";
+    conf.productId = "pr-test";
+    conf.signalingUrl = "https://signaling.test";
+    conf.tokenProvider = std::make_shared<nabto::test::FakeTokenGenerator>();
+    conf.wsImpl = ws_;
+    conf.httpCli = http_;
+    conf.timerFactory = timers_;
+    device_ = nabto::webrtc::SignalingDeviceImpl::create(conf);
+    device_->start();
+  }
+
+  void TearDown() override { device_->close(); }
+
+  std::shared_ptr<nabto::test::FakeWebsocket> ws_;
+  std::shared_ptr<nabto::test::FakeHttpClient> http_;
+  std::shared_ptr<nabto::test::ManualTimerFactory> timers_;
+  nabto::webrtc::SignalingDeviceImplPtr device_;
+};
+
+TEST_F(ReconnectHintTest, retry_after_delays_reconnect) {
+  auto response = std::make_unique<nabto::webrtc::SignalingHttpResponse>();
+  response->statusCode = 503;
+  response->headers = {{"Retry-After", "120"}};
+  auto cb = http_->callbacks_.front();
+  cb(std::move(response));
+  ASSERT_NE(timers_->timer_, nullptr);
+  ASSERT_GE(timers_->timer_->timeoutMs_, 120000);
+}
+
+TEST_F(ReconnectHintTest, websocket_hint_delays_reconnect) {
+  http_->respond(200,
+                 nlohmann::json({{"signalingUrl", "wss://ws.test"}}).dump());
+  ws_->openCb_();
+  ws_->messageCb_(
+      nlohmann::json({{"type", "RECONNECT"}, {"delayMs", 300000}}).dump());
+  ws_->closedCb_();
+  ASSERT_NE(timers_->timer_, nullptr);
+  ASSERT_GE(timers_->timer_->timeoutMs_, 300000);
+  ASSERT_LE(timers_->timer_->timeoutMs_,
+            300000 + ReconnectBackoff::DEFAULT_SPREAD_MS);
+}
@@ -0,0 +1,383 @@
+#include "../src/signaling_device/src/outbound_queue.hpp"
+#include "../src/signaling_device/src/signaling_device_impl.hpp"
+#include "fakes.hpp"
+
+#include <nabto/webrtc/device.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using nabto::webrtc::OutboundQueue;
+using nabto::webrtc::SendPriority;
+
+/**
+ * Websocket with a send buffer drained at a fixed rate, like a congested
+ * uplink. The test moves time and the link forward with transmit().
+ */
+class ThrottledWebsocket : public nabto::test::FakeWebsocket {
+ public:
+  struct Departure {
+    nlohmann::json msg;
+    uint32_t atMs;
+  };
+
+  bool send(const std::string& data) override {
+    buffer_.push_back(data);
+    buffered_ += data.size();
+    return true;
+  }
+
+  size_t bufferedAmount() override { return buffered_; }
+
+  void onBufferedAmountLow(size_t threshold,
+                           std::function<void()> callback) override {
+    threshold_ = threshold;
+    lowCb_ = std::move(callback);
+  }
+
+  void transmit(size_t bytes, uint32_t nowMs) {
+    const bool wasAbove = buffered_ > threshold_;
+    while (bytes > 0 && !buffer_.empty()) {
+      const size_t left = buffer_.front().size() - sentOfFront_;
+      const size_t now = std::min(bytes, left);
+      sentOfFront_ += now;
+      buffered_ -= now;
+      bytes -= now;
+      if (sentOfFront_ == buffer_.front().size()) {
+        departures_.push_back({nlohmann::json::parse(buffer_.front()), nowMs});
+        buffer_.pop_front();
+        sentOfFront_ = 0;
+      }
+    }
+    if (wasAbove && buffered_ <= threshold_ && lowCb_) {
+      lowCb_();
+    }
+  }
+
+  std::deque<std::string> buffer_;
+  size_t buffered_ = 0;
+  size_t sentOfFront_ = 0;
+  size_t threshold_ = 0;
+  std::function<void()> lowCb_;
+  std::vector<Departure> departures_;
+};
+
+// An 8 Mbit/s uplink.
+const size_t LINK_BYTES_PER_MS = 1000;
+// Each channel sends two large messages, together 20% more than the link
+// carries.
+const uint32_t NEW_CHANNEL_INTERVAL_MS = 10;
+const size_t MESSAGE_BYTES = 6000;
+const uint32_t PING_INTERVAL_MS = 100;
+// A PONG waits for at most the websocket send buffer, one frame which has
+// just been passed to the websocket and a margin for the envelopes.
+const uint32_t MAX_CONTROL_LATENCY_MS =
+    (nabto::webrtc::WebsocketConnection::SEND_BUFFER_HIGH_BYTES +
+     2 * MESSAGE_BYTES) /
+        LINK_BYTES_PER_MS +
+    2;
+
+class SendPriorityTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ws_ = std::make_shared<ThrottledWebsocket>();
+    http_ = std::make_shared<nabto::test::FakeHttpClient>();
+    nabto::webrtc::SignalingDeviceConfig conf;
+    conf.deviceId = "de-test";
+    conf.productId = "pr-test";
+    conf.signalingUrl = "https://signaling.test";
+    conf.tokenProvider = std::make_shared<nabto::test::FakeTokenGenerator>();
+    conf.wsImpl = ws_;
+    conf.httpCli = http_;
+    conf.timerFactory = std::make_shared<nabto::test::ManualTimerFactory>();
+    device_ = nabto::webrtc::SignalingDeviceImpl::create(conf);
+    device_->start();
+    http_->respond(200, R"({"signalingUrl": "wss://signaling.test"})");
+    ws_->openCb_();
+  }
+
+  void TearDown() override { device_->close(); }
+
+  // Open a channel every few ms, each answered by two large messages, while
+  // the backend pings the device. Returns the time from each PING to its PONG
+  // leaving the device.
+  std::vector<uint32_t> churn(uint32_t durationMs) {
+    const std::string message(MESSAGE_BYTES, 'a');
+    device_->addNewChannelListener(
+        [this, message](nabto::webrtc::SignalingChannelPtr channel,
+                        bool /*authorized*/) {
+          channel->sendMessageWithPriority(message, firstPriority_);
+          channel->sendMessage(message);
+        });
+    std::vector<uint32_t> pingsAt;
+    for (uint32_t now = 0; now < durationMs; now++) {
+      if (now % NEW_CHANNEL_INTERVAL_MS == 0) {
+        const std::string id = "c" + std::to_string(now);
+        openedAt_[id] = now;
+        ws_->messageCb_(
+            nlohmann::json(
+                {{"type", "MESSAGE"},
+                 {"channelId", id},
+                 {"authorized", true},
+                 {"message", {{"type", "DATA"}, {"seq", 0}, {"data", "x"}}}})
+                .dump());
+      }
+      if (now % PING_INTERVAL_MS == 0) {
+        pingsAt.push_back(now);
+        ws_->messageCb_(R"({"type": "PING"})");
+      }
+      ws_->transmit(LINK_BYTES_PER_MS, now);
+    }
+    std::vector<uint32_t> latencies;
+    size_t pong = 0;
+    for (const auto& departure : ws_->departures_) {
+      if (departure.msg.at("type") == "PONG") {
+        latencies.push_back(departure.atMs - pingsAt.at(pong));
+        pong++;
+      }
+    }
+    return latencies;
+  }
+
+  std::shared_ptr<ThrottledWebsocket> ws_;
+  std::shared_ptr<nabto::test::FakeHttpClient> http_;
+  nabto::webrtc::SignalingDeviceImplPtr device_;
+  nabto::webrtc::SignalingMessagePriority firstPriority_ =
+      nabto::webrtc::SignalingMessagePriority::NORMAL;
+  std::map<std::string, uint32_t> openedAt_;
+};
+
+}  // namespace
+
+TEST(OutboundQueue, lanes_in_priority_order) {
+  OutboundQueue queue;
+  queue.push(SendPriority::DATA, "data", "c1", true);
+  queue.push(SendPriority::ACK, "ack", "c2", false);
+  queue.push(SendPriority::CONTROL, "pong", "", false);
+  ASSERT_EQ(queue.size(), 3);
+  ASSERT_EQ(queue.pop(), "pong");
+  ASSERT_EQ(queue.pop(), "ack");
+  ASSERT_EQ(queue.pop(), "data");
+  ASSERT_FALSE(queue.pop().has_value());
+  ASSERT_TRUE(queue.empty());
+}
+
+TEST(OutboundQueue, ordered_frame_takes_earlier_channel_frames_along) {
+  OutboundQueue queue;
+  queue.push(SendPriority::DATA, "c1-0", "c1", true);
+  queue.push(SendPriority::DATA, "c2-0", "c2", true);
+  queue.push(SendPriority::DATA, "c1-1", "c1", true);
+  queue.push(SendPriority::ACK, "c2-ack", "c2", false);
+  queue.push(SendPriority::ACK, "c1-2", "c1", true);
+  queue.push(SendPriority::CONTROL, "pong", "", false);
+
+  std::vector<std::string> expected = {"pong", "c2-ack", "c1-0",
+                                       "c1-1", "c1-2",   "c2-0"};
+  for (const auto& frame : expected) {
+    ASSERT_EQ(queue.pop(), frame);
+  }
+}
+
+TEST(OutboundQueue, unordered_frame_does_not_move_others) {
+  OutboundQueue queue;
+  queue.push(SendPriority::DATA, "c1-0", "c1", true);
+  queue.push(SendPriority::ACK, "c1-ack", "c1", false);
+  ASSERT_EQ(queue.pop(), "c1-ack");
+  ASSERT_EQ(queue.pop(), "c1-0");
+}
+
+TEST(WebsocketConnectionSend, lanes_apply_when_websocket_buffers) {
+  auto ws = std::make_shared<ThrottledWebsocket>();
+  auto conn = nabto::webrtc::WebsocketConnection::create(
+      ws, std::make_shared<nabto::test::ManualTimerFactory>());
+  auto frame = [](const std::string& type, const std::string& body = "") {
+    return nlohmann::json({{"type", type}, {"body", body}}).dump();
+  };
+
+  // Fills the websocket buffer past the high mark.
+  const std::string bulk(
+      nabto::webrtc::WebsocketConnection::SEND_BUFFER_HIGH_BYTES, 'a');
+  conn->send(frame("BULK", bulk), SendPriority::DATA, "c1", true);
+  conn->send(frame("DATA"), SendPriority::DATA, "c2", true);
+  conn->send(frame("ACK"), SendPriority::ACK, "c3", false);
+  conn->send(frame("PONG"), SendPriority::CONTROL);
+  ASSERT_EQ(ws->buffer_.size(), 1);
+  ASSERT_TRUE(ws->lowCb_);
+  ASSERT_EQ(ws->threshold_,
+            nabto::webrtc::WebsocketConnection::SEND_BUFFER_LOW_BYTES);
+
+  ws->transmit(ws->buffered_, 0);
+  ws->transmit(ws->buffered_, 1);
+  std::vector<std::string> order;
+  for (const auto& departure : ws->departures_) {
+    order.push_back(departure.msg.at("type"));
+  }
+  const std::vector<std::string> expected = {"BULK", "PONG", "ACK", "DATA"};
+  ASSERT_EQ(order, expected);
+}
+
+TEST(WebsocketConnectionSend, websocket_without_buffer_sends_at_once) {
+  // The default bufferedAmount() reports an empty buffer, so nothing is
+  // queued and frames go out in the order sent.
+  auto ws = std::make_shared<nabto::test::FakeWebsocket>();
+  auto conn = nabto::webrtc::WebsocketConnection::create(
+      ws, std::make_shared<nabto::test::ManualTimerFactory>());
+  conn->send("data", SendPriority::DATA, "c1", true);
+  conn->send("pong", SendPriority::CONTROL);
+  const std::vector<std::string> expected = {"data", "pong"};
+  ASSERT_EQ(ws->sent_, expected);
+}
+
+TEST(WebsocketConnectionSend, websocket_is_called_without_lock) {
+  // A websocket may call back into the connection from send(), eg. with the
+  // buffered amount low callback.
+  class ReentrantWebsocket : public nabto::test::FakeWebsocket {
+   public:
+    bool send(const std::string& data) override {
+      sent_.push_back(data);
+      auto hook = std::move(onSend_);
+      onSend_ = nullptr;
+      if (hook) {
+        hook();
+      }
+      return true;
+    }
+    std::function<void()> onSend_;
+  };
+  auto ws = std::make_shared<ReentrantWebsocket>();
+  auto conn = nabto::webrtc::WebsocketConnection::create(
+      ws, std::make_shared<nabto::test::ManualTimerFactory>());
+  ws->onSend_ = [&conn]() {
+    conn->getRttStats();
+    conn->send("second", SendPriority::DATA, "c1", true);
+  };
+  conn->send("first", SendPriority::DATA, "c1", true);
+  conn->send("third", SendPriority::DATA, "c1", true);
+  const std::vector<std::string> expected = {"first", "second", "third"};
+  ASSERT_EQ(ws->sent_, expected);
+}
+
+TEST_F(SendPriorityTest, high_priority_message_is_resent_with_priority) {
+  std::map<std::string, nabto::webrtc::SignalingChannelPtr> channels;
+  device_->addNewChannelListener(
+      [&channels](nabto::webrtc::SignalingChannelPtr channel,
+                  bool /*authorized*/) {
+        channels[channel->getChannelId()] = channel;
+      });
+  for (const std::string id : {"c1", "c2"}) {
+    ws_->messageCb_(
+        nlohmann::json(
+            {{"type", "MESSAGE"},
+             {"channelId", id},
+             {"authorized", true},
+             {"message", {{"type", "DATA"}, {"seq", 0}, {"data", "x"}}}})
+            .dump());
+  }
+  ASSERT_EQ(channels.size(), 2);
+
+  channels["c1"]->sendMessageWithPriority(
+      "urgent", nabto::webrtc::SignalingMessagePriority::HIGH);
+  // Fills the websocket buffer, so the next frames are queued.
+  channels["c2"]->sendMessage(std::string(
+      nabto::webrtc::WebsocketConnection::SEND_BUFFER_HIGH_BYTES, 'a'));
+  channels["c2"]->sendMessage("normal");
+  // The client of c1 reconnected before it acknowledged the message.
+  ws_->messageCb_(R"({"type": "PEER_CONNECTED", "channelId": "c1"})");
+
+  ws_->transmit(ws_->buffered_, 0);
+  ws_->transmit(ws_->buffered_, 1);
+  ws_->transmit(ws_->buffered_, 2);
+  std::vector<std::string> data;
+  for (const auto& departure : ws_->departures_) {
+    if (departure.msg.at("type") == "MESSAGE" &&
+        departure.msg.at("message").at("type") == "DATA") {
+      data.push_back(departure.msg.at("message").at("data").dump());
+    }
+  }
+  const std::vector<std::string> expected = {
+      R"("urgent")",
+      nlohmann::json(std::string(
+                         nabto::webrtc::WebsocketConnection::
+                             SEND_BUFFER_HIGH_BYTES,
+                         'a'))
+          .dump(),
+      R"("urgent")", R"("normal")"};
+  ASSERT_EQ(data, expected);
+}
+
+TEST_F(SendPriorityTest, keep_alive_latency_is_bounded_under_churn) {
+  auto latencies = churn(3000);
+  ASSERT_EQ(latencies.size(), 30);
+  // The channels produce more data than the link carries, so without
+  // priorities the PONGs would wait behind the growing backlog.
+  size_t data = 0;
+  for (const auto& departure : ws_->departures_) {
+    if (departure.msg.at("type") == "MESSAGE" &&
+        departure.msg.at("message").at("type") == "DATA") {
+      data++;
+    }
+  }
+  ASSERT_LT(data + 40, 2 * openedAt_.size());
+  for (auto latency : latencies) {
+    ASSERT_LE(latency, MAX_CONTROL_LATENCY_MS);
+  }
+
+  // ACKs are not held back by the backlog either.
+  uint32_t lastAck = 0;
+  for (const auto& departure : ws_->departures_) {
+    if (departure.msg.at("type") == "MESSAGE" &&
+        departure.msg.at("message").at("type") == "ACK") {
+      const auto& id = departure.msg.at("channelId").get<std::string>();
+      lastAck = std::max(lastAck, departure.atMs - openedAt_.at(id));
+    }
+  }
+  ASSERT_LE(lastAck, MAX_CONTROL_LATENCY_MS);
+}
+
+TEST_F(SendPriorityTest, high_priority_first_message_skips_backlog) {
+  firstPriority_ = nabto::webrtc::SignalingMessagePriority::HIGH;
+  const uint32_t duration = 3000;
+  churn(duration);
+
+  // The first messages are all sent in time while the second messages, which
+  // are normal priority, queue up. Each channel is still delivered in
+  // order.
+  std::map<std::string, uint32_t> nextSeq;
+  uint32_t slowestFirst = 0;
+  size_t seconds = 0;
+  for (const auto& departure : ws_->departures_) {
+    if (departure.msg.at("type") != "MESSAGE" ||
+        departure.msg.at("message").at("type") != "DATA") {
+      continue;
+    }
+    const auto& id = departure.msg.at("channelId").get<std::string>();
+    const auto seq = departure.msg.at("message").at("seq").get<uint32_t>();
+    ASSERT_EQ(seq, nextSeq[id]);
+    nextSeq[id]++;
+    if (seq == 0) {
+      slowestFirst = std::max(slowestFirst, departure.atMs - openedAt_.at(id));
+    } else {
+      seconds++;
+    }
+  }
+  ASSERT_LE(slowestFirst, 2 * MAX_CONTROL_LATENCY_MS);
+  for (const auto& [id, openedAt] : openedAt_) {
+    if (openedAt + 2 * MAX_CONTROL_LATENCY_MS < duration) {
+      ASSERT_EQ(nextSeq.count(id), 1);
+    }
+  }
+  ASSERT_LT(seconds + 40, openedAt_.size());
+}
@@ -1,8 +1,32 @@
 #include "../src/signaling_device/src/signaling_device_impl.hpp"
+#include "fakes.hpp"
+
+#include <nabto/webrtc/device.hpp>
 
 #include <gtest/gtest.h>
 
+#include <nlohmann/json.hpp>
+
+#include <memory>
 #include <string>
+#include <vector>
+
+namespace {
+
+nabto::webrtc::SignalingDeviceImplPtr createDevice(
+    const std::shared_ptr<nabto::test::FakeHttpClient>& http,
+    const std::shared_ptr<nabto::test::FakeWebsocket>& ws) {
+  nabto::webrtc::SignalingDeviceConfig conf;
+  conf.deviceId = "de-test";
+  conf.productId = "pr-test";
+  conf.signalingUrl = "https://signaling.test";
+  conf.tokenProvider = std::make_shared<nabto::test::FakeTokenGenerator>();
+  conf.wsImpl = ws;
+  conf.httpCli = http;
+  return nabto::webrtc::SignalingDeviceImpl::create(conf);
+}
+
+}  // namespace
 
 TEST(signaling_device_impl, parseIceServersTest) {
   std::string iceServers = R"(
@@ -54,3 +78,53 @@ TEST(signaling_device_impl, parseIceServersExtraData) {
   ASSERT_TRUE(s2.username.empty());
   ASSERT_TRUE(s2.credential.empty());
 }
+
+TEST(signaling_device_impl, cancellationToken) {
+  auto token = nabto::webrtc::SignalingCancellationToken::create();
+  int first = 0;
+  int second = 0;
+  auto id = token->addCancelHandler([&first]() { first++; });
+  token->addCancelHandler([&second]() { second++; });
+  token->removeCancelHandler(id);
+  ASSERT_FALSE(token->isCancelled());
+  token->cancel();
+  token->cancel();
+  ASSERT_TRUE(token->isCancelled());
+  ASSERT_EQ(first, 0);
+  ASSERT_EQ(second, 1);
+
+  // Handlers added after cancel are invoked right away.
+  token->addCancelHandler([&first]() { first++; });
+  ASSERT_EQ(first, 1);
+}
+
+TEST(signaling_device_impl, closeCancelsHttpRequests) {
+  auto http = std::make_shared<nabto::test::FakeHttpClient>();
+  auto ws = std::make_shared<nabto::test::FakeWebsocket>();
+  auto device = createDevice(http, ws);
+  device->start();
+  std::vector<nabto::webrtc::IceServer> servers = {{}};
+  device->requestIceServers(
+      [&servers](const std::vector<nabto::webrtc::IceServer>& s) {
+        servers = s;
+      });
+  ASSERT_EQ(http->requests_.size(), 2);
+  for (const auto& req : http->requests_) {
+    ASSERT_NE(req.cancellationToken, nullptr);
+    ASSERT_FALSE(req.cancellationToken->isCancelled());
+    ASSERT_GT(req.connectTimeoutMs, 0);
+    ASSERT_GT(req.timeoutMs, 0);
+  }
+
+  device->close();
+  for (const auto& req : http->requests_) {
+    ASSERT_TRUE(req.cancellationToken->isCancelled());
+  }
+
+  // A response to the cancelled attach request must not open a websocket.
+  http->respond(200,
+                nlohmann::json({{"signalingUrl", "wss://ws.test"}}).dump());
+  ASSERT_TRUE(ws->url_.empty());
+  http->respond(0, "");
+  ASSERT_TRUE(servers.empty());
+}
@@ -0,0 +1,103 @@
+#include <nabto/webrtc/util/std_timer.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <set>
+#include <thread>
+
+namespace {
+
+using std::chrono_literals::operator""ms;
+using std::chrono_literals::operator""us;
+
+}  // namespace
+
+TEST(StdTimer, no_callback_after_cancel) {
+  auto factory = nabto::webrtc::util::StdTimerFactory::create();
+  for (int i = 0; i < 500; i++) {
+    auto timer = factory->createTimer();
+    std::atomic<bool> cancelled = false;
+    std::atomic<bool> late = false;
+    timer->setTimeout(0, [&]() {
+      if (cancelled) {
+        late = true;
+      }
+    });
+    // Vary the cancel to land before, during and after the callback.
+    std::this_thread::sleep_for(std::chrono::microseconds(i % 50));
+    timer->cancel();
+    cancelled = true;
+    std::this_thread::sleep_for(20us);
+    ASSERT_FALSE(late);
+  }
+}
+
+TEST(StdTimer, cancel_waits_for_running_callback) {
+  auto timer = nabto::webrtc::util::StdTimerFactory::create()->createTimer();
+  std::atomic<bool> started = false;
+  std::atomic<bool> done = false;
+  timer->setTimeout(1, [&]() {
+    started = true;
+    std::this_thread::sleep_for(50ms);
+    done = true;
+  });
+  while (!started) {
+    std::this_thread::yield();
+  }
+  timer->cancel();
+  ASSERT_TRUE(done);
+}
+
+TEST(StdTimer, cancel_and_set_from_callback) {
+  auto timer = nabto::webrtc::util::StdTimerFactory::create()->createTimer();
+  std::atomic<int> calls = 0;
+  std::function<void()> callback = [&]() {
+    calls++;
+    timer->cancel();
+    if (calls < 3) {
+      timer->setTimeout(1, callback);
+    }
+  };
+  timer->setTimeout(1, callback);
+  std::this_thread::sleep_for(200ms);
+  timer->cancel();
+  ASSERT_EQ(calls, 3);
+}
+
+TEST(StdTimer, reuses_thread_for_timeouts) {
+  auto timer = nabto::webrtc::util::StdTimerFactory::create()->createTimer();
+  std::set<std::thread::id> threads;
+  for (int i = 0; i < 5; i++) {
+    std::atomic<bool> done = false;
+    timer->setTimeout(1, [&]() {
+      threads.insert(std::this_thread::get_id());
+      done = true;
+    });
+    while (!done) {
+      std::this_thread::yield();
+    }
+    // Replaced before it fires.
+    timer->setTimeout(1000, []() {});
+  }
+  timer->cancel();
+  ASSERT_EQ(threads.size(), 1);
+}
+
+TEST(StdTimer, release_from_callback) {
+  auto timer = nabto::webrtc::util::StdTimerFactory::create()->createTimer();
+  std::atomic<bool> done = false;
+  auto owner = std::make_shared<nabto::webrtc::SignalingTimerPtr>(timer);
+  timer->setTimeout(1, [owner, &done]() {
+    owner->reset();
+    done = true;
+  });
+  timer.reset();
+  while (!done) {
+    std::this_thread::yield();
+  }
+  std::this_thread::sleep_for(10ms);
+}
@@ -0,0 +1,444 @@
+#pragma once
+
+#include <nabto/webrtc/device.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Simulated clock and backend for running the SDK in virtual time. Timers,
+ * network latency and backend behavior are all events on one VirtualClock,
+ * so hours of reconnects and keep alives run in milliseconds and always in
+ * the same order.
+ *
+ * Everything runs on the thread driving the clock, nothing here is thread
+ * safe.
+ */
+
+namespace nabto {
+namespace test {
+
+class VirtualClock {
+ public:
+  using EventId = uint64_t;
+
+  uint64_t nowMs() const { return nowMs_; }
+
+  std::chrono::steady_clock::time_point now() const {
+    return std::chrono::steady_clock::time_point(
+        std::chrono::milliseconds(nowMs_));
+  }
+
+  EventId schedule(uint64_t delayMs, std::function<void()> callback) {
+    const EventId id = nextId_++;
+    const uint64_t due = nowMs_ + delayMs;
+    events_[{due, id}] = std::move(callback);
+    dueTimes_[id] = due;
+    return id;
+  }
+
+  void cancel(EventId id) {
+    auto it = dueTimes_.find(id);
+    if (it != dueTimes_.end()) {
+      events_.erase({it->second, id});
+      dueTimes_.erase(it);
+    }
+  }
+
+  /**
+   * Run all events due within the next ms milliseconds in order, moving the
+   * clock to the time of each event.
+   */
+  void advance(uint64_t ms) {
+    const uint64_t end = nowMs_ + ms;
+    while (!events_.empty() && events_.begin()->first.first <= end) {
+      auto it = events_.begin();
+      nowMs_ = it->first.first;
+      auto callback = std::move(it->second);
+      dueTimes_.erase(it->first.second);
+      events_.erase(it);
+      callback();
+    }
+    nowMs_ = end;
+  }
+
+  size_t pendingEvents() const { return events_.size(); }
+
+ private:
+  uint64_t nowMs_ = 0;
+  EventId nextId_ = 0;
+  std::map<std::pair<uint64_t, EventId>, std::function<void()>> events_;
+  std::map<EventId, uint64_t> dueTimes_;
+};
+
+using VirtualClockPtr = std::shared_ptr<VirtualClock>;
+
+class VirtualTimer : public nabto::webrtc::SignalingTimer {
+ public:
+  explicit VirtualTimer(VirtualClockPtr clock) : clock_(std::move(clock)) {}
+
+  void setTimeout(uint32_t timeoutMs, std::function<void()> cb) override {
+    cancel();
+    pending_ = clock_->schedule(timeoutMs, [this, cb = std::move(cb)]() {
+      pending_.reset();
+      cb();
+    });
+  }
+
+  void cancel() override {
+    if (pending_.has_value()) {
+      clock_->cancel(*pending_);
+      pending_.reset();
+    }
+  }
+
+  ~VirtualTimer() override { cancel(); }
+  VirtualTimer(const VirtualTimer&) = delete;
+  VirtualTimer& operator=(const VirtualTimer&) = delete;
+  VirtualTimer(VirtualTimer&&) = delete;
+  VirtualTimer& operator=(VirtualTimer&&) = delete;
+
+ private:
+  VirtualClockPtr clock_;
+  std::optional<VirtualClock::EventId> pending_;
+};
+
+class VirtualTimerFactory : public nabto::webrtc::SignalingTimerFactory {
+ public:
+  explicit VirtualTimerFactory(VirtualClockPtr clock)
+      : clock_(std::move(clock)) {}
+
+  nabto::webrtc::SignalingTimerPtr createTimer() override {
+    return std::make_shared<VirtualTimer>(clock_);
+  }
+
+  std::chrono::steady_clock::time_point now() override {
+    return clock_->now();
+  }
+
+ private:
+  VirtualClockPtr clock_;
+};
+
+class SimulatedBackend;
+
+/**
+ * Websocket connected to a SimulatedBackend. Each message and event takes
+ * the one way latency of the backend to arrive.
+ */
+class SimulatedWebsocket
+    : public nabto::webrtc::SignalingWebsocket,
+      public std::enable_shared_from_this<SimulatedWebsocket> {
+ public:
+  explicit SimulatedWebsocket(std::shared_ptr<SimulatedBackend> backend)
+      : backend_(std::move(backend)) {}
+
+  bool send(const std::string& data) override;
+  void close() override;
+  void onOpen(std::function<void()> callback) override {
+    openCb_ = std::move(callback);
+  }
+  void onMessage(
+      std::function<void(const std::string& message)> callback) override {
+    messageCb_ = std::move(callback);
+  }
+  void onClosed(std::function<void()> callback) override {
+    closedCb_ = std::move(callback);
+  }
+  void onError(
+      std::function<void(const std::string& error)> callback) override {
+    errorCb_ = std::move(callback);
+  }
+  void open(const std::string& url) override;
+
+  /**
+   * Deliver a message from the backend after the latency.
+   */
+  void deliver(const nlohmann::json& message);
+
+  /**
+   * The backend closes the connection.
+   */
+  void drop();
+
+  bool isOpen() const { return open_; }
+
+ private:
+  std::shared_ptr<SimulatedBackend> backend_;
+  bool open_ = false;
+  // Incremented for each open, so events from an earlier connection are not
+  // delivered on a new one.
+  uint64_t connection_ = 0;
+  std::function<void()> openCb_;
+  std::function<void(const std::string& message)> messageCb_;
+  std::function<void()> closedCb_;
+  std::function<void(const std::string& error)> errorCb_;
+};
+
+/**
+ * HTTP client and websocket backend on a virtual clock. The behavior can be
+ * changed at any point of a simulation through the public members.
+ */
+class SimulatedBackend : public std::enable_shared_from_this<SimulatedBackend> {
+ public:
+  static std::shared_ptr<SimulatedBackend> create(VirtualClockPtr clock) {
+    return std::make_shared<SimulatedBackend>(std::move(clock));
+  }
+  explicit SimulatedBackend(VirtualClockPtr clock) : clock_(std::move(clock)) {}
+
+  class HttpClient : public nabto::webrtc::SignalingHttpClient {
+   public:
+    explicit HttpClient(std::shared_ptr<SimulatedBackend> backend)
+        : backend_(std::move(backend)) {}
+    bool sendRequest(const nabto::webrtc::SignalingHttpRequest& request,
+                     nabto::webrtc::HttpResponseCallback callback) override {
+      backend_->handleRequest(request, std::move(callback));
+      return true;
+    }
+
+   private:
+    std::shared_ptr<SimulatedBackend> backend_;
+  };
+
+  nabto::webrtc::SignalingHttpClientPtr httpClient() {
+    return std::make_shared<HttpClient>(shared_from_this());
+  }
+
+  std::shared_ptr<SimulatedWebsocket> createWebsocket() {
+    auto ws = std::make_shared<SimulatedWebsocket>(shared_from_this());
+    websockets_.push_back(ws);
+    return ws;
+  }
+
+  /**
+   * Close all open websockets, eg. a backend restart.
+   */
+  void dropConnections() {
+    for (const auto& weak : websockets_) {
+      auto ws = weak.lock();
+      if (ws && ws->isOpen()) {
+        ws->drop();
+      }
+    }
+  }
+
+  /**
+   * Send a message to all connected devices.
+   */
+  void broadcast(const nlohmann::json& message) {
+    for (const auto& weak : websockets_) {
+      auto ws = weak.lock();
+      if (ws && ws->isOpen()) {
+        ws->deliver(message);
+      }
+    }
+  }
+
+  void handleRequest(const nabto::webrtc::SignalingHttpRequest& request,
+                     nabto::webrtc::HttpResponseCallback callback) {
+    httpRequests_++;
+    const bool isAttach =
+        request.url.find("/v1/device/connect") != std::string::npos;
+    Endpoint* endpoint = findEndpoint(request.url);
+    if (isAttach) {
+      attachRequests_++;
+      if (endpoint != nullptr) {
+        endpoint->attachRequests++;
+      }
+    } else if (endpoint != nullptr && request.method == "GET") {
+      endpoint->probes++;
+    }
+    const uint32_t latency =
+        endpoint != nullptr ? endpoint->latencyMs : latencyMs_;
+    clock_->schedule(2 * latency, [this, isAttach, url = request.url,
+                                   callback = std::move(callback)]() {
+      Endpoint* endpoint = findEndpoint(url);
+      if (!available_ || (endpoint != nullptr && !endpoint->available)) {
+        callback(nullptr);
+        return;
+      }
+      auto response = std::make_unique<nabto::webrtc::SignalingHttpResponse>();
+      response->statusCode = isAttach ? attachStatus_ : 200;
+      response->headers = attachHeaders_;
+      response->body =
+          isAttach ? nlohmann::json({{"signalingUrl", "wss://sim"}}).dump()
+                   : nlohmann::json({{"iceServers", nlohmann::json::array()}})
+                         .dump();
+      callback(std::move(response));
+    });
+  }
+
+  /**
+   * Stand in for one signaling endpoint, eg. a region. Requests to URLs
+   * starting with the endpoint URL get its latency and availability instead
+   * of the backend wide ones.
+   */
+  struct Endpoint {
+    uint32_t latencyMs = 0;
+    bool available = true;
+    size_t attachRequests = 0;
+    size_t probes = 0;
+  };
+
+  Endpoint& addEndpoint(const std::string& url, uint32_t latencyMs) {
+    auto& endpoint = endpoints_[url];
+    endpoint.latencyMs = latencyMs;
+    return endpoint;
+  }
+
+  VirtualClockPtr clock_;
+  // One way latency between device and backend.
+  uint32_t latencyMs_ = 50;
+  // If false, attach requests fail and websockets do not open.
+  bool available_ = true;
+  bool answerPings_ = true;
+  int attachStatus_ = 200;
+  std::vector<std::pair<std::string, std::string>> attachHeaders_;
+
+  size_t httpRequests_ = 0;
+  size_t attachRequests_ = 0;
+  size_t websocketOpens_ = 0;
+  size_t pings_ = 0;
+
+ private:
+  Endpoint* findEndpoint(const std::string& url) {
+    for (auto& [prefix, endpoint] : endpoints_) {
+      if (url.rfind(prefix, 0) == 0) {
+        return &endpoint;
+      }
+    }
+    return nullptr;
+  }
+
+  std::vector<std::weak_ptr<SimulatedWebsocket>> websockets_;
+  std::map<std::string, Endpoint> endpoints_;
+};
+
+inline bool SimulatedWebsocket::send(const std::string& data) {
+  if (!open_) {
+    return false;
+  }
+  auto message = nlohmann::json::parse(data);
+  if (message.at("type") == "PING") {
+    // The backend sees the PING after the latency and answers it, so the
+    // PONG arrives a full round trip after the PING was sent.
+    auto self = shared_from_this();
+    const uint64_t connection = connection_;
+    backend_->clock_->schedule(backend_->latencyMs_, [self, connection]() {
+      if (!self->open_ || connection != self->connection_) {
+        return;
+      }
+      self->backend_->pings_++;
+      if (self->backend_->answerPings_) {
+        self->deliver({{"type", "PONG"}});
+      }
+    });
+  }
+  return true;
+}
+
+inline void SimulatedWebsocket::close() {
+  if (!open_) {
+    return;
+  }
+  open_ = false;
+  auto self = shared_from_this();
+  backend_->clock_->schedule(0, [self]() { self->closedCb_(); });
+}
+
+inline void SimulatedWebsocket::open(const std::string& /*url*/) {
+  backend_->websocketOpens_++;
+  auto self = shared_from_this();
+  const uint64_t connection = ++connection_;
+  backend_->clock_->schedule(
+      2 * backend_->latencyMs_, [self, connection]() {
+        if (connection != self->connection_) {
+          return;
+        }
+        if (self->backend_->available_) {
+          self->open_ = true;
+          self->openCb_();
+        } else {
+          self->errorCb_("connection refused");
+        }
+      });
+}
+
+inline void SimulatedWebsocket::deliver(const nlohmann::json& message) {
+  auto self = shared_from_this();
+  const uint64_t connection = connection_;
+  backend_->clock_->schedule(
+      backend_->latencyMs_, [self, connection, data = message.dump()]() {
+        if (self->open_ && connection == self->connection_) {
+          self->messageCb_(data);
+        }
+      });
+}
+
+inline void SimulatedWebsocket::drop() {
+  open_ = false;
+  auto self = shared_from_this();
+  const uint64_t connection = connection_;
+  backend_->clock_->schedule(backend_->latencyMs_, [self, connection]() {
+    if (connection == self->connection_) {
+      self->closedCb_();
+    }
+  });
+}
+
+/**
+ * Records the state changes of a device with the virtual time they happened
+ * at.
+ */
+class StateRecorder {
+ public:
+  StateRecorder(const nabto::webrtc::SignalingDevicePtr& device,
+                VirtualClockPtr clock)
+      : clock_(std::move(clock)) {
+    device->addStateChangeListener(
+        [this](nabto::webrtc::SignalingDeviceState state) {
+          states_.emplace_back(clock_->nowMs(), state);
+        });
+  }
+
+  std::vector<nabto::webrtc::SignalingDeviceState> states() const {
+    std::vector<nabto::webrtc::SignalingDeviceState> result;
+    result.reserve(states_.size());
+    for (const auto& [time, state] : states_) {
+      result.push_back(state);
+    }
+    return result;
+  }
+
+  std::vector<uint64_t> timesOf(nabto::webrtc::SignalingDeviceState state) {
+    std::vector<uint64_t> result;
+    for (const auto& [time, s] : states_) {
+      if (s == state) {
+        result.push_back(time);
+      }
+    }
+    return result;
+  }
+
+  nabto::webrtc::SignalingDeviceState last() const {
+    return states_.back().second;
+  }
+
+  std::vector<std::pair<uint64_t, nabto::webrtc::SignalingDeviceState>>
+      states_;
+
+ private:
+  VirtualClockPtr clock_;
+};
+
+}  // namespace test
+}  // namespace nabto
@@ -0,0 +1,135 @@
+#include "../src/signaling_device/src/reconnect_backoff.hpp"
+#include "../src/signaling_device/src/signaling_device_impl.hpp"
+#include "../src/signaling_device/src/websocket_connection.hpp"
+#include "fakes.hpp"
+#include "virtual_time.hpp"
+
+#include <nabto/webrtc/device.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace {
+
+using nabto::webrtc::SignalingDeviceState;
+
+const uint64_t MINUTE_MS = 60000;
+const uint64_t HOUR_MS = 60 * MINUTE_MS;
+const uint32_t KEEP_ALIVE_INTERVAL_MS = 30000;
+
+class VirtualTimeTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    clock_ = std::make_shared<nabto::test::VirtualClock>();
+    backend_ = nabto::test::SimulatedBackend::create(clock_);
+    nabto::webrtc::SignalingDeviceConfig conf;
+    conf.deviceId = "de-test";
+    conf.productId = "pr-test";
+    conf.signalingUrl = "https://signaling.test";
+    conf.tokenProvider = std::make_shared<nabto::test::FakeTokenGenerator>();
+    conf.wsImpl = backend_->createWebsocket();
+    conf.httpCli = backend_->httpClient();
+    conf.timerFactory =
+        std::make_shared<nabto::test::VirtualTimerFactory>(clock_);
+    conf.keepAliveIntervalMs = KEEP_ALIVE_INTERVAL_MS;
+    device_ = nabto::webrtc::SignalingDeviceImpl::create(conf);
+    recorder_ = std::make_unique<nabto::test::StateRecorder>(device_, clock_);
+    device_->start();
+  }
+
+  void TearDown() override {
+    device_->close();
+    clock_->advance(MINUTE_MS);
+  }
+
+  nabto::test::VirtualClockPtr clock_;
+  std::shared_ptr<nabto::test::SimulatedBackend> backend_;
+  nabto::webrtc::SignalingDeviceImplPtr device_;
+  std::unique_ptr<nabto::test::StateRecorder> recorder_;
+};
+
+}  // namespace
+
+TEST_F(VirtualTimeTest, stays_connected_for_hours) {
+  clock_->advance(6 * HOUR_MS);
+  std::vector<SignalingDeviceState> expected = {
+      SignalingDeviceState::CONNECTING, SignalingDeviceState::CONNECTED};
+  ASSERT_EQ(recorder_->states(), expected);
+  // The keep alive pings once per interval of silence, the interval starts
+  // when the previous PONG arrives.
+  ASSERT_GE(backend_->pings_,
+            6 * HOUR_MS / (KEEP_ALIVE_INTERVAL_MS + 2 * backend_->latencyMs_));
+  ASSERT_LE(backend_->pings_, 6 * HOUR_MS / KEEP_ALIVE_INTERVAL_MS);
+  ASSERT_EQ(device_->getRttStats().srttMs, 2 * backend_->latencyMs_);
+}
+
+TEST_F(VirtualTimeTest, reconnects_through_long_outage) {
+  clock_->advance(MINUTE_MS);
+  ASSERT_EQ(recorder_->last(), SignalingDeviceState::CONNECTED);
+
+  backend_->available_ = false;
+  backend_->dropConnections();
+  const uint64_t outageStart = clock_->nowMs();
+  clock_->advance(2 * HOUR_MS);
+  ASSERT_EQ(recorder_->last(), SignalingDeviceState::WAIT_RETRY);
+
+  // Attempts keep coming during the outage, but never more than the max
+  // backoff apart.
+  auto attempts = recorder_->timesOf(SignalingDeviceState::CONNECTING);
+  ASSERT_GT(attempts.size(),
+            2 * HOUR_MS / nabto::webrtc::ReconnectBackoff::MAX_DELAY_MS);
+  uint64_t previous = outageStart;
+  for (auto attempt : attempts) {
+    if (attempt > outageStart) {
+      ASSERT_LE(attempt - previous,
+                nabto::webrtc::ReconnectBackoff::MAX_DELAY_MS +
+                    4 * backend_->latencyMs_);
+      previous = attempt;
+    }
+  }
+
+  backend_->available_ = true;
+  clock_->advance(2 * MINUTE_MS);
+  ASSERT_EQ(recorder_->last(), SignalingDeviceState::CONNECTED);
+}
+
+TEST_F(VirtualTimeTest, missing_pongs_trigger_reconnect) {
+  clock_->advance(MINUTE_MS);
+  ASSERT_EQ(recorder_->last(), SignalingDeviceState::CONNECTED);
+
+  backend_->answerPings_ = false;
+  const uint64_t silentFrom = clock_->nowMs();
+  clock_->advance(KEEP_ALIVE_INTERVAL_MS +
+                  nabto::webrtc::WebsocketConnection::MAX_PONG_TIMEOUT_MS);
+  auto retries = recorder_->timesOf(SignalingDeviceState::WAIT_RETRY);
+  ASSERT_FALSE(retries.empty());
+  ASSERT_GT(retries[0], silentFrom);
+  ASSERT_LE(retries[0] - silentFrom,
+            KEEP_ALIVE_INTERVAL_MS +
+                nabto::webrtc::WebsocketConnection::MAX_PONG_TIMEOUT_MS);
+
+  backend_->answerPings_ = true;
+  clock_->advance(2 * MINUTE_MS);
+  ASSERT_EQ(recorder_->last(), SignalingDeviceState::CONNECTED);
+}
+
+TEST_F(VirtualTimeTest, reconnect_hint_holds_off_attempts) {
+  clock_->advance(MINUTE_MS);
+  const uint32_t delayMs = 10 * MINUTE_MS;
+  backend_->broadcast({{"type", "RECONNECT"}, {"delayMs", delayMs}});
+  clock_->advance(MINUTE_MS);
+  const size_t attaches = backend_->attachRequests_;
+  backend_->dropConnections();
+
+  clock_->advance(delayMs - MINUTE_MS);
+  ASSERT_EQ(backend_->attachRequests_, attaches);
+  clock_->advance(MINUTE_MS +
+                  nabto::webrtc::ReconnectBackoff::DEFAULT_SPREAD_MS);
+  ASSERT_EQ(backend_->attachRequests_, attaches + 1);
+  ASSERT_EQ(recorder_->last(), SignalingDeviceState::CONNECTED);
+}
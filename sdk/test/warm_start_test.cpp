@@ -0,0 +1,254 @@
+#include "../src/signaling_device/src/signaling_device_impl.hpp"
+#include "../src/signaling_device/src/warm_start_state.hpp"
+#include "fakes.hpp"
+
+#include <nabto/webrtc/device.hpp>
+#include <nabto/webrtc/util/file_state_store.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using nabto::webrtc::WarmStartState;
+
+// Header {"alg":"ES256"} and payload {"exp":4102444800}.
+const std::string JWT =
+    "eyJhbGciOiJFUzI1NiJ9.eyJleHAiOjQxMDI0NDQ4MDB9.signature";
+const int64_t JWT_EXPIRY = 4102444800;
+
+class MemoryStateStore : public nabto::webrtc::SignalingStateStore {
+ public:
+  std::string load() override { return state_; }
+  void save(const std::string& state) override {
+    state_ = state;
+    saves_++;
+  }
+
+  std::string state_;
+  size_t saves_ = 0;
+};
+
+class CountingTokenGenerator : public nabto::webrtc::SignalingTokenGenerator {
+ public:
+  bool generateToken(std::string& token) override {
+    token = JWT;
+    generated_++;
+    return true;
+  }
+
+  size_t generated_ = 0;
+};
+
+// Answers ICE server requests before sendRequest returns, like clients do on
+// some error paths.
+class InlineIceHttpClient : public nabto::test::FakeHttpClient {
+ public:
+  bool sendRequest(const nabto::webrtc::SignalingHttpRequest& request,
+                   nabto::webrtc::HttpResponseCallback callback) override {
+    FakeHttpClient::sendRequest(request, std::move(callback));
+    if (request.url.find("/v1/ice-servers") != std::string::npos) {
+      respond(200,
+              R"({"iceServers": [{"urls": ["turn:turn.test"]}], "ttl": 60})");
+    }
+    return true;
+  }
+};
+
+class WarmStartTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    store_ = std::make_shared<MemoryStateStore>();
+    tokens_ = std::make_shared<CountingTokenGenerator>();
+  }
+
+  void createDevice(
+      std::shared_ptr<nabto::test::FakeHttpClient> http = nullptr) {
+    ws_ = std::make_shared<nabto::test::FakeWebsocket>();
+    http_ = http ? http : std::make_shared<nabto::test::FakeHttpClient>();
+    timers_ = std::make_shared<nabto::test::ManualTimerFactory>();
+    nabto::webrtc::SignalingDeviceConfig conf;
+    conf.deviceId = "de-test";
+    conf.productId = "pr-test";
+    conf.signalingUrl = "https://signaling.test";
+    conf.tokenProvider = tokens_;
+    conf.wsImpl = ws_;
+    conf.httpCli = http_;
+    conf.timerFactory = timers_;
+    conf.stateStore = store_;
+    device_ = nabto::webrtc::SignalingDeviceImpl::create(conf);
+  }
+
+  // A first run which attaches and fetches ICE servers.
+  void coldStart() {
+    createDevice();
+    device_->start();
+    ASSERT_EQ(http_->requests_.size(), 1);
+    http_->respond(
+        200, nlohmann::json({{"signalingUrl", "wss://ws.test"}}).dump());
+    ws_->openCb_();
+    device_->requestIceServers(
+        [](const std::vector<nabto::webrtc::IceServer>& /*servers*/) {});
+    http_->respond(
+        200,
+        R"({"iceServers": [{"urls": ["turn:turn.test"], "username": "u",
+            "credential": "c"}], "ttl": 3600})");
+    device_->close();
+  }
+
+  std::shared_ptr<MemoryStateStore> store_;
+  std::shared_ptr<CountingTokenGenerator> tokens_;
+  std::shared_ptr<nabto::test::FakeWebsocket> ws_;
+  std::shared_ptr<nabto::test::FakeHttpClient> http_;
+  std::shared_ptr<nabto::test::ManualTimerFactory> timers_;
+  nabto::webrtc::SignalingDeviceImplPtr device_;
+};
+
+}  // namespace
+
+TEST(WarmStartState, dump_and_parse) {
+  WarmStartState state;
+  state.signalingUrl = "wss://ws.test";
+  state.signalingUrlReceivedAt = 1;
+  state.token = JWT;
+  state.tokenExpiresAt = JWT_EXPIRY;
+  state.iceServers = {{"u", "c", {"turn:turn.test"}}};
+  state.iceServersExpireAt = 2;
+  auto parsed = WarmStartState::parse(state.dump());
+  ASSERT_TRUE(parsed.has_value());
+  ASSERT_EQ(parsed->signalingUrl, state.signalingUrl);
+  ASSERT_EQ(parsed->signalingUrlReceivedAt, 1);
+  ASSERT_EQ(parsed->token, JWT);
+  ASSERT_EQ(parsed->tokenExpiresAt, JWT_EXPIRY);
+  ASSERT_EQ(parsed->iceServers.size(), 1);
+  ASSERT_EQ(parsed->iceServers[0].credential, "c");
+  ASSERT_EQ(parsed->iceServersExpireAt, 2);
+
+  ASSERT_FALSE(WarmStartState::parse("").has_value());
+  ASSERT_FALSE(WarmStartState::parse("garbage").has_value());
+  ASSERT_FALSE(WarmStartState::parse(R"({"version": 0})").has_value());
+}
+
+TEST(WarmStartState, token_expiry) {
+  ASSERT_EQ(WarmStartState::tokenExpiry(JWT), JWT_EXPIRY);
+  ASSERT_FALSE(WarmStartState::tokenExpiry("token").has_value());
+  ASSERT_FALSE(WarmStartState::tokenExpiry("a.b!c.d").has_value());
+}
+
+TEST(WarmStartState, validity) {
+  WarmStartState state;
+  state.signalingUrl = "wss://ws.test";
+  state.signalingUrlReceivedAt = 1000;
+  ASSERT_TRUE(state.hasSignalingUrl(1000));
+  ASSERT_FALSE(state.hasSignalingUrl(
+      1000 + WarmStartState::SIGNALING_URL_MAX_AGE_S));
+
+  state.token = JWT;
+  state.tokenExpiresAt = 1000;
+  ASSERT_TRUE(state.hasToken(0));
+  ASSERT_FALSE(state.hasToken(1000 - WarmStartState::TOKEN_MIN_REMAINING_S));
+}
+
+TEST_F(WarmStartTest, restart_skips_attach_and_ice_request) {
+  coldStart();
+  ASSERT_EQ(tokens_->generated_, 1);
+
+  auto state = WarmStartState::parse(store_->state_);
+  ASSERT_TRUE(state.has_value());
+  ASSERT_EQ(state->signalingUrl, "wss://ws.test");
+  ASSERT_EQ(state->token, JWT);
+  ASSERT_EQ(state->iceServers.size(), 1);
+
+  createDevice();
+  device_->start();
+  ASSERT_TRUE(http_->requests_.empty());
+  ASSERT_EQ(ws_->url_, "wss://ws.test");
+  ws_->openCb_();
+
+  std::vector<nabto::webrtc::IceServer> servers;
+  device_->requestIceServers(
+      [&servers](const std::vector<nabto::webrtc::IceServer>& s) {
+        servers = s;
+      });
+  ASSERT_TRUE(http_->requests_.empty());
+  ASSERT_EQ(servers.size(), 1);
+  ASSERT_EQ(servers[0].username, "u");
+  ASSERT_EQ(tokens_->generated_, 1);
+  device_->close();
+}
+
+TEST_F(WarmStartTest, failed_saved_url_falls_back_to_attach) {
+  coldStart();
+  createDevice();
+  device_->start();
+  ASSERT_TRUE(http_->requests_.empty());
+  ws_->errorCb_("connection refused");
+  timers_->timer_->fire();
+
+  ASSERT_EQ(http_->requests_.size(), 1);
+  // The saved token is still valid, so it is reused for the attach.
+  ASSERT_EQ(tokens_->generated_, 1);
+  bool authorized = false;
+  for (const auto& [name, value] : http_->requests_[0].headers) {
+    if (name == "Authorization") {
+      authorized = value == "Bearer " + JWT;
+    }
+  }
+  ASSERT_TRUE(authorized);
+  device_->close();
+}
+
+TEST_F(WarmStartTest, rejected_token_is_replaced) {
+  coldStart();
+  auto state = WarmStartState::parse(store_->state_);
+  ASSERT_TRUE(state.has_value());
+  state->signalingUrl.clear();
+  store_->state_ = state->dump();
+
+  createDevice();
+  device_->start();
+  ASSERT_EQ(tokens_->generated_, 1);
+  http_->respond(401, "");
+  timers_->timer_->fire();
+  ASSERT_EQ(http_->requests_.size(), 2);
+  ASSERT_EQ(tokens_->generated_, 2);
+  device_->close();
+}
+
+TEST_F(WarmStartTest, synchronous_ice_servers_response) {
+  createDevice(std::make_shared<InlineIceHttpClient>());
+  device_->start();
+
+  size_t servers = 0;
+  device_->requestIceServers(
+      [&servers](const std::vector<nabto::webrtc::IceServer>& result) {
+        servers = result.size();
+      });
+  ASSERT_EQ(servers, 1);
+  auto state = WarmStartState::parse(store_->state_);
+  ASSERT_TRUE(state.has_value());
+  ASSERT_EQ(state->iceServers.size(), 1);
+  device_->close();
+}
+
+TEST(FileStateStore, save_and_load) {
+  const auto path =
+      std::filesystem::temp_directory_path() / "nabto_state_store_test.json";
+  std::filesystem::remove(path);
+  auto store = nabto::webrtc::util::FileStateStore::create(path.string());
+  ASSERT_EQ(store->load(), "");
+  store->save("first");
+  store->save("second");
+  ASSERT_EQ(store->load(), "second");
+  auto perms = std::filesystem::status(path).permissions();
+  ASSERT_EQ(perms & std::filesystem::perms::others_read,
+            std::filesystem::perms::none);
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,120 @@
+#include "../src/signaling_device/src/websocket_connection.hpp"
+#include "fakes.hpp"
+
+#include <nabto/webrtc/device.hpp>
+
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using nabto::test::FakeWebsocket;
+using nabto::test::ManualTimerFactory;
+
+const uint32_t KEEP_ALIVE_INTERVAL = 5000;
+
+class WebsocketConnectionTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ws_ = std::make_shared<FakeWebsocket>();
+    tf_ = std::make_shared<ManualTimerFactory>();
+    conn_ = nabto::webrtc::WebsocketConnection::create(ws_, tf_,
+                                                       KEEP_ALIVE_INTERVAL);
+    conn_->onOpen([]() {});
+    conn_->onMessage(
+        [this](nabto::webrtc::SignalingMessageType type,
+               nlohmann::json& message) { received_.push_back(message); });
+    conn_->onClosed([this]() { closedEvents_++; });
+    conn_->onError([](const std::string& error) {});
+  }
+
+  void receive(const std::string& type) {
+    ws_->messageCb_(nlohmann::json({{"type", type}}).dump());
+  }
+
+  std::shared_ptr<FakeWebsocket> ws_;
+  std::shared_ptr<ManualTimerFactory> tf_;
+  nabto::webrtc::WebsocketConnectionPtr conn_;
+  std::vector<nlohmann::json> received_;
+  size_t closedEvents_ = 0;
+};
+
+}  // namespace
+
+TEST_F(WebsocketConnectionTest, no_ping_before_interval) {
+  ws_->openCb_();
+  ASSERT_TRUE(tf_->timer_);
+  ASSERT_EQ(tf_->timer_->timeoutMs_, KEEP_ALIVE_INTERVAL);
+
+  // The timer fires before the interval has passed on the clock, so the
+  // connection reschedules instead of pinging.
+  tf_->advance(KEEP_ALIVE_INTERVAL / 2);
+  tf_->timer_->fire();
+  ASSERT_EQ(ws_->pings(), 0);
+  ASSERT_TRUE(tf_->timer_->cb_);
+  ASSERT_EQ(tf_->timer_->timeoutMs_, KEEP_ALIVE_INTERVAL / 2);
+
+  tf_->advance(KEEP_ALIVE_INTERVAL / 2);
+  tf_->timer_->fire();
+  ASSERT_EQ(ws_->pings(), 1);
+}
+
+TEST_F(WebsocketConnectionTest, rtt_from_ping_pong) {
+  ws_->openCb_();
+  ASSERT_EQ(conn_->getRttStats().samples, 0);
+  ASSERT_EQ(conn_->pongTimeoutMs(),
+            nabto::webrtc::WebsocketConnection::INITIAL_PONG_TIMEOUT_MS);
+
+  conn_->checkAlive();
+  ASSERT_EQ(ws_->pings(), 1);
+  ASSERT_EQ(tf_->timer_->timeoutMs_,
+            nabto::webrtc::WebsocketConnection::INITIAL_PONG_TIMEOUT_MS);
+  // A second checkAlive while waiting for the PONG does not send a new PING.
+  conn_->checkAlive();
+  ASSERT_EQ(ws_->pings(), 1);
+
+  tf_->advance(20);
+  receive("PONG");
+  auto stats = conn_->getRttStats();
+  ASSERT_EQ(stats.samples, 1);
+  ASSERT_EQ(stats.lastRttMs, 20);
+  ASSERT_EQ(stats.srttMs, stats.lastRttMs);
+  ASSERT_EQ(stats.rttVarMs, stats.lastRttMs / 2);
+  ASSERT_GE(conn_->pongTimeoutMs(),
+            nabto::webrtc::WebsocketConnection::MIN_PONG_TIMEOUT_MS);
+  ASSERT_LE(conn_->pongTimeoutMs(),
+            nabto::webrtc::WebsocketConnection::MAX_PONG_TIMEOUT_MS);
+  ASSERT_TRUE(received_.empty());
+
+  // The pong timeout fires after the PONG, the connection stays open.
+  tf_->timer_->fire();
+  ASSERT_FALSE(ws_->closed_);
+}
+
+TEST_F(WebsocketConnectionTest, closes_on_missing_pong) {
+  // Without the keep alive the pong timeout is the only timer.
+  conn_ = nabto::webrtc::WebsocketConnection::create(ws_, tf_);
+  conn_->onOpen([]() {});
+  ws_->openCb_();
+  conn_->checkAlive();
+  ASSERT_EQ(ws_->pings(), 1);
+  tf_->advance(nabto::webrtc::WebsocketConnection::INITIAL_PONG_TIMEOUT_MS);
+  tf_->timer_->fire();
+  ASSERT_TRUE(ws_->closed_);
+}
+
+TEST_F(WebsocketConnectionTest, no_timer_after_close) {
+  ws_->openCb_();
+  ws_->closedCb_();
+  ASSERT_EQ(closedEvents_, 1);
+  ASSERT_FALSE(tf_->timer_->cb_);
+  conn_->checkAlive();
+  ASSERT_EQ(ws_->pings(), 0);
+}